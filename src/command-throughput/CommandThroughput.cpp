@@ -0,0 +1,360 @@
+/*
+ * iCub Robot Unit Tests (Robot Testing Framework)
+ *
+ * Copyright (C) 2015-2019 Istituto Italiano di Tecnologia (IIT)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <cstdio>
+#include <ctime>
+#include <algorithm>
+#include <robottestingframework/TestAssert.h>
+#include <robottestingframework/dll/Plugin.h>
+#include <yarp/os/Time.h>
+#include <yarp/os/Property.h>
+
+#include "ControlModeSwitcher.h"
+#include "CommandThroughput.h"
+
+using namespace robottestingframework;
+using namespace yarp::os;
+using namespace yarp::dev;
+
+// prepare the plugin
+ROBOTTESTINGFRAMEWORK_PREPARE_PLUGIN(CommandThroughput)
+
+CommandThroughput::CommandThroughput() : yarp::robottestingframework::TestCase("CommandThroughput") {
+    n_part_joints=0;
+    updates=1000;
+    switch_mode=false;
+    dd=0;
+    icmd=0;
+    ienc=0;
+    idir=0;
+    ipwm=0;
+    itrq=0;
+    ivel=0;
+}
+
+CommandThroughput::~CommandThroughput() { }
+
+bool CommandThroughput::setup(yarp::os::Property& property) {
+
+    //updating the test name
+    if(property.check("name"))
+        setName(property.find("name").asString());
+
+    // updating parameters
+    ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(property.check("robot"), "The robot name must be given as the test parameter!");
+    ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(property.check("part"), "The part name must be given as the test parameter!");
+
+    robotName = property.find("robot").asString();
+    partName = property.find("part").asString();
+
+    if(property.check("updates"))     {updates = property.find("updates").asInt32();}
+    if(property.check("switch_mode")) {switch_mode = (property.find("switch_mode").asInt32()!=0);}
+    if(property.check("filename"))    {filename = property.find("filename").asString();}
+    ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(updates>0,"invalid updates");
+
+    if (property.check("interfaces"))
+    {
+        Bottle* interfacesBottle = property.find("interfaces").asList();
+        ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(interfacesBottle!=0,"unable to parse interfaces parameter");
+        for (size_t i=0; i<interfacesBottle->size(); i++)
+        {
+            std::string s = interfacesBottle->get(i).asString();
+            if      (s=="position_direct") {interfaces.push_back(position_direct_interface);}
+            else if (s=="pwm")             {interfaces.push_back(pwm_interface);}
+            else if (s=="torque")          {interfaces.push_back(torque_interface);}
+            else if (s=="velocity")        {interfaces.push_back(velocity_interface);}
+            else
+            {
+                ROBOTTESTINGFRAMEWORK_ASSERT_ERROR(Asserter::format("invalid interface %s: can be position_direct, pwm, torque, velocity", s.c_str()));
+            }
+        }
+    }
+    else
+    {
+        interfaces.push_back(position_direct_interface);
+        interfaces.push_back(pwm_interface);
+        interfaces.push_back(torque_interface);
+        interfaces.push_back(velocity_interface);
+    }
+
+    Property options;
+    options.put("device", "remote_controlboard");
+    options.put("remote", "/"+robotName+"/"+partName);
+    options.put("local", "/commandThroughputTest/"+robotName+"/"+partName);
+
+    dd = new PolyDriver(options);
+    ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(dd->isValid(),"Unable to open device driver");
+    ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(dd->view(ienc),"Unable to open encoders interface");
+    ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(dd->view(icmd),"Unable to open control mode interface");
+    for (size_t i=0; i<interfaces.size(); i++)
+    {
+        if (interfaces[i]==position_direct_interface) {ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(dd->view(idir),"Unable to open position direct interface");}
+        if (interfaces[i]==pwm_interface)             {ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(dd->view(ipwm),"Unable to open pwm interface");}
+        if (interfaces[i]==torque_interface)          {ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(dd->view(itrq),"Unable to open torque interface");}
+        if (interfaces[i]==velocity_interface)        {ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(dd->view(ivel),"Unable to open velocity interface");}
+    }
+
+    if (!ienc->getAxes(&n_part_joints))
+    {
+        ROBOTTESTINGFRAMEWORK_ASSERT_ERROR("unable to get the number of joints of the part");
+    }
+
+    if (property.check("joints"))
+    {
+        Bottle* jointsBottle = property.find("joints").asList();
+        ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(jointsBottle!=0,"unable to parse joints parameter");
+        for (size_t i=0; i<jointsBottle->size(); i++) jointsList.push_back(jointsBottle->get(i).asInt32());
+    }
+    else
+    {
+        for (int i=0; i<n_part_joints; i++) jointsList.push_back(i);
+    }
+    ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(!jointsList.empty(),"invalid number of joints, it must be >0");
+    for (size_t i=0; i<jointsList.size(); i++)
+    {
+        ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(jointsList[i]>=0 && jointsList[i]<n_part_joints,
+                                                    Asserter::format("invalid joint %d", jointsList[i]));
+    }
+
+    if (property.check("joint_counts"))
+    {
+        Bottle* countsBottle = property.find("joint_counts").asList();
+        ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(countsBottle!=0,"unable to parse joint_counts parameter");
+        for (size_t i=0; i<countsBottle->size(); i++)
+        {
+            int c = countsBottle->get(i).asInt32();
+            ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(c>0 && c<=(int)jointsList.size(),
+                                                        Asserter::format("invalid joint count %d, it must be between 1 and the number of joints", c));
+            jointCounts.push_back(c);
+        }
+    }
+    else
+    {
+        for (size_t c=1; c<=jointsList.size(); c++) jointCounts.push_back((int)c);
+    }
+
+    cmd_tot.resize(n_part_joints);
+    cmd_some.resize(jointsList.size());
+    durations.resize(updates);
+
+    return true;
+}
+
+void CommandThroughput::tearDown()
+{
+    if (dd)
+    {
+        if (switch_mode) setMode(VOCAB_CM_POSITION);
+        delete dd;
+        dd =0;
+    }
+}
+
+void CommandThroughput::setMode(int desired_mode)
+{
+    //the interaction mode is not changed
+    ControlModeSwitcher switcher(icmd, 0, jointsList);
+    ControlModeSwitcher::Result result = switcher.change(desired_mode, VOCAB_IM_UNKNOWN);
+    ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(result.ok, switcher.failureMessage(result, "Control mode change"));
+}
+
+const char* CommandThroughput::interfaceName(interface_t interf)
+{
+    switch (interf)
+    {
+        case position_direct_interface: return "position_direct";
+        case pwm_interface:             return "pwm";
+        case torque_interface:          return "torque";
+        case velocity_interface:        return "velocity";
+    }
+    return "unknown";
+}
+
+const char* CommandThroughput::pathName(cmd_path_t path)
+{
+    switch (path)
+    {
+        case single_joint: return "single_joint";
+        case all_joints:   return "all_joints";
+        case some_joints:  return "some_joints";
+    }
+    return "unknown";
+}
+
+void CommandThroughput::prepareInterface(interface_t interf)
+{
+    // the commanded references are the current values, so that the joints hold their state
+    bool ok = true;
+    switch (interf)
+    {
+        case position_direct_interface:
+            ok = ienc->getEncoders(cmd_tot.data());
+            if (switch_mode) setMode(VOCAB_CM_POSITION_DIRECT);
+            break;
+        case pwm_interface:
+            ok = ipwm->getDutyCycles(cmd_tot.data());
+            if (switch_mode) setMode(VOCAB_CM_PWM);
+            break;
+        case torque_interface:
+            ok = itrq->getTorques(cmd_tot.data());
+            if (switch_mode) setMode(VOCAB_CM_TORQUE);
+            break;
+        case velocity_interface:
+            std::fill(cmd_tot.begin(), cmd_tot.end(), 0.0);
+            if (switch_mode) setMode(VOCAB_CM_VELOCITY);
+            break;
+    }
+    ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(ok, Asserter::format("Unable to read the current references for the %s interface", interfaceName(interf)));
+
+    for (size_t k=0; k<jointsList.size(); k++) cmd_some[k] = cmd_tot[jointsList[k]];
+}
+
+bool CommandThroughput::hasPath(interface_t interf, cmd_path_t path, int n_joints) const
+{
+    if (path==some_joints && interf==pwm_interface) return false;
+    if (path==all_joints && n_joints!=n_part_joints) return false;
+    return true;
+}
+
+void CommandThroughput::sendUpdate(interface_t interf, cmd_path_t path, int n_joints)
+{
+    const int* joints = jointsList.data();
+    switch (interf)
+    {
+        case position_direct_interface:
+            if      (path==single_joint) {for (int k=0; k<n_joints; k++) idir->setPosition(joints[k], cmd_some[k]);}
+            else if (path==some_joints)  {idir->setPositions(n_joints, joints, cmd_some.data());}
+            else                         {idir->setPositions(cmd_tot.data());}
+            break;
+        case pwm_interface:
+            if      (path==single_joint) {for (int k=0; k<n_joints; k++) ipwm->setRefDutyCycle(joints[k], cmd_some[k]);}
+            else                         {ipwm->setRefDutyCycles(cmd_tot.data());}
+            break;
+        case torque_interface:
+            if      (path==single_joint) {for (int k=0; k<n_joints; k++) itrq->setRefTorque(joints[k], cmd_some[k]);}
+            else if (path==some_joints)  {itrq->setRefTorques(n_joints, joints, cmd_some.data());}
+            else                         {itrq->setRefTorques(cmd_tot.data());}
+            break;
+        case velocity_interface:
+            if      (path==single_joint) {for (int k=0; k<n_joints; k++) ivel->velocityMove(joints[k], cmd_some[k]);}
+            else if (path==some_joints)  {ivel->velocityMove(n_joints, joints, cmd_some.data());}
+            else                         {ivel->velocityMove(cmd_tot.data());}
+            break;
+    }
+}
+
+double CommandThroughput::percentile(const std::vector<double>& sorted, double p)
+{
+    size_t i = (size_t)(p*(sorted.size()-1)+0.5);
+    return sorted[i];
+}
+
+CommandThroughput::Measurement CommandThroughput::measure(interface_t interf, cmd_path_t path, int n_joints)
+{
+    // a few updates to open the connections and warm up the caches
+    for (int i=0; i<10; i++) sendUpdate(interf, path, n_joints);
+
+    std::clock_t cpu_start = std::clock();
+    double wall_start = yarp::os::Time::now();
+    for (int i=0; i<updates; i++)
+    {
+        double t = yarp::os::Time::now();
+        sendUpdate(interf, path, n_joints);
+        durations[i] = yarp::os::Time::now()-t;
+    }
+    double wall = yarp::os::Time::now()-wall_start;
+    double cpu = (double)(std::clock()-cpu_start)/CLOCKS_PER_SEC;
+
+    std::sort(durations.begin(), durations.end());
+
+    Measurement m;
+    m.interf = interf;
+    m.path = path;
+    m.n_joints = n_joints;
+    m.updates_per_second = updates/wall;
+    m.p50 = percentile(durations, 0.5);
+    m.p90 = percentile(durations, 0.9);
+    m.p99 = percentile(durations, 0.99);
+    m.max = durations.back();
+    m.cpu_per_update = cpu/updates;
+    m.cpu_load = cpu/wall;
+    return m;
+}
+
+void CommandThroughput::run()
+{
+    std::vector<Measurement> results;
+    const cmd_path_t paths[] = {single_joint, some_joints, all_joints};
+    int max_count = *std::max_element(jointCounts.begin(), jointCounts.end());
+
+    for (size_t i=0; i<interfaces.size(); i++)
+    {
+        prepareInterface(interfaces[i]);
+        for (size_t c=0; c<jointCounts.size(); c++)
+        {
+            for (size_t p=0; p<3; p++)
+            {
+                if (!hasPath(interfaces[i], paths[p], jointCounts[c])) continue;
+                Measurement m = measure(interfaces[i], paths[p], jointCounts[c]);
+                ROBOTTESTINGFRAMEWORK_TEST_REPORT(Asserter::format("%s %s, %d joints: %.0f updates/s, update duration p50 %.3f ms p90 %.3f ms p99 %.3f ms max %.3f ms, cpu %.1f us/update (%.0f%%)",
+                                                  interfaceName(m.interf), pathName(m.path), m.n_joints, m.updates_per_second,
+                                                  m.p50*1000.0, m.p90*1000.0, m.p99*1000.0, m.max*1000.0,
+                                                  m.cpu_per_update*1e6, m.cpu_load*100.0));
+                results.push_back(m);
+            }
+        }
+        if (switch_mode) setMode(VOCAB_CM_POSITION);
+    }
+
+    for (size_t i=0; i<interfaces.size(); i++)
+    {
+        const Measurement* best = 0;
+        for (size_t r=0; r<results.size(); r++)
+        {
+            if (results[r].interf!=interfaces[i] || results[r].n_joints!=max_count) continue;
+            if (best==0 || results[r].updates_per_second>best->updates_per_second) best = &results[r];
+        }
+        if (best)
+        {
+            ROBOTTESTINGFRAMEWORK_TEST_REPORT(Asserter::format("%s, %d joints: the fastest path is %s (%.0f updates/s, p99 %.3f ms)",
+                                              interfaceName(best->interf), max_count, pathName(best->path),
+                                              best->updates_per_second, best->p99*1000.0));
+        }
+    }
+
+    if (!filename.empty())
+    {
+        FILE* f = fopen(filename.c_str(), "w");
+        ROBOTTESTINGFRAMEWORK_TEST_CHECK(f!=0, Asserter::format("Saving data to %s", filename.c_str()));
+        if (f)
+        {
+            fprintf(f, "# interface path joints updates_per_s p50_ms p90_ms p99_ms max_ms cpu_us_per_update cpu_load\n");
+            for (size_t r=0; r<results.size(); r++)
+            {
+                const Measurement& m = results[r];
+                fprintf(f, "%s %s %d %.1f %.4f %.4f %.4f %.4f %.2f %.3f\n",
+                        interfaceName(m.interf), pathName(m.path), m.n_joints, m.updates_per_second,
+                        m.p50*1000.0, m.p90*1000.0, m.p99*1000.0, m.max*1000.0,
+                        m.cpu_per_update*1e6, m.cpu_load);
+            }
+            fclose(f);
+        }
+    }
+}
@@ -0,0 +1,144 @@
+/*
+ * iCub Robot Unit Tests (Robot Testing Framework)
+ *
+ * Copyright (C) 2015-2019 Istituto Italiano di Tecnologia (IIT)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _COMMANDTHROUGHPUT_H_
+#define _COMMANDTHROUGHPUT_H_
+
+#include <string>
+#include <vector>
+#include <yarp/robottestingframework/TestCase.h>
+#include <yarp/dev/ControlBoardInterfaces.h>
+#include <yarp/dev/PolyDriver.h>
+
+/**
+* \ingroup icub-tests
+* This test is a benchmark of the command methods of the motion control interfaces.
+* For each interface (position direct, pwm, torque, velocity) and for each command path:
+* \li single_joint: one call for each joint (e.g. IPositionDirect::setPosition())
+* \li some_joints: one call for the listed joints (e.g. IPositionDirect::setPositions(n, joints, refs))
+* \li all_joints: one call for all the joints of the part (e.g. IPositionDirect::setPositions(refs))
+* a number of updates of the joint references is sent back to back, sweeping the number of commanded joints.
+* For each combination the test reports the updates per second, the percentiles of the duration of one update,
+* and the CPU time used by the test process (including the YARP communication threads) per update and as a fraction of the wall time.
+* At the end, the fastest path for each interface at the maximum number of joints is reported.
+* The IPWMControl interface has no some_joints method, and all_joints is measured only when the number of joints equals
+* the number of joints of the part.
+*
+* By default (switch_mode=0) the joints are left in their control mode: the references are delivered but ignored by the
+* control boards, so the robot does not move and only the cost of the API and of the communication is measured.
+* With switch_mode=1 the joints are switched to the control mode of each interface and the current value is commanded
+* (position, pwm, torque, zero velocity). Be aware that in pwm and torque mode the joints are not position controlled!
+*
+* example: testRunner -v -t CommandThroughput.dll -p "--robot icub --part left_arm --interfaces ""(position_direct torque)"" --updates 2000"
+*
+* Check the following functions:
+* \li IPositionDirect::setPosition(), IPositionDirect::setPositions()
+* \li IPWMControl::setRefDutyCycle(), IPWMControl::setRefDutyCycles()
+* \li ITorqueControl::setRefTorque(), ITorqueControl::setRefTorques()
+* \li IVelocityControl::velocityMove()
+*
+*  Accepts the following parameters:
+* | Parameter name     | Type   | Units | Default Value | Required | Description | Notes |
+* |:------------------:|:------:|:-----:|:-------------:|:--------:|:-----------:|:-----:|
+* | robot              | string | -     | -     | Yes | The name of the robot.     | e.g. icub |
+* | part               | string | -     | -     | Yes | The name of the robot part. | e.g. left_arm |
+* | joints             | vector of ints | - | all the joints of the part | No | List of joints to be commanded | |
+* | interfaces         | vector of strings | - | (position_direct pwm torque velocity) | No | The interfaces to be tested | |
+* | joint_counts       | vector of ints | - | (1 2 ... n) | No | The numbers of joints to be commanded (the first ones of the joints list) | |
+* | updates            | int    | -     | 1000  | No  | The number of reference updates for each measurement | |
+* | switch_mode        | int    | -     | 0     | No  | If 1, the joints are switched to the control mode of each interface | see the notes above |
+* | filename           | string | -     | -     | No  | If given, the results are written to this file, one row per measurement | |
+*
+*/
+
+class CommandThroughput : public yarp::robottestingframework::TestCase {
+public:
+    CommandThroughput();
+    virtual ~CommandThroughput();
+
+    virtual bool setup(yarp::os::Property& property);
+
+    virtual void tearDown();
+
+    virtual void run();
+
+private:
+    enum interface_t
+    {
+        position_direct_interface = 0,
+        pwm_interface = 1,
+        torque_interface = 2,
+        velocity_interface = 3
+    };
+
+    enum cmd_path_t
+    {
+        single_joint = 0,
+        all_joints = 1,
+        some_joints = 2
+    };
+
+    struct Measurement
+    {
+        interface_t interf;
+        cmd_path_t  path;
+        int         n_joints;
+        double      updates_per_second;
+        double      p50;
+        double      p90;
+        double      p99;
+        double      max;
+        double      cpu_per_update;
+        double      cpu_load;
+    };
+
+    void setMode(int desired_mode);
+    void prepareInterface(interface_t interf);
+    bool hasPath(interface_t interf, cmd_path_t path, int n_joints) const;
+    void sendUpdate(interface_t interf, cmd_path_t path, int n_joints);
+    Measurement measure(interface_t interf, cmd_path_t path, int n_joints);
+    static double percentile(const std::vector<double>& sorted, double p);
+    static const char* interfaceName(interface_t interf);
+    static const char* pathName(cmd_path_t path);
+
+    std::string robotName;
+    std::string partName;
+    std::string filename;
+    std::vector<int> jointsList;
+    std::vector<int> jointCounts;
+    std::vector<interface_t> interfaces;
+    int    n_part_joints;
+    int    updates;
+    bool   switch_mode;
+
+    yarp::dev::PolyDriver        *dd;
+    yarp::dev::IControlMode      *icmd;
+    yarp::dev::IEncoders         *ienc;
+    yarp::dev::IPositionDirect   *idir;
+    yarp::dev::IPWMControl       *ipwm;
+    yarp::dev::ITorqueControl    *itrq;
+    yarp::dev::IVelocityControl  *ivel;
+
+    std::vector<double> cmd_tot;  //references of all the joints of the part
+    std::vector<double> cmd_some; //references of the listed joints
+    std::vector<double> durations;
+};
+
+#endif //_COMMANDTHROUGHPUT_H_
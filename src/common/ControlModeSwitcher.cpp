@@ -0,0 +1,194 @@
+/*
+ * iCub Robot Unit Tests (Robot Testing Framework)
+ *
+ * Copyright (C) 2015-2019 Istituto Italiano di Tecnologia (IIT)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <cstdio>
+#include <yarp/os/Time.h>
+#include <yarp/os/Vocab.h>
+#include "ControlModeSwitcher.h"
+
+double ControlModeSwitcher::Result::maxLatency() const
+{
+    double max = 0;
+    for (size_t i = 0; i < latency.size(); i++)
+    {
+        if (latency[i] > max) max = latency[i];
+    }
+    return max;
+}
+
+ControlModeSwitcher::ControlModeSwitcher() :
+    m_icmd(0), m_iimd(0), m_poll_period(0.005), m_timeout(20.0), m_request_time(0), m_pending(false)
+{
+}
+
+ControlModeSwitcher::ControlModeSwitcher(yarp::dev::IControlMode* icmd, yarp::dev::IInteractionMode* iimd, const std::vector<int>& joints) :
+    ControlModeSwitcher()
+{
+    configure(icmd, iimd, joints);
+}
+
+ControlModeSwitcher::ControlModeSwitcher(yarp::dev::IControlMode* icmd, yarp::dev::IInteractionMode* iimd, const int* joints, int n_joints) :
+    ControlModeSwitcher()
+{
+    configure(icmd, iimd, joints, n_joints);
+}
+
+ControlModeSwitcher::ControlModeSwitcher(yarp::dev::IControlMode* icmd, yarp::dev::IInteractionMode* iimd, const yarp::sig::Vector& joints) :
+    ControlModeSwitcher()
+{
+    configure(icmd, iimd, joints);
+}
+
+void ControlModeSwitcher::configure(yarp::dev::IControlMode* icmd, yarp::dev::IInteractionMode* iimd, const std::vector<int>& joints)
+{
+    m_icmd = icmd;
+    m_iimd = iimd;
+    m_joints = joints;
+    m_pending = false;
+}
+
+void ControlModeSwitcher::configure(yarp::dev::IControlMode* icmd, yarp::dev::IInteractionMode* iimd, const int* joints, int n_joints)
+{
+    configure(icmd, iimd, std::vector<int>(joints, joints + n_joints));
+}
+
+void ControlModeSwitcher::configure(yarp::dev::IControlMode* icmd, yarp::dev::IInteractionMode* iimd, const yarp::sig::Vector& joints)
+{
+    std::vector<int> j(joints.size());
+    for (size_t i = 0; i < joints.size(); i++) j[i] = (int)joints[i];
+    configure(icmd, iimd, j);
+}
+
+bool ControlModeSwitcher::request(int control_mode, yarp::dev::InteractionModeEnum interaction_mode)
+{
+    if (m_icmd == 0 || m_joints.empty()) return false;
+    int n = (int)m_joints.size();
+    bool ret = true;
+
+    m_request_time = yarp::os::Time::now();
+    m_pending = true;
+
+    std::vector<int> cmodes(n, control_mode);
+    if (!m_icmd->setControlModes(n, m_joints.data(), cmodes.data()))
+    {
+        for (int i = 0; i < n; i++) ret &= m_icmd->setControlMode(m_joints[i], control_mode);
+    }
+
+    if (interaction_mode != VOCAB_IM_UNKNOWN)
+    {
+        if (m_iimd == 0) return false;
+        std::vector<yarp::dev::InteractionModeEnum> imodes(n, interaction_mode);
+        if (!m_iimd->setInteractionModes(n, m_joints.data(), imodes.data()))
+        {
+            for (int i = 0; i < n; i++) ret &= m_iimd->setInteractionMode(m_joints[i], interaction_mode);
+        }
+    }
+    return ret;
+}
+
+ControlModeSwitcher::Result ControlModeSwitcher::wait(int control_mode, yarp::dev::InteractionModeEnum interaction_mode)
+{
+    Result result;
+    result.requested_control_mode = control_mode;
+    result.requested_interaction_mode = interaction_mode;
+    if (m_icmd == 0 || m_joints.empty()) return result;
+    int n = (int)m_joints.size();
+    bool check_interaction = (interaction_mode != VOCAB_IM_UNKNOWN && m_iimd != 0);
+
+    double start = m_pending ? m_request_time : yarp::os::Time::now();
+    m_pending = false;
+
+    result.latency.assign(n, -1.0);
+    result.control_mode.assign(n, VOCAB_CM_UNKNOWN);
+    result.interaction_mode.assign(n, VOCAB_IM_UNKNOWN);
+
+    while (1)
+    {
+        if (!m_icmd->getControlModes(n, m_joints.data(), result.control_mode.data()))
+        {
+            for (int i = 0; i < n; i++) m_icmd->getControlMode(m_joints[i], &result.control_mode[i]);
+        }
+        if (check_interaction &&
+            !m_iimd->getInteractionModes(n, m_joints.data(), result.interaction_mode.data()))
+        {
+            for (int i = 0; i < n; i++) m_iimd->getInteractionMode(m_joints[i], &result.interaction_mode[i]);
+        }
+        double now = yarp::os::Time::now();
+
+        int ok = 0;
+        for (int i = 0; i < n; i++)
+        {
+            bool reached = result.control_mode[i] == control_mode &&
+                           (!check_interaction || result.interaction_mode[i] == interaction_mode);
+            if (reached && result.latency[i] < 0) result.latency[i] = now - start;
+            if (reached) ok++;
+        }
+        if (ok == n) { result.ok = true; break; }
+        if (now - start > m_timeout) break;
+        yarp::os::Time::delay(m_poll_period);
+    }
+    return result;
+}
+
+ControlModeSwitcher::Result ControlModeSwitcher::change(int control_mode, yarp::dev::InteractionModeEnum interaction_mode)
+{
+    request(control_mode, interaction_mode);
+    return wait(control_mode, interaction_mode);
+}
+
+std::string ControlModeSwitcher::toString(const Result& result) const
+{
+    std::string s;
+    char buff[64];
+    for (size_t i = 0; i < m_joints.size() && i < result.latency.size(); i++)
+    {
+        if (result.latency[i] < 0) snprintf(buff, sizeof(buff), "%sj%d -", i ? " " : "", m_joints[i]);
+        else                       snprintf(buff, sizeof(buff), "%sj%d %.1fms", i ? " " : "", m_joints[i], result.latency[i]*1000);
+        s += buff;
+    }
+    return s;
+}
+
+std::string ControlModeSwitcher::failureMessage(const Result& result, const std::string& title) const
+{
+    std::string s = title + " failed:";
+    bool found = false;
+    for (size_t i = 0; i < m_joints.size() && i < result.latency.size(); i++)
+    {
+        if (result.latency[i] >= 0) continue;
+        s += (found ? ", joint " : " joint ") + std::to_string(m_joints[i]) + " current mode is " +
+             modesToString(result.control_mode[i], result.interaction_mode[i]);
+        found = true;
+    }
+    if (!found) s += " unable to read the modes";
+    return s + ", it should be " + modesToString(result.requested_control_mode, result.requested_interaction_mode);
+}
+
+std::string ControlModeSwitcher::successMessage(const Result& result, const std::string& title) const
+{
+    return title + " passed: current mode is " + modesToString(result.requested_control_mode, result.requested_interaction_mode) +
+           ", latency " + toString(result);
+}
+
+std::string ControlModeSwitcher::modesToString(int control_mode, yarp::dev::InteractionModeEnum interaction_mode)
+{
+    return "(" + yarp::os::Vocab32::decode((yarp::os::NetInt32)control_mode) + "," +
+                 yarp::os::Vocab32::decode((yarp::os::NetInt32)interaction_mode) + ")";
+}
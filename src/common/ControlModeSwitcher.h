@@ -0,0 +1,110 @@
+/*
+ * iCub Robot Unit Tests (Robot Testing Framework)
+ *
+ * Copyright (C) 2015-2019 Istituto Italiano di Tecnologia (IIT)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _CONTROLMODESWITCHER_H_
+#define _CONTROLMODESWITCHER_H_
+
+#include <string>
+#include <vector>
+#include <yarp/dev/ControlBoardInterfaces.h>
+#include <yarp/sig/Vector.h>
+
+/**
+* Sets the control mode and the interaction mode of a group of joints and waits until
+* all of them have switched, measuring the transition latency of each joint.
+* The modes are set with the group calls setControlModes()/setInteractionModes() (joint by joint
+* if the group call fails) and read back with the group getters every pollPeriod seconds.
+* The latency of a joint is the time between the command and the first poll which reads the
+* requested modes, so its resolution is the poll period plus the duration of the read.
+* VOCAB_IM_UNKNOWN as interaction mode means that the interaction mode is neither set nor checked.
+*/
+class ControlModeSwitcher
+{
+public:
+    struct Result
+    {
+        bool ok;                                                 //all the joints reached the requested modes
+        std::vector<double> latency;                             //per joint [s], -1 if the joint did not switch
+        std::vector<int> control_mode;                           //the last modes read
+        std::vector<yarp::dev::InteractionModeEnum> interaction_mode;
+        int requested_control_mode;                              //the modes passed to wait()
+        yarp::dev::InteractionModeEnum requested_interaction_mode;
+
+        Result() : ok(false), requested_control_mode(VOCAB_CM_UNKNOWN), requested_interaction_mode(VOCAB_IM_UNKNOWN) {}
+
+        /** the max latency over the joints which switched, 0 if none */
+        double maxLatency() const;
+    };
+
+    ControlModeSwitcher();
+    ControlModeSwitcher(yarp::dev::IControlMode* icmd, yarp::dev::IInteractionMode* iimd, const std::vector<int>& joints);
+    ControlModeSwitcher(yarp::dev::IControlMode* icmd, yarp::dev::IInteractionMode* iimd, const int* joints, int n_joints);
+    ControlModeSwitcher(yarp::dev::IControlMode* icmd, yarp::dev::IInteractionMode* iimd, const yarp::sig::Vector& joints);
+
+    void configure(yarp::dev::IControlMode* icmd, yarp::dev::IInteractionMode* iimd, const std::vector<int>& joints);
+    void configure(yarp::dev::IControlMode* icmd, yarp::dev::IInteractionMode* iimd, const int* joints, int n_joints);
+    void configure(yarp::dev::IControlMode* icmd, yarp::dev::IInteractionMode* iimd, const yarp::sig::Vector& joints);
+
+    /** the interval between two reads of the modes, default 0.005 s */
+    void setPollPeriod(double period) { m_poll_period = period; }
+    /** the max time waited for the transition, default 20 s */
+    void setTimeout(double timeout) { m_timeout = timeout; }
+
+    const std::vector<int>& joints() const { return m_joints; }
+
+    /** sends the modes to all the joints and starts the latency measurement */
+    bool request(int control_mode, yarp::dev::InteractionModeEnum interaction_mode);
+
+    /**
+    * Polls the modes until all the joints are in the requested ones or the timeout expires.
+    * The latency is measured from the last request(); without a pending request (e.g. to check that
+    * the modes did not change) it is measured from the call to wait().
+    */
+    Result wait(int control_mode, yarp::dev::InteractionModeEnum interaction_mode);
+
+    /** request() followed by wait() */
+    Result change(int control_mode, yarp::dev::InteractionModeEnum interaction_mode);
+
+    /** e.g. "j0 2.1ms j1 3.4ms j2 -", with the joint numbers */
+    std::string toString(const Result& result) const;
+
+    /**
+    * e.g. "Test (t1) failed: joint 2 current mode is (pos,stif), it should be (trq,stif)",
+    * listing all the joints which did not switch
+    */
+    std::string failureMessage(const Result& result, const std::string& title) const;
+
+    /** e.g. "Test (t1) passed: current mode is (trq,stif), latency j0 2.1ms j2 3.4ms" */
+    std::string successMessage(const Result& result, const std::string& title) const;
+
+    /** e.g. "(pos,stif)" */
+    static std::string modesToString(int control_mode, yarp::dev::InteractionModeEnum interaction_mode);
+
+private:
+    yarp::dev::IControlMode*     m_icmd;
+    yarp::dev::IInteractionMode* m_iimd;
+    std::vector<int> m_joints;
+    double m_poll_period;
+    double m_timeout;
+    double m_request_time;
+    bool   m_pending;
+};
+
+#endif
@@ -0,0 +1,195 @@
+/*
+ * iCub Robot Unit Tests (Robot Testing Framework)
+ *
+ * Copyright (C) 2015-2019 Istituto Italiano di Tecnologia (IIT)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <math.h>
+#include <sstream>
+#include <utility>
+#include "CouplingMatrix.h"
+
+using namespace yarp::os;
+
+CouplingMatrix::CouplingMatrix() : valid(false), skipped(0)
+{
+}
+
+bool CouplingMatrix::fromRemoteVariable(const Bottle& kinematic_mj, size_t matrix_size, std::string& error)
+{
+    if (matrix_size == 0)
+    {
+        error = "invalid matrix_size: must be >0";
+        return false;
+    }
+
+    std::string new_source = kinematic_mj.toString();
+    if (valid && new_source == source && mat.rows() == matrix_size)
+    {
+        return true;
+    }
+
+    valid = false;
+    skipped = 0;
+    blockList.clear();
+    mat.resize(matrix_size, matrix_size);
+    mat.eye();
+
+    size_t offset = 0;
+    for (size_t i = 0; i < kinematic_mj.size(); i++)
+    {
+        // each entry may be received either as a list or as a string to be parsed
+        Bottle bv;
+        const Value& v = kinematic_mj.get(i);
+        if (v.isList())        bv = *v.asList();
+        else if (v.isString()) bv.fromString(v.asString());
+        else                   bv.fromString(v.toString());
+        if (bv.size() == 1 && bv.get(0).isList())
+        {
+            // copy first: the inner list is owned by bv
+            Bottle inner = *bv.get(0).asList();
+            bv = inner;
+        }
+
+        size_t n = (size_t)(sqrt((double)bv.size()) + 0.5);
+        if (n == 0 || n*n != bv.size())
+        {
+            std::stringstream ss;
+            ss << "kinematic_mj block " << i << " has " << bv.size() << " elements, which is not a square number";
+            error = ss.str();
+            return false;
+        }
+
+        if (offset >= matrix_size)
+        {
+            skipped++;
+            offset += n;
+            continue;
+        }
+
+        if (offset + n > matrix_size)
+        {
+            std::stringstream ss;
+            ss << "kinematic_mj block " << i << " (joints " << offset << ".." << offset+n-1 << ") does not fit in matrix_size " << matrix_size;
+            error = ss.str();
+            return false;
+        }
+
+        for (size_t r = 0; r < n; r++)
+        {
+            for (size_t c = 0; c < n; c++)
+            {
+                mat(offset+r, offset+c) = bv.get(r*n+c).asFloat64();
+            }
+        }
+
+        Block blk;
+        blk.offset = offset;
+        blk.size = n;
+        blockList.push_back(blk);
+        offset += n;
+    }
+
+    // the joints which are not covered by kinematic_mj are uncoupled
+    for (size_t j = (offset < matrix_size ? offset : matrix_size); j < matrix_size; j++)
+    {
+        Block blk;
+        blk.offset = j;
+        blk.size = 1;
+        blockList.push_back(blk);
+    }
+
+    inv.resize(matrix_size, matrix_size);
+    inv.zero();
+    for (size_t b = 0; b < blockList.size(); b++)
+    {
+        if (!invertBlock(mat, blockList[b].offset, blockList[b].size, inv))
+        {
+            std::stringstream ss;
+            ss << "kinematic_mj block at joint " << blockList[b].offset << " is singular";
+            error = ss.str();
+            return false;
+        }
+    }
+
+    source = new_source;
+    valid = true;
+    return true;
+}
+
+bool CouplingMatrix::invertBlock(const yarp::sig::Matrix& a, size_t offset, size_t n, yarp::sig::Matrix& out)
+{
+    // LU factorization with partial pivoting of the block, stored in place in lu
+    std::vector<double> lu(n*n);
+    std::vector<size_t> perm(n);
+    for (size_t r = 0; r < n; r++)
+    {
+        perm[r] = r;
+        for (size_t c = 0; c < n; c++) lu[r*n+c] = a(offset+r, offset+c);
+    }
+
+    for (size_t k = 0; k < n; k++)
+    {
+        size_t p = k;
+        for (size_t r = k+1; r < n; r++)
+        {
+            if (fabs(lu[r*n+k]) > fabs(lu[p*n+k])) p = r;
+        }
+        if (fabs(lu[p*n+k]) < 1e-12) return false;
+        if (p != k)
+        {
+            for (size_t c = 0; c < n; c++) std::swap(lu[k*n+c], lu[p*n+c]);
+            std::swap(perm[k], perm[p]);
+        }
+        for (size_t r = k+1; r < n; r++)
+        {
+            lu[r*n+k] /= lu[k*n+k];
+            for (size_t c = k+1; c < n; c++) lu[r*n+c] -= lu[r*n+k] * lu[k*n+c];
+        }
+    }
+
+    // solve L*U*x = P*e_c for each column of the identity
+    std::vector<double> x(n);
+    for (size_t col = 0; col < n; col++)
+    {
+        for (size_t r = 0; r < n; r++)
+        {
+            double s = (perm[r] == col) ? 1.0 : 0.0;
+            for (size_t c = 0; c < r; c++) s -= lu[r*n+c] * x[c];
+            x[r] = s;
+        }
+        for (size_t r = n; r-- > 0; )
+        {
+            double s = x[r];
+            for (size_t c = r+1; c < n; c++) s -= lu[r*n+c] * x[c];
+            x[r] = s / lu[r*n+r];
+        }
+        for (size_t r = 0; r < n; r++) out(offset+r, offset+col) = x[r];
+    }
+    return true;
+}
+
+std::string CouplingMatrix::blocksToString() const
+{
+    std::stringstream ss;
+    for (size_t b = 0; b < blockList.size(); b++)
+    {
+        if (b > 0) ss << " ";
+        ss << "[" << blockList[b].offset << ".." << blockList[b].offset + blockList[b].size - 1 << "]";
+    }
+    return ss.str();
+}
@@ -0,0 +1,81 @@
+/*
+ * iCub Robot Unit Tests (Robot Testing Framework)
+ *
+ * Copyright (C) 2015-2019 Istituto Italiano di Tecnologia (IIT)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _COUPLINGMATRIX_H_
+#define _COUPLINGMATRIX_H_
+
+#include <string>
+#include <vector>
+#include <yarp/os/Bottle.h>
+#include <yarp/sig/Matrix.h>
+
+/**
+* Block-diagonal joint/motor coupling matrix assembled from the kinematic_mj remote variable.
+* kinematic_mj contains one entry per coupled group of joints, each entry holding the
+* row-major elements of a square block. Blocks are placed one after the other along the
+* diagonal; the joints not covered by any block are left uncoupled (identity).
+* Every block is LU-factored (with partial pivoting) once, when the matrix is assembled,
+* so the inverse is computed per block and cached until kinematic_mj changes.
+*/
+class CouplingMatrix
+{
+public:
+    struct Block
+    {
+        size_t offset;
+        size_t size;
+    };
+
+    CouplingMatrix();
+
+    /**
+    * Assembles the matrix of size matrix_size x matrix_size from kinematic_mj.
+    * Blocks starting beyond matrix_size are skipped, blocks crossing it are an error.
+    * If kinematic_mj is the same of the last successful call the cached matrix is kept.
+    * Returns false and fills error if the variable is malformed or a block is singular.
+    */
+    bool fromRemoteVariable(const yarp::os::Bottle& kinematic_mj, size_t matrix_size, std::string& error);
+
+    bool isValid() const { return valid; }
+    size_t size() const { return mat.rows(); }
+
+    const yarp::sig::Matrix& matrix() const { return mat; }
+    const yarp::sig::Matrix& inverse() const { return inv; }
+
+    /** diagonal blocks covering all the rows, including the 1x1 blocks of the uncoupled joints */
+    const std::vector<Block>& blocks() const { return blockList; }
+
+    /** number of blocks skipped because they start beyond matrix_size */
+    size_t skippedBlocks() const { return skipped; }
+
+    std::string blocksToString() const;
+
+private:
+    static bool invertBlock(const yarp::sig::Matrix& a, size_t offset, size_t n, yarp::sig::Matrix& out);
+
+    bool   valid;
+    size_t skipped;
+    std::string source;
+    yarp::sig::Matrix mat;
+    yarp::sig::Matrix inv;
+    std::vector<Block> blockList;
+};
+
+#endif //_COUPLINGMATRIX_H_
@@ -0,0 +1,197 @@
+/*
+ * iCub Robot Unit Tests (Robot Testing Framework)
+ *
+ * Copyright (C) 2015-2019 Istituto Italiano di Tecnologia (IIT)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <cmath>
+#include <cstdio>
+#include <limits>
+#include "FrequencyResponseEstimator.h"
+
+FrequencyResponseEstimator::FrequencyResponseEstimator() :
+    m_hann(true)
+{
+}
+
+std::vector<double> FrequencyResponseEstimator::logSpace(double f_min, double f_max, size_t n)
+{
+    std::vector<double> f(n);
+    for (size_t k = 0; k < n; k++)
+    {
+        f[k] = (n > 1) ? f_min * std::pow(f_max / f_min, (double)k / (n - 1)) : f_min;
+    }
+    return f;
+}
+
+void FrequencyResponseEstimator::setFrequencies(const std::vector<double>& frequencies)
+{
+    m_frequencies = frequencies;
+    reset();
+}
+
+void FrequencyResponseEstimator::reset()
+{
+    m_crossRe.assign(m_frequencies.size(), 0.0);
+    m_crossIm.assign(m_frequencies.size(), 0.0);
+    m_inputPower.assign(m_frequencies.size(), 0.0);
+}
+
+bool FrequencyResponseEstimator::add(const double* time, const double* input, const double* output, size_t n, double timeOffset)
+{
+    size_t first = 0;
+    while (first < n && time[first] < timeOffset) first++;
+    if (n - first < 2) return false;
+
+    double in_mean = 0;
+    double out_mean = 0;
+    for (size_t i = first; i < n; i++)
+    {
+        in_mean += input[i];
+        out_mean += output[i];
+    }
+    in_mean /= (n - first);
+    out_mean /= (n - first);
+
+    double t0 = time[first];
+    double duration = time[n-1] - t0;
+    //the window and the sample weights need distinct timestamps
+    if (!(duration > 0)) return false;
+
+    for (size_t k = 0; k < m_frequencies.size(); k++)
+    {
+        double w = 2 * M_PI * m_frequencies[k];
+        double u_re = 0, u_im = 0, y_re = 0, y_im = 0;
+        for (size_t i = first; i < n; i++)
+        {
+            double t = time[i] - t0;
+            //each sample weights the interval to the next one
+            double dt = (i + 1 < n) ? time[i+1] - time[i] : time[i] - time[i-1];
+            if (m_hann) dt *= 0.5 * (1 - std::cos(2 * M_PI * t / duration));
+            double c = std::cos(w * t) * dt;
+            double s = -std::sin(w * t) * dt;
+            double u = input[i] - in_mean;
+            double y = output[i] - out_mean;
+            u_re += u * c; u_im += u * s;
+            y_re += y * c; y_im += y * s;
+        }
+        //Y * conj(U)
+        m_crossRe[k] += y_re * u_re + y_im * u_im;
+        m_crossIm[k] += y_im * u_re - y_re * u_im;
+        m_inputPower[k] += u_re * u_re + u_im * u_im;
+    }
+    return true;
+}
+
+std::vector<FrequencyResponseEstimator::Point> FrequencyResponseEstimator::response() const
+{
+    std::vector<Point> r;
+    for (size_t k = 0; k < m_frequencies.size(); k++)
+    {
+        if (m_inputPower[k] <= 0) continue;
+        double re = m_crossRe[k] / m_inputPower[k];
+        double im = m_crossIm[k] / m_inputPower[k];
+        Point p;
+        p.frequency = m_frequencies[k];
+        p.magnitude = std::sqrt(re * re + im * im);
+        p.phase = std::atan2(im, re) * 180.0 / M_PI;
+        r.push_back(p);
+    }
+    return r;
+}
+
+//linear interpolation in log-frequency of the point where y crosses level between a and b
+static double crossingFrequency(double f_a, double y_a, double f_b, double y_b, double level)
+{
+    double alpha = (y_a == y_b) ? 0 : (level - y_a) / (y_b - y_a);
+    return std::exp(std::log(f_a) + alpha * (std::log(f_b) - std::log(f_a)));
+}
+
+double FrequencyResponseEstimator::bandwidth() const
+{
+    std::vector<Point> r = response();
+    if (r.empty()) return std::numeric_limits<double>::quiet_NaN();
+
+    double level = r[0].magnitude / std::sqrt(2.0);
+    for (size_t k = 1; k < r.size(); k++)
+    {
+        if (r[k].magnitude < level)
+        {
+            return crossingFrequency(r[k-1].frequency, r[k-1].magnitude, r[k].frequency, r[k].magnitude, level);
+        }
+    }
+    return std::numeric_limits<double>::quiet_NaN();
+}
+
+double FrequencyResponseEstimator::phaseMargin(double* crossover) const
+{
+    const double nan = std::numeric_limits<double>::quiet_NaN();
+    if (crossover) *crossover = nan;
+
+    std::vector<Point> r = response();
+    double prev_f = 0, prev_mag = 0, prev_phase = 0;
+    for (size_t k = 0; k < r.size(); k++)
+    {
+        //L = T / (1 - T)
+        double t_re = r[k].magnitude * std::cos(r[k].phase * M_PI / 180.0);
+        double t_im = r[k].magnitude * std::sin(r[k].phase * M_PI / 180.0);
+        double d_re = 1 - t_re;
+        double d_im = -t_im;
+        double d2 = d_re * d_re + d_im * d_im;
+        if (d2 <= 0) continue;
+        double l_re = (t_re * d_re + t_im * d_im) / d2;
+        double l_im = (t_im * d_re - t_re * d_im) / d2;
+        double l_mag = std::sqrt(l_re * l_re + l_im * l_im);
+        double l_phase = std::atan2(l_im, l_re) * 180.0 / M_PI;
+
+        if (k > 0 && prev_mag >= 1.0 && l_mag < 1.0)
+        {
+            double f = crossingFrequency(prev_f, prev_mag, r[k].frequency, l_mag, 1.0);
+            double alpha = (std::log(f) - std::log(prev_f)) / (std::log(r[k].frequency) - std::log(prev_f));
+            //interpolate the phase along the shortest path
+            double dphase = l_phase - prev_phase;
+            if (dphase > 180) dphase -= 360;
+            if (dphase < -180) dphase += 360;
+            double phase = prev_phase + alpha * dphase;
+            double pm = 180.0 + phase;
+            while (pm > 180) pm -= 360;
+            while (pm <= -180) pm += 360;
+            if (crossover) *crossover = f;
+            return pm;
+        }
+        prev_f = r[k].frequency;
+        prev_mag = l_mag;
+        prev_phase = l_phase;
+    }
+    return nan;
+}
+
+bool FrequencyResponseEstimator::save(const std::string& filename) const
+{
+    FILE* fp = fopen(filename.c_str(), "w");
+    if (fp == 0) return false;
+
+    std::vector<Point> r = response();
+    for (size_t k = 0; k < r.size(); k++)
+    {
+        fprintf(fp, "%.6f %.6f %.6f\n", r[k].frequency, 20.0 * std::log10(r[k].magnitude), r[k].phase);
+    }
+
+    bool ok = (ferror(fp) == 0);
+    if (fclose(fp) != 0) ok = false;
+    return ok;
+}
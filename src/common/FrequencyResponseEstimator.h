@@ -0,0 +1,84 @@
+/*
+ * iCub Robot Unit Tests (Robot Testing Framework)
+ *
+ * Copyright (C) 2015-2019 Istituto Italiano di Tecnologia (IIT)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _FREQUENCYRESPONSEESTIMATOR_H_
+#define _FREQUENCYRESPONSEESTIMATOR_H_
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/**
+* Estimates the frequency response output/input of a system from records of its input and output.
+* The Fourier coefficients are computed by correlation at the requested frequencies using the actual
+* timestamps of the samples, so records with an irregular sampling period can be used.
+* Several records (e.g. the test cycles) can be added: the H1 estimate sum(Y*conj(U))/sum(|U|^2) is used.
+* The closed-loop bandwidth and the phase margin of the equivalent unity-feedback open loop L=T/(1-T)
+* are derived from the estimated closed-loop response T.
+*/
+class FrequencyResponseEstimator
+{
+public:
+    struct Point
+    {
+        double frequency; //Hz
+        double magnitude; //abs(output/input)
+        double phase;     //deg
+    };
+
+    FrequencyResponseEstimator();
+
+    /** n log-spaced frequencies from f_min to f_max */
+    static std::vector<double> logSpace(double f_min, double f_max, size_t n);
+
+    void setFrequencies(const std::vector<double>& frequencies);
+
+    /** if true (default) a Hann window is applied to each record, use false for periodic excitations */
+    void setWindow(bool hann) { m_hann = hann; }
+
+    /**
+    * Adds one record. Samples before timeOffset are ignored; the mean of input and output is removed.
+    * Returns false, and ignores the record, if it has less than two samples or a null duration: when no record
+    * is added the response is empty and bandwidth() and phaseMargin() are NaN.
+    */
+    bool add(const double* time, const double* input, const double* output, size_t n, double timeOffset = 0);
+
+    void reset();
+
+    std::vector<Point> response() const;
+
+    /** first frequency where the magnitude drops 3dB below the one at the lowest frequency, NaN if not found */
+    double bandwidth() const;
+
+    /** phase margin (deg) of L=T/(1-T) at its first gain crossover, NaN if there is no crossover */
+    double phaseMargin(double* crossover = 0) const;
+
+    /** writes one row per frequency: frequency, magnitude (dB), phase (deg) */
+    bool save(const std::string& filename) const;
+
+private:
+    bool m_hann;
+    std::vector<double> m_frequencies;
+    std::vector<double> m_crossRe; //sum of Y*conj(U)
+    std::vector<double> m_crossIm;
+    std::vector<double> m_inputPower; //sum of |U|^2
+};
+
+#endif
@@ -0,0 +1,83 @@
+/*
+ * iCub Robot Unit Tests (Robot Testing Framework)
+ *
+ * Copyright (C) 2015-2019 Istituto Italiano di Tecnologia (IIT)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <sstream>
+#include "JointBatchScheduler.h"
+
+JointBatchScheduler::Batches JointBatchScheduler::sequential(size_t n_joints)
+{
+    Batches batches(n_joints);
+    for (size_t i = 0; i < n_joints; i++) batches[i].push_back(i);
+    return batches;
+}
+
+JointBatchScheduler::Batches JointBatchScheduler::independent(const std::vector<int>& joints, const CouplingMatrix& coupling)
+{
+    //block index of each joint, the uncoupled joints get a block of their own
+    const std::vector<CouplingMatrix::Block>& blocks = coupling.blocks();
+    std::vector<size_t> block_of(joints.size());
+    for (size_t i = 0; i < joints.size(); i++)
+    {
+        block_of[i] = blocks.size() + (size_t)joints[i];
+        for (size_t b = 0; b < blocks.size(); b++)
+        {
+            if ((size_t)joints[i] >= blocks[b].offset && (size_t)joints[i] < blocks[b].offset + blocks[b].size)
+            {
+                block_of[i] = b;
+                break;
+            }
+        }
+    }
+
+    Batches batches;
+    for (size_t i = 0; i < joints.size(); i++)
+    {
+        size_t target = batches.size();
+        for (size_t k = 0; k < batches.size() && target == batches.size(); k++)
+        {
+            bool free = true;
+            for (size_t j = 0; j < batches[k].size(); j++)
+            {
+                if (block_of[batches[k][j]] == block_of[i]) { free = false; break; }
+            }
+            if (free) target = k;
+        }
+        if (target == batches.size()) batches.push_back(std::vector<size_t>());
+        batches[target].push_back(i);
+    }
+    return batches;
+}
+
+std::string JointBatchScheduler::toString(const Batches& batches, const std::vector<int>& joints)
+{
+    std::ostringstream ss;
+    for (size_t k = 0; k < batches.size(); k++)
+    {
+        if (k > 0) ss << " ";
+        ss << "(";
+        for (size_t j = 0; j < batches[k].size(); j++)
+        {
+            if (j > 0) ss << " ";
+            ss << joints[batches[k][j]];
+        }
+        ss << ")";
+    }
+    return ss.str();
+}
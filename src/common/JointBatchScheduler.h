@@ -0,0 +1,54 @@
+/*
+ * iCub Robot Unit Tests (Robot Testing Framework)
+ *
+ * Copyright (C) 2015-2019 Istituto Italiano di Tecnologia (IIT)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _JOINTBATCHSCHEDULER_H_
+#define _JOINTBATCHSCHEDULER_H_
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "CouplingMatrix.h"
+
+/**
+* Groups the tested joints into batches which can be moved at the same time.
+* Two joints are independent when they do not belong to the same diagonal block of the
+* joint/motor coupling matrix: the joints of a batch are all independent from each other.
+* A batch is a list of indices into the list of the tested joints.
+*/
+class JointBatchScheduler
+{
+public:
+    typedef std::vector<std::vector<size_t>> Batches;
+
+    /** one joint per batch, in the given order */
+    static Batches sequential(size_t n_joints);
+
+    /**
+    * Greedy grouping: each joint is added to the first batch which does not contain a joint of the same coupling block.
+    * The joints not covered by the coupling matrix are considered uncoupled.
+    * The order of the joints is kept inside each batch.
+    */
+    static Batches independent(const std::vector<int>& joints, const CouplingMatrix& coupling);
+
+    /** e.g. "(0 2) (1)", with the joint numbers */
+    static std::string toString(const Batches& batches, const std::vector<int>& joints);
+};
+
+#endif
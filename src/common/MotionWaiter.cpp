@@ -0,0 +1,139 @@
+/*
+ * iCub Robot Unit Tests (Robot Testing Framework)
+ *
+ * Copyright (C) 2015-2019 Istituto Italiano di Tecnologia (IIT)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <cmath>
+#include <yarp/os/Time.h>
+#include "MotionWaiter.h"
+
+MotionWaiter::MotionWaiter() :
+    m_ienc(0), m_itimed(0), m_ipos(0),
+    m_velocity_threshold(1.0), m_poll_period(0.01), m_timeout(20.0), m_use_motion_done(true)
+{
+}
+
+void MotionWaiter::configure(yarp::dev::IEncoders* ienc, yarp::dev::IPositionControl* ipos, const std::vector<int>& joints)
+{
+    m_ienc = ienc;
+    m_itimed = dynamic_cast<yarp::dev::IEncodersTimed*>(ienc);
+    m_ipos = ipos;
+    m_joints = joints;
+    m_tolerances.assign(joints.size(), 0.5);
+
+    int n_part_joints = 0;
+    if (m_ienc) m_ienc->getAxes(&n_part_joints);
+    m_encoders.assign(n_part_joints, 0.0);
+    m_stamps.assign(n_part_joints, 0.0);
+    m_speeds.assign(n_part_joints, 0.0);
+}
+
+void MotionWaiter::configure(yarp::dev::IEncoders* ienc, yarp::dev::IPositionControl* ipos, const int* joints, int n_joints)
+{
+    configure(ienc, ipos, std::vector<int>(joints, joints + n_joints));
+}
+
+void MotionWaiter::configure(yarp::dev::IEncoders* ienc, yarp::dev::IPositionControl* ipos, const yarp::sig::Vector& joints)
+{
+    std::vector<int> j(joints.size());
+    for (size_t i = 0; i < joints.size(); i++) j[i] = (int)joints[i];
+    configure(ienc, ipos, j);
+}
+
+void MotionWaiter::setTolerance(double tolerance)
+{
+    m_tolerances.assign(m_joints.size(), tolerance);
+}
+
+void MotionWaiter::setTolerances(const std::vector<double>& tolerances)
+{
+    for (size_t i = 0; i < m_tolerances.size() && i < tolerances.size(); i++) m_tolerances[i] = tolerances[i];
+}
+
+MotionWaiter::Result MotionWaiter::wait(const std::vector<double>& targets)
+{
+    Result result;
+    size_t n = m_joints.size();
+    result.position.assign(n, 0.0);
+    result.settled.assign(n, false);
+    if (m_ienc == 0 || targets.size() < n || m_encoders.empty()) return result;
+
+    bool check_speed = m_velocity_threshold > 0;
+    bool check_done = m_use_motion_done && m_ipos != 0;
+
+    double start = yarp::os::Time::now();
+    while (1)
+    {
+        bool read = m_itimed ? m_itimed->getEncodersTimed(m_encoders.data(), m_stamps.data())
+                             : m_ienc->getEncoders(m_encoders.data());
+        if (read && check_speed) read = m_ienc->getEncoderSpeeds(m_speeds.data());
+
+        bool done = true;
+        if (read && check_done)
+        {
+            //the group call is a single request, the single joint one is the fallback
+            if (!m_ipos->checkMotionDone((int)n, m_joints.data(), &done))
+            {
+                done = true;
+                for (size_t i = 0; i < n; i++)
+                {
+                    bool d = true;
+                    m_ipos->checkMotionDone(m_joints[i], &d);
+                    done = done && d;
+                }
+            }
+        }
+
+        int settled = 0;
+        for (size_t i = 0; i < n && read; i++)
+        {
+            int j = m_joints[i];
+            result.position[i] = m_encoders[j];
+            result.settled[i] = std::fabs(m_encoders[j] - targets[i]) < m_tolerances[i] &&
+                                (!check_speed || std::fabs(m_speeds[j]) < m_velocity_threshold);
+            if (result.settled[i]) settled++;
+        }
+
+        result.time = yarp::os::Time::now() - start;
+        if (read && done && settled == (int)n) { result.ok = true; break; }
+        if (result.time > m_timeout) break;
+        yarp::os::Time::delay(m_poll_period);
+    }
+    return result;
+}
+
+MotionWaiter::Result MotionWaiter::moveAndWait(const std::vector<double>& targets, const std::vector<double>& speeds)
+{
+    size_t n = m_joints.size();
+    if (m_ipos == 0 || targets.size() < n || speeds.size() < n) return wait(std::vector<double>());
+
+    if (!m_ipos->setRefSpeeds((int)n, m_joints.data(), speeds.data()))
+    {
+        for (size_t i = 0; i < n; i++) m_ipos->setRefSpeed(m_joints[i], speeds[i]);
+    }
+    if (!m_ipos->positionMove((int)n, m_joints.data(), targets.data()))
+    {
+        for (size_t i = 0; i < n; i++) m_ipos->positionMove(m_joints[i], targets[i]);
+    }
+    return wait(targets);
+}
+
+MotionWaiter::Result MotionWaiter::moveAndWait(const std::vector<double>& targets, double speed)
+{
+    return moveAndWait(targets, std::vector<double>(m_joints.size(), speed));
+}
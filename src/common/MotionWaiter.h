@@ -0,0 +1,91 @@
+/*
+ * iCub Robot Unit Tests (Robot Testing Framework)
+ *
+ * Copyright (C) 2015-2019 Istituto Italiano di Tecnologia (IIT)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _MOTIONWAITER_H_
+#define _MOTIONWAITER_H_
+
+#include <vector>
+#include <yarp/dev/ControlBoardInterfaces.h>
+#include <yarp/sig/Vector.h>
+
+/**
+* Waits until a group of joints has reached its target positions and settled.
+* At every poll all the encoders of the part are read with a single (timed, when available) call,
+* together with the encoder speeds, and a joint is settled when:
+* \li its position is within its tolerance from the target
+* \li its speed is below the velocity threshold
+* \li IPositionControl::checkMotionDone() reports the motion as done (if enabled and available)
+* The wait ends as soon as all the joints are settled, or after the timeout.
+*/
+class MotionWaiter
+{
+public:
+    struct Result
+    {
+        bool ok;                        //all the joints settled before the timeout
+        double time;                    //the time waited [s]
+        std::vector<double> position;   //the last positions read, per joint
+        std::vector<bool> settled;      //per joint
+
+        Result() : ok(false), time(0) {}
+    };
+
+    MotionWaiter();
+
+    void configure(yarp::dev::IEncoders* ienc, yarp::dev::IPositionControl* ipos, const std::vector<int>& joints);
+    void configure(yarp::dev::IEncoders* ienc, yarp::dev::IPositionControl* ipos, const int* joints, int n_joints);
+    void configure(yarp::dev::IEncoders* ienc, yarp::dev::IPositionControl* ipos, const yarp::sig::Vector& joints);
+
+    /** the same tolerance [deg] for all the joints, default 0.5 */
+    void setTolerance(double tolerance);
+    /** one tolerance [deg] per joint */
+    void setTolerances(const std::vector<double>& tolerances);
+    /** the max speed [deg/s] of a settled joint, default 1.0, 0 disables the check */
+    void setVelocityThreshold(double threshold) { m_velocity_threshold = threshold; }
+    /** the interval between two reads, default 0.01 s */
+    void setPollPeriod(double period) { m_poll_period = period; }
+    /** the max time waited, default 20 s */
+    void setTimeout(double timeout) { m_timeout = timeout; }
+    /** whether checkMotionDone() is part of the settled criterion, default true */
+    void useMotionDone(bool use) { m_use_motion_done = use; }
+
+    /** waits for the joints to settle at the targets, one per joint */
+    Result wait(const std::vector<double>& targets);
+
+    /** sets the reference speeds, sends the joints to the targets with a single call and waits */
+    Result moveAndWait(const std::vector<double>& targets, const std::vector<double>& speeds);
+    Result moveAndWait(const std::vector<double>& targets, double speed);
+
+private:
+    yarp::dev::IEncoders*        m_ienc;
+    yarp::dev::IEncodersTimed*   m_itimed;
+    yarp::dev::IPositionControl* m_ipos;
+    std::vector<int>    m_joints;
+    std::vector<double> m_tolerances;
+    std::vector<double> m_encoders;
+    std::vector<double> m_stamps;
+    std::vector<double> m_speeds;
+    double m_velocity_threshold;
+    double m_poll_period;
+    double m_timeout;
+    bool   m_use_motion_done;
+};
+
+#endif
@@ -0,0 +1,248 @@
+/*
+ * iCub Robot Unit Tests (Robot Testing Framework)
+ *
+ * Copyright (C) 2015-2019 Istituto Italiano di Tecnologia (IIT)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <cmath>
+#include <cstdio>
+#include <limits>
+#include <yarp/os/Value.h>
+
+#include "StepResponseAnalyzer.h"
+
+StepResponseLimits::StepResponseLimits() :
+    maxRiseTime(-1),
+    maxOvershoot(-1),
+    maxSettlingTime(-1),
+    maxSteadyStateError(-1),
+    settlingBand(0.05),
+    steadyStateWindow(0.2)
+{
+}
+
+void StepResponseLimits::fromProperty(const yarp::os::Searchable& property)
+{
+    if (property.check("max_rise_time"))          maxRiseTime = property.find("max_rise_time").asFloat64();
+    if (property.check("max_overshoot"))          maxOvershoot = property.find("max_overshoot").asFloat64();
+    if (property.check("max_settling_time"))      maxSettlingTime = property.find("max_settling_time").asFloat64();
+    if (property.check("max_steady_state_error")) maxSteadyStateError = property.find("max_steady_state_error").asFloat64();
+    if (property.check("settling_band"))          settlingBand = property.find("settling_band").asFloat64();
+    if (property.check("steady_state_window"))    steadyStateWindow = property.find("steady_state_window").asFloat64();
+}
+
+StepResponseAnalyzer::StepResponseAnalyzer(const StepResponseLimits& limits) :
+    m_limits(limits)
+{
+}
+
+StepResponseMetrics StepResponseAnalyzer::analyze(const double* time, const double* value, const double* command, size_t n,
+                                                  double settlingBand, double steadyStateWindow, double timeOffset)
+{
+    const double nan = std::numeric_limits<double>::quiet_NaN();
+    StepResponseMetrics m;
+    m.riseTime = nan;
+    m.overshoot = nan;
+    m.settlingTime = nan;
+    m.steadyStateError = nan;
+    m.valid = false;
+
+    //first sample after the step
+    size_t first = 0;
+    while (first < n && time[first] < timeOffset) first++;
+    if (first >= n || n - first < 2) return m;
+
+    //initial condition: average of the samples before the step
+    double initial_value = value[0];
+    double initial_cmd = command[0];
+    if (first > 0)
+    {
+        double sum = 0;
+        for (size_t i = 0; i < first; i++) sum += value[i];
+        initial_value = sum / first;
+        initial_cmd = command[first-1];
+    }
+
+    double final_cmd = command[n-1];
+    double amplitude = final_cmd - initial_cmd;
+    if (std::fabs(amplitude) < 1e-9) return m;
+
+    //steady-state value: average over the last part of the step
+    double duration = time[n-1] - time[first];
+    double window_start = time[n-1] - steadyStateWindow * duration;
+    double sum = 0;
+    size_t count = 0;
+    for (size_t i = first; i < n; i++)
+    {
+        if (time[i] >= window_start) { sum += value[i]; count++; }
+    }
+    double steady_value = sum / count;
+    m.steadyStateError = final_cmd - steady_value;
+
+    //rise time, from 10% to 90% of the commanded step
+    double t10 = nan;
+    double t90 = nan;
+    double sign = (amplitude > 0) ? 1.0 : -1.0;
+    double peak = 0;
+    for (size_t i = first; i < n; i++)
+    {
+        double y = (value[i] - initial_value) / amplitude;
+        if (std::isnan(t10) && y >= 0.1) t10 = time[i] - timeOffset;
+        if (std::isnan(t90) && y >= 0.9) t90 = time[i] - timeOffset;
+        double excursion = (value[i] - steady_value) * sign;
+        if (excursion > peak) peak = excursion;
+    }
+    if (!std::isnan(t10) && !std::isnan(t90)) m.riseTime = t90 - t10;
+
+    //overshoot, with respect to the actual response amplitude
+    double response = std::fabs(steady_value - initial_value);
+    if (response > 1e-9) m.overshoot = 100.0 * peak / response;
+
+    //settling time: the first sample after the last one outside the band
+    double band = settlingBand * std::fabs(amplitude);
+    m.settlingTime = 0;
+    for (size_t i = n; i-- > first; )
+    {
+        if (std::fabs(value[i] - steady_value) > band)
+        {
+            m.settlingTime = (i + 1 < n) ? time[i+1] - timeOffset : nan;
+            break;
+        }
+    }
+
+    m.valid = true;
+    return m;
+}
+
+StepResponseMetrics StepResponseAnalyzer::add(const double* time, const double* value, const double* command, size_t n, double timeOffset)
+{
+    StepResponseMetrics m = analyze(time, value, command, n, m_limits.settlingBand, m_limits.steadyStateWindow, timeOffset);
+    m_riseTime.push_back(m.riseTime);
+    m_overshoot.push_back(m.overshoot);
+    m_settlingTime.push_back(m.settlingTime);
+    m_steadyStateError.push_back(m.steadyStateError);
+    return m;
+}
+
+void StepResponseAnalyzer::reset()
+{
+    m_riseTime.clear();
+    m_overshoot.clear();
+    m_settlingTime.clear();
+    m_steadyStateError.clear();
+}
+
+StepResponseAnalyzer::Statistics StepResponseAnalyzer::stats(const std::vector<double>& v)
+{
+    const double nan = std::numeric_limits<double>::quiet_NaN();
+    Statistics s;
+    s.count = 0;
+    s.nanCount = 0;
+    s.mean = nan;
+    s.stddev = nan;
+    s.min = nan;
+    s.max = nan;
+
+    double sum = 0;
+    for (size_t i = 0; i < v.size(); i++)
+    {
+        if (std::isnan(v[i]))
+        {
+            s.nanCount++;
+            continue;
+        }
+        if (s.count == 0 || v[i] < s.min) s.min = v[i];
+        if (s.count == 0 || v[i] > s.max) s.max = v[i];
+        sum += v[i];
+        s.count++;
+    }
+    if (s.count == 0) return s;
+    s.mean = sum / s.count;
+
+    double sq = 0;
+    for (size_t i = 0; i < v.size(); i++)
+    {
+        if (!std::isnan(v[i])) sq += (v[i] - s.mean) * (v[i] - s.mean);
+    }
+    s.stddev = (s.count > 1) ? std::sqrt(sq / (s.count - 1)) : 0.0;
+    return s;
+}
+
+std::string StepResponseAnalyzer::toString() const
+{
+    Statistics r = riseTime();
+    Statistics o = overshoot();
+    Statistics st = settlingTime();
+    Statistics e = steadyStateError();
+    char buff[512];
+    snprintf(buff, sizeof(buff),
+             "rise time %.4f +/- %.4f s, overshoot %.2f +/- %.2f %%, settling time %.4f +/- %.4f s, steady-state error %.4f +/- %.4f (%d cycles, uncomputable: %d rise time, %d overshoot, %d settling time, %d steady-state error)",
+             r.mean, r.stddev, o.mean, o.stddev, st.mean, st.stddev, e.mean, e.stddev, (int)m_riseTime.size(),
+             (int)r.nanCount, (int)o.nanCount, (int)st.nanCount, (int)e.nanCount);
+    return std::string(buff);
+}
+
+static void checkLimit(const char* name, const StepResponseAnalyzer::Statistics& s, double limit, bool absolute, std::vector<std::string>& failures)
+{
+    if (limit < 0) return;
+    char buff[256];
+    if (s.count == 0)
+    {
+        snprintf(buff, sizeof(buff), "%s could not be computed", name);
+        failures.push_back(buff);
+        return;
+    }
+    if (s.nanCount > 0)
+    {
+        snprintf(buff, sizeof(buff), "%s could not be computed in %d of %d cycles", name, (int)s.nanCount, (int)(s.count + s.nanCount));
+        failures.push_back(buff);
+    }
+    double val = absolute ? std::fabs(s.mean) : s.mean;
+    if (val > limit)
+    {
+        snprintf(buff, sizeof(buff), "%s %.4f exceeds the limit %.4f", name, val, limit);
+        failures.push_back(buff);
+    }
+}
+
+bool StepResponseAnalyzer::check(std::vector<std::string>& failures) const
+{
+    failures.clear();
+    checkLimit("rise time", riseTime(), m_limits.maxRiseTime, false, failures);
+    checkLimit("overshoot", overshoot(), m_limits.maxOvershoot, false, failures);
+    checkLimit("settling time", settlingTime(), m_limits.maxSettlingTime, false, failures);
+    checkLimit("steady-state error", steadyStateError(), m_limits.maxSteadyStateError, true, failures);
+    return failures.empty();
+}
+
+std::string StepResponseAnalyzer::failuresToString() const
+{
+    std::vector<std::string> failures;
+    check(failures);
+    std::string s;
+    for (size_t f = 0; f < failures.size(); f++)
+    {
+        s += (f == 0 ? "" : ", ") + failures[f];
+    }
+    return s;
+}
+
+bool StepResponseAnalyzer::hasLimits() const
+{
+    return m_limits.maxRiseTime >= 0 || m_limits.maxOvershoot >= 0 ||
+           m_limits.maxSettlingTime >= 0 || m_limits.maxSteadyStateError >= 0;
+}
@@ -0,0 +1,124 @@
+/*
+ * iCub Robot Unit Tests (Robot Testing Framework)
+ *
+ * Copyright (C) 2015-2019 Istituto Italiano di Tecnologia (IIT)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _STEPRESPONSEANALYZER_H_
+#define _STEPRESPONSEANALYZER_H_
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <yarp/os/Searchable.h>
+
+/**
+* Metrics of a single step response.
+* Times are expressed with respect to the instant the step is commanded.
+* A metric which cannot be computed (e.g. the response never reaches 90% of the step) is NaN.
+*/
+struct StepResponseMetrics
+{
+    double riseTime;         //time from 10% to 90% of the step
+    double overshoot;        //peak beyond the steady-state value, in % of the response amplitude
+    double settlingTime;     //time after which the response stays within the settling band
+    double steadyStateError; //commanded value minus steady-state value
+    bool   valid;
+};
+
+/**
+* Limits on the step response metrics. A negative limit disables the corresponding check.
+* The limits are read from the test properties:
+* max_rise_time, max_overshoot, max_settling_time, max_steady_state_error, settling_band, steady_state_window.
+*/
+struct StepResponseLimits
+{
+    double maxRiseTime;
+    double maxOvershoot;
+    double maxSettlingTime;
+    double maxSteadyStateError;
+    double settlingBand;      //fraction of the step amplitude, default 0.05
+    double steadyStateWindow; //fraction of the step duration used to compute the steady-state value, default 0.2
+
+    StepResponseLimits();
+    void fromProperty(const yarp::os::Searchable& property);
+};
+
+/**
+* Computes the step response metrics and accumulates their statistics across the test cycles.
+*/
+class StepResponseAnalyzer
+{
+public:
+    struct Statistics
+    {
+        size_t count;       //cycles in which the metric was computed
+        size_t nanCount;    //cycles in which the metric could not be computed
+        double mean;
+        double stddev;
+        double min;
+        double max;
+    };
+
+    explicit StepResponseAnalyzer(const StepResponseLimits& limits = StepResponseLimits());
+
+    /**
+    * Analyzes one step. time - timeOffset is relative to the step (samples before timeOffset precede the step),
+    * value is the measured signal, command the reference.
+    */
+    static StepResponseMetrics analyze(const double* time, const double* value, const double* command, size_t n,
+                                       double settlingBand, double steadyStateWindow, double timeOffset = 0);
+
+    /**
+    * Analyzes one step with the configured settling band and window and accumulates the result.
+    * timeOffset (the instant the step is commanded) is subtracted from the times.
+    */
+    StepResponseMetrics add(const double* time, const double* value, const double* command, size_t n, double timeOffset = 0);
+
+    void reset();
+
+    Statistics riseTime() const         { return stats(m_riseTime); }
+    Statistics overshoot() const        { return stats(m_overshoot); }
+    Statistics settlingTime() const     { return stats(m_settlingTime); }
+    Statistics steadyStateError() const { return stats(m_steadyStateError); }
+
+    /** one line summary (mean +/- std) of all the metrics */
+    std::string toString() const;
+
+    /**
+    * Checks the mean of each metric against the limits. Returns false if at least one limit
+    * is exceeded or a limited metric could not be computed in any of the cycles, and fills the failures.
+    */
+    bool check(std::vector<std::string>& failures) const;
+
+    /** the failures of check() joined in a single line, empty if all the limits are met */
+    std::string failuresToString() const;
+
+    /** true if at least one metric is limited */
+    bool hasLimits() const;
+
+private:
+    static Statistics stats(const std::vector<double>& v);
+
+    StepResponseLimits  m_limits;
+    std::vector<double> m_riseTime;
+    std::vector<double> m_overshoot;
+    std::vector<double> m_settlingTime;
+    std::vector<double> m_steadyStateError;
+};
+
+#endif
@@ -0,0 +1,93 @@
+/*
+ * iCub Robot Unit Tests (Robot Testing Framework)
+ *
+ * Copyright (C) 2015-2019 Istituto Italiano di Tecnologia (IIT)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <cstdio>
+
+#include "StepSampleBuffer.h"
+
+StepSampleBuffer::StepSampleBuffer(size_t extraColumns) :
+    m_extra(extraColumns)
+{
+}
+
+void StepSampleBuffer::reserve(size_t samples, size_t cycles)
+{
+    m_time.reserve(samples);
+    m_value.reserve(samples);
+    m_command.reserve(samples);
+    for (size_t c = 0; c < m_extra.size(); c++) m_extra[c].reserve(samples);
+    m_cycles.reserve(cycles);
+}
+
+void StepSampleBuffer::clear()
+{
+    m_time.clear();
+    m_value.clear();
+    m_command.clear();
+    for (size_t c = 0; c < m_extra.size(); c++) m_extra[c].clear();
+    m_cycles.clear();
+}
+
+void StepSampleBuffer::beginCycle(int id)
+{
+    Cycle c;
+    c.id = id;
+    c.begin = m_time.size();
+    c.size = 0;
+    c.timeOffset = 0;
+    m_cycles.push_back(c);
+}
+
+void StepSampleBuffer::setTimeOffset(double offset)
+{
+    if (m_cycles.empty()) beginCycle(0);
+    m_cycles.back().timeOffset = offset;
+}
+
+void StepSampleBuffer::push(double time, double value, double command, const double* extra)
+{
+    if (m_cycles.empty()) beginCycle(0);
+    m_time.push_back(time);
+    m_value.push_back(value);
+    m_command.push_back(command);
+    for (size_t c = 0; c < m_extra.size(); c++) m_extra[c].push_back(extra ? extra[c] : 0.0);
+    m_cycles.back().size++;
+}
+
+bool StepSampleBuffer::save(const std::string& filename, bool append) const
+{
+    FILE* fp = fopen(filename.c_str(), append ? "a" : "w");
+    if (fp == 0) return false;
+
+    for (size_t k = 0; k < m_cycles.size(); k++)
+    {
+        const Cycle& c = m_cycles[k];
+        for (size_t t = c.begin; t < c.begin + c.size; t++)
+        {
+            fprintf(fp, "%d %.6f %.6f %.6f", c.id, m_time[t] - c.timeOffset, m_value[t], m_command[t]);
+            for (size_t e = 0; e < m_extra.size(); e++) fprintf(fp, " %.6f", m_extra[e][t]);
+            fprintf(fp, "\n");
+        }
+    }
+
+    bool ok = (ferror(fp) == 0);
+    if (fclose(fp) != 0) ok = false;
+    return ok;
+}
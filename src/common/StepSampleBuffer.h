@@ -0,0 +1,88 @@
+/*
+ * iCub Robot Unit Tests (Robot Testing Framework)
+ *
+ * Copyright (C) 2015-2019 Istituto Italiano di Tecnologia (IIT)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _STEPSAMPLEBUFFER_H_
+#define _STEPSAMPLEBUFFER_H_
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/**
+* Typed sample buffer used by the step response tests.
+* The samples of all the cycles of a joint are stored column by column (struct-of-arrays):
+* time, measured value, command and an optional number of extra columns (e.g. the PWM duty cycle).
+* The times are stored as acquired; the time offset of each cycle (the instant the step is commanded)
+* is applied only when the data is written to file, so that no copy of the samples is needed.
+* Memory is reserved in advance, so push() does not allocate as long as the reserved size is not exceeded.
+*/
+class StepSampleBuffer
+{
+public:
+    struct Cycle
+    {
+        int    id;
+        size_t begin;
+        size_t size;
+        double timeOffset;
+    };
+
+    explicit StepSampleBuffer(size_t extraColumns = 0);
+
+    /** reserves memory for the given total number of samples and cycles */
+    void reserve(size_t samples, size_t cycles);
+
+    /** removes all the samples, keeping the reserved memory */
+    void clear();
+
+    /** starts a new cycle: the following samples belong to it */
+    void beginCycle(int id);
+
+    /** sets the time offset of the current cycle, subtracted from the times when the data is written */
+    void setTimeOffset(double offset);
+
+    /** appends a sample to the current cycle. extra must contain extraColumns() values (or be null if there are none) */
+    void push(double time, double value, double command, const double* extra = 0);
+
+    size_t size() const         { return m_time.size(); }
+    size_t extraColumns() const { return m_extra.size(); }
+    size_t cycles() const       { return m_cycles.size(); }
+    const Cycle& cycle(size_t k) const { return m_cycles[k]; }
+
+    const double* time() const            { return m_time.data(); }
+    const double* value() const           { return m_value.data(); }
+    const double* command() const         { return m_command.data(); }
+    const double* extra(size_t col) const { return m_extra[col].data(); }
+
+    /**
+    * Writes one row per sample: cycle id, time minus the cycle offset, value, command and the extra columns.
+    * If append is true the rows are added at the end of the file. Returns false if the file cannot be written.
+    */
+    bool save(const std::string& filename, bool append = false) const;
+
+private:
+    std::vector<double>              m_time;
+    std::vector<double>              m_value;
+    std::vector<double>              m_command;
+    std::vector<std::vector<double>> m_extra;
+    std::vector<Cycle>               m_cycles;
+};
+
+#endif
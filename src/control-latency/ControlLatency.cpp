@@ -0,0 +1,340 @@
+/*
+ * iCub Robot Unit Tests (Robot Testing Framework)
+ *
+ * Copyright (C) 2015-2019 Istituto Italiano di Tecnologia (IIT)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <cmath>
+#include <algorithm>
+#include <robottestingframework/TestAssert.h>
+#include <robottestingframework/dll/Plugin.h>
+#include <yarp/os/Time.h>
+#include <yarp/os/Property.h>
+
+#include "ControlModeSwitcher.h"
+#include "ControlLatency.h"
+
+//a larger difference between the remote timestamps and the local clock means that the clocks are not synchronized
+static const double max_stamp_offset = 1.0; //s
+
+using namespace robottestingframework;
+using namespace yarp::os;
+using namespace yarp::dev;
+
+// prepare the plugin
+ROBOTTESTINGFRAMEWORK_PREPARE_PLUGIN(ControlLatency)
+
+ControlLatency::ControlLatency() : yarp::robottestingframework::TestCase("ControlLatency") {
+    n_part_joints=0;
+    pulses=10;
+    pulse_duration=0.1;
+    rest_duration=0.5;
+    poll_period=0.001;
+    position_pulse=1.0;
+    pwm_pulse=5.0;
+    torque_pulse=0.3;
+    position_threshold=0.05;
+    torque_threshold=0.05;
+    unsynced_stamps=false;
+    max_latency=-1;
+    max_missed=-1;
+    dd=0;
+    icmd=0;
+    iimd=0;
+    ienc=0;
+    idir=0;
+    ipwm=0;
+    itrq=0;
+}
+
+ControlLatency::~ControlLatency() { }
+
+bool ControlLatency::setup(yarp::os::Property& property) {
+
+    //updating the test name
+    if(property.check("name"))
+        setName(property.find("name").asString());
+
+    // updating parameters
+    ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(property.check("robot"), "The robot name must be given as the test parameter!");
+    ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(property.check("part"), "The part name must be given as the test parameter!");
+    ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(property.check("joints"), "The joints list must be given as the test parameter!");
+
+    robotName = property.find("robot").asString();
+    partName = property.find("part").asString();
+
+    Bottle* jointsBottle = property.find("joints").asList();
+    ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(jointsBottle!=0,"unable to parse joints parameter");
+    ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(jointsBottle->size()>0,"invalid number of joints, it must be >0");
+    for (size_t i=0; i<jointsBottle->size(); i++) jointsList.push_back(jointsBottle->get(i).asInt32());
+
+    if (property.check("modes"))
+    {
+        Bottle* modesBottle = property.find("modes").asList();
+        ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(modesBottle!=0,"unable to parse modes parameter");
+        for (size_t i=0; i<modesBottle->size(); i++)
+        {
+            std::string m = modesBottle->get(i).asString();
+            if      (m=="position_direct") {modes.push_back(position_direct_mode);}
+            else if (m=="pwm")             {modes.push_back(pwm_mode);}
+            else if (m=="torque")          {modes.push_back(torque_mode);}
+            else
+            {
+                ROBOTTESTINGFRAMEWORK_ASSERT_ERROR(Asserter::format("invalid mode %s: can be position_direct, pwm, torque", m.c_str()));
+            }
+        }
+    }
+    else
+    {
+        modes.push_back(position_direct_mode);
+    }
+
+    if(property.check("pulses"))             {pulses = property.find("pulses").asInt32();}
+    if(property.check("pulse_duration"))     {pulse_duration = property.find("pulse_duration").asFloat64();}
+    if(property.check("rest_duration"))      {rest_duration = property.find("rest_duration").asFloat64();}
+    if(property.check("poll_period"))        {poll_period = property.find("poll_period").asFloat64();}
+    if(property.check("position_pulse"))     {position_pulse = property.find("position_pulse").asFloat64();}
+    if(property.check("pwm_pulse"))          {pwm_pulse = property.find("pwm_pulse").asFloat64();}
+    if(property.check("torque_pulse"))       {torque_pulse = property.find("torque_pulse").asFloat64();}
+    if(property.check("position_threshold")) {position_threshold = property.find("position_threshold").asFloat64();}
+    if(property.check("torque_threshold"))   {torque_threshold = property.find("torque_threshold").asFloat64();}
+    if(property.check("max_latency"))        {max_latency = property.find("max_latency").asFloat64();}
+    if(property.check("max_missed"))         {max_missed = property.find("max_missed").asInt32();}
+
+    ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(pulses>0,"invalid pulses");
+    ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(pulse_duration>0,"invalid pulse_duration");
+    ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(rest_duration>0,"invalid rest_duration");
+    ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(poll_period>0,"invalid poll_period");
+    ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(position_threshold>0 && torque_threshold>0,"invalid threshold");
+
+    Property options;
+    options.put("device", "remote_controlboard");
+    options.put("remote", "/"+robotName+"/"+partName);
+    options.put("local", "/controlLatencyTest/"+robotName+"/"+partName);
+
+    dd = new PolyDriver(options);
+    ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(dd->isValid(),"Unable to open device driver");
+    ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(dd->view(ienc),"Unable to open encoders interface");
+    ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(dd->view(icmd),"Unable to open control mode interface");
+    ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(dd->view(iimd),"Unable to open interaction mode interface");
+    for (size_t m=0; m<modes.size(); m++)
+    {
+        if (modes[m]==position_direct_mode) {ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(dd->view(idir),"Unable to open position direct interface");}
+        if (modes[m]==pwm_mode)             {ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(dd->view(ipwm),"Unable to open pwm interface");}
+        if (modes[m]==torque_mode)          {ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(dd->view(itrq),"Unable to open torque interface");}
+    }
+
+    if (!ienc->getAxes(&n_part_joints))
+    {
+        ROBOTTESTINGFRAMEWORK_ASSERT_ERROR("unable to get the number of joints of the part");
+    }
+    for (size_t i=0; i<jointsList.size(); i++)
+    {
+        ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(jointsList[i]>=0 && jointsList[i]<n_part_joints,
+                                                    Asserter::format("invalid joint %d", jointsList[i]));
+    }
+
+    encoders.resize(n_part_joints);
+    stamps.resize(n_part_joints);
+
+    return true;
+}
+
+void ControlLatency::tearDown()
+{
+    if (dd)
+    {
+        for (size_t i=0; i<jointsList.size(); i++)
+        {
+            setMode(jointsList[i],VOCAB_CM_POSITION);
+        }
+        delete dd;
+        dd =0;
+    }
+}
+
+void ControlLatency::setMode(int joint, int desired_mode)
+{
+    ControlModeSwitcher switcher(icmd, iimd, &joint, 1);
+    ControlModeSwitcher::Result result = switcher.change(desired_mode, VOCAB_IM_STIFF);
+    ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(result.ok, switcher.failureMessage(result, "Control mode change"));
+}
+
+const char* ControlLatency::modeName(probe_mode_t mode)
+{
+    switch (mode)
+    {
+        case position_direct_mode: return "position_direct";
+        case pwm_mode:             return "pwm";
+        case torque_mode:          return "torque";
+    }
+    return "unknown";
+}
+
+bool ControlLatency::readFeedback(probe_mode_t mode, int joint, double& value, double& stamp)
+{
+    if (mode==torque_mode)
+    {
+        // torques have no timestamp: the reception time is used
+        stamp = yarp::os::Time::now();
+        return itrq->getTorque(joint,&value);
+    }
+
+    double read_time = yarp::os::Time::now();
+    if (!ienc->getEncodersTimed(encoders.data(),stamps.data())) return false;
+    value = encoders[joint];
+    stamp = stamps[joint];
+    // the command time is taken from the local clock, the encoder stamps from the robot one
+    if (stamp>0 && fabs(stamp-read_time)>max_stamp_offset)
+    {
+        unsynced_stamps = true;
+        stamp = 0;
+    }
+    if (stamp<=0) stamp = read_time;
+    return true;
+}
+
+void ControlLatency::sendCommand(probe_mode_t mode, int joint, double value)
+{
+    switch (mode)
+    {
+        case position_direct_mode: idir->setPosition(joint,value);     break;
+        case pwm_mode:             ipwm->setRefDutyCycle(joint,value); break;
+        case torque_mode:          itrq->setRefTorque(joint,value);    break;
+    }
+}
+
+bool ControlLatency::probe(probe_mode_t mode, int joint, double base, double pulse, double& latency)
+{
+    double threshold = (mode==torque_mode) ? torque_threshold : position_threshold;
+    double value = 0;
+    double stamp = 0;
+
+    // the feedback before the pulse, averaged over a few polls to reject the noise
+    double baseline = 0;
+    int n_baseline = 0;
+    for (int i=0; i<10; i++)
+    {
+        if (readFeedback(mode,joint,value,stamp)) {baseline+=value; n_baseline++;}
+        yarp::os::Time::delay(poll_period);
+    }
+    if (n_baseline==0) return false;
+    baseline /= n_baseline;
+
+    double t_cmd = yarp::os::Time::now();
+    sendCommand(mode,joint,base+pulse);
+
+    bool detected = false;
+    while (yarp::os::Time::now()-t_cmd < pulse_duration)
+    {
+        if (readFeedback(mode,joint,value,stamp) && fabs(value-baseline)>threshold)
+        {
+            latency = stamp-t_cmd;
+            detected = true;
+            break;
+        }
+        yarp::os::Time::delay(poll_period);
+    }
+
+    sendCommand(mode,joint,base);
+    return detected;
+}
+
+ControlLatency::LatencyStats ControlLatency::statistics(std::vector<double> v)
+{
+    LatencyStats s = {v.size(), 0, 0, 0, 0, 0};
+    if (v.empty()) return s;
+
+    std::sort(v.begin(),v.end());
+    for (size_t i=0; i<v.size(); i++) s.mean += v[i];
+    s.mean /= v.size();
+    for (size_t i=0; i<v.size(); i++) s.stddev += (v[i]-s.mean)*(v[i]-s.mean);
+    s.stddev = sqrt(s.stddev/v.size());
+    s.min = v.front();
+    s.max = v.back();
+    s.median = (v.size()%2) ? v[v.size()/2] : 0.5*(v[v.size()/2-1]+v[v.size()/2]);
+    return s;
+}
+
+void ControlLatency::probeJoint(probe_mode_t mode, int joint)
+{
+    double base = 0;
+    double amplitude = 0;
+
+    switch (mode)
+    {
+        case position_direct_mode:
+            setMode(joint,VOCAB_CM_POSITION_DIRECT);
+            ienc->getEncoder(joint,&base);
+            amplitude = position_pulse;
+            break;
+        case pwm_mode:
+            setMode(joint,VOCAB_CM_PWM);
+            amplitude = pwm_pulse;
+            break;
+        case torque_mode:
+            setMode(joint,VOCAB_CM_TORQUE);
+            amplitude = torque_pulse;
+            break;
+    }
+
+    unsynced_stamps = false;
+    std::vector<double> latencies;
+    latencies.reserve(pulses);
+    int missed = 0;
+    for (int p=0; p<pulses; p++)
+    {
+        // alternate the sign, so that the joint does not drift away
+        double pulse = (p%2) ? -amplitude : amplitude;
+        double latency = 0;
+        if (probe(mode,joint,base,pulse,latency)) latencies.push_back(latency);
+        else missed++;
+        yarp::os::Time::delay(rest_duration);
+    }
+
+    setMode(joint,VOCAB_CM_POSITION);
+
+    LatencyStats s = statistics(latencies);
+    ROBOTTESTINGFRAMEWORK_TEST_REPORT(Asserter::format("Joint %d, %s: %zu responses, %d missed, latency mean %.2f ms, stddev %.2f ms, min %.2f ms, median %.2f ms, max %.2f ms",
+                                      joint, modeName(mode), s.count, missed,
+                                      s.mean*1000.0, s.stddev*1000.0, s.min*1000.0, s.median*1000.0, s.max*1000.0));
+    if (unsynced_stamps)
+    {
+        ROBOTTESTINGFRAMEWORK_TEST_REPORT(Asserter::format("Joint %d, %s: the encoder timestamps are not synchronized with the local clock, the latency is measured from the local read time", joint, modeName(mode)));
+    }
+
+    ROBOTTESTINGFRAMEWORK_TEST_FAIL_IF_FALSE(s.count>0, Asserter::format("Joint %d, %s: no response detected", joint, modeName(mode)));
+    if (max_missed>=0)
+    {
+        ROBOTTESTINGFRAMEWORK_TEST_CHECK(missed<=max_missed, Asserter::format("Joint %d, %s: %d missed pulses (max %d)", joint, modeName(mode), missed, max_missed));
+    }
+    if (max_latency>=0 && s.count>0)
+    {
+        ROBOTTESTINGFRAMEWORK_TEST_CHECK(s.median<=max_latency, Asserter::format("Joint %d, %s: median latency %.2f ms (max %.2f ms)", joint, modeName(mode), s.median*1000.0, max_latency*1000.0));
+    }
+}
+
+void ControlLatency::run()
+{
+    for (size_t m=0; m<modes.size(); m++)
+    {
+        for (size_t i=0; i<jointsList.size(); i++)
+        {
+            probeJoint(modes[m],jointsList[i]);
+        }
+    }
+}
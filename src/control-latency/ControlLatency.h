@@ -0,0 +1,142 @@
+/*
+ * iCub Robot Unit Tests (Robot Testing Framework)
+ *
+ * Copyright (C) 2015-2019 Istituto Italiano di Tecnologia (IIT)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _CONTROLLATENCY_H_
+#define _CONTROLLATENCY_H_
+
+#include <string>
+#include <vector>
+#include <yarp/robottestingframework/TestCase.h>
+#include <yarp/dev/ControlBoardInterfaces.h>
+#include <yarp/dev/PolyDriver.h>
+
+/**
+* \ingroup icub-tests
+* This test measures the closed-loop latency of the motion control chain: the time from a command
+* (IPositionDirect::setPosition(), IPWMControl::setRefDutyCycle() or ITorqueControl::setRefTorque()) to the first
+* detectable reaction of the feedback stream.
+* For each joint and each control mode, a number of short command pulses (with alternating sign) is sent.
+* After each pulse the feedback is polled: the encoders with IEncodersTimed::getEncodersTimed() for the position direct and pwm modes,
+* the joint torques for the torque mode. The response is detected when the feedback moves more than a threshold from the value measured before the pulse;
+* the latency is the difference between the timestamp of the first sample beyond the threshold and the time the command was sent.
+* If the encoder timestamps are not available, or they are too far from the local clock (the robot clock is not synchronized),
+* the time the encoders were read is used instead.
+* Mean, standard deviation, min, median and max of the latency, and the number of pulses without a detectable response, are reported for each joint and mode.
+* The test runs on a real robot, on the simulator or on a fakeMotionControl device (see suites/controlLatency-fakeMotionControl.xml),
+* which moves its encoders only in the position direct mode.
+* Be aware that torque and pwm pulses move the joints without position control: keep the pulses small and short!
+*
+* example: testRunner -v -t ControlLatency.dll -p "--robot icub --part head --joints ""(0 1)"" --modes ""(position_direct pwm)"" --pulses 20"
+*
+* Check the following functions:
+* \li IPositionDirect::setPosition()
+* \li IPWMControl::setRefDutyCycle()
+* \li ITorqueControl::setRefTorque()
+* \li IEncodersTimed::getEncodersTimed()
+*
+*  Accepts the following parameters:
+* | Parameter name     | Type   | Units | Default Value | Required | Description | Notes |
+* |:------------------:|:------:|:-----:|:-------------:|:--------:|:-----------:|:-----:|
+* | robot              | string | -     | -     | Yes | The name of the robot.     | e.g. icub |
+* | part               | string | -     | -     | Yes | The name of the robot part. | e.g. left_arm |
+* | joints             | vector of ints | - | - | Yes | List of joints to be tested | |
+* | modes              | vector of strings | - | (position_direct) | No | The control modes to be tested: position_direct, pwm, torque | |
+* | pulses             | int    | -     | 10    | No  | The number of pulses for each joint and mode | |
+* | pulse_duration     | double | s     | 0.1   | No  | The duration of each pulse. A pulse without a response within this time is counted as missed | |
+* | rest_duration      | double | s     | 0.5   | No  | The time between two pulses | |
+* | poll_period        | double | s     | 0.001 | No  | The period used to poll the feedback | |
+* | position_pulse     | double | deg   | 1.0   | No  | The amplitude of the position direct pulses | |
+* | pwm_pulse          | double | %     | 5.0   | No  | The amplitude of the pwm pulses | |
+* | torque_pulse       | double | Nm    | 0.3   | No  | The amplitude of the torque pulses | |
+* | position_threshold | double | deg   | 0.05  | No  | The encoder variation which is considered a response | |
+* | torque_threshold   | double | Nm    | 0.05  | No  | The torque variation which is considered a response | |
+* | max_latency        | double | s     | -1    | No  | If >=0, the test fails if the median latency of a joint/mode is higher | |
+* | max_missed         | int    | -     | -1    | No  | If >=0, the test fails if more pulses of a joint/mode have no response | |
+*
+*/
+
+class ControlLatency : public yarp::robottestingframework::TestCase {
+public:
+    ControlLatency();
+    virtual ~ControlLatency();
+
+    virtual bool setup(yarp::os::Property& property);
+
+    virtual void tearDown();
+
+    virtual void run();
+
+private:
+    enum probe_mode_t
+    {
+        position_direct_mode = 0,
+        pwm_mode = 1,
+        torque_mode = 2
+    };
+
+    struct LatencyStats
+    {
+        size_t count;
+        double mean;
+        double stddev;
+        double min;
+        double median;
+        double max;
+    };
+
+    void setMode(int joint, int desired_mode);
+    bool readFeedback(probe_mode_t mode, int joint, double& value, double& stamp);
+    void sendCommand(probe_mode_t mode, int joint, double value);
+    bool probe(probe_mode_t mode, int joint, double base, double pulse, double& latency);
+    void probeJoint(probe_mode_t mode, int joint);
+    static LatencyStats statistics(std::vector<double> v);
+    static const char* modeName(probe_mode_t mode);
+
+    std::string robotName;
+    std::string partName;
+    std::vector<int> jointsList;
+    std::vector<probe_mode_t> modes;
+    int    n_part_joints;
+    int    pulses;
+    double pulse_duration;
+    double rest_duration;
+    double poll_period;
+    double position_pulse;
+    double pwm_pulse;
+    double torque_pulse;
+    double position_threshold;
+    double torque_threshold;
+    double max_latency;
+    int    max_missed;
+
+    yarp::dev::PolyDriver        *dd;
+    yarp::dev::IControlMode      *icmd;
+    yarp::dev::IInteractionMode  *iimd;
+    yarp::dev::IEncodersTimed    *ienc;
+    yarp::dev::IPositionDirect   *idir;
+    yarp::dev::IPWMControl       *ipwm;
+    yarp::dev::ITorqueControl    *itrq;
+
+    std::vector<double> encoders;
+    std::vector<double> stamps;
+    bool unsynced_stamps; //the encoder timestamps were too far from the local clock during the last joint/mode
+};
+
+#endif //_CONTROLLATENCY_H_
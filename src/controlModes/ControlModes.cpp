@@ -24,8 +24,10 @@
 #include <yarp/os/Time.h>
 #include <yarp/os/Property.h>
 #include <yarp/os/Vocab.h>
+#include <algorithm>
 
 #include "ControlModes.h"
+#include "MotionWaiter.h"
 
 using namespace robottestingframework;
 using namespace yarp::os;
@@ -50,6 +52,10 @@ ControlModes::ControlModes() : yarp::robottestingframework::TestCase("ControlMod
     cmd_tot=0;
     prevcurr_some=0;
     prevcurr_tot=0;
+    matrix=false;
+    slow_transition=0.1;
+    transition_timeout=1.0;
+    poll_period=0.001;
 }
 
 ControlModes::~ControlModes() { }
@@ -74,6 +80,11 @@ bool ControlModes::setup(yarp::os::Property& property) {
 
     ROBOTTESTINGFRAMEWORK_TEST_REPORT(robottestingframework::Asserter::format("Tolerance of %.2f is used to check home position", tolerance));
 
+    if(property.check("matrix"))            {matrix = property.find("matrix").asBool();}
+    if(property.check("slowTransition"))    {slow_transition = property.find("slowTransition").asFloat64();}
+    if(property.check("transitionTimeout")) {transition_timeout = property.find("transitionTimeout").asFloat64();}
+    if(property.check("pollPeriod"))        {poll_period = property.find("pollPeriod").asFloat64();}
+
     Bottle* jointsBottle = property.find("joints").asList();
     ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(jointsBottle!=0,"unable to parse joints parameter");
     n_cmd_joints = jointsBottle->size();
@@ -122,6 +133,7 @@ bool ControlModes::setup(yarp::os::Property& property) {
     home_pos = new double[n_cmd_joints];
 
     for (int i=0; i <n_cmd_joints; i++) jointsList[i]=jointsBottle->get(i).asInt32();
+    modeSwitcher.configure(icmd, iimd, jointsList, n_cmd_joints);
 
     Bottle* homePosBottle = property.find("home").asList();
     for (int i=0; i <n_cmd_joints; i++) home_pos[i]=homePosBottle->get(i).asFloat64();
@@ -190,10 +202,7 @@ void ControlModes::zeroCurrentLimits()
 
 void ControlModes::setMode(int desired_control_mode, yarp::dev::InteractionModeEnum desired_interaction_mode)
 {
-    for (int i=0; i<n_cmd_joints; i++)
-    {
-        setModeSingle(jointsList[i], desired_control_mode, desired_interaction_mode);
-    }
+    modeSwitcher.request(desired_control_mode, desired_interaction_mode);
 }
 
 void ControlModes::setModeSingle(int joint, int desired_control_mode, yarp::dev::InteractionModeEnum desired_interaction_mode)
@@ -205,60 +214,17 @@ void ControlModes::setModeSingle(int joint, int desired_control_mode, yarp::dev:
 
 void ControlModes::verifyMode(int desired_control_mode, yarp::dev::InteractionModeEnum desired_interaction_mode, std::string title)
 {
-    int cmode;
-    yarp::dev::InteractionModeEnum imode;
-    int timeout = 0;
-
-    while (1)
-    {
-        int ok=0;
-        for (int i=0; i<n_cmd_joints; i++)
-        {
-            icmd->getControlMode (jointsList[i],&cmode);
-            iimd->getInteractionMode(jointsList[i],&imode);
-            if (cmode==desired_control_mode && imode==desired_interaction_mode) ok++;
-        }
-        if (ok==n_cmd_joints) break;
-        if (timeout>100)
-        {
-            char sbuf[500];
-            sprintf(sbuf,"Test (%s) failed: current mode is (%s,%s), it should be (%s,%s)",title.c_str(), Vocab32::decode((NetInt32)cmode).c_str(), Vocab32::decode((NetInt32)imode).c_str(), Vocab32::decode((NetInt32)desired_control_mode).c_str(),Vocab32::decode((NetInt32)desired_interaction_mode).c_str());
-            ROBOTTESTINGFRAMEWORK_ASSERT_ERROR(sbuf);
-        }
-        yarp::os::Time::delay(0.2);
-        timeout++;
-    }
-    char sbuf[500];
-    sprintf(sbuf,"Test (%s) passed: current mode is (%s,%s)",title.c_str(),Vocab32::decode((NetInt32)desired_control_mode).c_str(), Vocab32::decode((NetInt32)desired_interaction_mode).c_str());
-    ROBOTTESTINGFRAMEWORK_TEST_REPORT(sbuf);
+    ControlModeSwitcher::Result result = modeSwitcher.wait(desired_control_mode, desired_interaction_mode);
+    ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(result.ok, modeSwitcher.failureMessage(result, "Test ("+title+")"));
+    ROBOTTESTINGFRAMEWORK_TEST_REPORT(modeSwitcher.successMessage(result, "Test ("+title+")"));
 }
 
 void ControlModes::verifyModeSingle(int joint, int desired_control_mode, yarp::dev::InteractionModeEnum desired_interaction_mode, std::string title)
 {
-    int cmode;
-    yarp::dev::InteractionModeEnum imode;
-    int timeout = 0;
-
-    while (1)
-    {
-        bool ok = false;
-        icmd->getControlMode (joint,&cmode);
-        iimd->getInteractionMode(joint,&imode);
-        if (cmode==desired_control_mode && imode==desired_interaction_mode) ok=true;
-
-        if (ok) break;
-        if (timeout>100)
-        {
-            char sbuf[500];
-            sprintf(sbuf,"Test (%s) failed: current mode is (%s,%s), it should be (%s,%s)",title.c_str(), Vocab32::decode((NetInt32)cmode).c_str(), Vocab32::decode((NetInt32)imode).c_str(), Vocab32::decode((NetInt32)desired_control_mode).c_str(),Vocab32::decode((NetInt32)desired_interaction_mode).c_str());
-            ROBOTTESTINGFRAMEWORK_ASSERT_ERROR(sbuf);
-        }
-        yarp::os::Time::delay(0.2);
-        timeout++;
-    }
-    char sbuf[500];
-    sprintf(sbuf,"Test (%s) passed: current mode is (%s,%s)",title.c_str(),Vocab32::decode((NetInt32)desired_control_mode).c_str(), Vocab32::decode((NetInt32)desired_interaction_mode).c_str());
-    ROBOTTESTINGFRAMEWORK_TEST_REPORT(sbuf);
+    ControlModeSwitcher switcher(icmd, iimd, &joint, 1);
+    ControlModeSwitcher::Result result = switcher.wait(desired_control_mode, desired_interaction_mode);
+    ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(result.ok, switcher.failureMessage(result, "Test ("+title+")"));
+    ROBOTTESTINGFRAMEWORK_TEST_REPORT(switcher.successMessage(result, "Test ("+title+")"));
 }
 
 void ControlModes::checkJointWithTorqueMode()
@@ -344,28 +310,13 @@ void ControlModes::executeCmd()
 
 void ControlModes::goHome()
 {
-    for (int i=0; i<n_cmd_joints; i++)
+    MotionWaiter waiter;
+    waiter.configure(ienc, ipos, jointsList, n_cmd_joints);
+    waiter.setTolerance(tolerance);
+    MotionWaiter::Result result = waiter.moveAndWait(std::vector<double>(home_pos, home_pos+n_cmd_joints), 20.0);
+    if (!result.ok)
     {
-        ipos->setRefSpeed(jointsList[i],20.0);
-        ipos->positionMove(jointsList[i],home_pos[i]);
-    }
-
-    int timeout = 0;
-    while (1)
-    {
-        int in_position=0;
-        for (int i=0; i<n_cmd_joints; i++)
-        {
-            ienc->getEncoder(jointsList[i],&pos_tot[jointsList[i]]);
-            if (fabs(pos_tot[jointsList[i]]-home_pos[i])<tolerance) in_position++;
-        }
-        if (in_position==n_cmd_joints) break;
-        if (timeout>100)
-        {
-            ROBOTTESTINGFRAMEWORK_ASSERT_ERROR("Timeout while reaching zero position");
-        }
-        yarp::os::Time::delay(0.2);
-        timeout++;
+        ROBOTTESTINGFRAMEWORK_ASSERT_ERROR("Timeout while reaching zero position");
     }
 }
 
@@ -390,6 +341,136 @@ void ControlModes::checkControlModeWithImCompliant(int desired_control_mode, std
     }
 
 }
+void ControlModes::runTransitionMatrix()
+{
+    typedef std::pair<int, yarp::dev::InteractionModeEnum> state_t;
+    const int control_modes[] = {VOCAB_CM_POSITION, VOCAB_CM_POSITION_DIRECT, VOCAB_CM_VELOCITY, VOCAB_CM_MIXED,
+                                 VOCAB_CM_TORQUE, VOCAB_CM_PWM, VOCAB_CM_CURRENT, VOCAB_CM_IDLE};
+    const yarp::dev::InteractionModeEnum interaction_modes[] = {VOCAB_IM_STIFF, VOCAB_IM_COMPLIANT};
+    std::vector<state_t> states;
+    for (auto im : interaction_modes)
+        for (auto cm : control_modes)
+            states.push_back(state_t(cm, im));
+    const state_t hub = states[0]; //(VOCAB_CM_POSITION, VOCAB_IM_STIFF)
+    const size_t n_states = states.size();
+
+    //torque control and compliant interaction are available only on the joints with torque control enabled
+    auto supported = [&](const state_t& st, int joint) -> bool
+    {
+        if (st.first==VOCAB_CM_TORQUE || st.second==VOCAB_IM_COMPLIANT) return jointTorqueCtrlEnabled[joint]!=0;
+        return true;
+    };
+
+    //latency[(from*n_states+to)*n_cmd_joints+joint]: >=0 latency [s], illegal: not reached within the timeout
+    const double not_tested = -2;
+    const double illegal = -1;
+    std::vector<double> latency(n_states*n_states*n_cmd_joints, not_tested);
+
+    double start_time = yarp::os::Time::now();
+    for (size_t from=0; from<n_states; from++)
+    {
+        for (size_t to=0; to<n_states; to++)
+        {
+            if (to==from) continue;
+
+            //the joints which support both states are tested in parallel
+            std::vector<int> joints;
+            std::vector<int> index;
+            for (int i=0; i<n_cmd_joints; i++)
+            {
+                if (supported(states[from], jointsList[i]) && supported(states[to], jointsList[i]))
+                {
+                    joints.push_back(jointsList[i]);
+                    index.push_back(i);
+                }
+            }
+            if (joints.empty()) continue;
+
+            ControlModeSwitcher switcher(icmd, iimd, joints);
+            switcher.setPollPeriod(poll_period);
+            switcher.setTimeout(transition_timeout);
+
+            //all the joints go back to the hub, so that none of them stays in an unsafe mode,
+            //then the tested ones reach the starting state
+            ControlModeSwitcher::Result at_hub = modeSwitcher.change(hub.first, hub.second);
+            ControlModeSwitcher::Result start;
+            if (from!=0) start = switcher.change(states[from].first, states[from].second);
+
+            ControlModeSwitcher::Result result = switcher.change(states[to].first, states[to].second);
+            for (size_t k=0; k<joints.size(); k++)
+            {
+                //the joints which could not reach the starting state are not tested
+                bool started = (from==0) ? at_hub.latency[index[k]]>=0 : start.latency[k]>=0;
+                if (!started) continue;
+                latency[(from*n_states+to)*n_cmd_joints+index[k]] = (result.latency[k]>=0) ? result.latency[k] : illegal;
+            }
+        }
+
+        modeSwitcher.change(hub.first, hub.second);
+        goHome();
+    }
+    double elapsed = yarp::os::Time::now()-start_time;
+
+    //one line per starting state, with the max latency over the joints
+    char buff[200];
+    int n_transitions=0;
+    int n_illegal=0;
+    int n_slow=0;
+    for (size_t from=0; from<n_states; from++)
+    {
+        std::string line = "from " + ControlModeSwitcher::modesToString(states[from].first, states[from].second) + ":";
+        for (size_t to=0; to<n_states; to++)
+        {
+            if (to==from) continue;
+            double max_latency = not_tested;
+            bool any_illegal = false;
+            for (int i=0; i<n_cmd_joints; i++)
+            {
+                double l = latency[(from*n_states+to)*n_cmd_joints+i];
+                if (l==not_tested) continue;
+                n_transitions++;
+                if (l==illegal) {any_illegal = true; n_illegal++; continue;}
+                if (l>slow_transition) n_slow++;
+                max_latency = std::max(max_latency, l);
+            }
+            std::string target = ControlModeSwitcher::modesToString(states[to].first, states[to].second);
+            if (any_illegal)            snprintf(buff, sizeof(buff), " %s X", target.c_str());
+            else if (max_latency>=0)    snprintf(buff, sizeof(buff), " %s %.1fms", target.c_str(), max_latency*1000);
+            else                        snprintf(buff, sizeof(buff), " %s -", target.c_str());
+            line += buff;
+        }
+        ROBOTTESTINGFRAMEWORK_TEST_REPORT(line);
+    }
+
+    //the details of the illegal and slow transitions
+    for (size_t from=0; from<n_states; from++)
+    {
+        for (size_t to=0; to<n_states; to++)
+        {
+            for (int i=0; i<n_cmd_joints; i++)
+            {
+                double l = (to==from) ? not_tested : latency[(from*n_states+to)*n_cmd_joints+i];
+                if (l==not_tested) continue;
+                std::string transition = ControlModeSwitcher::modesToString(states[from].first, states[from].second) + " -> " +
+                                         ControlModeSwitcher::modesToString(states[to].first, states[to].second);
+                if (l==illegal)
+                {
+                    ROBOTTESTINGFRAMEWORK_TEST_FAIL_IF_FALSE(false, "joint "+std::to_string(jointsList[i])+": transition "+transition+" not completed within the timeout");
+                }
+                else if (l>slow_transition)
+                {
+                    snprintf(buff, sizeof(buff), "%.1fms", l*1000);
+                    ROBOTTESTINGFRAMEWORK_TEST_REPORT("WARNING: joint "+std::to_string(jointsList[i])+": slow transition "+transition+" "+buff);
+                }
+            }
+        }
+    }
+
+    snprintf(buff, sizeof(buff), "Transition matrix: %d transitions tested in %.1f s, %d illegal, %d slower than %.1f ms",
+             n_transitions, elapsed, n_illegal, n_slow, slow_transition*1000);
+    ROBOTTESTINGFRAMEWORK_TEST_REPORT(buff);
+}
+
 void ControlModes::run()
 {
     char buff[500];
@@ -399,6 +480,12 @@ void ControlModes::run()
     verifyAmplifier(0,"test0b"); //@@@@@@ To be completed
     goHome();
 
+    if (matrix)
+    {
+        runTransitionMatrix();
+        return;
+    }
+
     //------ check all modes when stiff ------
     setMode(VOCAB_CM_POSITION,VOCAB_IM_STIFF);
     verifyMode(VOCAB_CM_POSITION,VOCAB_IM_STIFF,"test1");
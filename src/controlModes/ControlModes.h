@@ -22,9 +22,11 @@
 #define _CONTROLMODES_H_
 
 #include <string>
+#include <vector>
 #include <yarp/robottestingframework/TestCase.h>
 #include <yarp/dev/ControlBoardInterfaces.h>
 #include <yarp/dev/PolyDriver.h>
+#include "ControlModeSwitcher.h"
 
 /**
 * \ingroup icub-tests
@@ -35,6 +37,13 @@
 * The test intentionally generates an hardware fault to test the transition between VOCAB_CM_HW_FAULT to VOCAB_CM_IDLE. The fault is generated by zeroing the max current limit.
 * Check of the amplifier internal status (iAmplifier->getAmpStatus) has to be implemented yet.
 *
+* With the matrix option the scripted sequence is replaced by a benchmark of the complete transition matrix: for every ordered pair of
+* states (VOCAB_CM_POSITION, VOCAB_CM_POSITION_DIRECT, VOCAB_CM_VELOCITY, VOCAB_CM_MIXED, VOCAB_CM_TORQUE, VOCAB_CM_PWM, VOCAB_CM_CURRENT, VOCAB_CM_IDLE,
+* each with VOCAB_IM_STIFF and VOCAB_IM_COMPLIANT) the joints are brought to the first state through (VOCAB_CM_POSITION, VOCAB_IM_STIFF) and then switched
+* to the second one, all the joints which support both states at the same time. The latency of each transition is measured per joint.
+* The transitions which do not complete within transitionTimeout fail the test, the ones slower than slowTransition are reported.
+* The joints stay in the non-position states only for the duration of the transitions, and they are homed again after each row of the matrix.
+*
 * Example: testRunner -v -t ControlModes.dll -p "--robot icub --part head --joints ""(0 1 2 3 4 5)"" --zero 0"
 *
 * Check the following functions:
@@ -48,6 +57,10 @@
 * | part               | string | -     | -             | Yes      | The name of trhe robot part. | e.g. left_arm |
 * | joints             | vector of ints | -             | Yes      | List of joints to be tested. | |
 * | zero               | double | deg   | -             | Yes      | The home position for the tested joints. | |
+* | matrix             | bool   | -     | false         | No       | If true, the full transition matrix is benchmarked. | |
+* | slowTransition     | double | s     | 0.1           | No       | Matrix mode: the transitions slower than this are reported. | |
+* | transitionTimeout  | double | s     | 1.0           | No       | Matrix mode: the max time for a transition, after it the transition is considered illegal. | |
+* | pollPeriod         | double | s     | 0.001         | No       | Matrix mode: the period of the control mode reads, i.e. the resolution of the latency. | |
 */
 
 class ControlModes : public yarp::robottestingframework::TestCase {
@@ -74,6 +87,7 @@ public:
     void setModeSingle(int joint, int desired_control_mode, yarp::dev::InteractionModeEnum desired_interaction_mode);
     void checkJointWithTorqueMode();
     void checkControlModeWithImCompliant(int desired_control_mode, std::string title);
+    void runTransitionMatrix();
 
 private:
     std::string robotName;
@@ -85,6 +99,10 @@ private:
     int    n_part_joints;
     int    n_cmd_joints;
     double tolerance;
+    bool   matrix;
+    double slow_transition;
+    double transition_timeout;
+    double poll_period;
     enum cmd_mode_t
     {
       single_joint = 0,
@@ -97,6 +115,7 @@ private:
     yarp::dev::IAmplifierControl *iamp;
     yarp::dev::IControlMode     *icmd;
     yarp::dev::IInteractionMode  *iimd;
+    ControlModeSwitcher           modeSwitcher;
     yarp::dev::IEncoders         *ienc;
     yarp::dev::IPositionDirect   *idir;
     yarp::dev::IVelocityControl  *ivel;
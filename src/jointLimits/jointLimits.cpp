@@ -24,10 +24,14 @@
 #include <yarp/os/Time.h>
 #include <yarp/math/Math.h>
 #include <yarp/os/Property.h>
+#include <yarp/os/LogStream.h>
+#include <yarp/dev/IRemoteVariables.h>
 #include <fstream>
 #include <algorithm>
 #include <cstdlib>
 #include "jointLimits.h"
+#include "ControlModeSwitcher.h"
+#include "MotionWaiter.h"
 
 #include <stdio.h>
 
@@ -50,6 +54,10 @@ JointLimits::JointLimits() : yarp::robottestingframework::TestCase("JointLimits"
     enc_jnt=0;
     original_pids=0;
     pids_saved=false;
+    parallel=false;
+    samplePeriod=0.005;
+    settleWindow=0.3;
+    probeTimeout=20;
 }
 
 JointLimits::~JointLimits() { }
@@ -95,6 +103,16 @@ bool JointLimits::setup(yarp::os::Property& property) {
 
     Bottle* toleranceListBottle = property.find("toleranceList").asList(); //optional param
 
+    if(property.check("parallel"))
+      {parallel = property.find("parallel").asBool();}
+    if(property.check("samplePeriod"))
+      {samplePeriod = property.find("samplePeriod").asFloat64();}
+    if(property.check("settleWindow"))
+      {settleWindow = property.find("settleWindow").asFloat64();}
+    if(property.check("probeTimeout"))
+      {probeTimeout = property.find("probeTimeout").asFloat64();}
+    ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(samplePeriod>0,"invalid samplePeriod");
+
     Property options;
     options.put("device", "remote_controlboard");
     options.put("remote", "/"+robotName+"/"+partName);
@@ -123,7 +141,7 @@ bool JointLimits::setup(yarp::os::Property& property) {
     min_lims.resize(n_cmd_joints);
 
     home.resize (n_cmd_joints); for (int i=0; i< n_cmd_joints; i++) home[i]=homeBottle->get(i).asFloat64();
-    speed.resize(n_cmd_joints); for (int i=0; i< n_cmd_joints; i++) speed[i]=speedBottle->get(i).asFloat64();
+    speed.resize(n_cmd_joints); for (int i=0; i< n_cmd_joints; i++) { speed[i]=speedBottle->get(i).asFloat64(); ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(speed[i] > 0, "speed must be > 0"); }
     outputLimit.resize(n_cmd_joints);for (int i=0; i< n_cmd_joints; i++) outputLimit[i]=outputLimitBottle->get(i).asFloat64();
     outOfBoundPos.resize(n_cmd_joints); for (int i = 0; i < n_cmd_joints; i++) { outOfBoundPos[i] = outOfBoundPosition->get(i).asFloat64(); ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(outOfBoundPos[i] > 0 , "outOfBoundPosition must be > 0"); }
     toleranceList.resize(n_cmd_joints);
@@ -138,6 +156,27 @@ bool JointLimits::setup(yarp::os::Property& property) {
             toleranceList[i] = tolerance;
     }
 
+    //group the joints which can be probed at the same time
+    std::vector<int> joints(jointsList.data(), jointsList.data()+jointsList.size());
+    batches = JointBatchScheduler::sequential(n_cmd_joints);
+    if (parallel)
+    {
+        IRemoteVariables* ivar = 0;
+        Bottle b;
+        CouplingMatrix coupling;
+        std::string coupling_error;
+        if (dd->view(ivar) && ivar->getRemoteVariable("kinematic_mj", b) &&
+            coupling.fromRemoteVariable(b, n_part_joints, coupling_error))
+        {
+            batches = JointBatchScheduler::independent(joints, coupling);
+        }
+        else
+        {
+            yWarning() << "Unable to get the coupling matrix" << coupling_error << ": the joints will be probed one at a time";
+        }
+    }
+    ROBOTTESTINGFRAMEWORK_TEST_REPORT(Asserter::format("Joint batches: %s", JointBatchScheduler::toString(batches, joints).c_str()));
+
     original_pids = new yarp::dev::Pid[n_cmd_joints];
     for (unsigned int i=0; i<jointsList.size(); i++)
     {
@@ -187,159 +226,154 @@ void JointLimits::tearDown()
 
 void JointLimits::setMode(int desired_mode)
 {
-    for (unsigned int i=0; i<jointsList.size(); i++)
-    {
-        icmd->setControlMode((int)jointsList[i],desired_mode);
-        iimd->setInteractionMode((int)jointsList[i],VOCAB_IM_STIFF);
-        yarp::os::Time::delay(0.010);
-    }
-
-    int cmode;
-    yarp::dev::InteractionModeEnum imode;
-    int timeout = 0;
-
-    while (1)
-    {
-        int ok=0;
-        for (unsigned int i=0; i<jointsList.size(); i++)
-        {
-            icmd->getControlMode ((int)jointsList[i],&cmode);
-            iimd->getInteractionMode((int)jointsList[i],&imode);
-            if (cmode==desired_mode && imode==VOCAB_IM_STIFF) ok++;
-        }
-        if (ok==jointsList.size()) break;
-        if (timeout>100)
-        {
-            ROBOTTESTINGFRAMEWORK_ASSERT_ERROR("Unable to set control mode/interaction mode");
-        }
-        yarp::os::Time::delay(0.2);
-        timeout++;
-    }
+    ControlModeSwitcher switcher(icmd, iimd, jointsList);
+    ControlModeSwitcher::Result result = switcher.change(desired_mode, VOCAB_IM_STIFF);
+    ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(result.ok, switcher.failureMessage(result, "Control mode change"));
+    ROBOTTESTINGFRAMEWORK_TEST_REPORT(switcher.successMessage(result, "Control mode change"));
 }
 
 void JointLimits::goTo(yarp::sig::Vector position)
 {
-    for (unsigned int i=0; i<jointsList.size(); i++)
+    MotionWaiter waiter;
+    waiter.configure(ienc, ipos, jointsList);
+    waiter.setTolerances(std::vector<double>(toleranceList.data(), toleranceList.data()+toleranceList.size()));
+    MotionWaiter::Result result = waiter.moveAndWait(std::vector<double>(position.data(), position.data()+position.size()),
+                                                     std::vector<double>(speed.data(), speed.data()+speed.size()));
+    if (!result.ok)
     {
-        ipos->setRefSpeed((int)jointsList[i],speed[i]);
-        ipos->positionMove((int)jointsList[i],position[i]);
+        ROBOTTESTINGFRAMEWORK_ASSERT_ERROR("Timeout while reaching desired position");
     }
+}
 
-    int timeout = 0;
-    while (1)
+bool JointLimits::goToBatch(const std::vector<size_t>& idx, const std::vector<double>& positions)
+{
+    std::vector<int> joints(idx.size());
+    std::vector<double> tolerances(idx.size());
+    std::vector<double> speeds(idx.size());
+    for (size_t k = 0; k < idx.size(); k++)
     {
-        int in_position=0;
-        for (unsigned int i=0; i<jointsList.size(); i++)
-        {
-            double tmp=0;
-            ienc->getEncoder((int)jointsList[i],&tmp);
-            if (fabs(tmp-position[i])<toleranceList[i]) in_position++;
-        }
-        if (in_position==jointsList.size()) break;
-        if (timeout>100)
-        {
-            ROBOTTESTINGFRAMEWORK_ASSERT_ERROR("Timeout while reaching desired position");
-        }
-        yarp::os::Time::delay(0.2);
-        timeout++;
+        joints[k] = (int)jointsList[idx[k]];
+        tolerances[k] = toleranceList[idx[k]];
+        speeds[k] = speed[idx[k]];
     }
+    MotionWaiter waiter;
+    waiter.configure(ienc, ipos, joints);
+    waiter.setTolerances(tolerances);
+    return waiter.moveAndWait(positions, speeds).ok;
 }
 
-bool JointLimits::goToSingle(int i, double pos, double *reached_pos)
+bool JointLimits::probeLimits(const std::vector<size_t>& idx, const std::vector<double>& targets, const std::vector<double>& limits, double direction, std::vector<LimitProbe>& probes)
 {
-    ipos->setRefSpeed((int)jointsList[i],speed[i]);
-    ipos->positionMove((int)jointsList[i],pos);
-    double tmp=0;
+    size_t n = idx.size();
+    std::vector<int> joints(n);
+    std::vector<double> speeds(n);
+    std::vector<double> duration(n);
+    std::vector<double> anchor(n);
+    std::vector<double> anchorTime(n, 0.0);
+    probes.resize(n);
+
+    ienc->getEncoders(enc_jnt.data());
+    for (size_t k = 0; k < n; k++)
+    {
+        joints[k] = (int)jointsList[idx[k]];
+        speeds[k] = speed[idx[k]];
+        //the trajectory generator needs at least this time to complete the movement
+        duration[k] = fabs(targets[k] - enc_jnt[joints[k]]) / speeds[k];
+        anchor[k] = enc_jnt[joints[k]];
+        probes[k].reached = anchor[k];
+        probes[k].overshoot = direction * (anchor[k] - limits[k]);
+        probes[k].settleTime = -1;
+    }
+
+    ipos->setRefSpeeds((int)n, joints.data(), speeds.data());
+    ipos->positionMove((int)n, joints.data(), targets.data());
+    double t0 = yarp::os::Time::now();
 
-    int timeout = 0;
     while (1)
     {
-        ienc->getEncoder((int)jointsList[i],&tmp);
-        if (fabs(tmp-pos)<toleranceList[i]) break;
+        yarp::os::Time::delay(samplePeriod);
+        ienc->getEncoders(enc_jnt.data());
+        double t = yarp::os::Time::now() - t0;
 
-        if (timeout>100)
+        bool done = true;
+        for (size_t k = 0; k < n; k++)
         {
-            if(reached_pos != NULL)
+            double pos = enc_jnt[joints[k]];
+            probes[k].reached = pos;
+            probes[k].overshoot = std::max(probes[k].overshoot, direction * (pos - limits[k]));
+
+            //the joint is settled once it stays within tolerance of the last position it moved to
+            if (fabs(pos - anchor[k]) > toleranceList[idx[k]])
             {
-                *reached_pos = tmp;
+                anchor[k] = pos;
+                anchorTime[k] = t;
             }
-            return(false);
+            if (t < duration[k] || t - anchorTime[k] < settleWindow) done = false;
         }
 
-        yarp::os::Time::delay(0.2);
-        timeout++;
-    }
-    if(reached_pos != NULL)
-    {
-        *reached_pos = tmp;
-    }
-    return(true);
-}
-
-bool JointLimits::goToSingleExceed(int i, double position_to_reach, double limit, double reachedLimit, double *reached_pos)
-{
-    ipos->setRefSpeed((int)jointsList[i], speed[i]);
-    ipos->positionMove((int)jointsList[i], position_to_reach);
-    double tmp = 0;
-    bool excededLimit = false;
-    int timeout = 0;
-    double limitToCheck;
-    if(fabs(reachedLimit-limit)>toleranceList[i])
-    {
-        //if i'm here joint did NOT reached the limit and I would check joint doesn't exced reached limit
-        limitToCheck = reachedLimit;
-    }
-    else
-    {
-        limitToCheck = limit;
-    }
-    while (1)
-    {
-        ienc->getEncoder((int)jointsList[i], &tmp);
-        if(fabs(tmp - limitToCheck)>toleranceList[i])
+        if (done)
         {
-            excededLimit = true;
-            //ROBOTTESTINGFRAMEWORK_TEST_REPORT (Asserter::format("j %d exced limitTocheck %f: reached %f",(int)jointsList[i],  limitToCheck, tmp));
-            break;
+            for (size_t k = 0; k < n; k++) probes[k].settleTime = anchorTime[k];
+            return true;
         }
-        if (fabs(tmp - position_to_reach)<toleranceList[i])
+        if (t > probeTimeout)
         {
-            excededLimit = true;
-            //ROBOTTESTINGFRAMEWORK_TEST_REPORT (Asserter::format("j %d is near position_to_reach %f: reached %f",(int)jointsList[i],  position_to_reach, tmp));
-            break;
+            for (size_t k = 0; k < n; k++)
+            {
+                if (t >= duration[k] && t - anchorTime[k] >= settleWindow) probes[k].settleTime = anchorTime[k];
+            }
+            return false;
         }
-
-        if (timeout>50) break;
-        yarp::os::Time::delay(0.2);
-        timeout++;
     }
+}
 
-    *reached_pos = tmp;
+void JointLimits::testLimit(const std::vector<size_t>& idx, bool upper)
+{
+    const char* name = upper ? "max" : "min";
+    double direction = upper ? 1.0 : -1.0;
+    size_t n = idx.size();
+    std::vector<int> joints(jointsList.data(), jointsList.data()+jointsList.size());
+    std::string batchName = JointBatchScheduler::toString(JointBatchScheduler::Batches(1, idx), joints);
+    std::vector<double> limits(n);
+    std::vector<double> targets(n);
+    std::vector<LimitProbe> probes;
+
+    //check that the limit is reachable
+    for (size_t k = 0; k < n; k++) limits[k] = upper ? max_lims[idx[k]] : min_lims[idx[k]];
+    ROBOTTESTINGFRAMEWORK_TEST_REPORT(Asserter::format("Testing if %s limit is reachable, joints %s", name, batchName.c_str()));
+    probeLimits(idx, limits, limits, direction, probes);
+    for (size_t k = 0; k < n; k++)
+    {
+        size_t i = idx[k];
+        ROBOTTESTINGFRAMEWORK_TEST_REPORT(Asserter::format("joint %d %s limit %f: reached %f, peak overshoot %f, settle time %.3f s",
+                                          (int)jointsList[i], name, limits[k], probes[k].reached, probes[k].overshoot, probes[k].settleTime));
+        ROBOTTESTINGFRAMEWORK_TEST_CHECK (probes[k].settleTime >= 0 && fabs(probes[k].reached - limits[k]) < toleranceList[i],
+                                          Asserter::format("joint %d moved to %s limit: %f reached: %f", (int)jointsList[i], name, limits[k], probes[k].reached));
+    }
 
-/*    if (fabs(tmp - position_to_reach)<toleranceList[i])
+    //check that limit + outOfBoundPos is NOT reachable
+    for (size_t k = 0; k < n; k++)
     {
-        //I reached the out of bound target. That's bad!
-        return (true);
+        size_t i = idx[k];
+        targets[k] = limits[k] + direction * outOfBoundPos[i];
+        //if the joint did NOT reach the limit, check that it doesn't exceed the reached position
+        if (fabs(probes[k].reached - limits[k]) > toleranceList[i]) limits[k] = probes[k].reached;
     }
-    if (fabs(tmp - limit)<toleranceList[i])
+    ROBOTTESTINGFRAMEWORK_TEST_REPORT(Asserter::format("Testing that %s limit cannot be exceeded, joints %s", name, batchName.c_str()));
+    probeLimits(idx, targets, limits, direction, probes);
+    for (size_t k = 0; k < n; k++)
     {
-        //I'm still near the joint limit. That's fine.
-        return (false);
+        size_t i = idx[k];
+        ROBOTTESTINGFRAMEWORK_TEST_REPORT(Asserter::format("joint %d out of bound target %f: reached %f, peak overshoot %f, settle time %.3f s",
+                                          (int)jointsList[i], targets[k], probes[k].reached, probes[k].overshoot, probes[k].settleTime));
+        ROBOTTESTINGFRAMEWORK_TEST_CHECK (probes[k].overshoot <= toleranceList[i],
+                                          Asserter::format("check if joint %d doesn't exceed %s limit. target was: %f reached: %f, peak overshoot %f, limit %f",
+                                                           (int)jointsList[i], name, targets[k], probes[k].reached, probes[k].overshoot, limits[k]));
     }
-    //I dont know where I am, that's bad!
-    return(true);
-*/
-
-    if( excededLimit)
-        return (true);
-    else
-        return(false);
 }
 
-
 void JointLimits::run()
 {
-    char buff[500];
     setMode(VOCAB_CM_POSITION);
     ROBOTTESTINGFRAMEWORK_TEST_REPORT("all joints are going to home....");
     goTo(home);
@@ -352,69 +386,23 @@ void JointLimits::run()
         if (max_lims[i] == 0 && min_lims[i] == 0) ROBOTTESTINGFRAMEWORK_ASSERT_ERROR("Invalid limit: max==min==0");
     }
 
-    for (unsigned int i=0; i<jointsList.size(); i++)
+    std::vector<int> joints(jointsList.data(), jointsList.data()+jointsList.size());
+    for (size_t b = 0; b < batches.size(); b++)
     {
-        bool res;
-        double reached_pos=0;
-        double excededpos_reached = 0;
-
-    //1) Check max limit
-        sprintf(buff,"Testing if max limit is reachable, joint %d, max limit: %f",(int)jointsList[i],max_lims[i]);ROBOTTESTINGFRAMEWORK_TEST_REPORT(buff);
-        //check that max_limit is reachable
-        res = goToSingle(i, max_lims[i], &reached_pos);
-        ROBOTTESTINGFRAMEWORK_TEST_CHECK (res, Asserter::format("joint %d moved to max limit: %f reached: %f",  (int)jointsList[i], max_lims[i], reached_pos));
-        //if(!res)
-        //{
-        //    goToSingle(i,home[i], NULL); //I need to go to home in order to leave joint in safe position for further tests (other body parts)
-        //    sprintf(buff, "Timeout while reaching desired position(%.2f). Reached pos=%.2f", max_lims[i], reached_pos);ROBOTTESTINGFRAMEWORK_ASSERT_ERROR(buff);
-        //}
-        //else { sprintf(buff, "Test successfull, joint %d, max limit: %f reached: %f", (int)jointsList[i], max_lims[i], reached_pos); ROBOTTESTINGFRAMEWORK_TEST_REPORT(buff); }
-
-    //2) check that max_limit + outOfBoundPos is NOT reachable
-        sprintf(buff, "Testing that max limit cannot be exceeded, joint %d, max limit: %f", (int)jointsList[i], max_lims[i]); ROBOTTESTINGFRAMEWORK_TEST_REPORT(buff);
-        res = goToSingleExceed(i, max_lims[i] + outOfBoundPos[i], max_lims[i], reached_pos, &excededpos_reached);
-        ROBOTTESTINGFRAMEWORK_TEST_CHECK (!res, Asserter::format("check if joint %d desn't exced max limit. target was: %f reached: %f, limit %f ",  (int)jointsList[i], max_lims[i] + outOfBoundPos[i], excededpos_reached, max_lims[i]));
-        //if (res)
-        //{
-        //    goToSingle(i, home[i], NULL); //I need to go to home in order to leave joint in safe position for further tests (other body parts)
-        //    sprintf(buff, "Limit execeeded! Limit was (%.2f). Reached pos=%.2f", max_lims[i], reached_pos); ROBOTTESTINGFRAMEWORK_ASSERT_ERROR(buff);
-        //}
-        //else { sprintf(buff, "Test successfull, joint %d, target was: %f reached: %f, limit %f ", (int)jointsList[i], max_lims[i] + outOfBoundPos[i], reached_pos, max_lims[i]); ROBOTTESTINGFRAMEWORK_TEST_REPORT(buff); }
-
-    //3) Check min limit
-        //check that min_limit is reachable
-        sprintf(buff,"Testing if min limit is reachable, joint %d, min limit: %f",(int)jointsList[i],min_lims[i]);ROBOTTESTINGFRAMEWORK_TEST_REPORT(buff);
-        res = goToSingle(i, min_lims[i], &reached_pos);
-        ROBOTTESTINGFRAMEWORK_TEST_CHECK (res, Asserter::format("joint %d moved to min limit: %f reached: %f",  (int)jointsList[i], min_lims[i], reached_pos));
-
-        /*if(!res)
-        {
-            goToSingle(i,home[i], NULL);
-            sprintf(buff, "Timeout while reaching desired position(%.2f). Reached pos=%.2f", min_lims[i], reached_pos);ROBOTTESTINGFRAMEWORK_ASSERT_ERROR(buff);
-        }
-        else { sprintf(buff, "Test successfull, joint %d, min limit: %f reached: %f", (int)jointsList[i], min_lims[i], reached_pos); ROBOTTESTINGFRAMEWORK_TEST_REPORT(buff); }*/
-
-    //4) check that min_limit - outOfBoundPos is NOT reachable
-        sprintf(buff, "Testing that min limit cannot be exceeded, joint %d, min limit: %f", (int)jointsList[i], min_lims[i]); ROBOTTESTINGFRAMEWORK_TEST_REPORT(buff);
-        res = goToSingleExceed(i, min_lims[i] - outOfBoundPos[i], min_lims[i], reached_pos, & excededpos_reached);
-        ROBOTTESTINGFRAMEWORK_TEST_CHECK (!res, Asserter::format("check if joint %d desn't exced min limit. target was: %f reached: %f, limit %f ",  (int)jointsList[i], min_lims[i] - outOfBoundPos[i], excededpos_reached, min_lims[i]));
-
-        //if (res)
-        //{
-        //    goToSingle(i, home[i], NULL); //I need to go to home in order to leave joint in safe position for further tests (other body parts)
-        //    sprintf(buff, "Limit execeeded! Limit was (%.2f). Reached pos=%.2f", min_lims[i], reached_pos); ROBOTTESTINGFRAMEWORK_ASSERT_ERROR(buff);
-        //}
-        //else { sprintf(buff, "Test successfull, joint %d, target was: %f reached: %f, limit %f ", (int)jointsList[i], min_lims[i] - outOfBoundPos[i], reached_pos, min_lims[i]); ROBOTTESTINGFRAMEWORK_TEST_REPORT(buff); }
-
-    //5) Check home position
-        sprintf(buff,"Testing joint %d, homing to: %f",(int)jointsList[i],home[i]);ROBOTTESTINGFRAMEWORK_TEST_REPORT(buff);
-        res = goToSingle(i, home[i], &reached_pos);
-        if(!res)
+        const std::vector<size_t>& idx = batches[b];
+
+        testLimit(idx, true);
+        testLimit(idx, false);
+
+        //bring the batch back to home
+        std::string batchName = JointBatchScheduler::toString(JointBatchScheduler::Batches(1, idx), joints);
+        std::vector<double> positions(idx.size());
+        for (size_t k = 0; k < idx.size(); k++) positions[k] = home[idx[k]];
+        if (!goToBatch(idx, positions))
         {
-            sprintf(buff, "Timeout while reaching desired position(%.2f). Reached pos=%.2f", home[i], reached_pos);ROBOTTESTINGFRAMEWORK_ASSERT_ERROR(buff);
+            ROBOTTESTINGFRAMEWORK_ASSERT_ERROR("Timeout while homing joints " + batchName);
         }
-        else{ sprintf(buff, "Homing joint %d complete", (int)jointsList[i]); ROBOTTESTINGFRAMEWORK_TEST_REPORT(buff); }
-
+        ROBOTTESTINGFRAMEWORK_TEST_REPORT("Homing joints " + batchName + " complete");
     }
     ienc->getEncoders(enc_jnt.data());
     ROBOTTESTINGFRAMEWORK_TEST_REPORT("Test ends. All joints are going to home....");
@@ -22,12 +22,14 @@
 #define _JOINTLIMITS_H_
 
 #include <string>
+#include <vector>
 #include <yarp/robottestingframework/TestCase.h>
 #include <yarp/dev/ControlBoardInterfaces.h>
 #include <yarp/dev/PolyDriver.h>
 #include <yarp/sig/Vector.h>
 #include <yarp/os/Bottle.h>
 #include <yarp/sig/Matrix.h>
+#include "JointBatchScheduler.h"
 
 /**
 * \ingroup icub-tests
@@ -35,12 +37,16 @@
 * The limits are set in the robot configuration files. The test asks the limits to robotInterface using the IControlLimits interface.
 * The test moves each joint first to the max lim, then to the min lim, then to home.
 * If the joint is unable to reach the software limits within a certain tolerance, the test fails and the joint is put back in home position.
-* The timeout for each joint to reach the limit position is fixed to 20 seconds.
+* The timeout for each joint to reach the limit position is given by the probeTimeout parameter (20 seconds by default).
 * The test uses an limited output to avoid to damage the joint if, for example, an hardware limit is reached before the software limit.
 * If this limit is too small, the the joint may be unable to reach the limit (e.g. because of friction), so the value must be chosen accurately.
 * The test assumes the the position control is properly working and the position pid is properly tuned.
 * After testing the limits, this test also tries to move the joint out of the limits on puropose (adding to the joint limits the value of outOfBoundPosition).
 * The test is successfull if the position move command is correctly stopped at the limit.
+* During each movement the encoders are sampled every samplePeriod seconds: for each joint the test reports the peak overshoot
+* past the software limit and the settle time, i.e. the time after the command before the joint stays within tolerance.
+* With the parallel option the joints which are not mechanically coupled (according to the kinematic_mj coupling matrix of the part)
+* are probed at the same time.
 *
 * Example: testRunner -v -t JointLimits.dll -p "--robot icub --part head --joints ""(0 1 2)"" --home ""(0 0 0)"" --speed ""(20 20 20)"" --outputLimitPercent ""(30 30 30)"" --outOfBoundPosition ""(2 2 2)"" --tolerance 0.2"
 *
@@ -54,6 +60,7 @@
 * \li IEncoders::getEncoder()
 * \li IEncoders::getEncoders()
 * \li IPid::getPid()/IPid::setPid()
+* \li IRemoteVariables::getRemoteVariable() (kinematic_mj, only with the parallel option)
 * \li IControlMode::getControlMode()/setControlMode()
 * \li IInteractionMode::getInteractionMode()/setInteractionMode()
 *
@@ -68,6 +75,10 @@
 * | tolerance          | vector of doubles of size joints | deg   | - | Yes | The position tolerance used to check if the limit has been properly reached. | Typical value = 0.2 deg. |
 * | outputLimitPercent | vector of doubles of size joints | %     | - | Yes | The maximum motor output (expressed as percentage). | Safe values can be, for example, 30%.|
 * | outOfBoundPosition | vector of doubles of size joints | %     | - | Yes | This value is added the joint limit to test that a position command is not able to move out of the joint limits | Typical value 2 deg.|
+* | parallel           | bool   | -     | false | No  | If true, uncoupled joints are probed at the same time | Make sure that moving several joints at once is safe |
+* | samplePeriod       | double | s     | 0.005 | No  | The encoders sampling period used to measure overshoot and settle time | |
+* | settleWindow       | double | s     | 0.3   | No  | A joint is settled when it stays within tolerance for this time | |
+* | probeTimeout       | double | s     | 20    | No  | The maximum duration of each limit probe | |
 *
 */
 
@@ -82,9 +93,18 @@ public:
 
     virtual void run();
 
+    /** the outcome of a limit probe for a single joint */
+    struct LimitProbe
+    {
+        double reached;     //the last sampled position
+        double overshoot;   //the peak position past the limit (negative if the limit was never reached)
+        double settleTime;  //the time after the command before the joint stayed within tolerance, -1 if it never settled
+    };
+
     void goTo(yarp::sig::Vector position);
-    bool goToSingle(int i, double pos, double *reached_pos);
-    bool goToSingleExceed(int i, double position_to_reach, double limit, double reachedLimit, double *reached_pos);
+    bool goToBatch(const std::vector<size_t>& idx, const std::vector<double>& positions);
+    bool probeLimits(const std::vector<size_t>& idx, const std::vector<double>& targets, const std::vector<double>& limits, double direction, std::vector<LimitProbe>& probes);
+    void testLimit(const std::vector<size_t>& idx, bool upper);
 
     void setMode(int desired_mode);
     void saveToFile(std::string filename, yarp::os::Bottle &b);
@@ -95,6 +115,11 @@ private:
     yarp::sig::Vector jointsList;
 
     double tolerance;
+    bool   parallel;
+    double samplePeriod;
+    double settleWindow;
+    double probeTimeout;
+    JointBatchScheduler::Batches batches;
 
     int    n_part_joints;
 
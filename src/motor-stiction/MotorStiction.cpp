@@ -25,9 +25,11 @@
 #include <yarp/math/Math.h>
 #include <yarp/os/Property.h>
 #include <fstream>
+#include <sstream>
 #include <algorithm>
 #include <cstdlib>
 #include "MotorStiction.h"
+#include "MotionWaiter.h"
 
 //example1    -v -t MotorStiction.dll -p "--robot icub --part left_arm --joints ""(4)"" --home ""(45)"" --outputStep ""(0.5)"" --outputMax ""(50)"" --outputDelay ""(2.0)""  --threshold ""(5.0)"" "
 
@@ -47,6 +49,11 @@ MotorStiction::MotorStiction() : yarp::robottestingframework::TestCase("MotorSti
     iimd=0;
     ienc=0;
     ipwm = 0;
+    adaptive = false;
+    coarse_factor = 5.0;
+    max_asymmetry = 0;
+    max_spread = 0;
+    trend_threshold = 0.2;
 }
 
 MotorStiction::~MotorStiction() { }
@@ -70,6 +77,14 @@ bool MotorStiction::setup(yarp::os::Property& property) {
     robotName = property.find("robot").asString();
     partName = property.find("part").asString();
 
+    if(property.check("adaptive"))     {adaptive = property.find("adaptive").asBool();}
+    if(property.check("coarseFactor")) {coarse_factor = property.find("coarseFactor").asFloat64();}
+    ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(coarse_factor>=1,"coarseFactor must be >= 1");
+    if(property.check("maxAsymmetry"))   {max_asymmetry = property.find("maxAsymmetry").asFloat64();}
+    if(property.check("maxSpread"))      {max_spread = property.find("maxSpread").asFloat64();}
+    if(property.check("historyFile"))    {history_file = property.find("historyFile").asString();}
+    if(property.check("trendThreshold")) {trend_threshold = property.find("trendThreshold").asFloat64();}
+
     repeat = property.find("repeat").asInt32();
     ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(repeat>=0,"repeat must be greater than zero");
 
@@ -114,6 +129,7 @@ bool MotorStiction::setup(yarp::os::Property& property) {
     int n_cmd_joints = jointsBottle->size();
     ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(n_cmd_joints>0 && n_cmd_joints<=n_part_joints,"invalid number of joints, it must be >0 & <= number of part joints");
     for (int i=0; i <n_cmd_joints; i++) jointsList.push_back(jointsBottle->get(i).asInt32());
+    modeSwitcher.configure(icmd, iimd, jointsList);
 
     home.resize (n_cmd_joints);               for (int i=0; i< n_cmd_joints; i++) home[i]=homeBottle->get(i).asFloat64();
     opl_step.resize (n_cmd_joints);           for (int i=0; i< n_cmd_joints; i++) opl_step[i]=output_step_Bottle->get(i).asFloat64();
@@ -140,12 +156,7 @@ void MotorStiction::tearDown()
 
 void MotorStiction::setMode(int desired_control_mode, yarp::dev::InteractionModeEnum desired_interaction_mode)
 {
-    for (unsigned int i=0; i<jointsList.size(); i++)
-    {
-        icmd->setControlMode((int)jointsList[i],desired_control_mode);
-        iimd->setInteractionMode((int)jointsList[i],desired_interaction_mode);
-        yarp::os::Time::delay(0.010);
-    }
+    modeSwitcher.request(desired_control_mode, desired_interaction_mode);
 }
 
 void MotorStiction::setModeSingle(int i, int desired_control_mode, yarp::dev::InteractionModeEnum desired_interaction_mode)
@@ -157,61 +168,25 @@ void MotorStiction::setModeSingle(int i, int desired_control_mode, yarp::dev::In
 
 void MotorStiction::verifyMode(int desired_control_mode, yarp::dev::InteractionModeEnum desired_interaction_mode, std::string title)
 {
-    int cmode;
-    yarp::dev::InteractionModeEnum imode;
-    int timeout = 0;
-
-    while (1)
-    {
-        int ok=0;
-        for (unsigned int i=0; i<jointsList.size(); i++)
-        {
-            icmd->getControlMode ((int)jointsList[i],&cmode);
-            iimd->getInteractionMode((int)jointsList[i],&imode);
-            if (cmode==desired_control_mode && imode==desired_interaction_mode) ok++;
-        }
-        if (ok==jointsList.size()) break;
-        if (timeout>100)
-        {
-            char sbuf[500];
-            sprintf(sbuf,"Test (%s) failed: current mode is (%d,%d), it should be (%d,%d)",title.c_str(), desired_control_mode,desired_interaction_mode,cmode,imode);
-            ROBOTTESTINGFRAMEWORK_ASSERT_ERROR(sbuf);
-        }
-        yarp::os::Time::delay(0.2);
-        timeout++;
-    }
-    char sbuf[500];
-    sprintf(sbuf,"Test (%s) passed: current mode is (%d,%d)",title.c_str(), desired_control_mode,desired_interaction_mode);
-    ROBOTTESTINGFRAMEWORK_TEST_REPORT(sbuf);
+    ControlModeSwitcher::Result result = modeSwitcher.wait(desired_control_mode, desired_interaction_mode);
+    ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(result.ok, modeSwitcher.failureMessage(result, "Test ("+title+")"));
+    ROBOTTESTINGFRAMEWORK_TEST_REPORT(modeSwitcher.successMessage(result, "Test ("+title+")"));
 }
 
 void MotorStiction::goHome()
 {
-    for (unsigned int i=0; i<jointsList.size(); i++)
-    {
-        ipos->setRefSpeed((int)jointsList[i],20.0);
-        ipos->positionMove((int)jointsList[i],home[i]);
-        yarp::os::Time::delay(0.010);
-    }
-
     char buff [500];
     sprintf(buff,"Homing the whole part");ROBOTTESTINGFRAMEWORK_TEST_REPORT(buff);
 
-    int in_position=0;
+    MotionWaiter waiter;
+    waiter.configure(ienc, ipos, jointsList);
+    waiter.setTolerance(1.0);
+    MotionWaiter::Result result = waiter.moveAndWait(std::vector<double>(home.data(), home.data()+home.size()), 20.0);
     for (unsigned int i=0; i<jointsList.size(); i++)
     {
-        double time_started = yarp::os::Time::now();
-        while (1)
-        {
-            double pos;
-            ienc->getEncoder((int)jointsList[i],&pos);
-            if (fabs(pos-home[i])<1.0) break;
-            if (yarp::os::Time::now()-time_started>20)
-            {
-                sprintf(buff,"Timeout while reaching zero position, joint %d, curr_enc %f, home %f", (int)jointsList[i],pos,home[i]);
-                ROBOTTESTINGFRAMEWORK_ASSERT_ERROR(buff);
-            }
-        }
+        if (result.settled[i]) continue;
+        sprintf(buff,"Timeout while reaching zero position, joint %d, curr_enc %f, home %f", (int)jointsList[i],result.position[i],home[i]);
+        ROBOTTESTINGFRAMEWORK_ASSERT_ERROR(buff);
     }
 
     sprintf(buff,"Homing succesfully completed");ROBOTTESTINGFRAMEWORK_TEST_REPORT(buff);
@@ -233,7 +208,7 @@ void MotorStiction::saveToFile(std::string filename, yarp::os::Bottle &b)
     fs.close();
 }
 
-void MotorStiction::OplExecute(int i, std::vector<yarp::os::Bottle>& dataToPlotList, stiction_data& current_test, bool positive_sign)
+MotorStiction::ramp_result_t MotorStiction::rampOutput(int i, double step, bool positive_sign, bool stop_on_movement, yarp::os::Bottle& dataToPlot, double& opl)
 {
     char buff[500];
     double time     = yarp::os::Time::now();
@@ -242,14 +217,12 @@ void MotorStiction::OplExecute(int i, std::vector<yarp::os::Bottle>& dataToPlotL
     double start_enc=0;
     ienc->getEncoder((int)jointsList[i],&enc);
     ienc->getEncoder((int)jointsList[i],&start_enc);
-    bool not_moving = true;
-    double opl=0;
+    opl=0;
     setMode(VOCAB_CM_PWM, VOCAB_IM_STIFF);
     ipwm->setRefDutyCycle((int)jointsList[i], opl);
     double last_opl_cmd=yarp::os::Time::now();
-    Bottle dataToPlot;
 
-    while (not_moving)
+    while (1)
     {
         Bottle& row = dataToPlot.addList();
         Bottle& v1 = row.addList();
@@ -258,53 +231,40 @@ void MotorStiction::OplExecute(int i, std::vector<yarp::os::Bottle>& dataToPlotL
         ipwm->setRefDutyCycle((int)jointsList[i],opl);
         ienc->getEncoder((int)jointsList[i],&enc);
 
-        //sprintf(buff,"%f %f %f %f",enc,start_enc,fabs(enc-start_enc),movement_threshold[i]);ROBOTTESTINGFRAMEWORK_TEST_REPORT(buff);
+        time = yarp::os::Time::now();
+        v1.addFloat64(time);
+        v2.addFloat64(enc);
+        v2.addFloat64(opl);
 
-        if (fabs(enc-start_enc)>movement_threshold[i])
+        if (stop_on_movement && fabs(enc-start_enc)>movement_threshold[i])
         {
             ipwm->setRefDutyCycle((int)jointsList[i], 0.0);
-            not_moving=false;
-            if (positive_sign) {current_test.pos_opl=opl; current_test.pos_test_passed=true;}
-            else               {current_test.neg_opl=opl; current_test.neg_test_passed=true;}
-            dataToPlotList.push_back(dataToPlot);
-            sprintf(buff,"Test success (output=%f)",opl);ROBOTTESTINGFRAMEWORK_TEST_REPORT(buff);
+            return ramp_moved;
         }
-        else if (opl>=opl_max[i])
+        else if (fabs(opl)>=opl_max[i])
         {
             ipwm->setRefDutyCycle((int)jointsList[i], 0.0);
-            not_moving=false;
-            if (positive_sign) {current_test.pos_opl=opl; current_test.pos_test_passed=false;}
-            else               {current_test.neg_opl=opl; current_test.neg_test_passed=false;}
-            dataToPlotList.push_back(dataToPlot);
-            sprintf(buff,"Test failed failed because max output was reached(output=%f)",opl);ROBOTTESTINGFRAMEWORK_TEST_REPORT(buff);
+            return ramp_max_output;
         }
         else if (fabs(enc-max_lims[i]) < 1.0 ||
                  fabs(enc-min_lims[i]) < 1.0 )
         {
             ipwm->setRefDutyCycle((int)jointsList[i], 0.0);
-            not_moving=false;
-            if (positive_sign) {current_test.pos_opl=opl; current_test.pos_test_passed=false;}
-            else               {current_test.neg_opl=opl; current_test.neg_test_passed=false;}
-            dataToPlotList.push_back(dataToPlot);
-            sprintf(buff,"Test failed because hw limit was touched (enc=%f)",enc);ROBOTTESTINGFRAMEWORK_TEST_REPORT(buff);
+            return ramp_hw_limit;
         }
 
         if (yarp::os::Time::now()-last_opl_cmd>opl_delay[i])
         {
             if (positive_sign)
-            {opl+=opl_step[i];}
+            {opl+=step;}
             else
-            {opl-=opl_step[i];}
+            {opl-=step;}
             last_opl_cmd=yarp::os::Time::now();
         }
 
-        time = yarp::os::Time::now();
-        v1.addFloat64(time);
-        v2.addFloat64(enc);
-        v2.addFloat64(opl);
         yarp::os::Time::delay(0.010);
 
-        if (time-time_old>5.0 && not_moving==true)
+        if (time-time_old>5.0)
         {
             sprintf(buff,"test in progress on joint %d, current output value = %f",(int)jointsList[i],opl);ROBOTTESTINGFRAMEWORK_TEST_REPORT(buff);
             time_old=time;
@@ -312,74 +272,272 @@ void MotorStiction::OplExecute(int i, std::vector<yarp::os::Bottle>& dataToPlotL
     }
 }
 
-void MotorStiction::OplExecute2(int i, std::vector<yarp::os::Bottle>& dataToPlotList, stiction_data& current_test, bool positive_sign)
+bool MotorStiction::pulseOutput(int i, double opl, yarp::os::Bottle& dataToPlot, bool& hw_limit)
 {
-    char buff[500];
-    double time     = yarp::os::Time::now();
-    double time_old = yarp::os::Time::now();
     double enc=0;
     double start_enc=0;
-    ienc->getEncoder((int)jointsList[i],&enc);
+
+    //let the joint stop before the pulse
+    ipwm->setRefDutyCycle((int)jointsList[i], 0.0);
+    yarp::os::Time::delay(0.2);
     ienc->getEncoder((int)jointsList[i],&start_enc);
-    bool not_moving = true;
-    double opl=0;
-    setMode(VOCAB_CM_PWM,VOCAB_IM_STIFF);
-    ipwm->setRefDutyCycle((int)jointsList[i], opl);
-    double last_opl_cmd=yarp::os::Time::now();
-    Bottle dataToPlot;
 
-    while (not_moving)
+    bool moved = false;
+    hw_limit = false;
+    double start_time = yarp::os::Time::now();
+    while (yarp::os::Time::now()-start_time < opl_delay[i])
     {
+        ipwm->setRefDutyCycle((int)jointsList[i], opl);
+        ienc->getEncoder((int)jointsList[i],&enc);
+
         Bottle& row = dataToPlot.addList();
-        Bottle& v1 = row.addList();
+        row.addList().addFloat64(yarp::os::Time::now());
         Bottle& v2 = row.addList();
+        v2.addFloat64(enc);
+        v2.addFloat64(opl);
 
-        ipwm->setRefDutyCycle((int)jointsList[i], opl);
-        ienc->getEncoder((int)jointsList[i],&enc);
+        if (fabs(enc-max_lims[i]) < 1.0 || fabs(enc-min_lims[i]) < 1.0) {hw_limit = true; break;}
+        if (fabs(enc-start_enc)>movement_threshold[i]) {moved = true; break;}
+        yarp::os::Time::delay(0.010);
+    }
+    ipwm->setRefDutyCycle((int)jointsList[i], 0.0);
+    return moved;
+}
 
-        //sprintf(buff,"%f %f %f %f",enc,start_enc,fabs(enc-start_enc),movement_threshold[i]);ROBOTTESTINGFRAMEWORK_TEST_REPORT(buff);
+void MotorStiction::setResult(stiction_data& current_test, bool positive_sign, double opl, double opl_min, bool passed)
+{
+    if (positive_sign) {current_test.pos_opl=opl; current_test.pos_opl_min=opl_min; current_test.pos_test_passed=passed;}
+    else               {current_test.neg_opl=opl; current_test.neg_opl_min=opl_min; current_test.neg_test_passed=passed;}
+}
+
+void MotorStiction::OplExecute(int i, std::vector<yarp::os::Bottle>& dataToPlotList, stiction_data& current_test, bool positive_sign, success_t success)
+{
+    char buff[500];
+    Bottle dataToPlot;
+    double opl=0;
+    ramp_result_t result = rampOutput(i, opl_step[i], positive_sign, success==success_on_movement, dataToPlot, opl);
+    dataToPlotList.push_back(dataToPlot);
+
+    //the output was increased at most opl_delay before the detection: the previous step did not move the joint
+    double sign = positive_sign ? 1.0 : -1.0;
+    double opl_min = opl - sign*opl_step[i];
+    if (sign*opl_min < 0) opl_min = 0;
+
+    if (result==ramp_max_output)
+    {
+        setResult(current_test, positive_sign, opl, opl_min, false);
+        sprintf(buff,"Test failed failed because max output was reached(output=%f)",opl);ROBOTTESTINGFRAMEWORK_TEST_REPORT(buff);
+    }
+    else if (result==ramp_hw_limit && success==success_on_movement)
+    {
+        setResult(current_test, positive_sign, opl, opl_min, false);
+        sprintf(buff,"Test failed because hw limit was touched (output=%f)",opl);ROBOTTESTINGFRAMEWORK_TEST_REPORT(buff);
+    }
+    else
+    {
+        setResult(current_test, positive_sign, opl, opl_min, true);
+        sprintf(buff,"Test success (output=%f)",opl);ROBOTTESTINGFRAMEWORK_TEST_REPORT(buff);
+    }
+}
+
+void MotorStiction::OplExecuteAdaptive(int i, std::vector<yarp::os::Bottle>& dataToPlotList, stiction_data& current_test, bool positive_sign)
+{
+    char buff[500];
+    Bottle dataToPlot;
+    double sign = positive_sign ? 1.0 : -1.0;
+    double coarse_step = opl_step[i]*coarse_factor;
 
-        if (opl>=opl_max[i])
+    //coarse ramp: the breakaway output is between the last two steps
+    double opl=0;
+    ramp_result_t result = rampOutput(i, coarse_step, positive_sign, true, dataToPlot, opl);
+    if (result!=ramp_moved)
+    {
+        dataToPlotList.push_back(dataToPlot);
+        setResult(current_test, positive_sign, opl, opl, false);
+        sprintf(buff,"Test failed because %s (output=%f)", result==ramp_max_output ? "max output was reached" : "hw limit was touched", opl);ROBOTTESTINGFRAMEWORK_TEST_REPORT(buff);
+        return;
+    }
+    double hi = fabs(opl);
+    double lo = std::max(0.0, hi-coarse_step);
+
+    //bisection with short pulses from rest, down to the resolution of the fine ramp
+    int pulses = 0;
+    while (hi-lo > opl_step[i])
+    {
+        //the pulses move the joint away from home: go back before touching the limits
+        double enc=0;
+        ienc->getEncoder((int)jointsList[i],&enc);
+        if (fabs(enc-home[i]) > 3*movement_threshold[i])
         {
+            setMode(VOCAB_CM_POSITION, VOCAB_IM_STIFF);
+            goHome();
+            setModeSingle(i, VOCAB_CM_PWM, VOCAB_IM_STIFF);
             ipwm->setRefDutyCycle((int)jointsList[i], 0.0);
-            not_moving=false;
-            if (positive_sign) {current_test.pos_opl=opl; current_test.pos_test_passed=false;}
-            else               {current_test.neg_opl=opl; current_test.neg_test_passed=false;}
-            dataToPlotList.push_back(dataToPlot);
-            sprintf(buff,"Test failed failed because max output was reached(output=%f)",opl);ROBOTTESTINGFRAMEWORK_TEST_REPORT(buff);
         }
-        else if (fabs(enc-max_lims[i]) < 1.0 ||
-                 fabs(enc-min_lims[i]) < 1.0 )
+
+        double mid = 0.5*(lo+hi);
+        bool hw_limit = false;
+        bool moved = pulseOutput(i, sign*mid, dataToPlot, hw_limit);
+        pulses++;
+        if (hw_limit)
         {
-            ipwm->setRefDutyCycle((int)jointsList[i], 0.0);
-            not_moving=false;
-            if (positive_sign) {current_test.pos_opl=opl; current_test.pos_test_passed=true;}
-            else               {current_test.neg_opl=opl; current_test.neg_test_passed=true;}
             dataToPlotList.push_back(dataToPlot);
-            sprintf(buff,"Test success (output=%f)",opl);ROBOTTESTINGFRAMEWORK_TEST_REPORT(buff);
+            setResult(current_test, positive_sign, sign*hi, sign*lo, false);
+            sprintf(buff,"Test failed because hw limit was touched (output=%f)",sign*mid);ROBOTTESTINGFRAMEWORK_TEST_REPORT(buff);
+            return;
         }
+        if (moved) hi = mid;
+        else       lo = mid;
+    }
 
-        if (yarp::os::Time::now()-last_opl_cmd>opl_delay[i])
+    dataToPlotList.push_back(dataToPlot);
+    setResult(current_test, positive_sign, sign*hi, sign*lo, true);
+    sprintf(buff,"Test success (output=%f, breakaway in [%f %f] after %d pulses)",sign*hi,sign*lo,sign*hi,pulses);ROBOTTESTINGFRAMEWORK_TEST_REPORT(buff);
+}
+
+std::vector<stiction_statistics> MotorStiction::computeStatistics()
+{
+    std::vector<stiction_statistics> stats;
+    for (unsigned int i=0; i<jointsList.size(); i++)
+    {
+        stiction_statistics s;
+        s.jnt=(int)jointsList[i];
+        double pos_sum=0, neg_sum=0;
+        for (unsigned int k=0; k<stiction_data_list.size(); k++)
         {
-            if (positive_sign)
-            {opl+=opl_step[i];}
-            else
-            {opl-=opl_step[i];}
-            last_opl_cmd=yarp::os::Time::now();
+            const stiction_data& d = stiction_data_list[k];
+            if (d.jnt!=s.jnt) continue;
+            if (d.pos_test_passed) {pos_sum+=d.pos_opl; s.pos_samples++;}
+            if (d.neg_test_passed) {neg_sum+=d.neg_opl; s.neg_samples++;}
         }
+        if (s.pos_samples>0) s.pos_mean = pos_sum/s.pos_samples;
+        if (s.neg_samples>0) s.neg_mean = neg_sum/s.neg_samples;
 
-        time = yarp::os::Time::now();
-        v1.addFloat64(time);
-        v2.addFloat64(enc);
-        v2.addFloat64(opl);
-        yarp::os::Time::delay(0.010);
+        //sample standard deviation, 0 with a single sample
+        double pos_sq=0, neg_sq=0;
+        for (unsigned int k=0; k<stiction_data_list.size(); k++)
+        {
+            const stiction_data& d = stiction_data_list[k];
+            if (d.jnt!=s.jnt) continue;
+            if (d.pos_test_passed) pos_sq+=(d.pos_opl-s.pos_mean)*(d.pos_opl-s.pos_mean);
+            if (d.neg_test_passed) neg_sq+=(d.neg_opl-s.neg_mean)*(d.neg_opl-s.neg_mean);
+        }
+        if (s.pos_samples>1) s.pos_std = sqrt(pos_sq/(s.pos_samples-1));
+        if (s.neg_samples>1) s.neg_std = sqrt(neg_sq/(s.neg_samples-1));
+        double avg = 0.5*(fabs(s.pos_mean)+fabs(s.neg_mean));
+        if (s.pos_samples>0 && s.neg_samples>0 && avg>0)
+        {
+            s.asymmetry = (fabs(s.pos_mean)-fabs(s.neg_mean))/avg;
+        }
+        stats.push_back(s);
+    }
+    return stats;
+}
+
+void MotorStiction::checkStatistics(const std::vector<stiction_statistics>& stats)
+{
+    char buff[500];
+    for (unsigned int i=0; i<stats.size(); i++)
+    {
+        const stiction_statistics& s = stats[i];
+        sprintf(buff,"Joint %d: positive breakaway %f +/- %f (%d samples), negative breakaway %f +/- %f (%d samples), asymmetry %.1f%%",
+                s.jnt, s.pos_mean, s.pos_std, s.pos_samples, s.neg_mean, s.neg_std, s.neg_samples, s.asymmetry*100);
+        ROBOTTESTINGFRAMEWORK_TEST_REPORT(buff);
 
-        if (time-time_old>5.0 && not_moving==true)
+        if (max_asymmetry>0 && s.pos_samples>0 && s.neg_samples>0)
         {
-            sprintf(buff,"test in progress on joint %d, current output value = %f",(int)jointsList[i],opl);ROBOTTESTINGFRAMEWORK_TEST_REPORT(buff);
-            time_old=time;
+            sprintf(buff,"Joint %d: asymmetry %.1f%% within %.1f%%",s.jnt,s.asymmetry*100,max_asymmetry*100);
+            ROBOTTESTINGFRAMEWORK_TEST_CHECK(fabs(s.asymmetry)<=max_asymmetry, buff);
+        }
+        if (max_spread>0 && s.pos_samples>1)
+        {
+            sprintf(buff,"Joint %d: spread of the positive breakaway %f within %.1f%% of the mean",s.jnt,s.pos_std,max_spread*100);
+            ROBOTTESTINGFRAMEWORK_TEST_CHECK(s.pos_std<=max_spread*fabs(s.pos_mean), buff);
+        }
+        if (max_spread>0 && s.neg_samples>1)
+        {
+            sprintf(buff,"Joint %d: spread of the negative breakaway %f within %.1f%% of the mean",s.jnt,s.neg_std,max_spread*100);
+            ROBOTTESTINGFRAMEWORK_TEST_CHECK(s.neg_std<=max_spread*fabs(s.neg_mean), buff);
+        }
+    }
+}
+
+void MotorStiction::checkHistory(const std::vector<stiction_statistics>& stats)
+{
+    //each line: time robot part joint method pos_mean pos_std neg_mean neg_std
+    //only the runs with the same method (ramp or adaptive) are compared
+    std::string current_method = adaptive ? "adaptive" : "ramp";
+    std::ifstream fs(history_file.c_str());
+    if (!fs.is_open())
+    {
+        ROBOTTESTINGFRAMEWORK_TEST_REPORT("No stiction history found, this run will be the baseline");
+        return;
+    }
+
+    std::vector<double> pos_sum(stats.size(),0), neg_sum(stats.size(),0);
+    std::vector<int> runs(stats.size(),0);
+    std::string line;
+    while (std::getline(fs,line))
+    {
+        std::istringstream ss(line);
+        double time, pos_mean, pos_std, neg_mean, neg_std;
+        std::string robot, part, method;
+        int jnt;
+        if (!(ss >> time >> robot >> part >> jnt >> method >> pos_mean >> pos_std >> neg_mean >> neg_std)) continue;
+        if (robot!=robotName || part!=partName || method!=current_method) continue;
+        for (unsigned int i=0; i<stats.size(); i++)
+        {
+            if (stats[i].jnt!=jnt) continue;
+            pos_sum[i]+=fabs(pos_mean);
+            neg_sum[i]+=fabs(neg_mean);
+            runs[i]++;
+        }
+    }
+
+    char buff[500];
+    for (unsigned int i=0; i<stats.size(); i++)
+    {
+        const stiction_statistics& s = stats[i];
+        if (runs[i]==0)
+        {
+            sprintf(buff,"Joint %d: no stiction history, this run will be the baseline",s.jnt);ROBOTTESTINGFRAMEWORK_TEST_REPORT(buff);
+            continue;
         }
+        double pos_baseline = pos_sum[i]/runs[i];
+        double neg_baseline = neg_sum[i]/runs[i];
+        double pos_change = pos_baseline>0 ? fabs(s.pos_mean)/pos_baseline-1 : 0;
+        double neg_change = neg_baseline>0 ? fabs(s.neg_mean)/neg_baseline-1 : 0;
+        sprintf(buff,"Joint %d: breakaway change with respect to the baseline of %d runs: positive %+.1f%%, negative %+.1f%%",
+                s.jnt, runs[i], pos_change*100, neg_change*100);
+        ROBOTTESTINGFRAMEWORK_TEST_REPORT(buff);
+        if ((s.pos_samples>0 && pos_change>trend_threshold) ||
+            (s.neg_samples>0 && neg_change>trend_threshold))
+        {
+            sprintf(buff,"WARNING: joint %d stiction is growing (more than %.1f%% above the baseline), check the transmission",s.jnt,trend_threshold*100);
+            ROBOTTESTINGFRAMEWORK_TEST_REPORT(buff);
+        }
+    }
+}
+
+void MotorStiction::saveHistory(const std::vector<stiction_statistics>& stats)
+{
+    std::fstream fs;
+    fs.open (history_file.c_str(), std::fstream::out | std::fstream::app);
+    if (!fs.is_open())
+    {
+        ROBOTTESTINGFRAMEWORK_TEST_REPORT("Unable to open the stiction history file "+history_file);
+        return;
+    }
+    char line[500];
+    double now = yarp::os::Time::now();
+    for (unsigned int i=0; i<stats.size(); i++)
+    {
+        const stiction_statistics& s = stats[i];
+        if (s.pos_samples==0 || s.neg_samples==0) continue;
+        sprintf(line,"%.0f %s %s %d %s %f %f %f %f",now,robotName.c_str(),partName.c_str(),s.jnt,adaptive ? "adaptive" : "ramp",s.pos_mean,s.pos_std,s.neg_mean,s.neg_std);
+        fs << line << std::endl;
     }
+    fs.close();
 }
 
 void MotorStiction::run()
@@ -394,6 +552,7 @@ void MotorStiction::run()
 
     for (unsigned int i=0 ; i<jointsList.size(); i++)
     {
+        double joint_start_time = yarp::os::Time::now();
         for (int repeat_count=0; repeat_count<repeat; repeat_count++)
         {
             stiction_data current_test;
@@ -404,7 +563,8 @@ void MotorStiction::run()
             ipwm->setRefDutyCycle((int)jointsList[i], 0.0);
 
             sprintf(buff,"Testing joint %d, cycle %d, positive output",(int)jointsList[i],repeat_count);ROBOTTESTINGFRAMEWORK_TEST_REPORT(buff);
-            OplExecute(i,dataToPlotList,current_test, true);
+            if (adaptive) OplExecuteAdaptive(i,dataToPlotList,current_test, true);
+            else          OplExecute(i,dataToPlotList,current_test, true);
 
             setMode(VOCAB_CM_POSITION,VOCAB_IM_STIFF);
             goHome();
@@ -413,7 +573,8 @@ void MotorStiction::run()
             ipwm->setRefDutyCycle((int)jointsList[i], 0.0);
 
             sprintf(buff,"Testing joint %d, cycle %d, negative output",(int)jointsList[i],repeat_count);ROBOTTESTINGFRAMEWORK_TEST_REPORT(buff);
-            OplExecute(i,dataToPlotList,current_test, false);
+            if (adaptive) OplExecuteAdaptive(i,dataToPlotList,current_test, false);
+            else          OplExecute(i,dataToPlotList,current_test, false);
 
             setMode(VOCAB_CM_POSITION,VOCAB_IM_STIFF);
             goHome();
@@ -427,6 +588,7 @@ void MotorStiction::run()
             sprintf (filename, "plot_stiction_%s_j%d_p_c%d.txt",partName.c_str(),(int)jointsList[i],repeat_count);
             saveToFile(filename,dataToPlotList.rbegin()[1]); //second last element
         }
+        sprintf(buff,"Joint %d characterized in %.1f s",(int)jointsList[i],yarp::os::Time::now()-joint_start_time);ROBOTTESTINGFRAMEWORK_TEST_REPORT(buff);
     }
 
     goHome();
@@ -441,6 +603,14 @@ void MotorStiction::run()
         //system (plotstring);
     }
 
+    std::vector<stiction_statistics> stats = computeStatistics();
+    checkStatistics(stats);
+    if (!history_file.empty())
+    {
+        checkHistory(stats);
+        saveHistory(stats);
+    }
+
     //stiction_data_list.size() include tests for all joints, multiple cycles
     for (unsigned int i=0; i <stiction_data_list.size(); i++)
     {
@@ -29,6 +29,7 @@
 #include <yarp/sig/Vector.h>
 #include <yarp/os/Bottle.h>
 #include <yarp/sig/Matrix.h>
+#include "ControlModeSwitcher.h"
 
 class stiction_data
 {
@@ -39,11 +40,63 @@ class stiction_data
     bool   neg_test_passed;
     double pos_opl;
     double neg_opl;
+    double pos_opl_min; //the breakaway output is between pos_opl_min and pos_opl
+    double neg_opl_min;
 
     public:
-    stiction_data() {jnt=0; cycle=0; pos_test_passed=false; neg_test_passed=false; pos_opl=0; neg_opl=0;}
+    stiction_data() {jnt=0; cycle=0; pos_test_passed=false; neg_test_passed=false; pos_opl=0; neg_opl=0; pos_opl_min=0; neg_opl_min=0;}
 };
 
+class stiction_statistics
+{
+    public:
+    int    jnt;
+    int    pos_samples;
+    int    neg_samples;
+    double pos_mean;
+    double pos_std;
+    double neg_mean;
+    double neg_std;
+    double asymmetry; //(|pos|-|neg|)/mean(|pos|,|neg|)
+
+    public:
+    stiction_statistics() {jnt=0; pos_samples=0; neg_samples=0; pos_mean=0; pos_std=0; neg_mean=0; neg_std=0; asymmetry=0;}
+};
+
+/**
+* \ingroup icub-tests
+* This test measures the breakaway output (pwm duty cycle) of the motors, in both directions.
+* The joint is put in pwm mode and the output is ramped up by outputStep every outputDelay seconds, until the joint moves more than threshold degrees.
+* The test fails if outputMax is reached or a hardware limit is touched before the joint moves.
+* With the adaptive option, the ramp uses a coarseFactor times larger step to bracket the breakaway output, which is then refined
+* by bisection with pulses of outputDelay seconds starting from rest, down to the resolution outputStep. The breakaway output
+* is reported with the interval which contains it.
+* At the end, the mean, the standard deviation and the asymmetry between the positive and negative breakaway output are computed per joint,
+* over the successful repeats. If historyFile is given, the statistics are appended to it and compared with the previous runs of the same
+* robot part made with the same method, ramp or adaptive (the baseline): an increase of the breakaway output larger than trendThreshold raises a warning.
+*
+* example: testRunner -v -t MotorStiction.dll -p "--robot icub --part left_arm --joints ""(4)"" --home ""(45)"" --outputStep ""(0.5)"" --outputMax ""(50)"" --outputDelay ""(2.0)"" --threshold ""(5.0)"" --repeat 1"
+*
+*  Accepts the following parameters:
+* | Parameter name     | Type   | Units | Default Value | Required | Description | Notes |
+* |:------------------:|:------:|:-----:|:-------------:|:--------:|:-----------:|:-----:|
+* | robot              | string | -     | -     | Yes | The name of the robot.     | e.g. icub |
+* | part               | string | -     | -     | Yes | The name of the robot part. | e.g. left_arm |
+* | joints             | vector of ints | - | - | Yes | List of joints to be tested | |
+* | home               | vector of doubles | deg | - | Yes | The home position of each joint | |
+* | outputStep         | vector of doubles | % | - | Yes | The increment of the output of each joint | |
+* | outputDelay        | vector of doubles | s | - | Yes | The time between two increments (the pulse duration in adaptive mode) | |
+* | outputMax          | vector of doubles | % | - | Yes | The max output of each joint | |
+* | threshold          | vector of doubles | deg | - | Yes | The movement which detects the breakaway | |
+* | repeat             | int    | -     | -     | Yes | The number of times each joint is tested | |
+* | adaptive           | bool   | -     | false | No  | If true, the coarse ramp and bisection search is used | |
+* | coarseFactor       | double | -     | 5.0   | No  | Adaptive mode: the ratio between the coarse ramp step and outputStep | |
+* | maxAsymmetry       | double | -     | 0     | No  | The max relative difference between the positive and negative breakaway output | 0 means not checked |
+* | maxSpread          | double | -     | 0     | No  | The max ratio between the standard deviation and the mean of the breakaway output | 0 means not checked |
+* | historyFile        | string | -     | ""    | No  | The file which stores the statistics of the previous runs | empty means no history |
+* | trendThreshold     | double | -     | 0.2   | No  | The relative increase with respect to the baseline which raises a warning | |
+*
+*/
 class MotorStiction : public yarp::robottestingframework::TestCase
 {
 public:
@@ -62,16 +115,43 @@ public:
     void verifyMode(int desired_control_mode, yarp::dev::InteractionModeEnum desired_interaction_mode, std::string title);
     void saveToFile(std::string filename, yarp::os::Bottle &b);
 
-    //ok if the joints moves of 5 degrees
-    void OplExecute(int i, std::vector<yarp::os::Bottle>& dataToPlotList, stiction_data& current_test, bool positive_sign);
+    enum success_t
+    {
+        success_on_movement = 0, //ok if the joint moves more than the threshold
+        success_on_hw_limit = 1  //ok if the joint reaches the hardware limit
+    };
+
+    enum ramp_result_t
+    {
+        ramp_moved,
+        ramp_max_output,
+        ramp_hw_limit
+    };
 
-    //ok if the joint reaches the hardware limit
-    void OplExecute2(int i, std::vector<yarp::os::Bottle>& dataToPlotList, stiction_data& current_test, bool positive_sign);
+    //ramps the output by opl_step every opl_delay
+    void OplExecute(int i, std::vector<yarp::os::Bottle>& dataToPlotList, stiction_data& current_test, bool positive_sign, success_t success = success_on_movement);
+
+    //coarse ramp, then bisection with short pulses
+    void OplExecuteAdaptive(int i, std::vector<yarp::os::Bottle>& dataToPlotList, stiction_data& current_test, bool positive_sign);
 
 private:
+    ramp_result_t rampOutput(int i, double step, bool positive_sign, bool stop_on_movement, yarp::os::Bottle& dataToPlot, double& opl);
+    bool pulseOutput(int i, double opl, yarp::os::Bottle& dataToPlot, bool& hw_limit);
+    void setResult(stiction_data& current_test, bool positive_sign, double opl, double opl_min, bool passed);
+    std::vector<stiction_statistics> computeStatistics();
+    void checkStatistics(const std::vector<stiction_statistics>& stats);
+    void checkHistory(const std::vector<stiction_statistics>& stats);
+    void saveHistory(const std::vector<stiction_statistics>& stats);
+
     std::string robotName;
     std::string partName;
     int repeat;
+    bool adaptive;
+    double coarse_factor;
+    double max_asymmetry;
+    double max_spread;
+    std::string history_file;
+    double trend_threshold;
     std::vector<stiction_data> stiction_data_list;
     yarp::sig::Vector jointsList;
     yarp::sig::Vector home;
@@ -89,6 +169,7 @@ private:
     yarp::dev::IAmplifierControl *iamp;
     yarp::dev::IControlMode     *icmd;
     yarp::dev::IInteractionMode  *iimd;
+    ControlModeSwitcher           modeSwitcher;
     yarp::dev::IEncoders         *ienc;
     yarp::dev::IPWMControl       *ipwm;
     yarp::dev::IControlLimits    *ilim;
@@ -53,6 +53,9 @@ bool MotorTest::setup(yarp::os::Property &configuration) {
     iEncoders=NULL;
     iPosition=NULL;
     m_initialized=false;
+    m_pollPeriod=0.01;
+    m_settleWindow=0.2;
+    m_motionDoneTimeout=1.0;
 
     if(configuration.check("name"))
         setName(configuration.find("name").asString());
@@ -116,6 +119,14 @@ bool MotorTest::setup(yarp::os::Property &configuration) {
     for (int i=0; i<n; ++i)
         m_aTimeout[i]=bot.get(i).asFloat64();
 
+    if(configuration.check("pollPeriod"))
+      {m_pollPeriod = configuration.find("pollPeriod").asFloat64();}
+    if(configuration.check("settleWindow"))
+      {m_settleWindow = configuration.find("settleWindow").asFloat64();}
+    if(configuration.check("motionDoneTimeout"))
+      {m_motionDoneTimeout = configuration.find("motionDoneTimeout").asFloat64();}
+    ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(m_pollPeriod>0, "invalid pollPeriod");
+
     // opening interfaces
     yarp::os::Property options;
     options.put("device","remote_controlboard");
@@ -156,6 +167,90 @@ void MotorTest::tearDown() {
     if (m_aHome)      delete [] m_aHome;
 }
 
+MotorTest::MotionResult MotorTest::waitMotion(const std::vector<int>& joints, const double *targets, double timeStart, double timeout, bool groupCall)
+{
+    size_t n = joints.size();
+    MotionResult result;
+    result.reached = false;
+    result.motionDone = false;
+    result.motionDoneLatency = -1;
+    result.reachTime.assign(n, -1);
+    result.settleTime.assign(n, -1);
+
+    std::vector<double> encoders(m_NumJoints);
+    double allInTime = 0;
+    double doneTime = 0;
+    while (1) {
+        double t = yarp::os::Time::now() - timeStart;
+        bool read = iEncoders->getEncoders(encoders.data());
+        ROBOTTESTINGFRAMEWORK_TEST_FAIL_IF_FALSE(read, "getEncoders()");
+
+        bool allIn = read;
+        for (size_t k = 0; read && k < n; k++) {
+            int j = joints[k];
+            if (yarp::robottestingframework::TestAsserter::isApproxEqual(encoders[j], targets[j], m_aMinErr[j], m_aMaxErr[j])) {
+                if (result.reachTime[k] < 0)  result.reachTime[k] = t;
+                if (result.settleTime[k] < 0) result.settleTime[k] = t;
+            }
+            else {
+                result.settleTime[k] = -1;
+                allIn = false;
+            }
+        }
+
+        if (allIn && !result.reached) {
+            result.reached = true;
+            allInTime = t;
+        }
+
+        // the robot could still be moving when all the joints are in the band,
+        // so checkMotionDone is polled until it returns true
+        if (result.reached && !result.motionDone) {
+            bool done = false;
+            bool ret = false;
+            if (groupCall)
+                ret = iPosition->checkMotionDone((int)n, joints.data(), &done);
+            else if (n == 1)
+                ret = iPosition->checkMotionDone(joints[0], &done);
+            else
+                ret = iPosition->checkMotionDone(&done);
+
+            double now = yarp::os::Time::now() - timeStart;
+            if (ret && done) {
+                result.motionDone = true;
+                result.motionDoneLatency = now - allInTime;
+                doneTime = now;
+            }
+            else if (now - allInTime > m_motionDoneTimeout) {
+                break;
+            }
+        }
+
+        if (result.motionDone && allIn && t - doneTime >= m_settleWindow)
+            break;
+        // once the joints are in the band, checkMotionDone and the settling are given their own time,
+        // regardless of the movement timeout
+        if (!result.reached && t > timeout)
+            break;
+        if (result.reached && t > allInTime + m_motionDoneTimeout + m_settleWindow)
+            break;
+        yarp::os::Time::delay(m_pollPeriod);
+    }
+    return result;
+}
+
+void MotorTest::reportMotion(const std::vector<int>& joints, const MotionResult& result)
+{
+    for (size_t k = 0; k < joints.size(); k++) {
+        ROBOTTESTINGFRAMEWORK_TEST_REPORT(Asserter::format("joint %d: time to target %.3lf s, settle time %.3lf s",
+                                          joints[k], result.reachTime[k], result.settleTime[k]));
+    }
+    if (result.motionDone)
+        ROBOTTESTINGFRAMEWORK_TEST_REPORT(Asserter::format("checkMotionDone latency %.1lf ms", result.motionDoneLatency*1000.0));
+    else
+        ROBOTTESTINGFRAMEWORK_TEST_REPORT("checkMotionDone did not return true");
+}
+
 void MotorTest::run() {
 
     int nJoints=0;
@@ -186,10 +281,13 @@ void MotorTest::run() {
         while(timeNow<timeStart+m_aTimeout[joint] && !read) {
             // read encoders
             read=iEncoders->getEncoder(joint,m_aHome+joint);
-            yarp::os::Time::delay(0.1);
+            timeNow=yarp::os::Time::now();
+            if (!read)
+                yarp::os::Time::delay(m_pollPeriod);
         }
         ROBOTTESTINGFRAMEWORK_TEST_FAIL_IF_FALSE(read, "getEncoder() returned true");
 
+        timeStart=yarp::os::Time::now();
         ROBOTTESTINGFRAMEWORK_TEST_FAIL_IF_FALSE(iPosition->positionMove(joint, m_aTargetVal[joint]),
             Asserter::format("moving joint %d to %.2lf", joint, m_aTargetVal[joint]));
 
@@ -198,19 +296,17 @@ void MotorTest::run() {
         ROBOTTESTINGFRAMEWORK_TEST_FAIL_IF_FALSE(!doneAll&&ret, "checking checkMotionDone returns false after position move");
 
         ROBOTTESTINGFRAMEWORK_TEST_REPORT(Asserter::format("Waiting timeout %.2lf", m_aTimeout[joint]));
-        bool reached=false;
-        while(timeNow<timeStart+m_aTimeout[joint] && !reached) {
-            double pos;
-            iEncoders->getEncoder(joint,&pos);
-            reached = yarp::robottestingframework::TestAsserter::isApproxEqual(pos, m_aTargetVal[joint], m_aMinErr[joint], m_aMaxErr[joint]);
-            timeNow=yarp::os::Time::now();
-            yarp::os::Time::delay(0.1);
-        }
-        ROBOTTESTINGFRAMEWORK_TEST_FAIL_IF_FALSE(reached, "reached position");
+        MotionResult result = waitMotion(std::vector<int>(1, joint), m_aTargetVal, timeStart, m_aTimeout[joint], false);
+        reportMotion(std::vector<int>(1, joint), result);
+        ROBOTTESTINGFRAMEWORK_TEST_FAIL_IF_FALSE(result.reached, "reached position");
     }
 
     //////// check multiple joints
     ROBOTTESTINGFRAMEWORK_TEST_REPORT("Checking multiple joints...");
+    std::vector<int> allJoints(m_NumJoints);
+    for (int j=0; j<m_NumJoints; j++)
+        allJoints[j]=j;
+
     if (m_aRefAcc!=NULL) {
         ROBOTTESTINGFRAMEWORK_TEST_FAIL_IF_FALSE(iPosition->setRefAccelerations(m_aRefAcc),
                 "setting reference acceleration on all joints");
@@ -218,6 +314,7 @@ void MotorTest::run() {
     ROBOTTESTINGFRAMEWORK_TEST_FAIL_IF_FALSE(iPosition->setRefSpeeds(m_aRefVel),
             "setting reference speed on all joints");
 
+    double timeStart=yarp::os::Time::now();
     ROBOTTESTINGFRAMEWORK_TEST_FAIL_IF_FALSE(iPosition->positionMove(m_aHome),
             "moving all joints to home");
 
@@ -226,10 +323,6 @@ void MotorTest::run() {
     ret=iPosition->checkMotionDone(&doneAll);
     ROBOTTESTINGFRAMEWORK_TEST_FAIL_IF_FALSE(!doneAll&&ret, "checking checkMotionDone returns false after position move");
 
-    // wait some time
-    double timeStart=yarp::os::Time::now();
-    double timeNow=timeStart;
-
     double timeout=m_aTimeout[0];
     for(int j=0; j<m_NumJoints; j++)
     {
@@ -238,44 +331,18 @@ void MotorTest::run() {
     }
 
     ROBOTTESTINGFRAMEWORK_TEST_REPORT(Asserter::format("Waiting timeout %.2lf", timeout));
-    bool reached=false;
-    double *encoders;
-    encoders=new double [m_NumJoints];
-    while(timeNow<timeStart+timeout && !reached) {
-            ROBOTTESTINGFRAMEWORK_TEST_FAIL_IF_FALSE(iEncoders->getEncoders(encoders), "getEncoders()");
-            reached = yarp::robottestingframework::TestAsserter::isApproxEqual(encoders, m_aHome, m_aMinErr, m_aMaxErr, m_NumJoints);
-            timeNow=yarp::os::Time::now();
-            yarp::os::Time::delay(0.1);
-    }
-
-    ROBOTTESTINGFRAMEWORK_TEST_FAIL_IF_FALSE(reached, "reached position");
-
-    if(reached) {
-        // check checkMotionDone.
-        // because the previous movement was approximate, the robot
-        // could still be moving so we need to iterate a few times
-
-        int times=10;
-        bool doneAll=false;
-        bool ret=false;
-
-        while(times>0 && !doneAll) {
-            ret=iPosition->checkMotionDone(&doneAll);
-            if (!doneAll)
-                yarp::os::Time::delay(0.1);
-            times--;
-        }
-
-        ROBOTTESTINGFRAMEWORK_TEST_FAIL_IF_FALSE(doneAll&&ret, "checking checkMotionDone returns true");
-    }
-
+    MotionResult result = waitMotion(allJoints, m_aHome, timeStart, timeout, false);
+    reportMotion(allJoints, result);
+    ROBOTTESTINGFRAMEWORK_TEST_FAIL_IF_FALSE(result.reached, "reached position");
+    if (result.reached)
+        ROBOTTESTINGFRAMEWORK_TEST_FAIL_IF_FALSE(result.motionDone, "checking checkMotionDone returns true");
 
     ROBOTTESTINGFRAMEWORK_TEST_REPORT("Now checking group interface");
 
     //shuffle encoders
-    int *jmap=new int [m_NumJoints];
-    double *swapped_refvel=new double [m_NumJoints];
-    double *swapped_target=new double [m_NumJoints];
+    std::vector<int> jmap(m_NumJoints);
+    std::vector<double> swapped_refvel(m_NumJoints);
+    std::vector<double> swapped_target(m_NumJoints);
 
     for(int kk=0;kk<m_NumJoints;kk++)
     {
@@ -284,51 +351,20 @@ void MotorTest::run() {
         jmap[kk]=m_NumJoints-kk-1;
     }
 
-    ROBOTTESTINGFRAMEWORK_TEST_FAIL_IF_FALSE(iPosition->setRefSpeeds(m_NumJoints, jmap, swapped_refvel),
+    ROBOTTESTINGFRAMEWORK_TEST_FAIL_IF_FALSE(iPosition->setRefSpeeds(m_NumJoints, jmap.data(), swapped_refvel.data()),
             "setting reference speed on all joints using group interface");
 
-    ROBOTTESTINGFRAMEWORK_TEST_FAIL_IF_FALSE(iPosition->positionMove(m_NumJoints, jmap, swapped_target),
+    timeStart=yarp::os::Time::now();
+    ROBOTTESTINGFRAMEWORK_TEST_FAIL_IF_FALSE(iPosition->positionMove(m_NumJoints, jmap.data(), swapped_target.data()),
             "moving all joints to home using group interface");
 
-    ret=iPosition->checkMotionDone(m_NumJoints, jmap, &doneAll);
+    ret=iPosition->checkMotionDone(m_NumJoints, jmap.data(), &doneAll);
     ROBOTTESTINGFRAMEWORK_TEST_FAIL_IF_FALSE(!doneAll&&ret, "checking checkMotionDone returns false after position move");
 
-    timeStart=yarp::os::Time::now();
-    timeNow=timeStart;
-
     ROBOTTESTINGFRAMEWORK_TEST_REPORT(Asserter::format("Waiting timeout %.2lf", timeout));
-    reached=false;
-    while(timeNow<timeStart+timeout && !reached) {
-            iEncoders->getEncoders(encoders);
-            reached = yarp::robottestingframework::TestAsserter::isApproxEqual(encoders, m_aTargetVal, m_aMinErr, m_aMaxErr, m_NumJoints);
-            timeNow=yarp::os::Time::now();
-            yarp::os::Time::delay(0.1);
-    }
-    ROBOTTESTINGFRAMEWORK_TEST_FAIL_IF_FALSE(reached, "reached position");
-
-    if (reached) {
-        bool *done_vector=new bool [m_NumJoints];
-        // check checkMotionDone.
-        // because the previous movement was approximate, the robot
-        // could still be moving so we need to iterate a few times
-        int times=10;
-        bool doneAll=false;
-        bool ret=false;
-
-        while(times>0 && !doneAll) {
-            ret=iPosition->checkMotionDone(m_NumJoints, jmap, &doneAll);
-            if (!doneAll)
-                yarp::os::Time::delay(0.1);
-            times--;
-        }
-
-        ROBOTTESTINGFRAMEWORK_TEST_FAIL_IF_FALSE(doneAll&&ret, "checking checkMotionDone");
-        delete [] done_vector;
-    }
-
-    //cleanup
-    delete [] jmap;
-    delete [] swapped_refvel;
-    delete [] swapped_target;
-    delete [] encoders;
+    result = waitMotion(jmap, m_aTargetVal, timeStart, timeout, true);
+    reportMotion(jmap, result);
+    ROBOTTESTINGFRAMEWORK_TEST_FAIL_IF_FALSE(result.reached, "reached position");
+    if (result.reached)
+        ROBOTTESTINGFRAMEWORK_TEST_FAIL_IF_FALSE(result.motionDone, "checking checkMotionDone");
 }
@@ -23,6 +23,7 @@
 
 #include <yarp/robottestingframework/TestCase.h>
 
+#include <vector>
 #include <yarp/os/Value.h>
 #include <yarp/sig/Vector.h>
 #include <yarp/os/Time.h>
@@ -42,6 +43,11 @@
 * \li IEncoders::getEncoder()
 * \li IEncoders::getEncoders()
 *
+* During each movement the encoders are sampled every pollPeriod seconds. For each joint the test reports the time to target
+* (when the joint first enters the min/max error band) and the settle time (when it enters the band for the last time).
+* Once all the joints are in the band, checkMotionDone() is polled as well and its latency, i.e. the time from "in tolerance"
+* until it returns true, is reported.
+*
 *  Accepts the following parameters:
 * | Parameter name | Type   | Units | Default Value | Required | Description | Notes |
 * |:--------------:|:------:|:-----:|:-------------:|:--------:|:-----------:|:-----:|
@@ -54,6 +60,9 @@
 * | refvel         | vector of doubles of size joints | deg/s | - | Yes | For each joint the reference velocity value to set in the low level trajectory generator. | |
 * | refacc         | vector of doubles of size joints | deg/s^2 | - | No | For each joint the reference acceleration value to set in the low level trajectory generator. | |
 * | timeout         | vector of doubles of size joints | s | - | Yes | For each joint the maximum time to wait for the joint to reach the target. | |
+* | pollPeriod     | double | s     | 0.01          | No       | The encoders sampling period during the movements. | |
+* | settleWindow   | double | s     | 0.2           | No       | The time all the joints must stay in the error band after checkMotionDone returns true. | |
+* | motionDoneTimeout | double | s  | 1.0           | No       | The max time checkMotionDone may take to return true after all the joints are in the error band. | |
 *
 */
 class MotorTest : public yarp::robottestingframework::TestCase {
@@ -68,6 +77,27 @@ public:
     virtual void run();
 
 private:
+    /** the outcome of a movement sampled by waitMotion() */
+    struct MotionResult
+    {
+        bool reached;                   //all the joints entered the error band before the timeout
+        bool motionDone;                //checkMotionDone returned true
+        double motionDoneLatency;       //time from all joints in the band until checkMotionDone returned true, -1 if never
+        std::vector<double> reachTime;  //per joint, time from the command to the first sample in the band, -1 if never
+        std::vector<double> settleTime; //per joint, time from the command to the last entry in the band, -1 if out of the band at the end
+    };
+
+    /**
+    * Samples the encoders until all the given joints are in the error band around their target (indexed by joint number),
+    * checkMotionDone returns true and the joints stay in the band for settleWindow seconds, or the timeout expires.
+    * The timeout only bounds the movement: once all the joints are in the band, the loop lasts at most
+    * motionDoneTimeout + settleWindow more seconds.
+    * With groupCall the group version of checkMotionDone() is used, otherwise the single joint (one joint)
+    * or the all joints version.
+    */
+    MotionResult waitMotion(const std::vector<int>& joints, const double *targets, double timeStart, double timeout, bool groupCall);
+    void reportMotion(const std::vector<int>& joints, const MotionResult& result);
+
     yarp::dev::PolyDriver m_driver;
     yarp::dev::IEncoders *iEncoders;
     yarp::dev::IPositionControl *iPosition;
@@ -81,6 +111,9 @@ private:
     double *m_aRefVel;
     double *m_aRefAcc;
     double *m_aTimeout;
+    double m_pollPeriod;
+    double m_settleWindow;
+    double m_motionDoneTimeout;
 };
 
 #endif //_MOTORTEST_H_
@@ -0,0 +1,224 @@
+/*
+ * iCub Robot Unit Tests (Robot Testing Framework)
+ *
+ * Copyright (C) 2015-2019 Istituto Italiano di Tecnologia (IIT)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _ENCODERSCOUPLINGKERNEL_H_
+#define _ENCODERSCOUPLINGKERNEL_H_
+
+#include <array>
+#include <cstddef>
+#include <yarp/sig/Vector.h>
+#include "CouplingMatrix.h"
+
+/**
+* Allocation-free joint/motor coupling kernel used by OpticalEncodersConsistency.
+* All the buffers have a fixed capacity of MaxJoints elements, so that the per-tick
+* update does not create any temporary yarp::sig::Vector.
+* The coupling matrix is block-diagonal: the products are computed block by block, skipping the zero blocks.
+* A single call to update() computes, for every joint:
+* \li the joint encoders/velocities mapped to the motor side (gearbox * matrix * jnt)
+* \li the motor encoders mapped to the joint side (inv_matrix * (mot - offset) / gearbox)
+* \li the numerical derivatives of positions and velocities
+* \li the offset-compensated values which are plotted by the test
+*/
+template <size_t MaxJoints>
+class EncodersCouplingKernel
+{
+public:
+    EncodersCouplingKernel() : n(0), first(true) {}
+
+    static constexpr size_t capacity() { return MaxJoints; }
+
+    size_t size() const { return n; }
+
+    /**
+    * Loads the coupling matrix (with its cached inverse and block structure) and the gearbox ratios.
+    * Returns false if the sizes are not consistent or exceed the kernel capacity.
+    */
+    bool configure(const CouplingMatrix& coupling, const yarp::sig::Vector& gearbox)
+    {
+        size_t sz = gearbox.size();
+        if (!coupling.isValid()) return false;
+        if (sz == 0 || sz > MaxJoints) return false;
+        if (coupling.size() != sz) return false;
+
+        const yarp::sig::Matrix& matrix = coupling.matrix();
+        const yarp::sig::Matrix& inv_matrix = coupling.inverse();
+        n = sz;
+        for (size_t r = 0; r < n; r++)
+        {
+            gear[r] = gearbox[r];
+            for (size_t c = 0; c < n; c++)
+            {
+                m[r*MaxJoints+c] = matrix(r,c);
+                minv[r*MaxJoints+c] = inv_matrix(r,c);
+            }
+        }
+
+        // for each row, the columns spanned by its diagonal block
+        const std::vector<CouplingMatrix::Block>& blocks = coupling.blocks();
+        for (size_t b = 0; b < blocks.size(); b++)
+        {
+            for (size_t r = blocks[b].offset; r < blocks[b].offset + blocks[b].size; r++)
+            {
+                blk_begin[r] = blocks[b].offset;
+                blk_end[r] = blocks[b].offset + blocks[b].size;
+            }
+        }
+        reset();
+        return true;
+    }
+
+    /**
+    * Forgets the offsets and the previous samples: the next call to update() is
+    * treated as the first one.
+    */
+    void reset()
+    {
+        first = true;
+        for (size_t i = 0; i < MaxJoints; i++)
+        {
+            off_enc_jnt[i] = 0; off_enc_mot[i] = 0; off_enc_jnt2mot[i] = 0;
+            prev_enc_jnt[i] = 0; prev_enc_mot[i] = 0; prev_enc_jnt2mot[i] = 0;
+            prev_vel_jnt[i] = 0; prev_vel_mot[i] = 0; prev_vel_jnt2mot[i] = 0;
+        }
+    }
+
+    /**
+    * Processes one sample. Input arrays must contain size() elements, dt is the
+    * time elapsed since the previous sample (used for the numerical derivatives).
+    * On the first sample the current joint encoders, motor encoders and joint-to-motor
+    * values are taken as offsets.
+    */
+    void update(const double* enc_jnt, const double* enc_mot,
+                const double* vel_jnt, const double* vel_mot,
+                double dt)
+    {
+        double inv_dt = (dt > 0) ? 1.0/dt : 0.0;
+
+        for (size_t r = 0; r < n; r++)
+        {
+            const double* mr = &m[r*MaxJoints];
+            const double* mir = &minv[r*MaxJoints];
+            double e_j2m = 0;
+            double v_j2m = 0;
+            double e_m2j = 0;
+            for (size_t c = blk_begin[r]; c < blk_end[r]; c++)
+            {
+                e_j2m += mr[c] * enc_jnt[c];
+                v_j2m += mr[c] * vel_jnt[c];
+                e_m2j += mir[c] * (enc_mot[c] - off_enc_mot[c]);
+            }
+            enc_jnt2mot[r] = e_j2m * gear[r];
+            vel_jnt2mot[r] = v_j2m * gear[r];
+            enc_mot2jnt[r] = e_m2j / gear[r];
+        }
+
+        for (size_t i = 0; i < n; i++)
+        {
+            if (first)
+            {
+                off_enc_jnt[i] = enc_jnt[i];
+            }
+
+            diff_enc_jnt[i]     = (enc_jnt[i]     - prev_enc_jnt[i])     * inv_dt;
+            diff_enc_mot[i]     = (enc_mot[i]     - prev_enc_mot[i])     * inv_dt;
+            diff_enc_jnt2mot[i] = (enc_jnt2mot[i] - prev_enc_jnt2mot[i]) * inv_dt;
+            diff_vel_jnt[i]     = (vel_jnt[i]     - prev_vel_jnt[i])     * inv_dt;
+            diff_vel_mot[i]     = (vel_mot[i]     - prev_vel_mot[i])     * inv_dt;
+            diff_vel_jnt2mot[i] = (vel_jnt2mot[i] - prev_vel_jnt2mot[i]) * inv_dt;
+
+            prev_enc_jnt[i]     = enc_jnt[i];
+            prev_enc_mot[i]     = enc_mot[i];
+            prev_enc_jnt2mot[i] = enc_jnt2mot[i];
+            prev_vel_jnt[i]     = vel_jnt[i];
+            prev_vel_mot[i]     = vel_mot[i];
+            prev_vel_jnt2mot[i] = vel_jnt2mot[i];
+
+            if (first)
+            {
+                off_enc_mot[i] = enc_mot[i];
+                off_enc_jnt2mot[i] = enc_jnt2mot[i];
+            }
+
+            rel_enc_mot[i]     = enc_mot[i] - off_enc_mot[i];
+            rel_enc_jnt2mot[i] = enc_jnt2mot[i] - off_enc_jnt2mot[i];
+            abs_enc_mot2jnt[i] = enc_mot2jnt[i] + off_enc_jnt[i];
+        }
+
+        first = false;
+    }
+
+    const double* encJnt2Mot() const     { return enc_jnt2mot.data(); }
+    const double* encMot2Jnt() const     { return enc_mot2jnt.data(); }
+    const double* velJnt2Mot() const     { return vel_jnt2mot.data(); }
+    const double* diffEncJnt() const     { return diff_enc_jnt.data(); }
+    const double* diffEncMot() const     { return diff_enc_mot.data(); }
+    const double* diffEncJnt2Mot() const { return diff_enc_jnt2mot.data(); }
+    const double* diffVelJnt() const     { return diff_vel_jnt.data(); }
+    const double* diffVelMot() const     { return diff_vel_mot.data(); }
+    const double* diffVelJnt2Mot() const { return diff_vel_jnt2mot.data(); }
+
+    /** motor encoders minus the motor offset */
+    const double* relEncMot() const      { return rel_enc_mot.data(); }
+    /** joint encoders mapped to the motor side minus their offset */
+    const double* relEncJnt2Mot() const  { return rel_enc_jnt2mot.data(); }
+    /** motor encoders mapped to the joint side plus the joint offset */
+    const double* absEncMot2Jnt() const  { return abs_enc_mot2jnt.data(); }
+
+private:
+    typedef std::array<double, MaxJoints> buffer_t;
+
+    size_t n;
+    bool   first;
+
+    std::array<double, MaxJoints*MaxJoints> m;
+    std::array<double, MaxJoints*MaxJoints> minv;
+    buffer_t gear;
+    std::array<size_t, MaxJoints> blk_begin;
+    std::array<size_t, MaxJoints> blk_end;
+
+    buffer_t enc_jnt2mot;
+    buffer_t enc_mot2jnt;
+    buffer_t vel_jnt2mot;
+
+    buffer_t off_enc_jnt;
+    buffer_t off_enc_mot;
+    buffer_t off_enc_jnt2mot;
+
+    buffer_t prev_enc_jnt;
+    buffer_t prev_enc_mot;
+    buffer_t prev_enc_jnt2mot;
+    buffer_t prev_vel_jnt;
+    buffer_t prev_vel_mot;
+    buffer_t prev_vel_jnt2mot;
+
+    buffer_t diff_enc_jnt;
+    buffer_t diff_enc_mot;
+    buffer_t diff_enc_jnt2mot;
+    buffer_t diff_vel_jnt;
+    buffer_t diff_vel_mot;
+    buffer_t diff_vel_jnt2mot;
+
+    buffer_t rel_enc_mot;
+    buffer_t rel_enc_jnt2mot;
+    buffer_t abs_enc_mot2jnt;
+};
+
+#endif //_ENCODERSCOUPLINGKERNEL_H_
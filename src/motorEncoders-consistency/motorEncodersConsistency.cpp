@@ -30,6 +30,8 @@
 #include <cstdlib>
 #include <fstream>
 #include "motorEncodersConsistency.h"
+#include "ControlModeSwitcher.h"
+#include "MotionWaiter.h"
 #include <iostream>
 #include <yarp/dev/IRemoteVariables.h>
 
@@ -57,15 +59,13 @@ OpticalEncodersConsistency::OpticalEncodersConsistency() : yarp::robottestingfra
     imotenc=0;
 
     enc_jnt=0;
-    enc_jnt2mot=0;
     enc_mot=0;
     vel_jnt=0;
-    vel_jnt2mot=0;
     vel_mot=0;
     acc_jnt=0;
-    acc_jnt2mot=0;
     acc_mot=0;
     cycles =10;
+    matrix_size = 0;
     tolerance = 1.0;
     plot_enabled = false;
 }
@@ -120,7 +120,7 @@ bool OpticalEncodersConsistency::setup(yarp::os::Property& property) {
     tolerance = property.find("tolerance").asFloat64();
     ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(tolerance>=0,"invalid tolerance");
 
-    int matrix_size=property.find("matrix_size").asInt32();
+    matrix_size=property.find("matrix_size").asInt32();
     if (matrix_size>0)
     {
         matrix.resize(matrix_size,matrix_size);
@@ -176,6 +176,7 @@ bool OpticalEncodersConsistency::setup(yarp::os::Property& property) {
 
     int n_cmd_joints = jointsBottle->size();
     ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(n_cmd_joints>0 && n_cmd_joints<=n_part_joints,"invalid number of joints, it must be >0 & <= number of part joints");
+    ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(n_cmd_joints<=(int)kernel.capacity(),"too many joints for the coupling kernel");
     jointsList.clear();
     for (int i=0; i <n_cmd_joints; i++) jointsList.push_back(jointsBottle->get(i).asInt32());
 
@@ -185,15 +186,6 @@ bool OpticalEncodersConsistency::setup(yarp::os::Property& property) {
     vel_mot.resize(n_cmd_joints); vel_mot.zero();
     acc_jnt.resize(n_cmd_joints); acc_jnt.zero();
     acc_mot.resize(n_cmd_joints); acc_mot.zero();
-    prev_enc_jnt.resize(n_cmd_joints); prev_enc_jnt.zero();
-    prev_enc_mot.resize(n_cmd_joints); prev_enc_mot.zero();
-    prev_enc_jnt2mot.resize(n_cmd_joints); prev_enc_jnt2mot.zero();
-    prev_vel_jnt.resize(n_cmd_joints); prev_vel_jnt.zero();
-    prev_vel_mot.resize(n_cmd_joints); prev_vel_mot.zero();
-    prev_vel_jnt2mot.resize(n_cmd_joints); prev_vel_jnt2mot.zero();
-    prev_acc_jnt.resize(n_cmd_joints); prev_acc_jnt.zero();
-    prev_acc_mot.resize(n_cmd_joints); prev_acc_mot.zero();
-    prev_acc_jnt2mot.resize(n_cmd_joints); prev_acc_jnt2mot.zero();
     zero_vector.resize(n_cmd_joints);
     zero_vector.zero();
 
@@ -227,34 +219,10 @@ void OpticalEncodersConsistency::setMode(int desired_mode)
     if (icmd == 0) ROBOTTESTINGFRAMEWORK_ASSERT_ERROR("Invalid control mode interface");
     if (iimd == 0) ROBOTTESTINGFRAMEWORK_ASSERT_ERROR("Invalid interaction mode interface");
 
-    for (unsigned int i=0; i<jointsList.size(); i++)
-    {
-        icmd->setControlMode((int)jointsList[i],desired_mode);
-        iimd->setInteractionMode((int)jointsList[i],VOCAB_IM_STIFF);
-        yarp::os::Time::delay(0.010);
-    }
-
-    int cmode;
-    yarp::dev::InteractionModeEnum imode;
-    int timeout = 0;
-
-    while (1)
-    {
-        int ok=0;
-        for (unsigned int i=0; i<jointsList.size(); i++)
-        {
-            icmd->getControlMode ((int)jointsList[i],&cmode);
-            iimd->getInteractionMode((int)jointsList[i],&imode);
-            if (cmode==desired_mode && imode==VOCAB_IM_STIFF) ok++;
-        }
-        if (ok==jointsList.size()) break;
-        if (timeout>100)
-        {
-            ROBOTTESTINGFRAMEWORK_ASSERT_ERROR("Unable to set control mode/interaction mode");
-        }
-        yarp::os::Time::delay(0.2);
-        timeout++;
-    }
+    ControlModeSwitcher switcher(icmd, iimd, jointsList);
+    ControlModeSwitcher::Result result = switcher.change(desired_mode, VOCAB_IM_STIFF);
+    ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(result.ok, switcher.failureMessage(result, "Control mode change"));
+    ROBOTTESTINGFRAMEWORK_TEST_REPORT(switcher.successMessage(result, "Control mode change"));
 }
 
 void OpticalEncodersConsistency::goHome()
@@ -262,35 +230,17 @@ void OpticalEncodersConsistency::goHome()
     if (ipos == 0) ROBOTTESTINGFRAMEWORK_ASSERT_ERROR("Invalid position control interface");
     if (ienc == 0) ROBOTTESTINGFRAMEWORK_ASSERT_ERROR("Invalid encoders interface");
 
-    bool ret = true;
     char buff [500];
     sprintf(buff,"Homing the whole part");ROBOTTESTINGFRAMEWORK_TEST_REPORT(buff);
 
-    for (unsigned int i=0; i<jointsList.size(); i++)
+    MotionWaiter waiter;
+    waiter.configure(ienc, ipos, jointsList);
+    waiter.setTolerance(tolerance);
+    MotionWaiter::Result result = waiter.moveAndWait(std::vector<double>(home.data(), home.data()+home.size()),
+                                                     std::vector<double>(speed.data(), speed.data()+speed.size()));
+    if (!result.ok)
     {
-        ret = ipos->setRefSpeed((int)jointsList[i],speed[i]);
-        ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(ret, "ipos->setRefSpeed returned false");
-        ret = ipos->positionMove((int)jointsList[i],home[i]);
-        ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(ret, "ipos->positionMove returned false");
-    }
-
-    int timeout = 0;
-    while (1)
-    {
-        int in_position=0;
-        for (unsigned int i=0; i<jointsList.size(); i++)
-        {
-            double tmp=0;
-            ienc->getEncoder((int)jointsList[i],&tmp);
-            if (fabs(tmp-home[i])<tolerance) in_position++;
-        }
-        if (in_position==jointsList.size()) break;
-        if (timeout>100)
-        {
-            ROBOTTESTINGFRAMEWORK_ASSERT_ERROR("Timeout while reaching home position");
-        }
-        yarp::os::Time::delay(0.2);
-        timeout++;
+        ROBOTTESTINGFRAMEWORK_ASSERT_ERROR("Timeout while reaching home position");
     }
 }
 
@@ -310,6 +260,11 @@ void OpticalEncodersConsistency::saveToFile(std::string filename, yarp::os::Bott
     fs.close();
 }
 
+static void addToList(yarp::os::Bottle &b, const double* v, size_t n)
+{
+    for (size_t i=0; i<n; i++) b.addFloat64(v[i]);
+}
+
 void OpticalEncodersConsistency::run()
 {
     char buff [500];
@@ -331,60 +286,25 @@ void OpticalEncodersConsistency::run()
 
     yarp::os::Bottle b;
 
-    ivar->getRemoteVariable("kinematic_mj", b);
-
-    int matrix_size = matrix.cols();
+    ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(ivar->getRemoteVariable("kinematic_mj", b), "Unable to read the kinematic_mj remote variable");
 
-    matrix.eye();
-    
-    int njoints [4];
-    
-    for(int i=0 ; i< b.size() ; i++)
+    std::string coupling_error;
+    if (!coupling.fromRemoteVariable(b, matrix_size, coupling_error))
     {
-        Bottle bv;
-        bv.fromString(b.get(i).toString());
-        njoints[i] = sqrt(bv.size());
-
-        int ele = 0;
-        if(i==0) {
-        for (int r=0; r < njoints[i]; r++) 
-        {
-            for (int c=0; c < njoints[i]; c++) 
-            {
-                matrix(r,c) = bv.get(ele).asFloat64();
-                ele++;
-            }
-        }
-
-       }  
-       else{
-           for (int r=0; r < njoints[i]; r++) 
-            {
-                for (int c=0; c < njoints[i]; c++) 
-                {
-                    int jntprev = 0;
-                    for (int j=0; j < i; j++) jntprev += njoints[j];
-                    if(!jntprev > matrix_size)  matrix(r+jntprev,c+jntprev) = bv.get(ele).asFloat64();
-                    ele++;
-                }
-            }
-       }
-    
+        ROBOTTESTINGFRAMEWORK_ASSERT_ERROR(coupling_error);
     }
+    matrix = coupling.matrix();
+    inv_matrix = coupling.inverse();
 
-    // yDebug() << "MATRIX J2M : \n" << matrix.toString();
-
-// **************************************************************************************
-
-    trasp_matrix = matrix.transposed();
-    inv_matrix = yarp::math::luinv(matrix);
-    inv_trasp_matrix = inv_matrix.transposed();
-
+    sprintf(buff,"Coupling blocks: %s (%d blocks beyond matrix_size skipped)", coupling.blocksToString().c_str(), (int)coupling.skippedBlocks());
+    ROBOTTESTINGFRAMEWORK_TEST_REPORT(buff);
     sprintf(buff,"Matrix:\n %s \n", matrix.toString().c_str());
     ROBOTTESTINGFRAMEWORK_TEST_REPORT(buff);
     sprintf(buff,"Inv matrix:\n %s \n", inv_matrix.toString().c_str());
     ROBOTTESTINGFRAMEWORK_TEST_REPORT(buff);
 
+    ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(kernel.configure(coupling, gearbox), "coupling matrix size does not match the number of tested joints");
+
     Bottle dataToPlot_test1;
     Bottle dataToPlot_test2;
     Bottle dataToPlot_test3;
@@ -393,14 +313,10 @@ void OpticalEncodersConsistency::run()
 
     bool test_data_is_valid = false;
     bool first_time = true;
-    yarp::sig::Vector off_enc_mot; off_enc_mot.resize(jointsList.size());
-    yarp::sig::Vector off_enc_jnt; off_enc_jnt.resize(jointsList.size());
-    yarp::sig::Vector off_enc_jnt2mot; off_enc_jnt2mot.resize(jointsList.size());
-    yarp::sig::Vector off_enc_mot2jnt; off_enc_mot2jnt.resize(jointsList.size());
+    size_t n_cmd_joints = jointsList.size();
     yarp::sig::Vector tmp_vector;
     tmp_vector.resize(n_part_joints);
-
-
+    double prev_time = yarp::os::Time::now();
 
     while (1)
     {
@@ -425,30 +341,10 @@ void OpticalEncodersConsistency::run()
         ret = imotenc->getMotorEncoderAccelerations(tmp_vector.data()); for (unsigned int i = 0; i < jointsList.size(); i++) acc_mot[i] = tmp_vector[jointsList(i)];
         ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(ret, "imotenc->getMotorEncoderAccelerations returned false");
 
-        //if (enc_jnt == zero_vector) { ROBOTTESTINGFRAMEWORK_TEST_REPORT("Invalid getEncoders data"); test_data_is_valid = true; }
-        //if (enc_mot == zero_vector) { ROBOTTESTINGFRAMEWORK_TEST_REPORT("Invalid getMotorEncoders data"); test_data_is_valid = true; }
-        //if (vel_jnt == zero_vector) { ROBOTTESTINGFRAMEWORK_TEST_REPORT("Invalid getEncoderSpeeds data"); test_data_is_valid = true; }
-        //if (vel_mot == zero_vector) { ROBOTTESTINGFRAMEWORK_TEST_REPORT("Invalid getMotorEncoderSpeeds data"); test_data_is_valid = true; }
-        //if (acc_jnt == zero_vector) { ROBOTTESTINGFRAMEWORK_TEST_REPORT("Invalid getEncoderAccelerations data"); test_data_is_valid = true; }
-        //if (acc_mot == zero_vector) { ROBOTTESTINGFRAMEWORK_TEST_REPORT("Invalid getMotorEncoderAccelerations data"); test_data_is_valid = true; }
-
-        if (first_time)
-        {
-            off_enc_jnt = enc_jnt;
-            off_enc_mot2jnt = enc_mot2jnt;
-
-        }
-        
-        enc_jnt2mot = matrix * enc_jnt;
-        enc_mot2jnt = inv_matrix * (enc_mot - off_enc_mot);
-        vel_jnt2mot = matrix * vel_jnt;
-        //acc_jnt2mot = matrix * acc_jnt;
-
-
-        for (unsigned int i = 0; i < jointsList.size(); i++) enc_jnt2mot[i] = enc_jnt2mot[i] * gearbox[i];;
-        for (unsigned int i = 0; i < jointsList.size(); i++) vel_jnt2mot[i] = vel_jnt2mot[i] * gearbox[i];
-        //for (unsigned int i = 0; i < jointsList.size(); i++) acc_jnt2mot[i] = acc_jnt2mot[i] * gearbox[i];
-        for (unsigned int i = 0; i < jointsList.size(); i++) enc_mot2jnt[i] = enc_mot2jnt[i] / gearbox[i];
+        //coupled transforms, differencing and offsets are computed in a single pass, without temporaries
+        //the derivatives use the measured sample time, since the loop is not paced
+        kernel.update(enc_jnt.data(), enc_mot.data(), vel_jnt.data(), vel_mot.data(), curr_time - prev_time);
+        prev_time = curr_time;
 
         bool reached = false;
         int in_position = 0;
@@ -487,51 +383,19 @@ void OpticalEncodersConsistency::run()
             }
         }
 
-        //update previous and computes diff
-        diff_enc_jnt = (enc_jnt - prev_enc_jnt) / 0.010;
-        diff_enc_mot = (enc_mot - prev_enc_mot) / 0.010;
-        diff_enc_jnt2mot = (enc_jnt2mot - prev_enc_jnt2mot) / 0.010;
-        diff_vel_jnt = (vel_jnt - prev_vel_jnt) / 0.010;
-        diff_vel_mot = (vel_mot - prev_vel_mot) / 0.010;
-        diff_vel_jnt2mot = (vel_jnt2mot - prev_vel_jnt2mot) / 0.010;
-        diff_acc_jnt = (acc_jnt - prev_acc_jnt) / 0.010;
-        diff_acc_mot = (acc_mot - prev_acc_mot) / 0.010;
-        //diff_acc_jnt2mot = (acc_jnt2mot - prev_acc_jnt2mot) / 0.010;
-        prev_enc_jnt = enc_jnt;
-        prev_enc_mot = enc_mot;
-        prev_enc_jnt2mot = enc_jnt2mot;
-        prev_vel_jnt = vel_jnt;
-        prev_vel_mot = vel_mot;
-        prev_vel_jnt2mot = vel_jnt2mot;
-       // prev_acc_jnt = acc_jnt;
-        //prev_acc_mot = acc_mot;
-       // prev_acc_jnt2mot = acc_jnt2mot;
-
-        if (first_time)
-        {
-            off_enc_mot = enc_mot;
-            off_enc_jnt2mot = enc_jnt2mot;
-        }
-
         {
             //prepare data to plot
             //JOINT POSITIONS vs MOTOR POSITIONS
             Bottle& row_test1 = dataToPlot_test1.addList();
-            Bottle& v1_test1 = row_test1.addList();
-            Bottle& v2_test1 = row_test1.addList();
-            yarp::sig::Vector v1 = enc_mot - off_enc_mot;
-            yarp::sig::Vector v2 = enc_jnt2mot - off_enc_jnt2mot;
-            v1_test1.read(v1);
-            v2_test1.read(v2);
+            addToList(row_test1.addList(), kernel.relEncMot(), n_cmd_joints);
+            addToList(row_test1.addList(), kernel.relEncJnt2Mot(), n_cmd_joints);
         }
 
         {
             //JOINT VELOCITES vs MOTOR VELOCITIES
             Bottle& row_test2 = dataToPlot_test2.addList();
-            Bottle& v1_test2 = row_test2.addList();
-            Bottle& v2_test2 = row_test2.addList();
-            v1_test2.read(vel_mot);
-            v2_test2.read(vel_jnt2mot);
+            addToList(row_test2.addList(), vel_mot.data(), n_cmd_joints);
+            addToList(row_test2.addList(), kernel.velJnt2Mot(), n_cmd_joints);
         }
 
         {
@@ -539,10 +403,8 @@ void OpticalEncodersConsistency::run()
             if (first_time == false)
             {
                 Bottle& row_test3 = dataToPlot_test3.addList();
-                Bottle& v1_test3 = row_test3.addList();
-                Bottle& v2_test3 = row_test3.addList();
-                v1_test3.read(vel_jnt);
-                v2_test3.read(diff_enc_jnt);
+                addToList(row_test3.addList(), vel_jnt.data(), n_cmd_joints);
+                addToList(row_test3.addList(), kernel.diffEncJnt(), n_cmd_joints);
             }
         }
 
@@ -551,22 +413,16 @@ void OpticalEncodersConsistency::run()
             if (first_time == false)
             {
                 Bottle& row_test4 = dataToPlot_test4.addList();
-                Bottle& v1_test4 = row_test4.addList();
-                Bottle& v2_test4 = row_test4.addList();
-                v1_test4.read(vel_mot);
-                v2_test4.read(diff_enc_mot);
+                addToList(row_test4.addList(), vel_mot.data(), n_cmd_joints);
+                addToList(row_test4.addList(), kernel.diffEncMot(), n_cmd_joints);
             }
         }
 
         {
             //JOINT POSITIONS vs MOTOR POSITIONS REVERSED
             Bottle& row_test1 = dataToPlot_test1rev.addList();
-            Bottle& v1_test1 = row_test1.addList();
-            Bottle& v2_test1 = row_test1.addList();
-            yarp::sig::Vector v1 = enc_jnt;
-            yarp::sig::Vector v2 = enc_mot2jnt + off_enc_jnt;
-            v1_test1.read(v1);
-            v2_test1.read(v2);
+            addToList(row_test1.addList(), enc_jnt.data(), n_cmd_joints);
+            addToList(row_test1.addList(), kernel.absEncMot2Jnt(), n_cmd_joints);
         }
 
         //flag set
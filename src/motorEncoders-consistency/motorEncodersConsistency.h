@@ -27,6 +27,7 @@
 #include <yarp/dev/PolyDriver.h>
 #include <yarp/sig/Vector.h>
 #include <yarp/sig/Matrix.h>
+#include "encodersCouplingKernel.h"
 
 /**
 * \ingroup icub-tests
@@ -69,7 +70,7 @@
 * | tolerance          | vector of doubles of size joints  | deg   | - | Yes | The tolerance used when moving from min to max reference position and viceversa | |
 * | speed              | vector of doubles of size joints  | deg/s | - | Yes | The reference speed used during the movement  | |
 * | matrix_size | int                                   | -     | - | Yes | The number of rows of the coupling matrix | Typical value = 4. |
-* | matrix      | vector of doubles of size matrix_size | -     | - | Yes | The kinematic_mj coupling matrix | matrix is identity if joints are not coupled |
+* | matrix      | vector of doubles of size matrix_size | -     | - | No  | Unused: the coupling matrix is read at run time from the kinematic_mj remote variable | kinematic_mj blocks are placed along the diagonal, uncovered joints are not coupled |
 * | plotstring1 | string |      | - | Yes | The string which generates plot 1 | |
 * | plotstring2 | string |      | - | Yes | The string which generates plot 2 | |
 * | plotstring3 | string |      | - | Yes | The string which generates plot 3 | |
@@ -107,6 +108,7 @@ private:
     bool plot_enabled;
 
     int    n_part_joints;
+    int    matrix_size;
     int    cycles;
      
     yarp::dev::PolyDriver        *dd;
@@ -120,43 +122,14 @@ private:
 
     yarp::sig::Vector zero_vector;
     yarp::sig::Vector enc_jnt;
-    yarp::sig::Vector enc_jnt2mot;
     yarp::sig::Vector enc_mot;
-    yarp::sig::Vector enc_mot2jnt;
     yarp::sig::Vector vel_jnt;
-    yarp::sig::Vector vel_jnt2mot;
     yarp::sig::Vector vel_mot;
-    yarp::sig::Vector vel_mot2jnt;
     yarp::sig::Vector acc_jnt;
-    yarp::sig::Vector acc_jnt2mot;
     yarp::sig::Vector acc_mot;
-    yarp::sig::Vector acc_mot2jnt;
-
-    yarp::sig::Vector prev_enc_jnt;
-    yarp::sig::Vector prev_enc_jnt2mot;
-    yarp::sig::Vector prev_enc_mot;
-    yarp::sig::Vector prev_enc_mot2jnt;
-    yarp::sig::Vector prev_vel_jnt;
-    yarp::sig::Vector prev_vel_jnt2mot;
-    yarp::sig::Vector prev_vel_mot;
-    yarp::sig::Vector prev_vel_mot2jnt;
-    yarp::sig::Vector prev_acc_jnt;
-    yarp::sig::Vector prev_acc_jnt2mot;
-    yarp::sig::Vector prev_acc_mot;
-    yarp::sig::Vector prev_acc_mot2jnt;
-
-    yarp::sig::Vector diff_enc_jnt;
-    yarp::sig::Vector diff_enc_jnt2mot;
-    yarp::sig::Vector diff_enc_mot;
-    yarp::sig::Vector diff_enc_mot2jnt;
-    yarp::sig::Vector diff_vel_jnt;
-    yarp::sig::Vector diff_vel_jnt2mot;
-    yarp::sig::Vector diff_vel_mot;
-    yarp::sig::Vector diff_vel_mot2jnt;
-    yarp::sig::Vector diff_acc_jnt;
-    yarp::sig::Vector diff_acc_jnt2mot;
-    yarp::sig::Vector diff_acc_mot;
-    yarp::sig::Vector diff_acc_mot2jnt;
+
+    CouplingMatrix             coupling;
+    EncodersCouplingKernel<16> kernel;
 
     yarp::sig::Vector max;
     yarp::sig::Vector min;
@@ -171,8 +144,6 @@ private:
 
     yarp::sig::Matrix matrix;
     yarp::sig::Matrix inv_matrix;
-    yarp::sig::Matrix trasp_matrix;
-    yarp::sig::Matrix inv_trasp_matrix;
 };
 
 #endif //_opticalEncoders_H
@@ -24,6 +24,7 @@
 #include <yarp/os/Time.h>
 #include <yarp/os/Property.h>
 #include <algorithm>
+#include <cmath>
 #include "motorEncodersSignCheck.h"
 #include "iostream"
 
@@ -44,6 +45,10 @@ MotorEncodersSignCheck::MotorEncodersSignCheck() : yarp::robottestingframework::
     ienc=0;
     imenc=0;
     jPosMotion=0;
+    fast=false;
+    pulse_duration=0.05;
+    pulse_cycles=2;
+    min_correlation=0.3;
 }
 
 MotorEncodersSignCheck::~MotorEncodersSignCheck() { }
@@ -86,6 +91,16 @@ bool MotorEncodersSignCheck::setup(yarp::os::Property& property) {
     if(threshold_Bottle==0)
         ROBOTTESTINGFRAMEWORK_TEST_REPORT("Position threshold not configured. default value (5 deg) will be used ");
 
+    if(property.check("fast"))           {fast = property.find("fast").asBool();}
+    if(property.check("pulseDuration"))  {pulse_duration = property.find("pulseDuration").asFloat64();}
+    if(property.check("pulseCycles"))    {pulse_cycles = property.find("pulseCycles").asInt32();}
+    if(property.check("minCorrelation")) {min_correlation = property.find("minCorrelation").asFloat64();}
+    ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(pulse_duration>0 && pulse_cycles>0,"pulseDuration and pulseCycles must be greater than zero");
+
+    Bottle* pulse_pwm_Bottle = property.find("pulsePwm").asList();
+    //the pulses are applied to all the joints at the same time, so their amplitude must be given explicitly
+    ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(!fast || pulse_pwm_Bottle!=0,"The pulsePwm parameter must be given in fast mode");
+
     Bottle* pwm_start_Bottle = property.find("pwmStart").asList();
     ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(pwm_start_Bottle!=0,"unable to parse pwmStart parameter");
 
@@ -118,6 +133,17 @@ bool MotorEncodersSignCheck::setup(yarp::os::Property& property) {
     opl_step.resize (n_cmd_joints);           for (int i=0; i< n_cmd_joints; i++) opl_step[i]=pwm_step_Bottle->get(i).asFloat64();
     opl_max.resize (n_cmd_joints);            for (int i=0; i< n_cmd_joints; i++) opl_max[i]=pwm_max_Bottle->get(i).asFloat64();
     opl_start.resize(n_cmd_joints);           for (int i=0; i< n_cmd_joints; i++) opl_start[i]=pwm_start_Bottle->get(i).asFloat64();
+    pulse_pwm.resize(n_cmd_joints);
+    for (int i=0; i< n_cmd_joints && fast; i++)
+    {
+        pulse_pwm[i] = pulse_pwm_Bottle->get(i).asFloat64();
+        ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(pulse_pwm[i]>0,"pulsePwm must be greater than zero");
+        if (pulse_pwm[i] > opl_max[i])
+        {
+            ROBOTTESTINGFRAMEWORK_TEST_REPORT(robottestingframework::Asserter::format("joint %d: pulsePwm %.1f limited to pwmMax %.1f", (int)jointsList[i], pulse_pwm[i], opl_max[i]));
+            pulse_pwm[i] = opl_max[i];
+        }
+    }
     pos_threshold.resize (n_cmd_joints);
     if(threshold_Bottle!=0)
     {
@@ -238,6 +264,124 @@ void MotorEncodersSignCheck::OplExecute(int i)
     }
 }
 
+void MotorEncodersSignCheck::PulseExecute()
+{
+    size_t n = jointsList.size();
+
+    //orthogonal zero-mean patterns: the rows 1..n of a Sylvester Hadamard matrix
+    size_t length = 2;
+    while (length < n+1) length *= 2;
+    auto code = [](size_t row, size_t chip) -> double
+    {
+        size_t bits = row & chip;
+        int parity = 0;
+        while (bits) {parity ^= (bits & 1); bits >>= 1;}
+        return parity ? -1.0 : 1.0;
+    };
+
+    for (size_t i=0; i<n; i++)
+    {
+        setModeSingle(i,VOCAB_CM_PWM,VOCAB_IM_STIFF);
+        ipwm->setRefDutyCycle((int)jointsList[i],0.0);
+    }
+
+    const double sample_period = 0.002;
+    size_t chips = length*pulse_cycles;
+    std::vector<double> times;
+    std::vector<size_t> chip_of_sample;
+    std::vector<std::vector<double> > enc(n);
+    times.reserve((size_t)(chips*pulse_duration/sample_period)+16);
+
+    bool limit_reached = false;
+    size_t current_chip = chips;
+    double start = yarp::os::Time::now();
+    double next_time = start;
+    while (1)
+    {
+        double now = yarp::os::Time::now();
+        size_t chip = (size_t)((now-start)/pulse_duration);
+        if (chip >= chips) break;
+        if (chip != current_chip)
+        {
+            for (size_t i=0; i<n; i++)
+                ipwm->setRefDutyCycle((int)jointsList[i], pulse_pwm[i]*code(i+1, chip%length));
+            current_chip = chip;
+        }
+
+        times.push_back(now);
+        chip_of_sample.push_back(chip%length);
+        for (size_t i=0; i<n; i++)
+        {
+            double e=0;
+            imenc->getMotorEncoder((int)jointsList[i],&e);
+            enc[i].push_back(e);
+            if (jPosMotion->checkJointLimitsReached((int)jointsList[i])) limit_reached = true;
+        }
+        if (limit_reached) break;
+
+        next_time += sample_period;
+        double wait = next_time - yarp::os::Time::now();
+        if (wait > 0) yarp::os::Time::delay(wait);
+        else next_time = yarp::os::Time::now();
+    }
+
+    for (size_t i=0; i<n; i++)
+        ipwm->setRefDutyCycle((int)jointsList[i],0.0);
+
+    ROBOTTESTINGFRAMEWORK_TEST_FAIL_IF_FALSE(!limit_reached, "Test failed because hw limit was touched during the pulses");
+    if (limit_reached || times.size()<3) return;
+
+    ROBOTTESTINGFRAMEWORK_TEST_REPORT(robottestingframework::Asserter::format("Applied %d pulses of %.3f s to %d joints, %d samples",
+                                      (int)chips, pulse_duration, (int)n, (int)times.size()));
+
+    //the response lags the command: look for the correlation peak within one pulse
+    size_t max_lag = 1;
+    while (max_lag < times.size()-1 && times[max_lag]-times[0] < pulse_duration) max_lag++;
+
+    for (size_t i=0; i<n; i++)
+    {
+        std::vector<double> vel(times.size(),0.0);
+        for (size_t k=1; k<times.size(); k++)
+        {
+            double dt = times[k]-times[k-1];
+            vel[k] = (dt>0) ? (enc[i][k]-enc[i][k-1])/dt : 0;
+        }
+
+        double best_corr = 0;
+        size_t best_lag = 0;
+        for (size_t lag=0; lag<max_lag; lag++)
+        {
+            double uv=0, uu=0, vv=0;
+            for (size_t k=1+lag; k<times.size(); k++)
+            {
+                double u = code(i+1, chip_of_sample[k-lag]);
+                uv += u*vel[k];
+                uu += u*u;
+                vv += vel[k]*vel[k];
+            }
+            double corr = (uu>0 && vv>0) ? uv/sqrt(uu*vv) : 0;
+            if (fabs(corr) > fabs(best_corr)) {best_corr = corr; best_lag = lag;}
+        }
+        double lag_time = times[best_lag]-times[0];
+
+        if (best_corr >= min_correlation)
+        {
+            ROBOTTESTINGFRAMEWORK_TEST_REPORT(robottestingframework::Asserter::format("TEST SUCCESS joint %d: correlation %.2f, delay %.1f ms",
+                                              (int)jointsList[i], best_corr, lag_time*1000));
+        }
+        else if (best_corr <= -min_correlation)
+        {
+            ROBOTTESTINGFRAMEWORK_TEST_FAIL_IF_FALSE(0, robottestingframework::Asserter::format("joint %d: motor encoder moves opposite to the pwm (correlation %.2f, delay %.1f ms)",
+                                                     (int)jointsList[i], best_corr, lag_time*1000));
+        }
+        else
+        {
+            ROBOTTESTINGFRAMEWORK_TEST_FAIL_IF_FALSE(0, robottestingframework::Asserter::format("joint %d: response too weak to detect the sign (correlation %.2f), increase pulsePwm or pulseDuration",
+                                                     (int)jointsList[i], best_corr));
+        }
+    }
+}
+
 void MotorEncodersSignCheck::run()
 {
 
@@ -245,6 +389,13 @@ void MotorEncodersSignCheck::run()
     jPosMotion->setAndCheckPosControlMode();
     jPosMotion->goTo(home);
 
+    if (fast)
+    {
+        PulseExecute();
+        jPosMotion->setAndCheckPosControlMode();
+        jPosMotion->goTo(home);
+        return;
+    }
 
     for (unsigned int i=0 ; i<jointsList.size(); i++)
     {
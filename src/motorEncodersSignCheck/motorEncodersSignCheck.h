@@ -22,6 +22,7 @@
 #define _MOTORENCODERSSIGNCHECK_H_
 
 //#include <string>
+#include <vector>
 #include <yarp/robottestingframework/TestCase.h>
 #include <yarp/dev/ControlBoardInterfaces.h>
 #include <yarp/dev/PolyDriver.h>
@@ -39,6 +40,11 @@
 * and increments pwm with step defined in parameter "pwmStep" until motor doesn't move of Posthreshold degree at least.
 *
 *
+* With the fast option, all the joints are tested at the same time: each joint receives a bipolar pwm pattern of pulseDuration long pulses,
+* taken from a row of a Hadamard matrix, so that the patterns of different joints are orthogonal and have zero mean. The commanded pattern
+* is correlated with the motor encoder velocity: a positive correlation means that the sign is correct. The gravity drift is not correlated
+* with the pattern, so neither pwmStart nor a settling delay are needed, and the test takes well under a second for the whole part.
+*
 * Note: This test uses yarp::robottestingframework::jointsPosMotion class, a class for reduce time in developing test.
 *
 *
@@ -56,6 +62,11 @@
 * | pwmMax             | vector of doubles of size joints  | -     | - | Yes | The max pwm applicable | |
 * | Posthreshold       | vector of doubles of size joints  | deg   | 5 | No  | The minumum movement to check if motor position increases | |
 * | commandDelay       | vector of doubles of size joints  | deg   | 0.1 | No  | The delay between two SetRefOpenLooop commands consecutive | |
+* | fast               | bool   | -     | false | No  | If true, the sign is checked by correlating short pwm pulses with the motor encoder velocity | |
+* | pulsePwm           | vector of doubles of size joints  | -     | -     | Yes, in fast mode | The amplitude of the pwm pulses, limited to pwmMax | fast mode only. All the joints are pulsed at the same time: use a small fraction of pwmMax |
+* | pulseDuration      | double | s     | 0.05  | No  | The duration of each pulse | fast mode only |
+* | pulseCycles        | int    | -     | 2     | No  | The number of repetitions of the pulse pattern | fast mode only |
+* | minCorrelation     | double | -     | 0.3   | No  | The min normalized correlation between pwm and velocity | fast mode only |
 *
 */
 class MotorEncodersSignCheck : public yarp::robottestingframework::TestCase {
@@ -70,6 +81,7 @@ public:
     virtual void run();
     void setModeSingle(int i, int desired_control_mode, yarp::dev::InteractionModeEnum desired_interaction_mode);
     void OplExecute(int i);
+    void PulseExecute();
 
 private:
 
@@ -86,6 +98,12 @@ private:
     yarp::sig::Vector min_lims;
     yarp::sig::Vector pos_threshold;
     yarp::sig::Vector opl_start;
+    yarp::sig::Vector pulse_pwm;
+
+    bool   fast;
+    double pulse_duration;
+    int    pulse_cycles;
+    double min_correlation;
 
     int    n_part_joints;
 
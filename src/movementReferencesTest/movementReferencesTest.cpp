@@ -25,6 +25,7 @@
 #include <yarp/robottestingframework/TestAsserter.h>
 
 #include "movementReferencesTest.h"
+#include "ControlModeSwitcher.h"
 
 using namespace std;
 using namespace robottestingframework;
@@ -32,6 +33,8 @@ using namespace robottestingframework;
 using namespace yarp::os;
 
 
+static const double res_th = 0.01; //resolution threshold
+
 // prepare the plugin
 ROBOTTESTINGFRAMEWORK_PREPARE_PLUGIN(MovementReferencesTest)
 
@@ -58,6 +61,9 @@ bool MovementReferencesTest::setup(yarp::os::Property &config)
     iControlMode=NULL;
     iVelocity=NULL;
     initialized=false;
+    referenceTimeout=1.0;
+    pollPeriod=0.002;
+    for (int r=0; r<REF_COUNT; r++) latencies[r].clear();
 
     if(config.check("name"))
         setName(config.find("name").asString());
@@ -125,6 +131,12 @@ bool MovementReferencesTest::setup(yarp::os::Property &config)
     ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(refVelBottle!=0,"unable to parse refVel parameter");
 
 
+    if(config.check("referenceTimeout"))
+      {referenceTimeout = config.find("referenceTimeout").asFloat64();}
+    if(config.check("pollPeriod"))
+      {pollPeriod = config.find("pollPeriod").asFloat64();}
+    ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(referenceTimeout>0 && pollPeriod>0,"invalid referenceTimeout or pollPeriod");
+
     numJoints = jointsBottle->size();
     ROBOTTESTINGFRAMEWORK_TEST_REPORT(Asserter::format("num joints: %d", numJoints));
 
@@ -211,18 +223,65 @@ void MovementReferencesTest::tearDown() {
 
 void MovementReferencesTest::setAndCheckControlMode(int j, int mode)
 {
-    int rec_mode=VOCAB_CM_IDLE;
-    ROBOTTESTINGFRAMEWORK_TEST_FAIL_IF_FALSE(iControlMode->setControlMode(j, mode),
+    ControlModeSwitcher switcher(iControlMode, NULL, std::vector<int>(1, j));
+    switcher.setTimeout(referenceTimeout);
+    ROBOTTESTINGFRAMEWORK_TEST_FAIL_IF_FALSE(switcher.request(mode, VOCAB_IM_UNKNOWN),
             Asserter::format(("setting control mode for j %d"),j));
 
-    yarp::os::Time::delay(0.1);
+    ControlModeSwitcher::Result result = switcher.wait(mode, VOCAB_IM_UNKNOWN);
+    ROBOTTESTINGFRAMEWORK_ASSERT_FAIL_IF_FALSE(result.ok, switcher.failureMessage(result, "Control mode change"));
+}
 
-    ROBOTTESTINGFRAMEWORK_TEST_FAIL_IF_FALSE(iControlMode->getControlMode(j, &rec_mode),
-           Asserter::format(("getting control mode for j %d"),j));
+bool MovementReferencesTest::readReference(reference_t type, int j, double *value)
+{
+    switch (type)
+    {
+        case REF_POSITION:        return iPosition->getTargetPosition(j, value);
+        case REF_VELOCITY:        return iVelocity->getRefVelocity(j, value);
+        case REF_PWM:             return iPWM->getRefDutyCycle(j, value);
+        case REF_POSITION_DIRECT: return iPosDirect->getRefPosition(j, value);
+        default:                  return false;
+    }
+}
 
-    ROBOTTESTINGFRAMEWORK_ASSERT_FAIL_IF_FALSE((rec_mode == mode),
-           Asserter::format(("joint %d: is not in position"),j));
+double MovementReferencesTest::waitReference(reference_t type, int j, double expected, double t0, double *value)
+{
+    while (1)
+    {
+        double now = yarp::os::Time::now();
+        if (readReference(type, j, value) &&
+            yarp::robottestingframework::TestAsserter::isApproxEqual(expected, *value, res_th, res_th))
+        {
+            return now - t0;
+        }
+        if (now - t0 > referenceTimeout)
+        {
+            return -1;
+        }
+        yarp::os::Time::delay(pollPeriod);
+    }
+}
 
+void MovementReferencesTest::reportLatencies()
+{
+    const char* names[REF_COUNT] = {"position", "velocity", "pwm", "position direct"};
+    for (int r=0; r<REF_COUNT; r++)
+    {
+        if (latencies[r].empty())
+        {
+            ROBOTTESTINGFRAMEWORK_TEST_REPORT(Asserter::format("%s reference latency: no samples", names[r]));
+            continue;
+        }
+        double sum = 0;
+        double max = 0;
+        for (size_t k=0; k<latencies[r].size(); k++)
+        {
+            sum += latencies[r][k];
+            if (latencies[r][k] > max) max = latencies[r][k];
+        }
+        ROBOTTESTINGFRAMEWORK_TEST_REPORT(Asserter::format("%s reference latency: mean %.1f ms, max %.1f ms over %d joints",
+                                          names[r], sum/latencies[r].size()*1000.0, max*1000.0, (int)latencies[r].size()));
+    }
 }
 
 void MovementReferencesTest::run() {
@@ -273,11 +332,8 @@ void MovementReferencesTest::run() {
                 Asserter::format(("go to target pos  for j %d"),jList[i]));
     }
 
-    yarp::os::Time::delay(5);
-
     ROBOTTESTINGFRAMEWORK_TEST_REPORT("Checking individual joints...");
 
-    const double res_th = 0.01; //resolution threshold
     //numJoints=numJointsInPart;
     for (int i=0; i<numJoints; ++i)
     {
@@ -290,26 +346,26 @@ void MovementReferencesTest::run() {
 
         setAndCheckControlMode(jList[i], VOCAB_CM_POSITION);
 
-        ROBOTTESTINGFRAMEWORK_TEST_FAIL_IF_FALSE(jPosMotion->goToSingle(jList[i], targetPos[i]),
-                Asserter::format(("go to target pos  for j %d"),jList[i])); //Note: gotosingle use IPositioncontrol2::PositionMove
-
-    yarp::os::Time::delay(0.5);
-
-        ROBOTTESTINGFRAMEWORK_TEST_FAIL_IF_FALSE(iPosition->getTargetPosition(jList[i], &rec_targetPos),
-                Asserter::format(("getting target pos for j %d"),jList[i]));
+        double t0 = yarp::os::Time::now();
+        ROBOTTESTINGFRAMEWORK_TEST_FAIL_IF_FALSE(iPosition->positionMove(jList[i], targetPos[i]),
+                Asserter::format(("go to target pos  for j %d"),jList[i]));
 
-        bool res = yarp::robottestingframework::TestAsserter::isApproxEqual(targetPos[i], rec_targetPos, res_th, res_th);
+        double latency = waitReference(REF_POSITION, jList[i], targetPos[i], t0, &rec_targetPos);
+        if (latency >= 0) latencies[REF_POSITION].push_back(latency);
+        bool res = (latency >= 0);
         ROBOTTESTINGFRAMEWORK_TEST_CHECK(res, Asserter::format(
-                           ("IPositionControl: getting target pos for j %d: setval =%.2f received %.2f"),
-                           jList[i], targetPos[i],rec_targetPos));
+                           ("IPositionControl: getting target pos for j %d: setval =%.2f received %.2f latency %.1f ms"),
+                           jList[i], targetPos[i],rec_targetPos, latency*1000.0));
+
+        //wait for the joint to reach the target (gotosingle sends again the same positionMove)
+        ROBOTTESTINGFRAMEWORK_TEST_FAIL_IF_FALSE(jPosMotion->goToSingle(jList[i], targetPos[i]),
+                Asserter::format(("go to target pos  for j %d"),jList[i]));
 
         //if(!res)
         //    std::cout <<"ERRORE: getTargetPosition: j " << jList[i] << "sent" << targetPos[i] << "rec" << rec_targetPos;
         //else
         //    std::cout <<"OK: getTargetPosition: j " << jList[i] << "sent" << targetPos[i] << "rec" << rec_targetPos;
 
-        yarp::os::Time::delay(3);
-
     //2) check get reference output (pwm mode) returns the ouput set by setRefOutput
         ROBOTTESTINGFRAMEWORK_TEST_REPORT(Asserter::format("Checking pwm reference joint %d", jList[i]));
 
@@ -318,25 +374,22 @@ void MovementReferencesTest::run() {
 
         double output = 2;
         double rec_output = 0;
+        t0 = yarp::os::Time::now();
         ROBOTTESTINGFRAMEWORK_TEST_FAIL_IF_FALSE(iPWM->setRefDutyCycle(jList[i], output),
                Asserter::format(("set ref output for j %d"),jList[i]));
-yarp::os::Time::delay(0.5);
-
-        ROBOTTESTINGFRAMEWORK_TEST_FAIL_IF_FALSE(iPWM->getRefDutyCycle(jList[i], &rec_output),
-               Asserter::format(("get ref output for j %d"),jList[i]));
 
+        latency = waitReference(REF_PWM, jList[i], output, t0, &rec_output);
+        if (latency >= 0) latencies[REF_PWM].push_back(latency);
         ROBOTTESTINGFRAMEWORK_TEST_CHECK((output == rec_output),
-               Asserter::format(("getting target output for j %d: setval =%.2f received %.2f"),jList[i], output,rec_output));
+               Asserter::format(("getting target output for j %d: setval =%.2f received %.2f latency %.1f ms"),jList[i], output,rec_output, latency*1000.0));
 
+        //here I expect getTargetPosition returns targetPos[j] and not homePos[j] because joint is in pwm control mode and
+        //the positionMove(homepos) command should be discarded by firmware motor controller.
+        //The target is observed for referenceTimeout seconds, unless it changes earlier.
+        t0 = yarp::os::Time::now();
         ROBOTTESTINGFRAMEWORK_TEST_FAIL_IF_FALSE(iPosition->positionMove(jList[i], homePos[i]),
                 Asserter::format(("go to home  for j %d"),jList[i]));
-yarp::os::Time::delay(0.5);
-        ROBOTTESTINGFRAMEWORK_TEST_FAIL_IF_FALSE(iPosition->getTargetPosition(jList[i], &rec_targetPos),
-               Asserter::format(("getting target pos for j %d"),jList[i]));
-
-        //here I expect getTargetPosition returns targetPos[j] and not homePos[j] because joint is in pwm control mode and
-        //the positionMove(homepos) command should be discarded by firmware motor controller
-        res = yarp::robottestingframework::TestAsserter::isApproxEqual(homePos[i], rec_targetPos, res_th, res_th);
+        res = (waitReference(REF_POSITION, jList[i], homePos[i], t0, &rec_targetPos) >= 0);
         ROBOTTESTINGFRAMEWORK_TEST_CHECK(!res,
                Asserter::format(("joint %d discards PosotinMove command while it is in opnLoop mode. Set=%.2f rec=%.2f"),jList[i], homePos[i], rec_targetPos));
 
@@ -352,16 +405,15 @@ yarp::os::Time::delay(0.5);
 
         double delta = 0.1;
         double new_directPos = curr_pos+delta;
+        t0 = yarp::os::Time::now();
         ROBOTTESTINGFRAMEWORK_TEST_FAIL_IF_FALSE(iPosDirect->setPosition(jList[i], new_directPos),
                Asserter::format(("Direct:setPosition for j %d"),jList[i]));
-yarp::os::Time::delay(0.5);
-
-        ROBOTTESTINGFRAMEWORK_TEST_FAIL_IF_FALSE(iPosDirect->getRefPosition(jList[i], &rec_targetPos),
-               Asserter::format(("getting target pos for j %d"),jList[i]));
 
-        res = yarp::robottestingframework::TestAsserter::isApproxEqual(new_directPos, rec_targetPos, res_th, res_th);
+        latency = waitReference(REF_POSITION_DIRECT, jList[i], new_directPos, t0, &rec_targetPos);
+        if (latency >= 0) latencies[REF_POSITION_DIRECT].push_back(latency);
+        res = (latency >= 0);
         ROBOTTESTINGFRAMEWORK_TEST_CHECK(res,
-               Asserter::format(("iDirect: getting target direct pos for j %d: setval =%.2f received %.2f"),jList[i], new_directPos,rec_targetPos));
+               Asserter::format(("iDirect: getting target direct pos for j %d: setval =%.2f received %.2f latency %.1f ms"),jList[i], new_directPos,rec_targetPos, latency*1000.0));
 
         //here I'm going to check the position reference is not changed.
         ROBOTTESTINGFRAMEWORK_TEST_FAIL_IF_FALSE(iPosition->getTargetPosition(jList[i], &rec_targetPos),
@@ -379,16 +431,18 @@ yarp::os::Time::delay(0.5);
         setAndCheckControlMode(jList[i], VOCAB_CM_VELOCITY);
 
         double vel= 0.5;
-        double rec_vel;
+        double rec_vel = 0;
+        t0 = yarp::os::Time::now();
         ROBOTTESTINGFRAMEWORK_TEST_FAIL_IF_FALSE(iVelocity->velocityMove(jList[i], vel),
                Asserter::format(("IVelocity:velocityMove for j %d"),jList[i]));
 
-yarp::os::Time::delay(0.5);
-        ROBOTTESTINGFRAMEWORK_TEST_FAIL_IF_FALSE(iVelocity->getRefVelocity(jList[i], &rec_vel),
-               Asserter::format(("IVelocity:getting target velocity for j %d"),jList[i]));
-        res = yarp::robottestingframework::TestAsserter::isApproxEqual(vel, rec_vel, res_th, res_th);
+        latency = waitReference(REF_VELOCITY, jList[i], vel, t0, &rec_vel);
+        if (latency >= 0) latencies[REF_VELOCITY].push_back(latency);
+        res = (latency >= 0);
         ROBOTTESTINGFRAMEWORK_TEST_CHECK(res,
-               Asserter::format(("iVelocity: getting target vel for j %d: setval =%.2f received %.2f"),jList[i], vel,rec_vel));
+               Asserter::format(("iVelocity: getting target vel for j %d: setval =%.2f received %.2f latency %.1f ms"),jList[i], vel,rec_vel, latency*1000.0));
     }
 
+    reportLatencies();
+
 }
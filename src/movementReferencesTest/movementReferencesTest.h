@@ -29,6 +29,7 @@
 #include <yarp/dev/PolyDriver.h>
 #include <yarp/dev/ControlBoardInterfaces.h>
 #include "yarp/robottestingframework/JointsPosMotion.h"
+#include <vector>
 
 /**
 * \ingroup icub-tests
@@ -40,6 +41,9 @@
 * \li IPositionDirect::getRefPosition()
 * \li IPWMControl::getRefDutyCycle()
 *
+* After each reference is set, the corresponding getter is polled every pollPeriod seconds until it returns the
+* expected value or referenceTimeout expires. The time needed by each reference to become readable is reported
+* for every joint, and summarized per interface at the end of the test.
 *
 *  Accepts the following parameters:
 * | Parameter name | Type   | Units | Default Value | Required | Description | Notes |
@@ -51,6 +55,8 @@
 * | target         | vector of doubles of size joints | deg | - | Yes  | For each joint the position to reach for passing the test. | |
 * | refvel         | vector of doubles of size joints | deg/s | - | Yes | For each joint the reference velocity value to set in the low level trajectory generator. | |
 * | refacc         | vector of doubles of size joints | deg/s^2 | - | No | For each joint the reference acceleration value to set in the low level trajectory generator. | |
+* | referenceTimeout | double | s   | 1.0           | No       | The max time waited for a reference to become readable. | It is also the time a discarded positionMove is observed. |
+* | pollPeriod     | double | s     | 0.002         | No       | The interval between two reads of a reference. | |
 *
 */
 class MovementReferencesTest : public yarp::robottestingframework::TestCase {
@@ -65,7 +71,19 @@ public:
     virtual void run();
 
 private:
+    enum reference_t
+    {
+        REF_POSITION = 0,
+        REF_VELOCITY,
+        REF_PWM,
+        REF_POSITION_DIRECT,
+        REF_COUNT
+    };
+
     void setAndCheckControlMode(int j, int mode);
+    bool readReference(reference_t type, int j, double *value);
+    double waitReference(reference_t type, int j, double expected, double t0, double *value);
+    void reportLatencies();
 
 
     yarp::dev::PolyDriver *dd;
@@ -92,6 +110,9 @@ private:
     yarp::sig::Vector homePos;
     yarp::sig::Vector refVel;
     yarp::sig::Vector refAcc;
+    double referenceTimeout;
+    double pollPeriod;
+    std::vector<double> latencies[REF_COUNT];
     //yarp::sig::Vector timeout;
 };
 
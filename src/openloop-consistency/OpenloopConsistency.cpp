@@ -26,6 +26,7 @@
 #include <yarp/os/Property.h>
 
 #include "OpenloopConsistency.h"
+#include "MotionWaiter.h"
 
 //example1    -v -t OpenLoopConsistency.dll -p "--robot icub --part head --joints ""(0)"" --home ""(0)"" "
 //example2    -v -t OpenLoopConsistency.dll -p "--robot icub --part head --joints ""(0 1 2)"" --home ""(0 0 0)"" "
@@ -116,6 +117,7 @@ bool OpenLoopConsistency::setup(yarp::os::Property& property) {
     prevcurr_some=new double[n_cmd_joints];
     home=new double[n_cmd_joints];
     for (int i=0; i <n_cmd_joints; i++) jointsList[i]=jointsBottle->get(i).asInt32();
+    modeSwitcher.configure(icmd, iimd, jointsList, n_cmd_joints);
     for (int i=0; i <n_cmd_joints; i++) home[i]=homeBottle->get(i).asFloat64();
     return true;
 }
@@ -134,68 +136,25 @@ void OpenLoopConsistency::tearDown()
 
 void OpenLoopConsistency::setMode(int desired_control_mode, yarp::dev::InteractionModeEnum desired_interaction_mode)
 {
-    for (int i=0; i<n_cmd_joints; i++)
-    {
-        icmd->setControlMode(jointsList[i],desired_control_mode);
-        iimd->setInteractionMode(jointsList[i],desired_interaction_mode);
-        yarp::os::Time::delay(0.010);
-    }
+    modeSwitcher.request(desired_control_mode, desired_interaction_mode);
 }
 
 void OpenLoopConsistency::verifyMode(int desired_control_mode, yarp::dev::InteractionModeEnum desired_interaction_mode, std::string title)
 {
-    int cmode;
-    yarp::dev::InteractionModeEnum imode;
-    int timeout = 0;
-
-    while (1)
-    {
-        int ok=0;
-        for (int i=0; i<n_cmd_joints; i++)
-        {
-            icmd->getControlMode (jointsList[i],&cmode);
-            iimd->getInteractionMode(jointsList[i],&imode);
-            if (cmode==desired_control_mode && imode==desired_interaction_mode) ok++;
-        }
-        if (ok==n_cmd_joints) break;
-        if (timeout>100)
-        {
-            char sbuf[500];
-            sprintf(sbuf,"Test (%s) failed: current mode is (%s,%s), it should be (%s,%s)",title.c_str(), Vocab32::decode((NetInt32)desired_control_mode).c_str(),Vocab32::decode((NetInt32)desired_interaction_mode).c_str(), Vocab32::decode((NetInt32)cmode).c_str(),Vocab32::decode((NetInt32)imode).c_str());
-            ROBOTTESTINGFRAMEWORK_ASSERT_ERROR(sbuf);
-        }
-        yarp::os::Time::delay(0.2);
-        timeout++;
-    }
-    char sbuf[500];
-    sprintf(sbuf,"Test (%s) passed: current mode is (%s,%s)",title.c_str(), Vocab32::decode((NetInt32)desired_control_mode).c_str(),Vocab32::decode((NetInt32)desired_interaction_mode).c_str());
-    ROBOTTESTINGFRAMEWORK_TEST_REPORT(sbuf);
+    ControlModeSwitcher::Result result = modeSwitcher.wait(desired_control_mode, desired_interaction_mode);
+    ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(result.ok, modeSwitcher.failureMessage(result, "Test ("+title+")"));
+    ROBOTTESTINGFRAMEWORK_TEST_REPORT(modeSwitcher.successMessage(result, "Test ("+title+")"));
 }
 
 void OpenLoopConsistency::goHome()
 {
-    for (int i=0; i<n_cmd_joints; i++)
-    {
-        ipos->setRefSpeed(jointsList[i],20.0);
-        ipos->positionMove(jointsList[i],home[i]);
-    }
-
-    int timeout = 0;
-    while (1)
+    MotionWaiter waiter;
+    waiter.configure(ienc, ipos, jointsList, n_cmd_joints);
+    waiter.setTolerance(0.5);
+    MotionWaiter::Result result = waiter.moveAndWait(std::vector<double>(home, home+n_cmd_joints), 20.0);
+    if (!result.ok)
     {
-        int in_position=0;
-        for (int i=0; i<n_cmd_joints; i++)
-        {
-            ienc->getEncoder(jointsList[i],&pos_tot[jointsList[i]]);
-            if (fabs(pos_tot[jointsList[i]]-home[i])<0.5) in_position++;
-        }
-        if (in_position==n_cmd_joints) break;
-        if (timeout>100)
-        {
-            ROBOTTESTINGFRAMEWORK_ASSERT_ERROR("Timeout while reaching home position");
-        }
-        yarp::os::Time::delay(0.2);
-        timeout++;
+        ROBOTTESTINGFRAMEWORK_ASSERT_ERROR("Timeout while reaching home position");
     }
 }
 
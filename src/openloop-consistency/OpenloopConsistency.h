@@ -25,6 +25,7 @@
 #include <yarp/robottestingframework/TestCase.h>
 #include <yarp/dev/ControlBoardInterfaces.h>
 #include <yarp/dev/PolyDriver.h>
+#include "ControlModeSwitcher.h"
 
 class OpenLoopConsistency : public yarp::robottestingframework::TestCase {
 public:
@@ -67,6 +68,7 @@ private:
     yarp::dev::IAmplifierControl *iamp;
     yarp::dev::IControlMode     *icmd;
     yarp::dev::IInteractionMode  *iimd;
+    ControlModeSwitcher           modeSwitcher;
     yarp::dev::IEncoders         *ienc;
     yarp::dev::IPWMControl       *ipwm;
 
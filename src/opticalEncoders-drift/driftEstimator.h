@@ -0,0 +1,130 @@
+/*
+ * iCub Robot Unit Tests (Robot Testing Framework)
+ *
+ * Copyright (C) 2015-2019 Istituto Italiano di Tecnologia (IIT)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _DRIFTESTIMATOR_H_
+#define _DRIFTESTIMATOR_H_
+
+#include <math.h>
+#include <cstddef>
+
+/**
+* Online linear model of the encoder drift: y = offset + slope * cycle + gain * joint.
+* y is the motor encoder value read every time the joint comes back to the same position, joint is the joint
+* encoder value read at the same instant: the gain term absorbs the positioning error of each return, so that
+* the slope is the drift of the motor encoder with respect to the joint encoder.
+* If the joint position never changes the gain term cannot be estimated and the model falls back to
+* y = offset + slope * cycle.
+* The regression is updated incrementally (Welford-style running sums), so it can be
+* evaluated at any time with constant memory.
+*/
+class DriftEstimator
+{
+public:
+    DriftEstimator() { reset(); }
+
+    void reset()
+    {
+        n = 0;
+        mean_c = 0; mean_j = 0; mean_y = 0;
+        scc = 0; scj = 0; sjj = 0;
+        scy = 0; sjy = 0; syy = 0;
+    }
+
+    void add(double cycle, double joint, double value)
+    {
+        n++;
+        double dc = cycle - mean_c;
+        double dj = joint - mean_j;
+        double dy = value - mean_y;
+        mean_c += dc / n;
+        mean_j += dj / n;
+        mean_y += dy / n;
+        scc += dc * (cycle - mean_c);
+        scj += dc * (joint - mean_j);
+        sjj += dj * (joint - mean_j);
+        scy += dc * (value - mean_y);
+        sjy += dj * (value - mean_y);
+        syy += dy * (value - mean_y);
+    }
+
+    size_t samples() const { return n; }
+
+    bool isValid() const { return scc > 0 && (double)n > 2 + (useJoint() ? 1 : 0); }
+
+    /** drift per cycle */
+    double slope() const
+    {
+        if (scc <= 0) return 0.0;
+        if (!useJoint()) return scy / scc;
+        return (sjj * scy - scj * sjy) / det();
+    }
+
+    /** motor encoder change per joint encoder change, 0 if the joint position never changed */
+    double gain() const
+    {
+        if (!useJoint()) return 0.0;
+        return (scc * sjy - scj * scy) / det();
+    }
+
+    double offset() const { return mean_y - slope() * mean_c - gain() * mean_j; }
+
+    /** standard error of the slope, computed from the residuals */
+    double slopeStdErr() const
+    {
+        if (!isValid()) return HUGE_VAL;
+        double dof = (double)n - 2 - (useJoint() ? 1 : 0);
+        double res = (syy - slope() * scy - gain() * sjy) / dof;
+        if (res < 0) res = 0;
+        if (!useJoint()) return sqrt(res / scc);
+        return sqrt(res * sjj / det());
+    }
+
+    /**
+    * True when the 95% confidence interval of the slope lies entirely on one side
+    * of the threshold, i.e. more samples would not change the verdict.
+    */
+    bool isSettled(double threshold) const
+    {
+        if (!isValid()) return false;
+        double ci = 1.96 * slopeStdErr();
+        double s = fabs(slope());
+        return (s + ci < threshold) || (s - ci > threshold);
+    }
+
+private:
+    /** determinant of the normal equations of the two regressors */
+    double det() const { return scc * sjj - scj * scj; }
+
+    /** the joint position is used only if it varied independently of the cycle number */
+    bool useJoint() const { return scc > 0 && sjj > 0 && det() > 1e-9 * scc * sjj; }
+
+    size_t n;
+    double mean_c;
+    double mean_j;
+    double mean_y;
+    double scc;
+    double scj;
+    double sjj;
+    double scy;
+    double sjy;
+    double syy;
+};
+
+#endif //_DRIFTESTIMATOR_H_
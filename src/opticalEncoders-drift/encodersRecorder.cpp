@@ -0,0 +1,177 @@
+/*
+ * iCub Robot Unit Tests (Robot Testing Framework)
+ *
+ * Copyright (C) 2015-2019 Istituto Italiano di Tecnologia (IIT)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <cstdint>
+#include <cstring>
+#include "encodersRecorder.h"
+
+static const char recorder_magic[8] = {'E','N','C','R','E','C','0','1'};
+
+EncodersRecorder::EncodersRecorder() :
+    fp(nullptr), n(0), row_size(0), rows_per_buffer(0), total_rows(0),
+    active(0), fill(0), pending(false), pending_buffer(0), pending_rows(0),
+    stop(false), io_error(false)
+{
+}
+
+EncodersRecorder::~EncodersRecorder()
+{
+    close();
+}
+
+bool EncodersRecorder::open(const std::string& filename, size_t n_joints, size_t rows_per_buffer_)
+{
+    if (fp) close();
+    if (n_joints == 0 || rows_per_buffer_ == 0) return false;
+
+    fp = fopen(filename.c_str(), "wb");
+    if (!fp) return false;
+
+    uint32_t header[2] = {(uint32_t)n_joints, 0};
+    if (fwrite(recorder_magic, sizeof(recorder_magic), 1, fp) != 1 ||
+        fwrite(header, sizeof(header), 1, fp) != 1)
+    {
+        fclose(fp);
+        fp = nullptr;
+        return false;
+    }
+
+    n = n_joints;
+    row_size = 1 + 2*n;
+    rows_per_buffer = rows_per_buffer_;
+    buffers[0].assign(row_size*rows_per_buffer, 0.0);
+    buffers[1].assign(row_size*rows_per_buffer, 0.0);
+    active = 0;
+    fill = 0;
+    total_rows = 0;
+    pending = false;
+    stop = false;
+    io_error = false;
+
+    writer = std::thread(&EncodersRecorder::writerLoop, this);
+    return true;
+}
+
+bool EncodersRecorder::append(double timestamp, const double* mot, const double* jnt)
+{
+    if (!fp || io_error) return false;
+
+    double* row = &buffers[active][fill*row_size];
+    row[0] = timestamp;
+    memcpy(row+1, mot, n*sizeof(double));
+    memcpy(row+1+n, jnt, n*sizeof(double));
+    fill++;
+    total_rows++;
+
+    if (fill == rows_per_buffer) handOff();
+    return true;
+}
+
+void EncodersRecorder::handOff()
+{
+    std::unique_lock<std::mutex> lock(mtx);
+    cv.wait(lock, [this]{ return !pending; });
+    pending = true;
+    pending_buffer = active;
+    pending_rows = fill;
+    active = 1 - active;
+    fill = 0;
+    cv.notify_all();
+}
+
+void EncodersRecorder::writerLoop()
+{
+    std::unique_lock<std::mutex> lock(mtx);
+    while (true)
+    {
+        cv.wait(lock, [this]{ return pending || stop; });
+        if (pending)
+        {
+            size_t buf = pending_buffer;
+            size_t nrows = pending_rows;
+            lock.unlock();
+            bool ok = fwrite(buffers[buf].data(), row_size*sizeof(double), nrows, fp) == nrows;
+            lock.lock();
+            if (!ok) io_error = true;
+            pending = false;
+            cv.notify_all();
+        }
+        else if (stop)
+        {
+            break;
+        }
+    }
+}
+
+bool EncodersRecorder::close()
+{
+    if (!fp) return true;
+
+    if (fill > 0) handOff();
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        stop = true;
+    }
+    cv.notify_all();
+    if (writer.joinable()) writer.join();
+
+    bool ok = !io_error;
+    if (fclose(fp) != 0) ok = false;
+    fp = nullptr;
+    buffers[0].clear(); buffers[0].shrink_to_fit();
+    buffers[1].clear(); buffers[1].shrink_to_fit();
+    return ok;
+}
+
+bool EncodersRecorder::toText(const std::string& bin_filename, const std::string& txt_filename)
+{
+    FILE* in = fopen(bin_filename.c_str(), "rb");
+    if (!in) return false;
+
+    char magic[8];
+    uint32_t header[2];
+    if (fread(magic, sizeof(magic), 1, in) != 1 || memcmp(magic, recorder_magic, sizeof(magic)) != 0 ||
+        fread(header, sizeof(header), 1, in) != 1 || header[0] == 0)
+    {
+        fclose(in);
+        return false;
+    }
+
+    FILE* out = fopen(txt_filename.c_str(), "w");
+    if (!out)
+    {
+        fclose(in);
+        return false;
+    }
+
+    size_t row_size = 1 + 2*(size_t)header[0];
+    std::vector<double> row(row_size);
+    bool ok = true;
+    while (fread(row.data(), sizeof(double), row_size, in) == row_size)
+    {
+        fprintf(out, "%.6f", row[0]);
+        for (size_t i = 1; i < row_size; i++) fprintf(out, " %.6f", row[i]);
+        if (fprintf(out, "\n") < 0) { ok = false; break; }
+    }
+
+    fclose(in);
+    if (fclose(out) != 0) ok = false;
+    return ok;
+}
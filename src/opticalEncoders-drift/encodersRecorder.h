@@ -0,0 +1,97 @@
+/*
+ * iCub Robot Unit Tests (Robot Testing Framework)
+ *
+ * Copyright (C) 2015-2019 Istituto Italiano di Tecnologia (IIT)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _ENCODERSRECORDER_H_
+#define _ENCODERSRECORDER_H_
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+/**
+* Streaming recorder of encoder samples.
+* Each sample is stored as a fixed-width binary row of doubles:
+* timestamp, n motor encoders, n joint encoders (host byte order).
+* The file starts with an 8 bytes magic string followed by the number of joints (uint32)
+* and a reserved uint32.
+* Rows are collected in one of two preallocated buffers: when a buffer is full it is handed
+* to a writer thread, while the acquisition continues on the other one. Memory usage is
+* therefore constant regardless of the duration of the test.
+*/
+class EncodersRecorder
+{
+public:
+    EncodersRecorder();
+    ~EncodersRecorder();
+
+    /**
+    * Creates the binary file and starts the writer thread.
+    * rows_per_buffer is the number of rows of each of the two buffers.
+    */
+    bool open(const std::string& filename, size_t n_joints, size_t rows_per_buffer = 1000);
+
+    /**
+    * Appends a row. mot and jnt must contain n_joints elements.
+    * Blocks only if the writer thread is still flushing the other buffer.
+    * Returns false if the recorder is not open or a write error occurred.
+    */
+    bool append(double timestamp, const double* mot, const double* jnt);
+
+    /** Flushes the pending rows, stops the writer thread and closes the file */
+    bool close();
+
+    bool isOpen() const { return fp != nullptr; }
+    size_t rows() const { return total_rows; }
+
+    /**
+    * Converts a binary file written by the recorder to text, one row per line:
+    * timestamp, motor encoders, joint encoders.
+    */
+    static bool toText(const std::string& bin_filename, const std::string& txt_filename);
+
+private:
+    void writerLoop();
+    void handOff(); //must be called with the mutex unlocked
+
+    FILE*  fp;
+    size_t n;
+    size_t row_size;
+    size_t rows_per_buffer;
+    size_t total_rows;
+
+    std::vector<double> buffers[2];
+    size_t active;
+    size_t fill;
+
+    std::mutex              mtx;
+    std::condition_variable cv;
+    std::thread             writer;
+    bool   pending;
+    size_t pending_buffer;
+    size_t pending_rows;
+    bool   stop;
+    std::atomic<bool> io_error;
+};
+
+#endif //_ENCODERSRECORDER_H_
@@ -0,0 +1,52 @@
+/*
+ * iCub Robot Unit Tests (Robot Testing Framework)
+ *
+ * Copyright (C) 2015-2019 Istituto Italiano di Tecnologia (IIT)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <cstdio>
+#include <string>
+#include "encodersRecorder.h"
+
+// usage: encodersRecorderToText <input.bin> [output.txt]
+int main(int argc, char* argv[])
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s <input.bin> [output.txt]\n", argv[0]);
+        return 1;
+    }
+
+    std::string input = argv[1];
+    std::string output;
+    if (argc > 2)
+    {
+        output = argv[2];
+    }
+    else
+    {
+        size_t dot = input.find_last_of('.');
+        output = (dot == std::string::npos ? input : input.substr(0, dot)) + ".txt";
+    }
+
+    if (!EncodersRecorder::toText(input, output))
+    {
+        fprintf(stderr, "unable to convert %s to %s\n", input.c_str(), output.c_str());
+        return 1;
+    }
+    return 0;
+}
@@ -30,6 +30,10 @@
 #include <algorithm>
 #include <cstdlib>
 #include "opticalEncodersDrift.h"
+#include "encodersRecorder.h"
+#include "driftEstimator.h"
+#include "ControlModeSwitcher.h"
+#include "MotionWaiter.h"
 #include <iostream>
 #include <ctime>
 #include <filesystem>
@@ -60,6 +64,13 @@ OpticalEncodersDrift::OpticalEncodersDrift() : yarp::robottestingframework::Test
     end_enc_mot=0;
     err_enc_mot=0;
     cycles=100;
+    plot=false;
+    text_output=true;
+    max_drift_per_cycle=0;
+    max_drift_per_hour=0;
+    early_stop=false;
+    min_cycles=10;
+    settle_time=0.5;
 }
 
 OpticalEncodersDrift::~OpticalEncodersDrift() { }
@@ -107,6 +118,22 @@ bool OpticalEncodersDrift::setup(yarp::os::Property& property) {
 
     plot = property.find("plot_enabled").asBool();
 
+    if (property.check("text_output"))
+        text_output = property.find("text_output").asBool();
+
+    if (property.check("max_drift_per_cycle"))
+        max_drift_per_cycle = property.find("max_drift_per_cycle").asFloat64();
+    if (property.check("max_drift_per_hour"))
+        max_drift_per_hour = property.find("max_drift_per_hour").asFloat64();
+    if (property.check("early_stop"))
+        early_stop = property.find("early_stop").asBool();
+    if (property.check("min_cycles"))
+        min_cycles = property.find("min_cycles").asInt32();
+    ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(min_cycles>=3,"invalid min_cycles, it must be >=3");
+    if (property.check("settle_time"))
+        settle_time = property.find("settle_time").asFloat64();
+    ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(settle_time>=0,"invalid settle_time");
+
     if(plot)
         ROBOTTESTINGFRAMEWORK_TEST_REPORT("This test will run gnuplot utility at the end.");
     else
@@ -146,6 +173,7 @@ bool OpticalEncodersDrift::setup(yarp::os::Property& property) {
     min.resize  (n_cmd_joints); for (int i=0; i< n_cmd_joints; i++) min[i]=minBottle->get(i).asFloat64();
     home.resize (n_cmd_joints); for (int i=0; i< n_cmd_joints; i++) home[i]=homeBottle->get(i).asFloat64();
     speed.resize(n_cmd_joints); for (int i=0; i< n_cmd_joints; i++) speed[i]=speedBottle->get(i).asFloat64();
+    drift.resize(n_cmd_joints);
 
     return true;
 }
@@ -157,87 +185,36 @@ void OpticalEncodersDrift::tearDown()
 
 void OpticalEncodersDrift::setMode(int desired_mode)
 {
-    for (unsigned int i=0; i<jointsList.size(); i++)
-    {
-        icmd->setControlMode((int)jointsList[i],desired_mode);
-        iimd->setInteractionMode((int)jointsList[i],VOCAB_IM_STIFF);
-        yarp::os::Time::delay(0.010);
-    }
-
-    int cmode;
-    yarp::dev::InteractionModeEnum imode;
-    int timeout = 0;
-
-    while (1)
-    {
-        int ok=0;
-        for (unsigned int i=0; i<jointsList.size(); i++)
-        {
-            icmd->getControlMode ((int)jointsList[i],&cmode);
-            iimd->getInteractionMode((int)jointsList[i],&imode);
-            if (cmode==desired_mode && imode==VOCAB_IM_STIFF) ok++;
-        }
-        if (ok==jointsList.size()) break;
-        if (timeout>100)
-        {
-            ROBOTTESTINGFRAMEWORK_ASSERT_ERROR("Unable to set control mode/interaction mode");
-        }
-        yarp::os::Time::delay(0.2);
-        timeout++;
-    }
+    ControlModeSwitcher switcher(icmd, iimd, jointsList);
+    ControlModeSwitcher::Result result = switcher.change(desired_mode, VOCAB_IM_STIFF);
+    ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(result.ok, switcher.failureMessage(result, "Control mode change"));
+    ROBOTTESTINGFRAMEWORK_TEST_REPORT(switcher.successMessage(result, "Control mode change"));
 }
 
 bool OpticalEncodersDrift::goHome()
 {
-    for (unsigned int i=0; i<jointsList.size(); i++)
-    {
-        ipos->setRefSpeed((int)jointsList[i],speed[i]);
-        ipos->positionMove((int)jointsList[i],home[i]);
-    }
-
-    int timeout = 0;
-    while (1)
+    MotionWaiter waiter;
+    waiter.configure(ienc, ipos, jointsList);
+    waiter.setTolerance(tolerance);
+    MotionWaiter::Result result = waiter.moveAndWait(std::vector<double>(home.data(), home.data()+home.size()), std::vector<double>(speed.data(), speed.data()+speed.size()));
+    if (!result.ok)
     {
-        int in_position=0;
-        for (unsigned int i=0; i<jointsList.size(); i++)
-        {
-            double tmp=0;
-            ienc->getEncoder((int)jointsList[i],&tmp);
-            if (fabs(tmp-home[i])<tolerance) in_position++;
-        }
-        if (in_position==jointsList.size()) break;
-        if (timeout>100)
-        {
-            ROBOTTESTINGFRAMEWORK_TEST_REPORT("Timeout while reaching home position");
-            return false;
-        }
-        yarp::os::Time::delay(0.2);
-        timeout++;
+        ROBOTTESTINGFRAMEWORK_TEST_REPORT("Timeout while reaching home position");
+        return false;
     }
     return true;
 }
 
-bool OpticalEncodersDrift::saveToFile(const std::string &filename, const yarp::os::Bottle &b)
+double OpticalEncodersDrift::driftThresholdPerCycle(double cycle_period)
 {
-    std::fstream fs;
-    fs.open (filename.c_str(), std::fstream::out);
-
-    if ( (fs.rdstate() & std::ifstream::failbit ) != 0 )
-    {
-        std::cerr << "Error opening " << filename << "\n";
-        return false;
-    }
-
-    for (unsigned int i=0; i<b.size(); i++)
+    //the tighter of the two limits, expressed per cycle. Returns 0 if no limit is set.
+    double threshold = max_drift_per_cycle;
+    if (max_drift_per_hour > 0 && cycle_period > 0)
     {
-        std::string s = b.get(i).toString();
-        std::replace(s.begin(), s.end(), '(', ' ');
-        std::replace(s.begin(), s.end(), ')', ' ');
-        fs << s << std::endl;
+        double per_cycle = max_drift_per_hour * cycle_period / 3600.0;
+        if (threshold <= 0 || per_cycle < threshold) threshold = per_cycle;
     }
-
-    fs.close();
-    return true;
+    return threshold;
 }
 
 void OpticalEncodersDrift::run()
@@ -251,9 +228,49 @@ void OpticalEncodersDrift::run()
         ipos->positionMove((int)jointsList[i], min[i]);
     }
 
+    time_t now = time(0);
+    tm *ltm = localtime(&now);
+
+    char folder_time_buffer[80];
+    char file_time_buffer[80];
+
+    strftime(folder_time_buffer, sizeof(folder_time_buffer), "%d%m%Y", ltm);
+    strftime(file_time_buffer, sizeof(file_time_buffer), "%d%m%Y_%H%M", ltm);
+
+    string folder_time_str(folder_time_buffer);
+    string file_time_str(file_time_buffer); //This string contain also minutes
+
+    // Create the filename with date and time
+    string filename = "encDrift_plot_";
+    filename += partName;
+    filename += "_";
+    filename += file_time_str;
+
+    constexpr char default_robot_name[] = "RobotName";
+
+    string robot_str = yarp::conf::environment::get_string("YARP_ROBOT_NAME", default_robot_name);
+    string directory_tree = "results/" + robot_str + "/encoders-icub_" + folder_time_str + "/encDrift";
+    create_directories(directory_tree); // This function return false if there is an error or if the directories already exist
+
+    //data are streamed to a binary file while the test is running, and converted to text at the end
+    string bin_filename_with_path = directory_tree + "/" + filename + ".bin";
+    string filename_with_path = directory_tree + "/" + filename + ".txt";
+    EncodersRecorder recorder;
+    ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(recorder.open(bin_filename_with_path, jointsList.size()), "Unable to open " + bin_filename_with_path);
+
     int  curr_cycle=0;
     double start_time = yarp::os::Time::now();
-    Bottle dataToPlot;
+    double test_start_time = start_time;
+    yarp::sig::Vector enc_jnt_of_interest (jointsList.size());
+    yarp::sig::Vector enc_mot_of_interest (jointsList.size());
+
+    //drift model: the motor encoders are sampled every time the joints come back to the min position and settle
+    for (size_t i = 0; i < drift.size(); i++) drift[i].reset();
+    int    n_returns = 0;
+    double first_return_time = 0;
+    double cycle_period = 0;
+    double settle_start = -1;
+    bool   settled = false;
 
     imot->getMotorEncoders             (home_enc_mot.data());
     while(1)
@@ -265,21 +282,17 @@ void OpticalEncodersDrift::run()
         ienc->getEncoders                  (enc_jnt.data());
         imot->getMotorEncoders             (enc_mot.data());
         //extract only the joints of interest
-        yarp::sig::Vector enc_jnt_of_interest (jointsList.size());
-        yarp::sig::Vector enc_mot_of_interest (jointsList.size());
         for (size_t i =0; i< jointsList.size(); i++)
         {
             enc_jnt_of_interest[i] = enc_jnt[jointsList[i]];
             enc_mot_of_interest[i] = enc_mot[jointsList[i]];
         }
-        //put the data into a Bottle
-        //this is the output format: n values for the motor encoders, then n values for the jnt encoders
-        Bottle& row = dataToPlot.addList();
-        Bottle& b_mot = row.addList();
-        Bottle& b_jnt = row.addList();
-        b_mot.read(enc_mot_of_interest);
-        b_jnt.read(enc_jnt_of_interest);
-       
+        //output format: timestamp, then n values for the motor encoders, then n values for the jnt encoders
+        if (!recorder.append(curr_time-test_start_time, enc_mot_of_interest.data(), enc_jnt_of_interest.data()))
+        {
+            ROBOTTESTINGFRAMEWORK_ASSERT_ERROR("Error while writing " + bin_filename_with_path);
+        }
+
         bool reached= false;
         int in_position=0;
         for (unsigned int i=0; i<jointsList.size(); i++)
@@ -298,16 +311,46 @@ void OpticalEncodersDrift::run()
 
         if (reached)
         {
-            if (go_to_max==false)
+            if (go_to_max==false && settle_start<0)
+            {
+                //the joints enter the tolerance band while still moving: wait for the end of the motion
+                bool done = true;
+                for (unsigned int i=0; i<jointsList.size() && done; i++)
+                {
+                    bool joint_done = false;
+                    ipos->checkMotionDone((int)jointsList[i], &joint_done);
+                    done = joint_done;
+                }
+                if (done) settle_start = curr_time;
+            }
+            else if (go_to_max==false && curr_time-settle_start >= settle_time)
             {
+                //joint and motor encoders have been read together at the top of this iteration, so the
+                //residual positioning error can be separated from the drift
+                for (size_t i = 0; i < jointsList.size(); i++)
+                    drift[i].add(n_returns, enc_jnt_of_interest[i], enc_mot_of_interest[i]);
+                settle_start = -1;
+
                 for (unsigned int i=0; i<jointsList.size(); i++)
                     ipos->positionMove(i,max[i]);
                 go_to_max=true;
                 curr_cycle++;
                 start_time = yarp::os::Time::now();
                 if (curr_cycle % 10 == 0) ROBOTTESTINGFRAMEWORK_TEST_REPORT(Asserter::format("Cycle %d/%d completed", curr_cycle, cycles));
+
+                if (n_returns == 0) first_return_time = curr_time;
+                else                cycle_period = (curr_time - first_return_time) / n_returns;
+                n_returns++;
+
+                if (early_stop && n_returns >= min_cycles && cycle_period > 0)
+                {
+                    double threshold = driftThresholdPerCycle(cycle_period);
+                    settled = (threshold > 0);
+                    for (size_t i = 0; i < drift.size() && settled; i++)
+                        settled = drift[i].isSettled(threshold);
+                }
             }
-            else
+            else if (go_to_max==true)
             {
                 for (unsigned int i=0; i<jointsList.size(); i++)
                     ipos->positionMove(i,min[i]);
@@ -319,64 +362,79 @@ void OpticalEncodersDrift::run()
         }
 
         if (curr_cycle>=cycles) break;
+        if (settled)
+        {
+            ROBOTTESTINGFRAMEWORK_TEST_REPORT(Asserter::format("Drift estimate settled after %d cycles, stopping early", n_returns));
+            break;
+        }
 
         yarp::os::Time::delay(0.010);
     }
 
+    bool recorded = recorder.close();
+
     bool isInHome = goHome();
     yarp::os::Time::delay(2.0);
 
-    //automatic check, not complete yet
+    imot->getMotorEncoders             (end_enc_mot.data());
+    for (int i=0; i<n_part_joints; i++)
     {
-        imot->getMotorEncoders             (end_enc_mot.data());
-        for (int i=0; i<n_part_joints; i++)
-        {
-            err_enc_mot[i]=home_enc_mot[i]-end_enc_mot[i];
-
-            if (fabs(err_enc_mot[i]) > tolerance)
-            {
-                //...assert something
-            }
-        }
+        err_enc_mot[i]=home_enc_mot[i]-end_enc_mot[i];
     }
 
-    time_t now = time(0);
-    tm *ltm = localtime(&now);
-
-    char folder_time_buffer[80];
-    char file_time_buffer[80];
+    //automatic check, based on the drift model
+    bool drift_ok = true;
+    for (size_t i = 0; i < jointsList.size(); i++)
+    {
+        int j = (int)jointsList[i];
+        if (!drift[i].isValid())
+        {
+            ROBOTTESTINGFRAMEWORK_TEST_REPORT(Asserter::format("Joint %d: not enough cycles (%d) to estimate the drift", j, (int)drift[i].samples()));
+            continue;
+        }
 
-    strftime(folder_time_buffer, sizeof(folder_time_buffer), "%d%m%Y", ltm);
-    strftime(file_time_buffer, sizeof(file_time_buffer), "%d%m%Y_%H%M", ltm);
+        double per_cycle = drift[i].slope();
+        double per_hour  = (cycle_period > 0) ? per_cycle * 3600.0 / cycle_period : 0.0;
+        ROBOTTESTINGFRAMEWORK_TEST_REPORT(Asserter::format("Joint %d: drift %.6f +/- %.6f motor deg/cycle, %.3f motor deg/hour (cycle period %.2fs, home-end error %.3f motor deg, motor/joint gain %.3f)",
+                                          j, per_cycle, 1.96*drift[i].slopeStdErr(), per_hour, cycle_period, err_enc_mot[j], drift[i].gain()));
 
-    string folder_time_str(folder_time_buffer);
-    string file_time_str(file_time_buffer); //This string contain also minutes
+        if (max_drift_per_cycle > 0)
+        {
+            bool ok = fabs(per_cycle) <= max_drift_per_cycle;
+            ROBOTTESTINGFRAMEWORK_TEST_FAIL_IF_FALSE(ok, Asserter::format("Joint %d: drift per cycle %.6f exceeds %.6f", j, per_cycle, max_drift_per_cycle));
+            drift_ok = drift_ok && ok;
+        }
+        if (max_drift_per_hour > 0)
+        {
+            bool ok = fabs(per_hour) <= max_drift_per_hour;
+            ROBOTTESTINGFRAMEWORK_TEST_FAIL_IF_FALSE(ok, Asserter::format("Joint %d: drift per hour %.3f exceeds %.3f", j, per_hour, max_drift_per_hour));
+            drift_ok = drift_ok && ok;
+        }
+    }
+    if (drift_ok && (max_drift_per_cycle > 0 || max_drift_per_hour > 0))
+    {
+        ROBOTTESTINGFRAMEWORK_TEST_REPORT("Drift is within the configured limits");
+    }
 
-    // Create the filename with date and time
-    string filename = "encDrift_plot_";
-    filename += partName;
-    filename += "_";
-    filename += file_time_str;
-    filename += ".txt";
-    
-    constexpr char default_robot_name[] = "RobotName";
+    bool saved_files = recorded;
+    if (recorded && text_output)
+    {
+        saved_files = EncodersRecorder::toText(bin_filename_with_path, filename_with_path);
+    }
 
-    string robot_str = yarp::conf::environment::get_string("YARP_ROBOT_NAME", default_robot_name);
-    string directory_tree = "results/" + robot_str + "/encoders-icub_" + folder_time_str + "/encDrift";
-    create_directories(directory_tree); // This function return false if there is an error or if the directories already exist
-    
-    string filename_with_path = directory_tree + "/" + filename;
-    bool saved_files = saveToFile(filename_with_path,dataToPlot);
-    
     if(!saved_files)
     {
         ROBOTTESTINGFRAMEWORK_TEST_REPORT("Error saving files to plot!");
     }
 
     char plotstring[1000];
-    sprintf (plotstring, "gnuplot -e \" unset key; plot for [col=1:%d] '%s' using col with lines \" -persist", (int)jointsList.size(),filename_with_path.c_str());
+    sprintf (plotstring, "gnuplot -e \" unset key; plot for [col=2:%d] '%s' using col with lines \" -persist", (int)jointsList.size()+1,filename_with_path.c_str());
     
-    if(plot)
+    if(!text_output)
+    {
+        ROBOTTESTINGFRAMEWORK_TEST_REPORT("Text output is disabled, convert the binary file with encodersRecorderToText before plotting.");
+    }
+    else if(plot)
     {
         system (plotstring);
     }
@@ -387,6 +445,6 @@ void OpticalEncodersDrift::run()
     }
 
     ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(isInHome, "This part is not in home. Suite test will be terminated!");
-    ROBOTTESTINGFRAMEWORK_TEST_REPORT("Test is finished. Your files are saved in: \n" + filename_with_path);
+    ROBOTTESTINGFRAMEWORK_TEST_REPORT("Test is finished. Your files are saved in: \n" + (text_output ? filename_with_path : bin_filename_with_path));
 
 }
\ No newline at end of file
@@ -22,19 +22,26 @@
 #define _OPTICALENCODERSDRIFT_H_
 
 #include <string>
+#include <vector>
 #include <yarp/robottestingframework/TestCase.h>
 #include <yarp/dev/ControlBoardInterfaces.h>
 #include <yarp/dev/PolyDriver.h>
 #include <yarp/sig/Vector.h>
 #include <yarp/os/Bottle.h>
 #include <yarp/sig/Matrix.h>
+#include "driftEstimator.h"
 
 /**
 * \ingroup icub-tests
 * This tests checks if the relative encoders measurements are consistent over time, by performing cyclic movements between two reference positions (min and max).
-* The test collects data during the joint motion, saves data to a text file a plots the result. If the relative encoder is working correctly, the plot should have no drift.
+* The test collects data during the joint motion, streams them to a binary file (timestamp, motor encoders, joint encoders), converts it to text and plots the result. If the relative encoder is working correctly, the plot should have no drift.
 * Otherwise, a drift in the plot may be caused by a damaged reflective encoder/ optical disk.
 * For best reliability an high number of cycles (e.g. >100) is suggested.
+* Every time the joints come back to the min position and the motion is done, after a settling time, the motor
+* encoders are sampled together with the joint encoders and fitted against the cycle number and the joint position
+* with an online linear regression: the joint position term absorbs the positioning error of each return, and the
+* cycle term is the drift per cycle, which is also extrapolated to one hour using the measured cycle period.
+* The test fails if the drift exceeds the configured limits.
 
 * example: testRunner -v -t OpticalEncodersDrift.dll -p "--robot icub --part head --joints ""(0 1 2)"" --home ""(0 0 0)" --speed "(20 20 20)" --max "(10 10 10)" --min "(-10 -10 -10)" --cycles 100 --tolerance 1.0 "
 * example: testRunner -v -t OpticalEncodersDrift.dll -p "--robot icub --part head --joints ""(2)""     --home ""(0)""    --speed "(20      )" --max "(10      )" --min "(-10)"         --cycles 100 --tolerance 1.0 "
@@ -55,6 +62,13 @@
 * | min                | vector of doubles of size joints  | deg   | - | Yes | The min position using during the joint movement | |
 * | tolerance          | vector of doubles of size joints  | deg   | - | Yes | The tolerance used when moving from min to max reference position and viceversa | |
 * | speed              | vector of doubles of size joints  | deg/s | - | Yes | The reference speed used during the movement  | |
+* | plot_enabled       | bool   | -     | false         | No       | If true, gnuplot is run at the end of the test | |
+* | text_output        | bool   | -     | true          | No       | If true, the binary data file is converted to text at the end of the test | |
+* | max_drift_per_cycle | double | motor deg | 0          | No       | The test fails if the estimated drift per cycle exceeds this value | 0 disables the check |
+* | max_drift_per_hour | double | motor deg | 0           | No       | The test fails if the extrapolated drift per hour exceeds this value | 0 disables the check |
+* | early_stop         | bool   | -     | false         | No       | Stops the test as soon as the drift estimate is statistically settled with respect to the limits | |
+* | min_cycles         | int    | -     | 10            | No       | Minimum number of cycles before an early stop | |
+* | settle_time        | double | s     | 0.5           | No       | Time waited after checkMotionDone() before sampling the encoders at the min position | |
 
 *
 */
@@ -72,7 +86,7 @@ public:
 
     bool goHome();
     void setMode(int desired_mode);
-    bool saveToFile(const std::string &filename, const yarp::os::Bottle &b);
+    double driftThresholdPerCycle(double cycle_period);
 
 private:
     std::string robotName;
@@ -103,6 +117,14 @@ private:
     yarp::sig::Vector speed;
 
     bool plot; //if true, the test runs gnuplot utility at end of test.
+    bool text_output; //if true, the binary recording is converted to text at end of test.
+
+    std::vector<DriftEstimator> drift;
+    double max_drift_per_cycle;
+    double max_drift_per_hour;
+    bool   early_stop;
+    int    min_cycles;
+    double settle_time;
 };
 
 #endif //_opticalEncodersDRIFT_H
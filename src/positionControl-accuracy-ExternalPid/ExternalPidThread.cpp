@@ -0,0 +1,161 @@
+/*
+ * iCub Robot Unit Tests (Robot Testing Framework)
+ *
+ * Copyright (C) 2015-2019 Istituto Italiano di Tecnologia (IIT)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <cmath>
+#include <yarp/os/Time.h>
+
+#include "ExternalPidThread.h"
+
+//a larger difference between the remote timestamps and the local clock means that the clocks are not synchronized
+static const double max_stamp_offset = 1.0; //s
+
+ExternalPidThread::ExternalPidThread(double period, yarp::dev::IEncodersTimed* ienc, yarp::dev::IPWMControl* ipwm, int n_part_joints) :
+    yarp::os::PeriodicThread(period, yarp::os::ShouldUseSystemClock::No, yarp::os::PeriodicThreadClock::Absolute),
+    m_ienc(ienc),
+    m_ipwm(ipwm),
+    m_encoders(n_part_joints, 0.0),
+    m_stamps(n_part_joints, 0.0),
+    m_joint(0),
+    m_zero(0),
+    m_step(0),
+    m_stepDuration(0),
+    m_vup(0),
+    m_vdown(0),
+    m_startTime(0),
+    m_prevTime(0),
+    m_timeZero(0),
+    m_readErrors(false),
+    m_unsyncedStamps(false)
+{
+}
+
+void ExternalPidThread::prepare(int joint, double zero, double step, double step_duration)
+{
+    m_joint = joint;
+    m_zero = zero;
+    m_step = step;
+    m_stepDuration = step_duration;
+    m_pid.reset();
+
+    m_samples.clear();
+    m_samples.reserve((size_t)std::ceil(step_duration / getPeriod()) + 2);
+}
+
+bool ExternalPidThread::threadInit()
+{
+    m_startTime = yarp::os::Time::now();
+    m_prevTime = 0;
+    m_timeZero = 0;
+    m_readErrors = false;
+    m_unsyncedStamps = false;
+    return true;
+}
+
+void ExternalPidThread::run()
+{
+    double curr_time = yarp::os::Time::now();
+    double elapsed = curr_time - m_startTime;
+
+    double ref = m_zero;
+    if (elapsed > m_stepDuration)
+    {
+        askToStop();
+        return;
+    }
+    if (elapsed > 1.0)
+    {
+        ref = m_zero + m_step;
+        if (m_timeZero == 0) m_timeZero = elapsed;
+    }
+
+    //never reallocate inside the loop
+    if (m_samples.size() == m_samples.capacity())
+    {
+        askToStop();
+        return;
+    }
+
+    //pid computation
+    if (!m_ienc->getEncodersTimed(m_encoders.data(), m_stamps.data())) m_readErrors = true;
+    double fb = m_encoders[m_joint];
+    double duty = m_pid.compute(ref, fb);
+
+    //stiction compensation
+    duty += (ref > fb) ? m_vup : m_vdown;
+
+    //control
+    m_ipwm->setRefDutyCycle(m_joint, duty);
+    double cmd_time = yarp::os::Time::now();
+
+    //the encoder stamp comes from the robot clock, the command time from the local one
+    double sense_time = m_stamps[m_joint];
+    if (sense_time > 0 && std::fabs(sense_time - curr_time) > max_stamp_offset)
+    {
+        m_unsyncedStamps = true;
+        sense_time = 0;
+    }
+    if (sense_time <= 0) sense_time = curr_time;
+
+    Sample s;
+    s.time = elapsed;
+    s.encoder = fb;
+    s.ref = ref;
+    s.duty = duty;
+    s.period = m_samples.empty() ? 0 : curr_time - m_prevTime;
+    s.latency = cmd_time - sense_time;
+    m_samples.push_back(s);
+    m_prevTime = curr_time;
+}
+
+//statistics of the period (skipping the first sample, which has none) or of the latency
+static ExternalPidThread::TimingStats timingStats(const std::vector<ExternalPidThread::Sample>& samples, bool period)
+{
+    ExternalPidThread::TimingStats st;
+    st.count = 0;
+    st.mean = 0;
+    st.stddev = 0;
+    st.max = 0;
+
+    double sum = 0;
+    double sum2 = 0;
+    for (size_t i = period ? 1 : 0; i < samples.size(); i++)
+    {
+        double v = period ? samples[i].period : samples[i].latency;
+        sum += v;
+        sum2 += v * v;
+        if (st.count == 0 || v > st.max) st.max = v;
+        st.count++;
+    }
+    if (st.count == 0) return st;
+    st.mean = sum / st.count;
+    double var = sum2 / st.count - st.mean * st.mean;
+    st.stddev = (var > 0) ? std::sqrt(var) : 0;
+    return st;
+}
+
+ExternalPidThread::TimingStats ExternalPidThread::periodStats() const
+{
+    return timingStats(m_samples, true);
+}
+
+ExternalPidThread::TimingStats ExternalPidThread::latencyStats() const
+{
+    return timingStats(m_samples, false);
+}
@@ -0,0 +1,107 @@
+/*
+ * iCub Robot Unit Tests (Robot Testing Framework)
+ *
+ * Copyright (C) 2015-2019 Istituto Italiano di Tecnologia (IIT)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _EXTERNALPIDTHREAD_H_
+#define _EXTERNALPIDTHREAD_H_
+
+#include <vector>
+#include <yarp/os/PeriodicThread.h>
+#include <yarp/dev/ControlBoardInterfaces.h>
+#include "ScalarPid.h"
+
+/**
+* Periodic thread which runs the external position PID of a joint, commanding its PWM.
+* At every period the encoders are read with their timestamps, the PID is evaluated and the duty cycle is sent.
+* The thread uses absolute-deadline scheduling and all its buffers are preallocated by prepare(), so the loop does not allocate.
+* For each sample the actual loop period and the latency from sensing to command (from the encoder timestamp,
+* or from the start of the read if the timestamp is not available or the robot clock is not synchronized with
+* the local one, to the end of the PWM command) are recorded.
+*/
+class ExternalPidThread : public yarp::os::PeriodicThread
+{
+public:
+    struct Sample
+    {
+        double time;     //time since the start of the cycle
+        double encoder;
+        double ref;
+        double duty;
+        double period;   //time since the previous sample (0 for the first one)
+        double latency;  //from sensing to command
+    };
+
+    struct TimingStats
+    {
+        size_t count;
+        double mean;
+        double stddev;
+        double max;
+    };
+
+    ExternalPidThread(double period, yarp::dev::IEncodersTimed* ienc, yarp::dev::IPWMControl* ipwm, int n_part_joints);
+
+    ScalarPid& pid() { return m_pid; }
+
+    /** feed-forward duty cycle added when the reference is above (vup) or below (vdown) the encoder */
+    void setStictionCompensation(double vup, double vdown) { m_vup = vup; m_vdown = vdown; }
+
+    /**
+    * Prepares a new cycle: the reference is zero for the first second, then zero+step until step_duration.
+    * The PID state is reset.
+    */
+    void prepare(int joint, double zero, double step, double step_duration);
+
+    const std::vector<Sample>& samples() const { return m_samples; }
+    double timeZero() const { return m_timeZero; }
+    bool readErrors() const { return m_readErrors; }
+    /** true if the encoder timestamps were too far from the local clock and the latency was measured from the start of the read */
+    bool unsyncedStamps() const { return m_unsyncedStamps; }
+
+    /** statistics of the loop period (jitter is its standard deviation) and of the sensing to command latency */
+    TimingStats periodStats() const;
+    TimingStats latencyStats() const;
+
+protected:
+    bool threadInit() override;
+    void run() override;
+
+private:
+    yarp::dev::IEncodersTimed* m_ienc;
+    yarp::dev::IPWMControl*    m_ipwm;
+    std::vector<double>        m_encoders;
+    std::vector<double>        m_stamps;
+    std::vector<Sample>        m_samples;
+    ScalarPid                  m_pid;
+
+    int    m_joint;
+    double m_zero;
+    double m_step;
+    double m_stepDuration;
+    double m_vup;
+    double m_vdown;
+
+    double m_startTime;
+    double m_prevTime;
+    double m_timeZero;
+    bool   m_readErrors;
+    bool   m_unsyncedStamps;
+};
+
+#endif
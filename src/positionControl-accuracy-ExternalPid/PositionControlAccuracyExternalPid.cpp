@@ -24,11 +24,12 @@
 #include <yarp/os/LogStream.h>
 #include <yarp/os/Time.h>
 #include <yarp/os/Property.h>
-#include <fstream>
-#include <algorithm>
 #include <cstdlib>
+#include <vector>
 
 #include "PositionControlAccuracyExternalPid.h"
+#include "ControlModeSwitcher.h"
+#include "MotionWaiter.h"
 
 using namespace robottestingframework;
 using namespace yarp::os;
@@ -37,7 +38,8 @@ using namespace yarp::dev;
 // prepare the plugin
 ROBOTTESTINGFRAMEWORK_PREPARE_PLUGIN(PositionControlAccuracyExernalPid)
 
-PositionControlAccuracyExernalPid::PositionControlAccuracyExernalPid() : yarp::robottestingframework::TestCase("PositionControlAccuracyExernalPid") {
+PositionControlAccuracyExernalPid::PositionControlAccuracyExernalPid() : yarp::robottestingframework::TestCase("PositionControlAccuracyExernalPid"),
+                                                                         m_samples(1) {
     m_jointsList = 0;
     m_encoders = 0;
     m_zeros = 0;
@@ -48,6 +50,9 @@ PositionControlAccuracyExernalPid::PositionControlAccuracyExernalPid() : yarp::r
     ienc=0;
     idir=0;
     ipwm=0;
+    ient=0;
+    m_pid_thread=0;
+    m_rt_priority=0;
     m_home_tolerance=0.5;
     m_step_duration=4;
     m_pospid_vup=0;
@@ -81,6 +86,8 @@ bool PositionControlAccuracyExernalPid::setup(yarp::os::Property& property) {
       {m_pospid_vup = property.find("pid_vup").asFloat64();}
     if(property.check("pid_vdown"))
       {m_pospid_vdown = property.find("pid_vdown").asFloat64();}
+    if(property.check("rt_priority"))
+      {m_rt_priority = property.find("rt_priority").asInt32();}
 
     m_robotName = property.find("robot").asString();
     m_partName = property.find("part").asString();
@@ -97,9 +104,15 @@ bool PositionControlAccuracyExernalPid::setup(yarp::os::Property& property) {
     m_cycles = property.find("cycles").asInt32();
     ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(m_cycles>0, "invalid cycles");
 
+    m_step_limits.fromProperty(property);
+
     m_sampleTime = property.find("sampleTime").asFloat64();
     ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(m_sampleTime>0, "invalid sampleTime");
 
+    //one cycle lasts step_duration, sampled every sampleTime
+    size_t samples_per_cycle = (size_t)ceil(m_step_duration / m_sampleTime) + 2;
+    m_samples.reserve(m_cycles * samples_per_cycle, m_cycles);
+
     Property options;
     options.put("device", "remote_controlboard");
     options.put("remote", "/" + m_robotName + "/" + m_partName);
@@ -109,6 +122,7 @@ bool PositionControlAccuracyExernalPid::setup(yarp::os::Property& property) {
     ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(dd->isValid(),"Unable to open device driver");
     ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(dd->view(idir),"Unable to open position direct interface");
     ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(dd->view(ienc),"Unable to open encoders interface");
+    ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(dd->view(ient),"Unable to open timed encoders interface");
     ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(dd->view(ipos),"Unable to open position interface");
     ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(dd->view(icmd),"Unable to open control mode interface");
     ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(dd->view(iimd),"Unable to open interaction mode interface");
@@ -125,10 +139,9 @@ bool PositionControlAccuracyExernalPid::setup(yarp::os::Property& property) {
     for (int i = 0; i <m_n_cmd_joints; i++) m_jointsList[i] = jointsBottle->get(i).asInt32();
     for (int i = 0; i <m_n_cmd_joints; i++) m_zeros[i] = zerosBottle->get(i).asFloat64();
 
-    double  p_Ts = m_sampleTime;
-    yarp::sig::Vector p_Kp(1,0.0);
-    yarp::sig::Vector p_Ki(1,0.0);
-    yarp::sig::Vector p_Kd(1,0.0);
+    double p_Kp=0;
+    double p_Ki=0;
+    double p_Kd=0;
     if(property.check("Kp"))
       {p_Kp = property.find("Kp").asFloat64();}
     if(property.check("Ki"))
@@ -138,16 +151,11 @@ bool PositionControlAccuracyExernalPid::setup(yarp::os::Property& property) {
     double p_Max=100;
     if(property.check("MaxValue"))
       {p_Max = property.find("MaxValue").asFloat64();}
-    yarp::sig::Vector p_Wp(1,1);
-    yarp::sig::Vector p_Wi(1,1);
-    yarp::sig::Vector p_Wd(1,1);
-    yarp::sig::Vector p_N (1,10);
-    yarp::sig::Vector p_Tt (1,1);
-    yarp::sig::Matrix p_Lim (1,2);
-    yInfo() << "Using gains Kp:" << p_Kp[0] << " Ki:"<<p_Ki[0] << " Kd:"<<p_Kd[0] << " Max:" << p_Max;
-    p_Lim[0][0]=-p_Max;
-    p_Lim[0][1]=+p_Max;
-    ppid = new iCub::ctrl::parallelPID(p_Ts, p_Kp, p_Ki, p_Kd, p_Wp, p_Wi, p_Wd, p_N, p_Tt, p_Lim);
+    yInfo() << "Using gains Kp:" << p_Kp << " Ki:"<<p_Ki << " Kd:"<<p_Kd << " Max:" << p_Max;
+
+    m_pid_thread = new ExternalPidThread(m_sampleTime, ient, ipwm, m_n_part_joints);
+    m_pid_thread->pid().configure(m_sampleTime, p_Kp, p_Ki, p_Kd, p_Max);
+    m_pid_thread->setStictionCompensation(m_pospid_vup, m_pospid_vdown);
 
     if (m_requested_filename=="auto")
     {
@@ -155,11 +163,11 @@ bool PositionControlAccuracyExernalPid::setup(yarp::os::Property& property) {
         m_requested_filename="ext_";
         m_requested_filename+=(m_robotName+"_");
         m_requested_filename+=(m_partName+"_");
-        sprintf(buff,"%.3f",p_Kp[0]);
+        sprintf(buff,"%.3f",p_Kp);
         m_requested_filename+=("Kp_"+std::string(buff)+"_");
-        sprintf(buff,"%.3f",p_Ki[0]);
+        sprintf(buff,"%.3f",p_Ki);
         m_requested_filename+=("Ki_"+std::string(buff)+"_");
-        sprintf(buff,"%.3f",p_Kd[0]);
+        sprintf(buff,"%.3f",p_Kd);
         m_requested_filename+=("Kdi_"+std::string(buff)+"_");
         sprintf(buff,"%.3f",m_pospid_vup);
         m_requested_filename+=("Vup_"+std::string(buff)+"_");
@@ -175,6 +183,7 @@ bool PositionControlAccuracyExernalPid::setup(yarp::os::Property& property) {
 
 void PositionControlAccuracyExernalPid::tearDown()
 {
+    if (m_pid_thread) { m_pid_thread->stop(); delete m_pid_thread; m_pid_thread = 0; }
     if (m_jointsList) { delete [] m_jointsList; m_jointsList = 0; }
     if (m_zeros) { delete [] m_zeros; m_zeros = 0; }
     if (m_encoders) { delete [] m_encoders; m_encoders = 0; }
@@ -183,64 +192,23 @@ void PositionControlAccuracyExernalPid::tearDown()
 
 void PositionControlAccuracyExernalPid::setMode(int desired_mode)
 {
-    for (int i = 0; i<m_n_cmd_joints; i++)
-    {
-        icmd->setControlMode(m_jointsList[i], desired_mode);
-        iimd->setInteractionMode(m_jointsList[i], VOCAB_IM_STIFF);
-        yarp::os::Time::delay(0.010);
-    }
-
-    int cmode;
-    yarp::dev::InteractionModeEnum imode;
-    int timeout = 0;
-
-    while (1)
-    {
-        int ok=0;
-        for (int i = 0; i<m_n_cmd_joints; i++)
-        {
-            icmd->getControlMode(m_jointsList[i], &cmode);
-            iimd->getInteractionMode(m_jointsList[i], &imode);
-            if (cmode==desired_mode && imode==VOCAB_IM_STIFF) ok++;
-        }
-        if (ok == m_n_cmd_joints) break;
-        if (timeout>100)
-        {
-            ROBOTTESTINGFRAMEWORK_ASSERT_ERROR("Unable to set control mode/interaction mode");
-        }
-        yarp::os::Time::delay(0.2);
-        timeout++;
-    }
+    ControlModeSwitcher switcher(icmd, iimd, m_jointsList, m_n_cmd_joints);
+    ControlModeSwitcher::Result result = switcher.change(desired_mode, VOCAB_IM_STIFF);
+    ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(result.ok, switcher.failureMessage(result, "Control mode change"));
+    ROBOTTESTINGFRAMEWORK_TEST_REPORT(switcher.successMessage(result, "Control mode change"));
 }
 
 bool PositionControlAccuracyExernalPid::goHome()
 {
-    for (int i = 0; i<m_n_cmd_joints; i++)
+    MotionWaiter waiter;
+    waiter.configure(ienc, ipos, m_jointsList, m_n_cmd_joints);
+    waiter.setTolerance(m_home_tolerance);
+    MotionWaiter::Result result = waiter.moveAndWait(std::vector<double>(m_zeros, m_zeros+m_n_cmd_joints), 20.0);
+    if (!result.ok)
     {
-        ipos->setRefSpeed(m_jointsList[i], 20.0);
-        ipos->positionMove(m_jointsList[i], m_zeros[i]);
-    }
-
-    int timeout = 0;
-    while (1)
-    {
-        int in_position=0;
-        for (int i = 0; i<m_n_cmd_joints; i++)
-        {
-            ienc->getEncoder(m_jointsList[i], &m_encoders[m_jointsList[i]]);
-            if (fabs(m_encoders[m_jointsList[i]] - m_zeros[i])<m_home_tolerance) in_position++;
-        }
-        if (in_position == m_n_cmd_joints) break;
-        if (timeout>100)
-        {
-            ROBOTTESTINGFRAMEWORK_ASSERT_ERROR("Timeout while reaching zero position");
-            return false;
-        }
-        yarp::os::Time::delay(0.2);
-        timeout++;
+        ROBOTTESTINGFRAMEWORK_ASSERT_ERROR("Timeout while reaching zero position");
+        return false;
     }
-    //sleep some additional time to complete movement from m_home_tolerance to 0
-    yarp::os::Time::delay(0.5);
     return true;
 }
 
@@ -248,6 +216,9 @@ void PositionControlAccuracyExernalPid::run()
 {
     for (int i = 0; i < m_n_cmd_joints; i++)
     {
+        StepResponseAnalyzer analyzer(m_step_limits);
+        m_samples.clear();
+
         for (int cycle = 0; cycle < m_cycles; cycle++)
         {
             setMode(VOCAB_CM_POSITION);
@@ -256,10 +227,7 @@ void PositionControlAccuracyExernalPid::run()
                 ROBOTTESTINGFRAMEWORK_ASSERT_FAIL("Test stopped");
             };
 
-            ppid->reset(yarp::sig::Vector(1,0.0));
-
             setMode(VOCAB_CM_PWM);
-            double start_time = yarp::os::Time::now();
 
             char cbuff[64];
             sprintf(cbuff, "Testing Joint: %d cycle: %d", i, cycle);
@@ -267,75 +235,53 @@ void PositionControlAccuracyExernalPid::run()
             std::string buff(cbuff);
             ROBOTTESTINGFRAMEWORK_TEST_REPORT(buff);
 
-            double time_zero = 0;
-            yarp::os::Bottle      dataToPlotRaw;
-            yarp::os::Bottle      dataToPlotSync;
-            ienc->getEncoders(m_encoders);
-
-            while (1)
+            //the external pid runs in its own periodic thread
+            m_pid_thread->prepare(m_jointsList[i], m_zeros[i], m_step, m_step_duration);
+            ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(m_pid_thread->start(), "Unable to start the pid thread");
+            if (m_rt_priority > 0 && !m_pid_thread->setPriority(m_rt_priority, 1))
             {
-                double curr_time = yarp::os::Time::now();
-                double elapsed = curr_time - start_time;
-                double ref=0;
-                if (elapsed <= 1.0)
-                {
-                    ref=m_zeros[i];
-                }
-                else if (elapsed > 1.0 && elapsed <= m_step_duration)
-                {
-                    ref=m_zeros[i]+m_step;
-                    if (time_zero == 0) time_zero = elapsed;
-                }
-                else
-                {
-                    break;
-                }
-
-                //pid computation
-                ienc->getEncoders(m_encoders);
-                m_cmd_single = ppid->compute(yarp::sig::Vector(1,ref),yarp::sig::Vector(1,m_encoders[m_jointsList[i]]))[0];
-
-                //stiction compensation
-                if (ref>m_encoders[m_jointsList[i]])
-                {
-                    m_cmd_single+=m_pospid_vup;
-                }
-                else
-                {
-                    m_cmd_single+=m_pospid_vdown;
-                }
-
-                //control
-                ipwm->setRefDutyCycle(m_jointsList[i], m_cmd_single);
-
-                Bottle& b1 = dataToPlotRaw.addList();
-                b1.addInt32(cycle);
-                b1.addFloat64(elapsed);
-                b1.addFloat64(m_encoders[m_jointsList[i]]);
-                b1.addFloat64(ref);
-                b1.addFloat64(m_cmd_single);
-                yarp::os::Time::delay(m_sampleTime);
+                yWarning() << "Unable to set SCHED_FIFO priority" << m_rt_priority << "for the pid thread";
             }
+            while (m_pid_thread->isRunning())
+            {
+                yarp::os::Time::delay(0.05);
+            }
+            m_pid_thread->stop();
 
-            //reorder data
-            for (int t = 0; t < dataToPlotRaw.size(); t++)
+            ROBOTTESTINGFRAMEWORK_TEST_CHECK(!m_pid_thread->readErrors(), "getEncodersTimed failed during the step");
+            if (m_pid_thread->unsyncedStamps())
+            {
+                ROBOTTESTINGFRAMEWORK_TEST_REPORT("The encoder timestamps are not synchronized with the local clock: the latency is measured from the start of the encoder read");
+            }
+            ExternalPidThread::TimingStats period = m_pid_thread->periodStats();
+            ExternalPidThread::TimingStats latency = m_pid_thread->latencyStats();
+            ROBOTTESTINGFRAMEWORK_TEST_REPORT(Asserter::format("Joint %d cycle %d: period %.4f s, jitter %.4f s, max period %.4f s, sensing to command latency %.4f s (max %.4f s)",
+                                                               m_jointsList[i], cycle, period.mean, period.stddev, period.max, latency.mean, latency.max));
+
+            //the duty cycle is saved as extra column
+            const std::vector<ExternalPidThread::Sample>& samples = m_pid_thread->samples();
+            m_samples.beginCycle(cycle);
+            for (size_t t = 0; t < samples.size(); t++)
             {
-                int    cycle = dataToPlotRaw.get(t).asList()->get(0).asInt32();
-                double time = dataToPlotRaw.get(t).asList()->get(1).asFloat64();
-                double val = dataToPlotRaw.get(t).asList()->get(2).asFloat64();
-                double cmd = dataToPlotRaw.get(t).asList()->get(3).asFloat64();
-                double duty = dataToPlotRaw.get(t).asList()->get(4).asFloat64();
-                Bottle& b1 = dataToPlotSync.addList();
-                b1.addInt32(cycle);
-                b1.addFloat64(time - time_zero);
-                b1.addFloat64(val);
-                b1.addFloat64(cmd);
-                b1.addFloat64(duty);
+                m_samples.push(samples[t].time, samples[t].encoder, samples[t].ref, &samples[t].duty);
             }
+            double time_zero = m_pid_thread->timeZero();
 
-            m_dataToSave.append(dataToPlotSync);
+            m_samples.setTimeOffset(time_zero);
+
+            const StepSampleBuffer::Cycle& c = m_samples.cycle(m_samples.cycles() - 1);
+            StepResponseMetrics m = analyzer.add(m_samples.time() + c.begin, m_samples.value() + c.begin, m_samples.command() + c.begin, c.size, c.timeOffset);
+            //a step which cannot be analyzed is a failure only if some metric is limited
+            if (analyzer.hasLimits())
+                ROBOTTESTINGFRAMEWORK_TEST_CHECK(m.valid, Asserter::format("Step response of joint %d cycle %d can be analyzed", m_jointsList[i], cycle));
+            else if (!m.valid)
+                ROBOTTESTINGFRAMEWORK_TEST_REPORT(Asserter::format("Step response of joint %d cycle %d cannot be analyzed", m_jointsList[i], cycle));
         } //cycle loop
 
+        ROBOTTESTINGFRAMEWORK_TEST_REPORT(Asserter::format("Joint %d step response: %s", m_jointsList[i], analyzer.toString().c_str()));
+        std::string failures = analyzer.failuresToString();
+        ROBOTTESTINGFRAMEWORK_TEST_FAIL_IF_FALSE(failures.empty(), Asserter::format("Joint %d step response out of limits: %s", m_jointsList[i], failures.c_str()));
+
         //save data
         std::string filename;
         if (m_requested_filename=="")
@@ -352,7 +298,7 @@ void PositionControlAccuracyExernalPid::run()
             filename=m_requested_filename;
         }
         yInfo() << "Saving file to: "<< filename;
-        saveToFile(filename, m_dataToSave);
+        ROBOTTESTINGFRAMEWORK_TEST_CHECK(m_samples.save(filename), Asserter::format("Saving data to %s", filename.c_str()));
     } //joint loop
 
     //data acquisition ends here
@@ -372,19 +318,3 @@ void PositionControlAccuracyExernalPid::run()
         system(plotstring);
     }*/
 }
-
-void PositionControlAccuracyExernalPid::saveToFile(std::string filename, yarp::os::Bottle &b)
-{
-    std::fstream fs;
-    fs.open(filename.c_str(), std::fstream::out);
-
-    for (int i = 0; i<b.size(); i++)
-    {
-        std::string s = b.get(i).toString();
-        std::replace(s.begin(), s.end(), '(', ' ');
-        std::replace(s.begin(), s.end(), ')', ' ');
-        fs << s << std::endl;
-    }
-
-    fs.close();
-}
@@ -25,15 +25,21 @@
 #include <yarp/robottestingframework/TestCase.h>
 #include <yarp/dev/ControlBoardInterfaces.h>
 #include <yarp/dev/PolyDriver.h>
-//#include <iCub/ctrl/math.h>
-#include <iCub/ctrl/pids.h>
+
+#include "ExternalPidThread.h"
+#include "StepResponseAnalyzer.h"
+#include "StepSampleBuffer.h"
 
 /**
 * \ingroup icub-tests
 * This tests checks the response of the system to a position step, sending directly PWM commands to a joint.
-* The PWM commands are computed using iCub::ctrl::parallelPID class.
-* This test currently does not return any error report. It simply moves a joint, and saves data to a different file for each joint.
-* The data acquired can be analyzed with a Matlab script to evaluate the position PID properties.
+* The PWM commands are computed by a parallel PID (with the same structure of iCub::ctrl::parallelPID) running in a dedicated
+* periodic thread with absolute-deadline scheduling, which reads the encoders with their timestamps.
+* For each cycle the loop period, its jitter and the latency from sensing to command are reported, so that the timing of
+* the external loop can be told apart from the PID performance.
+* For each joint, rise time, overshoot, settling time and steady-state error are computed on every cycle and their mean and standard deviation are reported.
+* The test fails if the mean of a metric exceeds its limit (the checks are disabled by default).
+* The data acquired is also saved to a different file for each joint, and can be analyzed with a Matlab script to evaluate the position PID properties.
 * Be aware that a step greater than 5 degrees at the maximum speed can be dangerous for both the robot and the human operator!
 
 * example: testRunner -v -t PositionControlAccuracyExternalPid.dll -p "--robot icubSim --part head --joints ""(0 1 2)"" --zeros ""(0 0 0)""  --step 5  --cycles 10 --sampleTime 0.010 --Kp 1.0"
@@ -56,6 +62,13 @@
 * | Ki                 | double |       | 0     | No  | The Integral gain | |
 * | Kd                 | double |       | 0     | No  | The Derivative gain | |
 * | MaxValue           | double | %     | 100   | No  | max value for PID output (saturator). | |
+* | rt_priority        | int    | -     | 0     | No  | If >0, the pid thread runs with SCHED_FIFO policy at this priority | Requires the proper privileges |
+* | max_rise_time      | double | s     | -1    | No  | If >=0, max acceptable mean rise time (10%-90%) | |
+* | max_overshoot      | double | %     | -1    | No  | If >=0, max acceptable mean overshoot, in percentage of the response amplitude | |
+* | max_settling_time  | double | s     | -1    | No  | If >=0, max acceptable mean settling time | |
+* | max_steady_state_error | double | deg | -1  | No  | If >=0, max acceptable absolute mean steady-state error | |
+* | settling_band      | double | -     | 0.05  | No  | The settling band, as a fraction of the step amplitude | |
+* | steady_state_window | double | -    | 0.2   | No  | The final fraction of the step used to compute the steady-state value | |
 *
 */
 
@@ -73,7 +86,6 @@ public:
     bool goHome();
     void executeCmd();
     void setMode(int desired_mode);
-    void saveToFile(std::string filename, yarp::os::Bottle &b);
 
 private:
     std::string m_robotName;
@@ -85,7 +97,7 @@ private:
     double      m_step;
     int         m_n_part_joints;
     int         m_n_cmd_joints;
-    yarp::os::Bottle      m_dataToSave;
+    StepSampleBuffer      m_samples;
 
     yarp::dev::PolyDriver        *dd;
     yarp::dev::IPositionControl *ipos;
@@ -94,18 +106,21 @@ private:
     yarp::dev::IEncoders         *ienc;
     yarp::dev::IPositionDirect   *idir;
     yarp::dev::IPWMControl       *ipwm;
+    yarp::dev::IEncodersTimed    *ient;
 
-    iCub::ctrl::parallelPID      *ppid;
+    ExternalPidThread            *m_pid_thread;
+    int                           m_rt_priority;
 
     double m_pospid_vup;
     double m_pospid_vdown;
 
 
-    double  m_cmd_single;
     double* m_encoders;
     std::string  m_requested_filename;
     double m_home_tolerance;
     double m_step_duration;
+
+    StepResponseLimits m_step_limits;
 };
 
 #endif
@@ -0,0 +1,92 @@
+/*
+ * iCub Robot Unit Tests (Robot Testing Framework)
+ *
+ * Copyright (C) 2015-2019 Istituto Italiano di Tecnologia (IIT)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _SCALARPID_H_
+#define _SCALARPID_H_
+
+#include <cmath>
+
+/**
+* Single-input parallel PID with the same structure of iCub::ctrl::parallelPID (with unit set-point weights):
+* u = Kp*e + Ki*integral(e) + Kd*de/dt, with the derivative filtered by a first order filter of
+* time constant Kd/(Kp*N), back-calculation anti-windup with time constant Tt and output saturation.
+* The evaluation works on plain doubles, so it never allocates.
+*/
+class ScalarPid
+{
+public:
+    ScalarPid() : m_ts(0.01), m_kp(0), m_ki(0), m_kd(0), m_n(10), m_tt(1), m_max(100)
+    {
+        reset();
+    }
+
+    void configure(double ts, double kp, double ki, double kd, double max, double n = 10, double tt = 1)
+    {
+        m_ts = ts; m_kp = kp; m_ki = ki; m_kd = kd; m_max = max; m_n = n; m_tt = tt;
+        reset();
+    }
+
+    void reset()
+    {
+        m_integral = 0;
+        m_derivative = 0;
+        m_prevError = 0;
+        m_first = true;
+    }
+
+    double compute(double ref, double fb)
+    {
+        double e = ref - fb;
+        if (m_first) { m_prevError = e; m_first = false; }
+
+        double tf = (m_kp != 0) ? std::fabs(m_kd / (m_kp * m_n)) : 0;
+        m_derivative = (tf * m_derivative + (e - m_prevError)) / (tf + m_ts);
+        m_prevError = e;
+
+        double u = m_kp * e + m_integral + m_kd * m_derivative;
+        double u_sat = u;
+        if (u_sat > m_max) u_sat = m_max;
+        if (u_sat < -m_max) u_sat = -m_max;
+
+        m_integral += m_ts * (m_ki * e + (u_sat - u) / m_tt);
+        return u_sat;
+    }
+
+    double kp() const { return m_kp; }
+    double ki() const { return m_ki; }
+    double kd() const { return m_kd; }
+    double max() const { return m_max; }
+
+private:
+    double m_ts;
+    double m_kp;
+    double m_ki;
+    double m_kd;
+    double m_n;
+    double m_tt;
+    double m_max;
+
+    double m_integral;
+    double m_derivative;
+    double m_prevError;
+    bool   m_first;
+};
+
+#endif
@@ -0,0 +1,141 @@
+/*
+ * iCub Robot Unit Tests (Robot Testing Framework)
+ *
+ * Copyright (C) 2015-2019 Istituto Italiano di Tecnologia (IIT)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <cmath>
+#include "ExcitationSignal.h"
+
+ExcitationSignal::ExcitationSignal() :
+    m_type(Step),
+    m_amplitude(0),
+    m_fMin(0),
+    m_fMax(0),
+    m_duration(0),
+    m_shift(0)
+{
+}
+
+bool ExcitationSignal::parseType(const std::string& name, Type& type)
+{
+    if (name == "step")      { type = Step; return true; }
+    if (name == "chirp")     { type = Chirp; return true; }
+    if (name == "multisine") { type = Multisine; return true; }
+    return false;
+}
+
+void ExcitationSignal::configureStep(double amplitude)
+{
+    m_type = Step;
+    m_amplitude = amplitude;
+    m_frequencies.clear();
+    m_phases.clear();
+    m_shift = 0;
+}
+
+void ExcitationSignal::configureChirp(double amplitude, double f_min, double f_max, double duration)
+{
+    m_type = Chirp;
+    m_amplitude = amplitude;
+    m_fMin = f_min;
+    m_fMax = f_max;
+    m_duration = duration;
+    m_frequencies.clear();
+    m_phases.clear();
+    m_shift = 0;
+}
+
+void ExcitationSignal::configureMultisine(double amplitude, double f_min, double f_max, size_t n, double duration)
+{
+    m_type = Multisine;
+    m_amplitude = amplitude;
+    m_fMin = f_min;
+    m_fMax = f_max;
+    m_duration = duration;
+    m_frequencies.clear();
+    m_phases.clear();
+
+    //log-spaced frequencies, rounded to the frequency resolution of the record and without duplicates
+    double df = 1.0 / duration;
+    for (size_t k = 0; k < n; k++)
+    {
+        double f = (n > 1) ? f_min * std::pow(f_max / f_min, (double)k / (n - 1)) : f_min;
+        double bin = std::round(f / df);
+        if (bin < 1) bin = 1;
+        f = bin * df;
+        if (m_frequencies.empty() || f > m_frequencies.back() + df * 0.5) m_frequencies.push_back(f);
+    }
+
+    //Schroeder phases
+    size_t m = m_frequencies.size();
+    for (size_t k = 0; k < m; k++)
+    {
+        m_phases.push_back(-M_PI * k * (k + 1) / m);
+    }
+
+    //the signal is periodic over the record: start it from its first zero crossing, so that the reference
+    //does not jump when the excitation starts. The shift changes only the phases of the sines.
+    m_shift = 0;
+    if (m == 0 || multisine(0) == 0) return;
+    double dt = 1.0 / (20.0 * m_frequencies.back());
+    for (double t = dt; t <= duration; t += dt)
+    {
+        if ((multisine(t) > 0) == (multisine(0) > 0)) continue;
+        double lo = t - dt;
+        double hi = t;
+        for (int i = 0; i < 50; i++)
+        {
+            double mid = 0.5 * (lo + hi);
+            if ((multisine(mid) > 0) == (multisine(lo) > 0)) lo = mid;
+            else                                             hi = mid;
+        }
+        m_shift = 0.5 * (lo + hi);
+        return;
+    }
+}
+
+double ExcitationSignal::multisine(double t) const
+{
+    double v = 0;
+    for (size_t k = 0; k < m_frequencies.size(); k++)
+    {
+        v += std::sin(2 * M_PI * m_frequencies[k] * t + m_phases[k]);
+    }
+    return v;
+}
+
+double ExcitationSignal::value(double t) const
+{
+    switch (m_type)
+    {
+    case Chirp:
+    {
+        if (t > m_duration) t = m_duration;
+        double ratio = m_fMax / m_fMin;
+        double phase = 2 * M_PI * m_fMin * m_duration / std::log(ratio) * (std::pow(ratio, t / m_duration) - 1);
+        return m_amplitude * std::sin(phase);
+    }
+    case Multisine:
+    {
+        return m_frequencies.empty() ? 0 : m_amplitude * multisine(t + m_shift) / m_frequencies.size();
+    }
+    case Step:
+    default:
+        return m_amplitude;
+    }
+}
@@ -0,0 +1,74 @@
+/*
+ * iCub Robot Unit Tests (Robot Testing Framework)
+ *
+ * Copyright (C) 2015-2019 Istituto Italiano di Tecnologia (IIT)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _EXCITATIONSIGNAL_H_
+#define _EXCITATIONSIGNAL_H_
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/**
+* Reference offset applied by PositionStepSampler after the first second of each cycle.
+* \li step: constant amplitude
+* \li chirp: logarithmic swept sine from f_min to f_max over the given duration
+* \li multisine: sum of n sines with log-spaced frequencies between f_min and f_max, rounded to
+*     multiples of 1/duration so that the record contains an integer number of periods of each sine.
+*     The phases follow Schroeder's rule to limit the crest factor, the amplitude of each sine is
+*     amplitude divided by the number of sines, so the reference never exceeds amplitude. The signal is
+*     shifted in time to start from a zero crossing, so the reference does not jump at the start.
+*/
+class ExcitationSignal
+{
+public:
+    enum Type { Step, Chirp, Multisine };
+
+    ExcitationSignal();
+
+    /** parses "step", "chirp" or "multisine" */
+    static bool parseType(const std::string& name, Type& type);
+
+    void configureStep(double amplitude);
+    void configureChirp(double amplitude, double f_min, double f_max, double duration);
+    void configureMultisine(double amplitude, double f_min, double f_max, size_t n, double duration);
+
+    Type type() const { return m_type; }
+
+    /** value of the excitation t seconds after its start */
+    double value(double t) const;
+
+    /** the frequencies of the multisine (empty for the other types) */
+    const std::vector<double>& frequencies() const { return m_frequencies; }
+
+private:
+    /** sum of the sines of the multisine, not scaled */
+    double multisine(double t) const;
+
+    Type   m_type;
+    double m_amplitude;
+    double m_fMin;
+    double m_fMax;
+    double m_duration;
+    double m_shift; //time shift of the multisine [s]
+    std::vector<double> m_frequencies;
+    std::vector<double> m_phases;
+};
+
+#endif
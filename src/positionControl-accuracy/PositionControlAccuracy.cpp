@@ -24,12 +24,14 @@
 #include <yarp/os/LogStream.h>
 #include <yarp/os/Time.h>
 #include <yarp/os/Property.h>
-#include <fstream>
-#include <algorithm>
+#include <yarp/dev/IRemoteVariables.h>
 #include <cstdlib>
 #include <cmath>
+#include <vector>
 
 #include "PositionControlAccuracy.h"
+#include "ControlModeSwitcher.h"
+#include "MotionWaiter.h"
 
 using namespace robottestingframework;
 using namespace yarp::os;
@@ -50,6 +52,17 @@ PositionControlAccuracy::PositionControlAccuracy() : yarp::robottestingframework
     idir=0;
     m_home_tolerance=0.5;
     m_step_duration=4;
+    m_sampler=0;
+    m_rt_priority=0;
+    m_max_missed_deadlines=-1;
+    m_missed_deadlines=0;
+    m_parallel=false;
+    m_f_min=0.1;
+    m_f_max=5.0;
+    m_n_freqs=20;
+    m_excitation_duration=20.0;
+    m_min_bandwidth=-1;
+    m_min_phase_margin=-1;
 }
 
 PositionControlAccuracy::~PositionControlAccuracy() { }
@@ -74,6 +87,25 @@ bool PositionControlAccuracy::setup(yarp::os::Property& property) {
       {m_home_tolerance = property.find("home_tolerance").asFloat64();}
     if(property.check("step_duration"))
       {m_step_duration = property.find("step_duration").asFloat64();}
+    if(property.check("rt_priority"))
+      {m_rt_priority = property.find("rt_priority").asInt32();}
+    if(property.check("max_missed_deadlines"))
+      {m_max_missed_deadlines = property.find("max_missed_deadlines").asInt32();}
+    if(property.check("parallel"))
+      {m_parallel = property.find("parallel").asBool();}
+    if(property.check("f_min"))
+      {m_f_min = property.find("f_min").asFloat64();}
+    if(property.check("f_max"))
+      {m_f_max = property.find("f_max").asFloat64();}
+    if(property.check("n_freqs"))
+      {m_n_freqs = property.find("n_freqs").asInt32();}
+    if(property.check("excitation_duration"))
+      {m_excitation_duration = property.find("excitation_duration").asFloat64();}
+    if(property.check("min_bandwidth"))
+      {m_min_bandwidth = property.find("min_bandwidth").asFloat64();}
+    if(property.check("min_phase_margin"))
+      {m_min_phase_margin = property.find("min_phase_margin").asFloat64();}
+    m_step_limits.fromProperty(property);
 
     m_robotName = property.find("robot").asString();
     m_partName = property.find("part").asString();
@@ -93,6 +125,35 @@ bool PositionControlAccuracy::setup(yarp::os::Property& property) {
     m_sampleTime = property.find("sampleTime").asFloat64();
     ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(m_sampleTime>0, "invalid sampleTime");
 
+    ExcitationSignal::Type excitation_type = ExcitationSignal::Step;
+    if(property.check("excitation"))
+    {
+        ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(ExcitationSignal::parseType(property.find("excitation").asString(), excitation_type),
+                                                    "invalid excitation: it must be step, chirp or multisine");
+    }
+    if (excitation_type == ExcitationSignal::Step)
+    {
+        m_excitation.configureStep(m_step);
+    }
+    else
+    {
+        ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(m_f_min>0 && m_f_max>m_f_min, "invalid frequency range: it must be 0<f_min<f_max");
+        ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(m_f_max<0.5/m_sampleTime, "f_max must be lower than the Nyquist frequency 0.5/sampleTime");
+        ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(m_n_freqs>1, "invalid n_freqs: it must be >1");
+        ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(m_excitation_duration>0, "invalid excitation_duration");
+        if (excitation_type == ExcitationSignal::Chirp)
+            m_excitation.configureChirp(m_step, m_f_min, m_f_max, m_excitation_duration);
+        else
+            m_excitation.configureMultisine(m_step, m_f_min, m_f_max, m_n_freqs, m_excitation_duration);
+        //the excitation starts after one second
+        m_step_duration = 1.0 + m_excitation_duration;
+    }
+
+    //one cycle lasts step_duration, sampled every sampleTime
+    size_t samples_per_cycle = (size_t)std::ceil(m_step_duration / m_sampleTime) + 2;
+    m_samples.assign(m_n_cmd_joints, StepSampleBuffer());
+    for (int i = 0; i < m_n_cmd_joints; i++) m_samples[i].reserve(m_cycles * samples_per_cycle, m_cycles);
+
     Property options;
     options.put("device", "remote_controlboard");
     options.put("remote", "/" + m_robotName + "/" + m_partName);
@@ -118,6 +179,31 @@ bool PositionControlAccuracy::setup(yarp::os::Property& property) {
     for (int i = 0; i <m_n_cmd_joints; i++) m_jointsList[i] = jointsBottle->get(i).asInt32();
     for (int i = 0; i <m_n_cmd_joints; i++) m_zeros[i] = zerosBottle->get(i).asFloat64();
 
+    m_sampler = new PositionStepSampler(m_sampleTime, ienc, idir, m_n_part_joints);
+    if(property.check("deadline_tolerance"))
+      {m_sampler->setDeadlineTolerance(property.find("deadline_tolerance").asFloat64());}
+
+    //group the joints which can be stepped at the same time
+    std::vector<int> joints(m_jointsList, m_jointsList + m_n_cmd_joints);
+    m_batches = JointBatchScheduler::sequential(m_n_cmd_joints);
+    if (m_parallel)
+    {
+        IRemoteVariables* ivar = 0;
+        Bottle b;
+        CouplingMatrix coupling;
+        std::string coupling_error;
+        if (dd->view(ivar) && ivar->getRemoteVariable("kinematic_mj", b) &&
+            coupling.fromRemoteVariable(b, m_n_part_joints, coupling_error))
+        {
+            m_batches = JointBatchScheduler::independent(joints, coupling);
+        }
+        else
+        {
+            yWarning() << "Unable to get the coupling matrix" << coupling_error << ": the joints will be tested one at a time";
+        }
+    }
+    ROBOTTESTINGFRAMEWORK_TEST_REPORT(Asserter::format("Joint batches: %s", JointBatchScheduler::toString(m_batches, joints).c_str()));
+
     double p_Kp=std::nanf("");
     double p_Ki=std::nanf("");
     double p_Kd=std::nanf("");
@@ -151,6 +237,7 @@ bool PositionControlAccuracy::setup(yarp::os::Property& property) {
 
 void PositionControlAccuracy::tearDown()
 {
+    if (m_sampler) { m_sampler->stop(); delete m_sampler; m_sampler = 0; }
     if (m_jointsList) { delete [] m_jointsList; m_jointsList = 0; }
     if (m_zeros) { delete [] m_zeros; m_zeros = 0; }
     if (m_encoders) { delete [] m_encoders; m_encoders = 0; }
@@ -159,165 +246,173 @@ void PositionControlAccuracy::tearDown()
 
 void PositionControlAccuracy::setMode(int desired_mode)
 {
-    for (int i = 0; i<m_n_cmd_joints; i++)
-    {
-        icmd->setControlMode(m_jointsList[i], desired_mode);
-        iimd->setInteractionMode(m_jointsList[i], VOCAB_IM_STIFF);
-        yarp::os::Time::delay(0.010);
-    }
-
-    int cmode;
-    yarp::dev::InteractionModeEnum imode;
-    int timeout = 0;
-
-    while (1)
-    {
-        int ok=0;
-        for (int i = 0; i<m_n_cmd_joints; i++)
-        {
-            icmd->getControlMode(m_jointsList[i], &cmode);
-            iimd->getInteractionMode(m_jointsList[i], &imode);
-            if (cmode==desired_mode && imode==VOCAB_IM_STIFF) ok++;
-        }
-        if (ok == m_n_cmd_joints) break;
-        if (timeout>100)
-        {
-            ROBOTTESTINGFRAMEWORK_ASSERT_ERROR("Unable to set control mode/interaction mode");
-        }
-        yarp::os::Time::delay(0.2);
-        timeout++;
-    }
+    ControlModeSwitcher switcher(icmd, iimd, m_jointsList, m_n_cmd_joints);
+    ControlModeSwitcher::Result result = switcher.change(desired_mode, VOCAB_IM_STIFF);
+    ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(result.ok, switcher.failureMessage(result, "Control mode change"));
+    ROBOTTESTINGFRAMEWORK_TEST_REPORT(switcher.successMessage(result, "Control mode change"));
 }
 
 bool PositionControlAccuracy::goHome()
 {
-    for (int i = 0; i<m_n_cmd_joints; i++)
+    MotionWaiter waiter;
+    waiter.configure(ienc, ipos, m_jointsList, m_n_cmd_joints);
+    waiter.setTolerance(m_home_tolerance);
+    MotionWaiter::Result result = waiter.moveAndWait(std::vector<double>(m_zeros, m_zeros+m_n_cmd_joints), 20.0);
+    if (!result.ok)
     {
-        ipos->setRefSpeed(m_jointsList[i], 20.0);
-        ipos->positionMove(m_jointsList[i], m_zeros[i]);
+        ROBOTTESTINGFRAMEWORK_ASSERT_ERROR("Timeout while reaching zero position");
+        return false;
     }
+    return true;
+}
 
-    int timeout = 0;
-    while (1)
+void PositionControlAccuracy::run()
+{
+    m_missed_deadlines = 0;
+    for (size_t batch = 0; batch < m_batches.size(); batch++)
     {
-        int in_position=0;
-        for (int i = 0; i<m_n_cmd_joints; i++)
+        const std::vector<size_t>& idx = m_batches[batch];
+        std::vector<int> batch_joints(idx.size());
+        std::vector<double> batch_zeros(idx.size());
+        std::vector<StepResponseAnalyzer> analyzers(idx.size(), StepResponseAnalyzer(m_step_limits));
+        std::vector<FrequencyResponseEstimator> estimators(idx.size());
+        for (size_t k = 0; k < idx.size(); k++)
         {
-            ienc->getEncoder(m_jointsList[i], &m_encoders[m_jointsList[i]]);
-            if (fabs(m_encoders[m_jointsList[i]] - m_zeros[i])<m_home_tolerance) in_position++;
+            //no window: the multisine record contains an integer number of periods of each sine, and a window
+            //would remove most of the energy of the chirp at the edges of the band, where it sweeps f_min and f_max
+            estimators[k].setWindow(false);
+            if (m_excitation.type() == ExcitationSignal::Multisine)
+            {
+                estimators[k].setFrequencies(m_excitation.frequencies());
+            }
+            else
+            {
+                estimators[k].setFrequencies(FrequencyResponseEstimator::logSpace(m_f_min, m_f_max, m_n_freqs));
+            }
         }
-        if (in_position == m_n_cmd_joints) break;
-        if (timeout>100)
+        for (size_t k = 0; k < idx.size(); k++)
         {
-            ROBOTTESTINGFRAMEWORK_ASSERT_ERROR("Timeout while reaching zero position");
-            return false;
+            batch_joints[k] = m_jointsList[idx[k]];
+            batch_zeros[k] = m_zeros[idx[k]];
+            m_samples[idx[k]].clear();
         }
-        yarp::os::Time::delay(0.2);
-        timeout++;
-    }
-    //sleep some additional time to complete movement from m_home_tolerance to 0
-    yarp::os::Time::delay(0.5);
-    return true;
-}
 
-void PositionControlAccuracy::run()
-{
-    for (int i = 0; i < m_n_cmd_joints; i++)
-    {
         for (int cycle = 0; cycle < m_cycles; cycle++)
         {
-			ipid->setPid(VOCAB_PIDTYPE_POSITION,m_jointsList[i],m_orig_pid);
+            for (size_t k = 0; k < idx.size(); k++)
+                ipid->setPid(VOCAB_PIDTYPE_POSITION,batch_joints[k],m_orig_pid);
             setMode(VOCAB_CM_POSITION);
             if (goHome() == false)
             {
                 ROBOTTESTINGFRAMEWORK_ASSERT_FAIL("Test stopped");
             };
 
-            ipid->setPid(VOCAB_PIDTYPE_POSITION,m_jointsList[i],m_new_pid);
+            for (size_t k = 0; k < idx.size(); k++)
+                ipid->setPid(VOCAB_PIDTYPE_POSITION,batch_joints[k],m_new_pid);
             setMode(VOCAB_CM_POSITION_DIRECT);
-            double start_time = yarp::os::Time::now();
-
-            char cbuff[64];
-            sprintf(cbuff, "Testing Joint: %d cycle: %d", i, cycle);
 
-            std::string buff(cbuff);
-            ROBOTTESTINGFRAMEWORK_TEST_REPORT(buff);
+            std::string batch_str;
+            for (size_t k = 0; k < idx.size(); k++)
+                batch_str += (k == 0 ? "" : " ") + std::to_string(batch_joints[k]);
+            ROBOTTESTINGFRAMEWORK_TEST_REPORT(Asserter::format("Testing Joints: %s cycle: %d", batch_str.c_str(), cycle));
 
-            double time_zero = 0;
-            yarp::os::Bottle      dataToPlotRaw;
-            yarp::os::Bottle      dataToPlotSync;
+            //the step is commanded and acquired by the periodic sampler thread, for all the joints of the batch at the same time
+            m_sampler->prepare(batch_joints, batch_zeros, m_excitation, m_step_duration);
+            ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(m_sampler->start(), "Unable to start the sampler thread");
+            if (m_rt_priority > 0 && !m_sampler->setPriority(m_rt_priority, 1))
+            {
+                yWarning() << "Unable to set SCHED_FIFO priority" << m_rt_priority << "for the sampler thread";
+            }
+            while (m_sampler->isRunning())
+            {
+                yarp::os::Time::delay(0.05);
+            }
+            m_sampler->stop();
 
-            while (1)
+            ROBOTTESTINGFRAMEWORK_TEST_CHECK(!m_sampler->readErrors(), "getEncoders failed during the step");
+            const std::vector<PositionStepSampler::Sample>& samples = m_sampler->samples();
+            const std::vector<size_t>& missed = m_sampler->missedDeadlines();
+            for (size_t k = 0; k < missed.size(); k++)
             {
-                double curr_time = yarp::os::Time::now();
-                double elapsed = curr_time - start_time;
+                yWarning() << "Joints" << batch_str << "cycle" << cycle << ": sample" << missed[k]
+                           << "at" << samples[missed[k]].time << "s missed its deadline by" << samples[missed[k]].lateness << "s";
+            }
+            ROBOTTESTINGFRAMEWORK_TEST_REPORT(Asserter::format("Joints %s cycle %d: %d samples, %d missed deadlines, max lateness %.4f s",
+                                                               batch_str.c_str(), cycle, (int)samples.size(), (int)missed.size(), m_sampler->maxLateness()));
+            m_missed_deadlines += missed.size();
 
-                if (elapsed <= 1.0)
+            for (size_t k = 0; k < idx.size(); k++)
+            {
+                StepSampleBuffer& buffer = m_samples[idx[k]];
+                const std::vector<double>& encoders = m_sampler->encoders(k);
+                const std::vector<double>& commands = m_sampler->commands(k);
+                buffer.beginCycle(cycle);
+                buffer.setTimeOffset(m_sampler->timeZero());
+                for (size_t t = 0; t < samples.size(); t++)
                 {
-                    m_cmd_single = m_zeros[i]; //0.0;
+                    buffer.push(samples[t].time, encoders[t], commands[t]);
                 }
-                else if (elapsed > 1.0 && elapsed <= m_step_duration)
+
+                const StepSampleBuffer::Cycle& c = buffer.cycle(buffer.cycles() - 1);
+                if (m_excitation.type() == ExcitationSignal::Step)
                 {
-                    m_cmd_single = m_zeros[i] + m_step;
-                    if (time_zero == 0) time_zero = elapsed;
+                    StepResponseMetrics m = analyzers[k].add(buffer.time() + c.begin, buffer.value() + c.begin, buffer.command() + c.begin, c.size, c.timeOffset);
+                    //a step which cannot be analyzed is a failure only if some metric is limited
+                    if (analyzers[k].hasLimits())
+                        ROBOTTESTINGFRAMEWORK_TEST_CHECK(m.valid, Asserter::format("Step response of joint %d cycle %d can be analyzed", batch_joints[k], cycle));
+                    else if (!m.valid)
+                        ROBOTTESTINGFRAMEWORK_TEST_REPORT(Asserter::format("Step response of joint %d cycle %d cannot be analyzed", batch_joints[k], cycle));
                 }
                 else
                 {
-                    break;
+                    if (!estimators[k].add(buffer.time() + c.begin, buffer.command() + c.begin, buffer.value() + c.begin, c.size, c.timeOffset))
+                        ROBOTTESTINGFRAMEWORK_TEST_REPORT(Asserter::format("Frequency response of joint %d cycle %d cannot be analyzed", batch_joints[k], cycle));
                 }
-
-                ienc->getEncoders(m_encoders);
-                idir->setPosition(m_jointsList[i], m_cmd_single);
-
-                Bottle& b1 = dataToPlotRaw.addList();
-                b1.addInt32(cycle);
-                b1.addFloat64(elapsed);
-                b1.addFloat64(m_encoders[m_jointsList[i]]);
-                b1.addFloat64(m_cmd_single);
-                yarp::os::Time::delay(m_sampleTime);
             }
+        } //cycle loop
 
-            //reorder data
-            for (int t = 0; t < dataToPlotRaw.size(); t++)
+        for (size_t k = 0; k < idx.size(); k++)
+        {
+            int i = (int)idx[k];
+            if (m_excitation.type() == ExcitationSignal::Step)
             {
-                int    cycle = dataToPlotRaw.get(t).asList()->get(0).asInt32();
-                double time = dataToPlotRaw.get(t).asList()->get(1).asFloat64();
-                double val = dataToPlotRaw.get(t).asList()->get(2).asFloat64();
-                double cmd = dataToPlotRaw.get(t).asList()->get(3).asFloat64();
-                Bottle& b1 = dataToPlotSync.addList();
-                b1.addInt32(cycle);
-                b1.addFloat64(time - time_zero);
-                b1.addFloat64(val);
-                b1.addFloat64(cmd);
+                reportStepResponse(m_jointsList[i], analyzers[k]);
+            }
+            else
+            {
+                reportFrequencyResponse(i, estimators[k]);
             }
 
-            m_dataToSave.append(dataToPlotSync);
-        } //cycle loop
-
-        //save data
-        std::string filename;
-        if (m_requested_filename=="")
-        {
-            char cfilename[128];
-            sprintf(cfilename, "positionControlAccuracy_plot_%s%d.txt", m_partName.c_str(), i);
-            filename = cfilename;
-            //filename += m_partName;
-            //filename += std::to_string(i);
-            //filename += ".txt";
-        }
-        else
-        {
-            filename=m_requested_filename;
+            //save data
+            std::string filename;
+            bool append = false;
+            if (m_requested_filename=="")
+            {
+                char cfilename[128];
+                sprintf(cfilename, "positionControlAccuracy_plot_%s%d.txt", m_partName.c_str(), i);
+                filename = cfilename;
+            }
+            else
+            {
+                //all the joints are saved in the same file, in the order they were tested
+                filename=m_requested_filename;
+                append = (batch > 0 || k > 0);
+            }
+            yInfo() << "Saving file to: "<< filename;
+            ROBOTTESTINGFRAMEWORK_TEST_CHECK(m_samples[i].save(filename, append), Asserter::format("Saving data to %s", filename.c_str()));
+            ipid->setPid(VOCAB_PIDTYPE_POSITION,m_jointsList[i],m_orig_pid);
         }
-        yInfo() << "Saving file to: "<< filename;
-        saveToFile(filename, m_dataToSave);
-        ipid->setPid(VOCAB_PIDTYPE_POSITION,m_jointsList[i],m_orig_pid);
-    } //joint loop
+    } //batch loop
 
     //data acquisition ends here
     setMode(VOCAB_CM_POSITION);
     goHome();
     ROBOTTESTINGFRAMEWORK_TEST_REPORT("Data acquisition complete");
+    ROBOTTESTINGFRAMEWORK_TEST_REPORT(Asserter::format("Total missed deadlines: %d", (int)m_missed_deadlines));
+    if (m_max_missed_deadlines >= 0)
+    {
+        ROBOTTESTINGFRAMEWORK_TEST_CHECK((int)m_missed_deadlines <= m_max_missed_deadlines, "Number of missed sampling deadlines");
+    }
 
     //plot data
     /*for (int i = 0; i < m_n_cmd_joints; i++)
@@ -332,18 +427,34 @@ void PositionControlAccuracy::run()
     }*/
 }
 
-void PositionControlAccuracy::saveToFile(std::string filename, yarp::os::Bottle &b)
+void PositionControlAccuracy::reportStepResponse(int joint, const StepResponseAnalyzer& analyzer)
 {
-    std::fstream fs;
-    fs.open(filename.c_str(), std::fstream::out);
+    ROBOTTESTINGFRAMEWORK_TEST_REPORT(Asserter::format("Joint %d step response: %s", joint, analyzer.toString().c_str()));
+    std::string failures = analyzer.failuresToString();
+    ROBOTTESTINGFRAMEWORK_TEST_FAIL_IF_FALSE(failures.empty(), Asserter::format("Joint %d step response out of limits: %s", joint, failures.c_str()));
+}
 
-    for (int i = 0; i<b.size(); i++)
+void PositionControlAccuracy::reportFrequencyResponse(int i, const FrequencyResponseEstimator& estimator)
+{
+    int joint = m_jointsList[i];
+    double crossover = 0;
+    double bandwidth = estimator.bandwidth();
+    double phase_margin = estimator.phaseMargin(&crossover);
+    ROBOTTESTINGFRAMEWORK_TEST_REPORT(Asserter::format("Joint %d frequency response: bandwidth %.3f Hz, phase margin %.1f deg at %.3f Hz",
+                                                       joint, bandwidth, phase_margin, crossover));
+    if (m_min_bandwidth >= 0)
+    {
+        ROBOTTESTINGFRAMEWORK_TEST_FAIL_IF_FALSE(bandwidth >= m_min_bandwidth,
+                                                 Asserter::format("Joint %d bandwidth %.3f Hz is below %.3f Hz", joint, bandwidth, m_min_bandwidth));
+    }
+    if (m_min_phase_margin >= 0)
     {
-        std::string s = b.get(i).toString();
-        std::replace(s.begin(), s.end(), '(', ' ');
-        std::replace(s.begin(), s.end(), ')', ' ');
-        fs << s << std::endl;
+        ROBOTTESTINGFRAMEWORK_TEST_FAIL_IF_FALSE(phase_margin >= m_min_phase_margin,
+                                                 Asserter::format("Joint %d phase margin %.1f deg is below %.1f deg", joint, phase_margin, m_min_phase_margin));
     }
 
-    fs.close();
+    char cfilename[128];
+    sprintf(cfilename, "positionControlAccuracy_bode_%s%d.txt", m_partName.c_str(), i);
+    yInfo() << "Saving frequency response to: "<< cfilename;
+    ROBOTTESTINGFRAMEWORK_TEST_CHECK(estimator.save(cfilename), Asserter::format("Saving data to %s", cfilename));
 }
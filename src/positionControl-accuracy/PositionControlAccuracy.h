@@ -22,15 +22,30 @@
 #define _POSITIONACCURACY_H_
 
 #include <string>
+#include <vector>
 #include <yarp/robottestingframework/TestCase.h>
 #include <yarp/dev/ControlBoardInterfaces.h>
 #include <yarp/dev/PolyDriver.h>
 
+#include "FrequencyResponseEstimator.h"
+#include "JointBatchScheduler.h"
+#include "PositionStepSampler.h"
+#include "StepResponseAnalyzer.h"
+#include "StepSampleBuffer.h"
+
 /**
 * \ingroup icub-tests
 * This tests checks the a position PID response, sending a step reference signal with a positionDirect command.
-* This test currently does not return any error report. It simply moves a joint, and saves data to a different file for each joint.
-* The data acquired can be analyzed with a Matlab script to evaluate the position PID properties.
+* The reference is sent and the encoders are acquired by a periodic thread with absolute-deadline scheduling, every sampleTime.
+* With the parallel option the joints which are not mechanically coupled (according to the kinematic_mj coupling matrix of the part)
+* are grouped in batches and stepped at the same time, so that the homing phase is shared by all the joints of a batch.
+* Instead of the step, a chirp or a multisine excitation of amplitude 'step' can be used: in this case the closed-loop
+* frequency response (Bode magnitude and phase) of each joint is estimated by correlation, averaging all the cycles.
+* The bandwidth (-3dB) and the phase margin of the equivalent unity-feedback open loop are reported and the response is saved to a file.
+* Samples taken late are logged as missed deadlines, so that the harness timing can be told apart from the controller response.
+* For each joint, rise time, overshoot, settling time and steady-state error are computed on every cycle and their mean and standard deviation are reported.
+* The test fails if the mean of a metric exceeds its limit (the checks are disabled by default).
+* The data acquired is also saved to a different file for each joint, and can be analyzed with a Matlab script to evaluate the position PID properties.
 * Be aware that a step greater than 5 degrees at the maximum speed can be dangerous for both the robot and the human operator!
 
 * example: testRunner -v -t PositionControlAccuracy.dll -p "--robot icubSim --part head --joints ""(0 1 2)"" --zeros ""(0 0 0)""  --step 5  --cycles 10 --sampleTime 0.010"
@@ -44,11 +59,28 @@
 * | joints             | vector of ints | - | - | Yes | List of joints to be tested | |
 * | zeros              | double | deg   | -     | Yes | The home position for each joint | |
 * | cycles             | int    | -     | -     | Yes | Each joint will be tested multiple times |   |
-* | step               | double | deg   | -     | Yes | The amplitude of the step reference signal | Recommended max: 5 deg! |
+* | step               | double | deg   | -     | Yes | The amplitude of the step reference signal (or of the chirp/multisine excitation) | Recommended max: 5 deg! |
 * | sampleTime         | double | s     | -     | Yes | The sample time of the control thread | |
 * | home_tolerance     | double | deg   | 0.5   | No  | The max acceptable position error during the homing phase. | |
 * | filename           | string |       |       | No  | The output filename. If not specified, the name will be generated using 'part' parameter and joint number | |
 * | step_duration      | double | s     |       | No  | The duration of the step. After this time, a new test cycle starts. | |
+* | rt_priority        | int    | -     | 0     | No  | If >0, the sampler thread runs with SCHED_FIFO policy at this priority | Requires the proper privileges |
+* | deadline_tolerance | double | s     | sampleTime/2 | No | A sample taken later than this with respect to its nominal time is a missed deadline | |
+* | max_missed_deadlines | int  | -     | -1    | No  | If >=0, the test fails when the total number of missed deadlines exceeds this value | |
+* | parallel           | bool   | -     | false | No  | If true, uncoupled joints are tested at the same time | Make sure that moving several joints at once is safe |
+* | excitation         | string | -     | step  | No  | The reference signal: step, chirp or multisine | |
+* | excitation_duration | double | s    | 20    | No  | The duration of the chirp/multisine excitation. It replaces step_duration | |
+* | f_min              | double | Hz    | 0.1   | No  | The lowest frequency of the chirp/multisine | |
+* | f_max              | double | Hz    | 5     | No  | The highest frequency of the chirp/multisine | Must be lower than 0.5/sampleTime |
+* | n_freqs            | int    | -     | 20    | No  | The number of sines of the multisine, or of frequencies analyzed with the chirp | |
+* | min_bandwidth      | double | Hz    | -1    | No  | If >=0, the test fails if the closed-loop bandwidth is lower | |
+* | min_phase_margin   | double | deg   | -1    | No  | If >=0, the test fails if the phase margin is lower | |
+* | max_rise_time      | double | s     | -1    | No  | If >=0, max acceptable mean rise time (10%-90%) | |
+* | max_overshoot      | double | %     | -1    | No  | If >=0, max acceptable mean overshoot, in percentage of the response amplitude | |
+* | max_settling_time  | double | s     | -1    | No  | If >=0, max acceptable mean settling time | |
+* | max_steady_state_error | double | deg | -1  | No  | If >=0, max acceptable absolute mean steady-state error | |
+* | settling_band      | double | -     | 0.05  | No  | The settling band, as a fraction of the step amplitude | |
+* | steady_state_window | double | -    | 0.2   | No  | The final fraction of the step used to compute the steady-state value | |
 *
 */
 
@@ -66,7 +98,8 @@ public:
     bool goHome();
     void executeCmd();
     void setMode(int desired_mode);
-    void saveToFile(std::string filename, yarp::os::Bottle &b);
+    void reportStepResponse(int joint, const StepResponseAnalyzer& analyzer);
+    void reportFrequencyResponse(int i, const FrequencyResponseEstimator& estimator);
 
 private:
     std::string m_robotName;
@@ -78,7 +111,7 @@ private:
     double      m_step;
     int         m_n_part_joints;
     int         m_n_cmd_joints;
-    yarp::os::Bottle      m_dataToSave;
+    std::vector<StepSampleBuffer> m_samples;
 
     yarp::dev::PolyDriver        *dd;
     yarp::dev::IPositionControl *ipos;
@@ -95,6 +128,24 @@ private:
     double m_step_duration;
     yarp::dev::Pid m_orig_pid;
     yarp::dev::Pid m_new_pid;
+
+    PositionStepSampler* m_sampler;
+    int    m_rt_priority;
+    int    m_max_missed_deadlines;
+    size_t m_missed_deadlines;
+
+    StepResponseLimits m_step_limits;
+
+    bool m_parallel;
+    JointBatchScheduler::Batches m_batches;
+
+    ExcitationSignal m_excitation;
+    double m_f_min;
+    double m_f_max;
+    int    m_n_freqs;
+    double m_excitation_duration;
+    double m_min_bandwidth;
+    double m_min_phase_margin;
 };
 
 #endif
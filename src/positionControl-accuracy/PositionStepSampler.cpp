@@ -0,0 +1,123 @@
+/*
+ * iCub Robot Unit Tests (Robot Testing Framework)
+ *
+ * Copyright (C) 2015-2019 Istituto Italiano di Tecnologia (IIT)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <cmath>
+#include <yarp/os/Time.h>
+
+#include "PositionStepSampler.h"
+
+PositionStepSampler::PositionStepSampler(double period, yarp::dev::IEncoders* ienc, yarp::dev::IPositionDirect* idir, int n_part_joints) :
+    yarp::os::PeriodicThread(period, yarp::os::ShouldUseSystemClock::No, yarp::os::PeriodicThreadClock::Absolute),
+    m_ienc(ienc),
+    m_idir(idir),
+    m_encoders(n_part_joints, 0.0),
+    m_stepDuration(0),
+    m_deadlineTolerance(period * 0.5),
+    m_startTime(0),
+    m_timeZero(0),
+    m_maxLateness(0),
+    m_tick(0),
+    m_readErrors(false)
+{
+}
+
+void PositionStepSampler::prepare(const std::vector<int>& joints, const std::vector<double>& zeros, const ExcitationSignal& excitation, double step_duration)
+{
+    m_joints = joints;
+    m_zeros = zeros;
+    m_refs.resize(joints.size());
+    m_excitation = excitation;
+    m_stepDuration = step_duration;
+
+    size_t capacity = (size_t)std::ceil(step_duration / getPeriod()) + 2;
+    m_samples.clear();
+    m_samples.reserve(capacity);
+    m_missed.clear();
+    m_missed.reserve(capacity);
+    m_jointEncoders.resize(joints.size());
+    m_jointCommands.resize(joints.size());
+    for (size_t k = 0; k < joints.size(); k++)
+    {
+        m_jointEncoders[k].clear();
+        m_jointEncoders[k].reserve(capacity);
+        m_jointCommands[k].clear();
+        m_jointCommands[k].reserve(capacity);
+    }
+}
+
+bool PositionStepSampler::threadInit()
+{
+    m_startTime = yarp::os::Time::now();
+    m_timeZero = 0;
+    m_maxLateness = 0;
+    m_tick = 0;
+    m_readErrors = false;
+    return true;
+}
+
+void PositionStepSampler::run()
+{
+    double curr_time = yarp::os::Time::now();
+    double elapsed = curr_time - m_startTime;
+    //if the scheduler skipped some slots, the sample belongs to a later slot and the skipped ones are missed too
+    size_t slot = (size_t)std::floor(elapsed / getPeriod());
+    if (slot < m_tick) slot = m_tick;
+    double lateness = elapsed - slot * getPeriod();
+    bool skipped = (slot > m_tick);
+    m_tick = slot + 1;
+
+    if (elapsed > m_stepDuration)
+    {
+        askToStop();
+        return;
+    }
+
+    //the step (or the excitation) starts after one second
+    double offset = 0;
+    if (elapsed > 1.0)
+    {
+        offset = m_excitation.value(elapsed - 1.0);
+        if (m_timeZero == 0) m_timeZero = elapsed;
+    }
+
+    //never reallocate inside the loop
+    if (m_samples.size() == m_samples.capacity())
+    {
+        askToStop();
+        return;
+    }
+
+    if (!m_ienc->getEncoders(m_encoders.data())) m_readErrors = true;
+    for (size_t k = 0; k < m_joints.size(); k++) m_refs[k] = m_zeros[k] + offset;
+    m_idir->setPositions((int)m_joints.size(), m_joints.data(), m_refs.data());
+
+    Sample s;
+    s.time = elapsed;
+    s.lateness = lateness;
+    m_samples.push_back(s);
+    for (size_t k = 0; k < m_joints.size(); k++)
+    {
+        m_jointEncoders[k].push_back(m_encoders[m_joints[k]]);
+        m_jointCommands[k].push_back(m_refs[k]);
+    }
+
+    if (lateness > m_maxLateness) m_maxLateness = lateness;
+    if (skipped || lateness > m_deadlineTolerance) m_missed.push_back(m_samples.size() - 1);
+}
@@ -0,0 +1,95 @@
+/*
+ * iCub Robot Unit Tests (Robot Testing Framework)
+ *
+ * Copyright (C) 2015-2019 Istituto Italiano di Tecnologia (IIT)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _POSITIONSTEPSAMPLER_H_
+#define _POSITIONSTEPSAMPLER_H_
+
+#include <vector>
+#include <yarp/os/PeriodicThread.h>
+#include <yarp/dev/ControlBoardInterfaces.h>
+#include "ExcitationSignal.h"
+
+/**
+* Periodic thread which sends the step (or the excitation signal) reference with IPositionDirect and acquires the encoders.
+* A batch of joints can be stepped at the same time: the references of all the joints are sent with a single
+* setPositions() call, and one encoder/command stream is recorded for each joint.
+* The thread uses absolute-deadline scheduling (PeriodicThreadClock::Absolute), so the sampling
+* period does not drift with the time spent in the RPC calls. Samples are stored in a buffer
+* preallocated by prepare(), so no allocation happens inside the loop.
+* A sample is considered to have missed its deadline when it is taken more than the configured
+* tolerance after its nominal time (start + k * period), or when one or more periods were skipped before it.
+*/
+class PositionStepSampler : public yarp::os::PeriodicThread
+{
+public:
+    struct Sample
+    {
+        double time;     //time since the start of the cycle
+        double lateness; //delay with respect to the nominal sample time
+    };
+
+    PositionStepSampler(double period, yarp::dev::IEncoders* ienc, yarp::dev::IPositionDirect* idir, int n_part_joints);
+
+    /**
+    * Prepares a new cycle: the joints are kept at their zero for the first second, then the
+    * reference zero+excitation is sent until step_duration.
+    */
+    void prepare(const std::vector<int>& joints, const std::vector<double>& zeros, const ExcitationSignal& excitation, double step_duration);
+
+    void setDeadlineTolerance(double tolerance) { m_deadlineTolerance = tolerance; }
+
+    const std::vector<Sample>& samples() const { return m_samples; }
+    /** encoder and command streams of the k-th joint of the batch, one value per sample */
+    const std::vector<double>& encoders(size_t k) const { return m_jointEncoders[k]; }
+    const std::vector<double>& commands(size_t k) const { return m_jointCommands[k]; }
+    double timeZero() const { return m_timeZero; }
+    const std::vector<size_t>& missedDeadlines() const { return m_missed; }
+    double maxLateness() const { return m_maxLateness; }
+    bool readErrors() const { return m_readErrors; }
+
+protected:
+    bool threadInit() override;
+    void run() override;
+
+private:
+    yarp::dev::IEncoders*       m_ienc;
+    yarp::dev::IPositionDirect* m_idir;
+    std::vector<double>         m_encoders;
+    std::vector<Sample>         m_samples;
+    std::vector<size_t>         m_missed;
+
+    std::vector<int>                 m_joints;
+    std::vector<double>              m_zeros;
+    std::vector<double>              m_refs;
+    std::vector<std::vector<double>> m_jointEncoders;
+    std::vector<std::vector<double>> m_jointCommands;
+
+    ExcitationSignal m_excitation;
+    double m_stepDuration;
+    double m_deadlineTolerance;
+
+    double m_startTime;
+    double m_timeZero;
+    double m_maxLateness;
+    size_t m_tick;
+    bool   m_readErrors;
+};
+
+#endif
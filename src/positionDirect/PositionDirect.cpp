@@ -23,8 +23,12 @@
 #include <robottestingframework/dll/Plugin.h>
 #include <yarp/os/Time.h>
 #include <yarp/os/Property.h>
+#include <yarp/os/LogStream.h>
 
 #include "PositionDirect.h"
+#include "FrequencyResponseEstimator.h"
+#include "ControlModeSwitcher.h"
+#include "MotionWaiter.h"
 
 using namespace robottestingframework;
 using namespace yarp::os;
@@ -34,16 +38,18 @@ using namespace yarp::dev;
 ROBOTTESTINGFRAMEWORK_PREPARE_PLUGIN(PositionDirect)
 
 PositionDirect::PositionDirect() : yarp::robottestingframework::TestCase("PositionDirect") {
-    jointsList=0;
-    pos_tot=0;
+    max_phase_lag=-1;
+    max_drop_rate=-1;
+    rt_priority=0;
+    n_part_joints=0;
+    n_cmd_joints=0;
     dd=0;
     ipos=0;
     icmd=0;
     iimd=0;
     ienc=0;
     idir=0;
-    cmd_some=0;
-    cmd_tot=0;
+    streamer=0;
 }
 
 PositionDirect::~PositionDirect() { }
@@ -64,7 +70,6 @@ bool PositionDirect::setup(yarp::os::Property& property) {
     ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(property.check("cycles"), "The number of cycles of the control signal must be given as the test parameter!");
     ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(property.check("tolerance"), "The tolerance of the control signal must be given as the test parameter!");
     ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(property.check("sampleTime"), "The sampleTime of the control signal must be given as the test parameter!");
-    ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(property.check("cmdMode"), "the cmdType must be given as the test parameter! 0=single_joint, 1=all_joints, 2=some_joints");
 
     robotName = property.find("robot").asString();
     partName = property.find("part").asString();
@@ -89,10 +94,11 @@ bool PositionDirect::setup(yarp::os::Property& property) {
     ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(tolerance>0,"invalid tolerance");
 
     sampleTime = property.find("sampleTime").asFloat64();
-    ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(sampleTime>0,"invalid sampleTime");
+    ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(sampleTime>=0.001,"invalid sampleTime, it must be >=0.001");
 
-    cmd_mode = (cmd_mode_t) property.find("cmdMode").asInt32();
-    ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(cmd_mode>=0 && cmd_mode<=2,"invalid cmdMode: can be 0=single_joint, 1=all_joints ,2=some_joints");
+    if(property.check("max_phase_lag")) {max_phase_lag = property.find("max_phase_lag").asFloat64();}
+    if(property.check("max_drop_rate")) {max_drop_rate = property.find("max_drop_rate").asFloat64();}
+    if(property.check("rt_priority"))   {rt_priority = property.find("rt_priority").asInt32();}
 
     Property options;
     options.put("device", "remote_controlboard");
@@ -112,148 +118,193 @@ bool PositionDirect::setup(yarp::os::Property& property) {
         ROBOTTESTINGFRAMEWORK_ASSERT_ERROR("unable to get the number of joints of the part");
     }
 
-    if (cmd_mode==all_joints && n_part_joints!=n_cmd_joints)
+    for (int i=0; i <n_cmd_joints; i++) jointsList.push_back(jointsBottle->get(i).asInt32());
+
+    if (property.check("cmdMode"))
     {
-        ROBOTTESTINGFRAMEWORK_ASSERT_ERROR("if all_joints=2 mode is selected, joints parameter must include the full list of joints");
+        Bottle modesBottle;
+        if (property.find("cmdMode").isList()) modesBottle = *property.find("cmdMode").asList();
+        else modesBottle.add(property.find("cmdMode"));
+        for (size_t i=0; i<modesBottle.size(); i++)
+        {
+            int m = modesBottle.get(i).asInt32();
+            ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(m>=0 && m<=2,"invalid cmdMode: can be 0=single_joint, 1=all_joints ,2=some_joints");
+            cmd_modes.push_back((PositionDirectStreamer::CommandPath) m);
+            if (m==PositionDirectStreamer::all_joints && n_part_joints!=n_cmd_joints)
+            {
+                ROBOTTESTINGFRAMEWORK_ASSERT_ERROR("if all_joints=1 mode is selected, joints parameter must include the full list of joints");
+            }
+        }
     }
-
-    if (cmd_mode==single_joint && n_cmd_joints!=1)
+    else
     {
-        ROBOTTESTINGFRAMEWORK_ASSERT_ERROR("if single_joint=1 mode is selected, joints parameter must include one single joint");
+        cmd_modes.push_back(PositionDirectStreamer::single_joint);
+        cmd_modes.push_back(PositionDirectStreamer::some_joints);
+        if (n_part_joints==n_cmd_joints) cmd_modes.push_back(PositionDirectStreamer::all_joints);
     }
 
-    cmd_tot = new double[n_part_joints];
-    pos_tot=new double[n_part_joints];
-    jointsList=new int[n_cmd_joints];
-    cmd_some=new double[n_cmd_joints];
-    for (int i=0; i <n_cmd_joints; i++) jointsList[i]=jointsBottle->get(i).asInt32();
+    streamer = new PositionDirectStreamer(sampleTime, ienc, idir, n_part_joints);
 
     return true;
 }
 
 void PositionDirect::tearDown()
 {
-    if (jointsList) {delete jointsList; jointsList =0;}
+    if (streamer) {streamer->stop(); delete streamer; streamer =0;}
     if (dd) {delete dd; dd =0;}
 }
 
 void PositionDirect::setMode(int desired_mode)
 {
-    for (int i=0; i<n_cmd_joints; i++)
+    ControlModeSwitcher switcher(icmd, iimd, jointsList);
+    ControlModeSwitcher::Result result = switcher.change(desired_mode, VOCAB_IM_STIFF);
+    ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(result.ok, switcher.failureMessage(result, "Control mode change"));
+    ROBOTTESTINGFRAMEWORK_TEST_REPORT(switcher.successMessage(result, "Control mode change"));
+}
+
+void PositionDirect::goHome()
+{
+    MotionWaiter waiter;
+    waiter.configure(ienc, ipos, jointsList);
+    waiter.setTolerance(0.5);
+    MotionWaiter::Result result = waiter.moveAndWait(std::vector<double>(n_cmd_joints, zero), 20.0);
+    if (!result.ok)
     {
-        icmd->setControlMode(jointsList[i],desired_mode);
-        iimd->setInteractionMode(jointsList[i],VOCAB_IM_STIFF);
-        yarp::os::Time::delay(0.010);
+        ROBOTTESTINGFRAMEWORK_ASSERT_ERROR("Timeout while reaching zero position");
     }
+}
 
-    int cmode;
-    yarp::dev::InteractionModeEnum imode;
-    int timeout = 0;
-
-    while (1)
+const char* PositionDirect::pathName(PositionDirectStreamer::CommandPath path)
+{
+    switch (path)
     {
-        int ok=0;
-        for (int i=0; i<n_cmd_joints; i++)
-        {
-            icmd->getControlMode (jointsList[i],&cmode);
-            iimd->getInteractionMode(jointsList[i],&imode);
-            if (cmode==desired_mode && imode==VOCAB_IM_STIFF) ok++;
-        }
-        if (ok==n_cmd_joints) break;
-        if (timeout>100)
-        {
-            ROBOTTESTINGFRAMEWORK_ASSERT_ERROR("Unable to set control mode/interaction mode");
-        }
-        yarp::os::Time::delay(0.2);
-        timeout++;
+        case PositionDirectStreamer::single_joint: return "single_joint";
+        case PositionDirectStreamer::all_joints:   return "all_joints";
+        case PositionDirectStreamer::some_joints:  return "some_joints";
     }
+    return "unknown";
 }
 
-void PositionDirect::executeCmd()
+PositionDirect::PathResult PositionDirect::stream(PositionDirectStreamer::CommandPath path)
 {
-    if (cmd_mode==single_joint)
+    setMode(VOCAB_CM_POSITION);
+    goHome();
+    setMode(VOCAB_CM_POSITION_DIRECT);
+
+    streamer->prepare(path, jointsList, zero, amplitude, frequency, cycles/frequency);
+    ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(streamer->start(), "Unable to start the streaming thread");
+    if (rt_priority > 0 && !streamer->setPriority(rt_priority, 1))
     {
-        for (int i=0; i<n_cmd_joints; i++)
-        {
-            idir->setPosition(jointsList[i],cmd_single);
-        }
+        yWarning() << "Unable to set SCHED_FIFO priority" << rt_priority << "for the streaming thread";
     }
-    else if (cmd_mode==some_joints)
+    while (streamer->isRunning())
     {
-        for (int i=0; i<n_cmd_joints; i++)
-        {
-            cmd_some[i]=cmd_single;
-        }
-        idir->setPositions(n_cmd_joints,jointsList, cmd_some);
+        yarp::os::Time::delay(0.05);
     }
-    else if (cmd_mode==all_joints)
+    streamer->stop();
+
+    setMode(VOCAB_CM_POSITION);
+    goHome();
+
+    PathResult result;
+    result.path = path;
+    const char* name = pathName(path);
+    const std::vector<PositionDirectStreamer::Sample>& samples = streamer->samples();
+    ROBOTTESTINGFRAMEWORK_TEST_CHECK(!streamer->readErrors(), Asserter::format("%s: getEncodersTimed failed during the streaming", name));
+    if (streamer->unsyncedStamps())
     {
-        for (int i=0; i<n_part_joints; i++)
-        {
-            cmd_tot[i]=cmd_single;
-        }
-        idir->setPositions(cmd_tot);
+        ROBOTTESTINGFRAMEWORK_TEST_REPORT(Asserter::format("%s: the encoder timestamps are not synchronized with the local clock, the encoders are timestamped when they are read", name));
     }
-    else
+    ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(!samples.empty(), Asserter::format("%s: no sample acquired", name));
+
+    result.call_mean = 0;
+    result.call_max = 0;
+    for (size_t i=0; i<samples.size(); i++)
     {
-        ROBOTTESTINGFRAMEWORK_ASSERT_ERROR("Invalid cmd_mode");
+        result.call_mean += samples[i].call;
+        if (samples[i].call > result.call_max) result.call_max = samples[i].call;
     }
+    result.call_mean /= samples.size();
+    result.drop_rate = (double)streamer->droppedReferences() / streamer->slots();
 
-    prev_cmd=cmd_single;
-}
-
-void PositionDirect::goHome()
-{
-    for (int i=0; i<n_cmd_joints; i++)
+    ROBOTTESTINGFRAMEWORK_TEST_REPORT(Asserter::format("%s: %d references sent, %d dropped (%.2f%%), max lateness %.2f ms, call duration mean %.3f ms max %.3f ms, %d stale encoder readings",
+                                      name, (int)samples.size(), (int)streamer->droppedReferences(), result.drop_rate*100.0,
+                                      streamer->maxLateness()*1000.0, result.call_mean*1000.0, result.call_max*1000.0, (int)streamer->staleEncoders()));
+    if (max_drop_rate >= 0)
     {
-        ipos->setRefSpeed(jointsList[i],20.0);
-        ipos->positionMove(jointsList[i],zero);
+        ROBOTTESTINGFRAMEWORK_TEST_CHECK(result.drop_rate <= max_drop_rate, Asserter::format("%s: reference drop rate %.4f (max %.4f)", name, result.drop_rate, max_drop_rate));
     }
 
-    int timeout = 0;
-    while (1)
+    //the first period contains the transient from the rest position
+    double t_start = (cycles > 1) ? 1.0/frequency : 0.0;
+    std::vector<double> frequencies(1, frequency);
+    result.rms_error = 0;
+    result.phase_lag = 0;
+    for (int k=0; k<n_cmd_joints; k++)
     {
-        int in_position=0;
-        for (int i=0; i<n_cmd_joints; i++)
+        const std::vector<double>& encoders = streamer->encoders(k);
+        const std::vector<double>& stamps = streamer->stamps(k);
+        std::vector<double> refs(encoders.size());
+        double sum_sq = 0;
+        double max_err = 0;
+        size_t n = 0;
+        for (size_t i=0; i<encoders.size(); i++)
         {
-            ienc->getEncoder(jointsList[i],&pos_tot[jointsList[i]]);
-            if (fabs(pos_tot[jointsList[i]]-zero)<0.5) in_position++;
+            refs[i] = streamer->reference(stamps[i]);
+            if (stamps[i] < t_start) continue;
+            double err = encoders[i]-refs[i];
+            sum_sq += err*err;
+            if (fabs(err) > max_err) max_err = fabs(err);
+            n++;
         }
-        if (in_position==n_cmd_joints) break;
-        if (timeout>100)
+        ROBOTTESTINGFRAMEWORK_TEST_FAIL_IF_FALSE(n>0, Asserter::format("%s, joint %d: no sample after the first period", name, jointsList[k]));
+        double rms = sqrt(sum_sq/n);
+
+        //the reference is periodic over the analyzed window: no window is needed
+        FrequencyResponseEstimator fre;
+        fre.setFrequencies(frequencies);
+        fre.setWindow(false);
+        std::vector<FrequencyResponseEstimator::Point> response;
+        if (fre.add(stamps.data(), refs.data(), encoders.data(), encoders.size(), t_start)) response = fre.response();
+        if (response.empty())
         {
-            ROBOTTESTINGFRAMEWORK_ASSERT_ERROR("Timeout while reaching zero position");
+            ROBOTTESTINGFRAMEWORK_TEST_FAIL_IF_FALSE(false, Asserter::format("%s, joint %d: unable to estimate the phase lag", name, jointsList[k]));
+            continue;
         }
-        yarp::os::Time::delay(0.2);
-        timeout++;
+        FrequencyResponseEstimator::Point p = response[0];
+        double lag = -p.phase;
+
+        ROBOTTESTINGFRAMEWORK_TEST_REPORT(Asserter::format("%s, joint %d: tracking error rms %.3f deg max %.3f deg, gain %.3f, phase lag %.2f deg (%.2f ms)",
+                                          name, jointsList[k], rms, max_err, p.magnitude, lag, lag/360.0/frequency*1000.0));
+        ROBOTTESTINGFRAMEWORK_TEST_CHECK(rms <= tolerance, Asserter::format("%s, joint %d: rms tracking error %.3f deg (max %.3f deg)", name, jointsList[k], rms, tolerance));
+        if (max_phase_lag >= 0)
+        {
+            ROBOTTESTINGFRAMEWORK_TEST_CHECK(lag <= max_phase_lag, Asserter::format("%s, joint %d: phase lag %.2f deg (max %.2f deg)", name, jointsList[k], lag, max_phase_lag));
+        }
+        result.rms_error += rms/n_cmd_joints;
+        result.phase_lag += lag/n_cmd_joints;
     }
+
+    return result;
 }
 
 void PositionDirect::run()
 {
-    setMode(VOCAB_CM_POSITION);
-    goHome();
-    setMode(VOCAB_CM_POSITION_DIRECT);
-
-    double start_time = yarp::os::Time::now();
-    const double max_step = 2.0;
-    prev_cmd=cmd_single = amplitude*sin(0.0)+zero;
-    while(1)
+    std::vector<PathResult> results;
+    for (size_t m=0; m<cmd_modes.size(); m++)
     {
-        double curr_time = yarp::os::Time::now();
-        double elapsed = curr_time-start_time;
-        cmd_single = amplitude*(2*3.14159265359*frequency*elapsed)+zero;
-
-        ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(fabs(prev_cmd-cmd_single)<max_step,
-                            Asserter::format("error in signal generation: previous: %+6.3f current: %+6.3f max step:  %+6.3f",
-                                             prev_cmd,cmd_single,max_step));
-        ienc->getEncoders(pos_tot);
-        executeCmd();
-        //printf("%+6.3f %f\n",elapsed, cmd);
-        yarp::os::Time::delay(sampleTime);
-        if (elapsed*frequency>cycles) break;
+        results.push_back(stream(cmd_modes[m]));
     }
 
-    setMode(VOCAB_CM_POSITION);
-    goHome();
+    if (results.size() > 1)
+    {
+        ROBOTTESTINGFRAMEWORK_TEST_REPORT("Comparison of the command methods (averages over the joints):");
+        for (size_t m=0; m<results.size(); m++)
+        {
+            ROBOTTESTINGFRAMEWORK_TEST_REPORT(Asserter::format("%-12s drop rate %6.2f%%, call mean %.3f ms max %.3f ms, rms error %.3f deg, phase lag %.2f deg",
+                                              pathName(results[m].path), results[m].drop_rate*100.0,
+                                              results[m].call_mean*1000.0, results[m].call_max*1000.0,
+                                              results[m].rms_error, results[m].phase_lag));
+        }
+    }
 }
@@ -22,24 +22,35 @@
 #define _POSITIONDIRECT_H_
 
 #include <string>
+#include <vector>
 #include <yarp/robottestingframework/TestCase.h>
 #include <yarp/dev/ControlBoardInterfaces.h>
 #include <yarp/dev/PolyDriver.h>
+#include "PositionDirectStreamer.h"
 
 /**
 * \ingroup icub-tests
-* This tests checks the positionDirect control, sending a sinusoidal reference signal, with parametric frequency and amplitude.
-* The sample time, typical in the range of 10 ms, can be also be adjusted by the user.
-* This test currently does not return any error report. It simply moves a joint, and the user visually evaluates the smoothness of the performed trajectory. In the future automatic checks/plots may be added to the test.
-* Be aware theat may exists set of parameters (e.g. high values of sample time / ampiltude /frequency) that may lead to PID instability and damage the joint.
+* This tests checks the positionDirect control, streaming a sinusoidal reference signal, with parametric frequency and amplitude.
+* The reference is sent by a periodic thread with the given sample time, which can be as low as 1 ms (1 kHz).
 * The test is able to check all the three types of yarp methods (single joint, multi joint, all joints), depending on the value of cmdMode Parameter.
+* If cmdMode is a list, or it is not given, the same sinusoid is streamed once with each method, and the results are compared.
+* For each method and joint, the timed encoders are compared with the reference evaluated at the encoder timestamps (the first period is skipped):
+* \li tracking error: rms and max of encoder - reference
+* \li phase lag and gain of the encoders with respect to the reference at the test frequency
+* \li reference drop rate: the fraction of sample times in which no reference was sent, because the streaming thread could not keep the rate
+* \li duration of the IPositionDirect calls and number of stale encoder readings (timestamp not updated)
+* The encoder timestamps must be in the same time base as the test (e.g. the test runs on the same machine as the robot interface, or the network clock is used),
+* otherwise the phase lag contains the clock offset.
+* Be aware theat may exists set of parameters (e.g. high values of sample time / ampiltude /frequency) that may lead to PID instability and damage the joint.
 
 * example: testRunner -v -t PositionDirect.dll - p "--robot icub --part head --joints ""(0 1 2)"" --zero 0 --frequency 0.8 --amplitude 10.0 --cycles 10 --tolerance 1.0 --sampleTime 0.010 --cmdMode 0"
-* example: testRunner -v -t PositionDirect.dll - p "--robot icub --part head --joints ""(2)"" --zero 0 --frequency 0.4 --amplitude 10.0 --cycles 10 --tolerance 1.0 --sampleTime 0.010 --cmdMode 0"
+* example: testRunner -v -t PositionDirect.dll - p "--robot icub --part head --joints ""(2)"" --zero 0 --frequency 0.4 --amplitude 10.0 --cycles 10 --tolerance 1.0 --sampleTime 0.001 --cmdMode ""(0 2)"""
 
 * Check the following functions:
+* \li IPositionDirect::setPosition()
 * \li IPositionDirect::setPositions()
 * \li IControlMode::setControlMode()
+* \li IEncodersTimed::getEncodersTimed()
 *
 *  Accepts the following parameters:
 * | Parameter name     | Type   | Units | Default Value | Required | Description | Notes |
@@ -48,12 +59,15 @@
 * | part               | string | -     | -     | Yes | The name of trhe robot part. | e.g. left_arm |
 * | joints             | vector of ints | - | - | Yes | List of joints to be tested | |
 * | zero               | double | deg   | -     | Yes | The home position for each joint | |
-* | cycles             | int    | -     | -     | Yes | The number of test cycles (going from max to min position and viceversa) |   |
-* | frequency          | double | deg   | -     | Yes | The frequency of the sine reference signal | |
+* | cycles             | int    | -     | -     | Yes | The number of periods of the sine reference signal |   |
+* | frequency          | double | Hz    | -     | Yes | The frequency of the sine reference signal | |
 * | amplitude          | double | deg   | -     | Yes | The ampiltude of the sine reference signal | |
-* | tolerance          | double | deg   | -     | Yes | The tolerance used when moving from min to max reference position and viceversa | |
-* | sampleTime         | double | s     | -     | Yes | The sample time of the control thread | |
-* | cmdMode            | int    | deg   | -     | Yes | = 0 to test single joint method, = 1 to test all joints, = 2 to test multi joint method | |
+* | tolerance          | double | deg   | -     | Yes | The maximum rms tracking error | |
+* | sampleTime         | double | s     | -     | Yes | The sample time of the streaming thread | min 0.001 |
+* | cmdMode            | int or vector of ints | - | (0 2 1) | No | = 0 to test single joint method, = 1 to test all joints, = 2 to test multi joint method | all joints (1) requires joints to include all the joints of the part, and it is skipped by the default list otherwise |
+* | max_phase_lag      | double | deg   | -1    | No  | If >=0, the test fails if the phase lag of a joint is higher | |
+* | max_drop_rate      | double | -     | -1    | No  | If >=0, the test fails if the fraction of dropped references is higher | e.g. 0.01 |
+* | rt_priority        | int    | -     | 0     | No  | If >0, the streaming thread runs with SCHED_FIFO policy at this priority | Requires the proper privileges |
 *
 */
 
@@ -69,42 +83,46 @@ public:
     virtual void run();
 
     void goHome();
-    void executeCmd();
     void setMode(int desired_mode);
 
 private:
+    struct PathResult
+    {
+        PositionDirectStreamer::CommandPath path;
+        double drop_rate;
+        double call_mean;
+        double call_max;
+        double rms_error;
+        double phase_lag;
+    };
+
+    PathResult stream(PositionDirectStreamer::CommandPath path);
+    static const char* pathName(PositionDirectStreamer::CommandPath path);
+
     std::string robotName;
     std::string partName;
-    int* jointsList;
+    std::vector<int> jointsList;
+    std::vector<PositionDirectStreamer::CommandPath> cmd_modes;
     double frequency;
     double amplitude;
     double cycles;
     double tolerance;
     double sampleTime;
     double zero;
+    double max_phase_lag;
+    double max_drop_rate;
+    int    rt_priority;
     int    n_part_joints;
     int    n_cmd_joints;
-    enum cmd_mode_t
-    {
-      single_joint = 0,
-      all_joints = 1,
-      some_joints =2
-    } cmd_mode;
 
     yarp::dev::PolyDriver        *dd;
     yarp::dev::IPositionControl *ipos;
     yarp::dev::IControlMode     *icmd;
     yarp::dev::IInteractionMode  *iimd;
-    yarp::dev::IEncoders         *ienc;
+    yarp::dev::IEncodersTimed    *ienc;
     yarp::dev::IPositionDirect   *idir;
 
-    double  cmd_single;
-    double* cmd_tot;
-    double* cmd_some;
-
-    double* pos_tot;
-
-    double prev_cmd;
+    PositionDirectStreamer       *streamer;
 };
 
 #endif //_PositionDirect_H
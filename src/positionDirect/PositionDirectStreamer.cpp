@@ -0,0 +1,162 @@
+/*
+ * iCub Robot Unit Tests (Robot Testing Framework)
+ *
+ * Copyright (C) 2015-2019 Istituto Italiano di Tecnologia (IIT)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <cmath>
+#include <yarp/os/Time.h>
+
+#include "PositionDirectStreamer.h"
+
+//a larger difference between the remote timestamps and the local clock means that the clocks are not synchronized
+static const double max_stamp_offset = 1.0; //s
+
+PositionDirectStreamer::PositionDirectStreamer(double period, yarp::dev::IEncodersTimed* ienc, yarp::dev::IPositionDirect* idir, int n_part_joints) :
+    yarp::os::PeriodicThread(period, yarp::os::ShouldUseSystemClock::No, yarp::os::PeriodicThreadClock::Absolute),
+    m_ienc(ienc),
+    m_idir(idir),
+    m_nPartJoints(n_part_joints),
+    m_encoders(n_part_joints, 0.0),
+    m_encStamps(n_part_joints, 0.0),
+    m_refs(n_part_joints, 0.0),
+    m_path(some_joints),
+    m_zero(0),
+    m_amplitude(0),
+    m_frequency(0),
+    m_duration(0),
+    m_startTime(0),
+    m_prevStamp(0),
+    m_maxLateness(0),
+    m_tick(0),
+    m_stale(0),
+    m_readErrors(false),
+    m_unsyncedStamps(false)
+{
+}
+
+void PositionDirectStreamer::prepare(CommandPath path, const std::vector<int>& joints, double zero, double amplitude, double frequency, double duration)
+{
+    m_path = path;
+    m_joints = joints;
+    m_zero = zero;
+    m_amplitude = amplitude;
+    m_frequency = frequency;
+    m_duration = duration;
+
+    size_t capacity = (size_t)std::ceil(duration / getPeriod()) + 2;
+    m_samples.clear();
+    m_samples.reserve(capacity);
+    m_jointEncoders.resize(joints.size());
+    m_jointStamps.resize(joints.size());
+    for (size_t k = 0; k < joints.size(); k++)
+    {
+        m_jointEncoders[k].clear();
+        m_jointEncoders[k].reserve(capacity);
+        m_jointStamps[k].clear();
+        m_jointStamps[k].reserve(capacity);
+    }
+}
+
+double PositionDirectStreamer::reference(double t) const
+{
+    return m_zero + m_amplitude * sin(2 * M_PI * m_frequency * t);
+}
+
+bool PositionDirectStreamer::threadInit()
+{
+    m_startTime = yarp::os::Time::now();
+    m_prevStamp = 0;
+    m_maxLateness = 0;
+    m_tick = 0;
+    m_stale = 0;
+    m_readErrors = false;
+    m_unsyncedStamps = false;
+    return true;
+}
+
+void PositionDirectStreamer::sendReferences(double ref)
+{
+    if (m_path == single_joint)
+    {
+        for (size_t k = 0; k < m_joints.size(); k++)
+        {
+            m_idir->setPosition(m_joints[k], ref);
+        }
+    }
+    else if (m_path == some_joints)
+    {
+        for (size_t k = 0; k < m_joints.size(); k++) m_refs[k] = ref;
+        m_idir->setPositions((int)m_joints.size(), m_joints.data(), m_refs.data());
+    }
+    else
+    {
+        for (int i = 0; i < m_nPartJoints; i++) m_refs[i] = ref;
+        m_idir->setPositions(m_refs.data());
+    }
+}
+
+void PositionDirectStreamer::run()
+{
+    double curr_time = yarp::os::Time::now();
+    double elapsed = curr_time - m_startTime;
+
+    //never reallocate inside the loop
+    if (elapsed > m_duration || m_samples.size() == m_samples.capacity())
+    {
+        askToStop();
+        return;
+    }
+
+    //if the scheduler skipped some slots, their references are lost
+    size_t slot = (size_t)std::floor(elapsed / getPeriod());
+    if (slot < m_tick) slot = m_tick;
+    double lateness = elapsed - slot * getPeriod();
+    m_tick = slot + 1;
+
+    double read_time = yarp::os::Time::now();
+    if (!m_ienc->getEncodersTimed(m_encoders.data(), m_encStamps.data())) m_readErrors = true;
+
+    double t_call = yarp::os::Time::now();
+    sendReferences(reference(elapsed));
+
+    Sample s;
+    s.time = elapsed;
+    s.lateness = lateness;
+    s.call = yarp::os::Time::now() - t_call;
+    m_samples.push_back(s);
+
+    //without a valid timestamp the encoders are assumed to be sampled when they are read
+    double stamp = (m_encStamps[m_joints[0]] > 0) ? m_encStamps[m_joints[0]] : read_time;
+    if (stamp == m_prevStamp) m_stale++;
+    m_prevStamp = stamp;
+    for (size_t k = 0; k < m_joints.size(); k++)
+    {
+        //the stamps are compared with m_startTime, taken from the local clock
+        double s_k = m_encStamps[m_joints[k]];
+        if (s_k > 0 && std::fabs(s_k - read_time) > max_stamp_offset)
+        {
+            m_unsyncedStamps = true;
+            s_k = 0;
+        }
+        if (s_k <= 0) s_k = read_time;
+        m_jointEncoders[k].push_back(m_encoders[m_joints[k]]);
+        m_jointStamps[k].push_back(s_k - m_startTime);
+    }
+
+    if (lateness > m_maxLateness) m_maxLateness = lateness;
+}
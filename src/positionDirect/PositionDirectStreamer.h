@@ -0,0 +1,112 @@
+/*
+ * iCub Robot Unit Tests (Robot Testing Framework)
+ *
+ * Copyright (C) 2015-2019 Istituto Italiano di Tecnologia (IIT)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _POSITIONDIRECTSTREAMER_H_
+#define _POSITIONDIRECTSTREAMER_H_
+
+#include <vector>
+#include <yarp/os/PeriodicThread.h>
+#include <yarp/dev/ControlBoardInterfaces.h>
+
+/**
+* Periodic thread which streams a sinusoidal reference zero+amplitude*sin(2*pi*frequency*t) with IPositionDirect
+* and acquires the timed encoders of the commanded joints.
+* The reference is sent with one of the three IPositionDirect methods (see CommandPath), so that their
+* performance can be compared.
+* The thread uses absolute-deadline scheduling (PeriodicThreadClock::Absolute). When one or more periods are
+* skipped because an iteration took too long, the corresponding references are never sent: they are counted as dropped.
+* Samples are stored in buffers preallocated by prepare(), so no allocation happens inside the loop.
+*/
+class PositionDirectStreamer : public yarp::os::PeriodicThread
+{
+public:
+    enum CommandPath
+    {
+      single_joint = 0, //setPosition(), once for each joint
+      all_joints = 1,   //setPositions(), all the joints of the part
+      some_joints = 2   //setPositions(), the listed joints only
+    };
+
+    struct Sample
+    {
+        double time;     //time since the start, when the reference was computed
+        double lateness; //delay with respect to the nominal sample time
+        double call;     //duration of the IPositionDirect call(s)
+    };
+
+    PositionDirectStreamer(double period, yarp::dev::IEncodersTimed* ienc, yarp::dev::IPositionDirect* idir, int n_part_joints);
+
+    /**
+    * Prepares a new run. With all_joints, joints must contain all the joints of the part.
+    */
+    void prepare(CommandPath path, const std::vector<int>& joints, double zero, double amplitude, double frequency, double duration);
+
+    /** the reference at time t since the start */
+    double reference(double t) const;
+
+    const std::vector<Sample>& samples() const { return m_samples; }
+    /** encoder stream of the k-th joint: values and timestamps (since the start), one per sample */
+    const std::vector<double>& encoders(size_t k) const { return m_jointEncoders[k]; }
+    const std::vector<double>& stamps(size_t k) const { return m_jointStamps[k]; }
+    /** number of periods elapsed since the start, i.e. the number of references that should have been sent */
+    size_t slots() const { return m_tick; }
+    size_t droppedReferences() const { return m_tick - m_samples.size(); }
+    /** number of samples whose encoder timestamp did not change since the previous one */
+    size_t staleEncoders() const { return m_stale; }
+    double maxLateness() const { return m_maxLateness; }
+    bool readErrors() const { return m_readErrors; }
+    /** true if some encoder timestamps were too far from the local clock and were replaced by the local read time */
+    bool unsyncedStamps() const { return m_unsyncedStamps; }
+
+protected:
+    bool threadInit() override;
+    void run() override;
+
+private:
+    void sendReferences(double ref);
+
+    yarp::dev::IEncodersTimed*  m_ienc;
+    yarp::dev::IPositionDirect* m_idir;
+    int                         m_nPartJoints;
+    std::vector<double>         m_encoders;
+    std::vector<double>         m_encStamps;
+    std::vector<double>         m_refs;
+    std::vector<Sample>         m_samples;
+
+    CommandPath                      m_path;
+    std::vector<int>                 m_joints;
+    std::vector<std::vector<double>> m_jointEncoders;
+    std::vector<std::vector<double>> m_jointStamps;
+
+    double m_zero;
+    double m_amplitude;
+    double m_frequency;
+    double m_duration;
+
+    double m_startTime;
+    double m_prevStamp;
+    double m_maxLateness;
+    size_t m_tick;
+    size_t m_stale;
+    bool   m_readErrors;
+    bool   m_unsyncedStamps;
+};
+
+#endif
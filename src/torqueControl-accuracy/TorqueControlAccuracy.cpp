@@ -21,13 +21,16 @@
 #include <math.h>
 #include <robottestingframework/TestAssert.h>
 #include <robottestingframework/dll/Plugin.h>
+#include <yarp/os/LogStream.h>
 #include <yarp/os/Time.h>
 #include <yarp/os/Property.h>
-#include <fstream>
-#include <algorithm>
+#include <yarp/dev/IRemoteVariables.h>
 #include <cstdlib>
+#include <vector>
 
 #include "TorqueControlAccuracy.h"
+#include "ControlModeSwitcher.h"
+#include "MotionWaiter.h"
 
 using namespace robottestingframework;
 using namespace yarp::os;
@@ -36,17 +39,23 @@ using namespace yarp::dev;
 // prepare the plugin
 ROBOTTESTINGFRAMEWORK_PREPARE_PLUGIN(TorqueControlAccuracy)
 
+//a larger difference between the remote timestamps and the local clock means that the clocks are not synchronized
+static const double max_stamp_offset = 1.0; //s
+
 TorqueControlAccuracy::TorqueControlAccuracy() : yarp::robottestingframework::TestCase("TorqueControlAccuracy") {
     m_jointsList = 0;
     m_encoders = 0;
     m_torques = 0;
     m_zeros = 0;
+    m_parallel = false;
+    m_record_position = false;
     dd=0;
     ipos=0;
     icmd=0;
     iimd=0;
     ienc=0;
     itrq=0;
+    itim=0;
 }
 
 TorqueControlAccuracy::~TorqueControlAccuracy() { }
@@ -81,9 +90,22 @@ bool TorqueControlAccuracy::setup(yarp::os::Property& property) {
     m_cycles = property.find("cycles").asInt32();
     ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF(m_cycles>0, "invalid cycles");
 
+    m_step_limits.fromProperty(property);
+
+    if(property.check("parallel"))
+      {m_parallel = property.find("parallel").asBool();}
+    if(property.check("record_position"))
+      {m_record_position = property.find("record_position").asBool();}
+
     m_sampleTime = property.find("sampleTime").asFloat64();
     ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF(m_sampleTime>0, "invalid sampleTime");
 
+    //one cycle lasts 4 seconds, sampled every sampleTime
+    size_t samples_per_cycle = (size_t)ceil(4.0 / m_sampleTime) + 2;
+    //the position, if requested, is stored as an additional column
+    m_samples.assign(m_n_cmd_joints, StepSampleBuffer(m_record_position ? 1 : 0));
+    for (int i = 0; i < m_n_cmd_joints; i++) m_samples[i].reserve(m_cycles * samples_per_cycle, m_cycles);
+
     Property options;
     options.put("device", "remote_controlboard");
     options.put("remote", "/" + m_robotName + "/" + m_partName);
@@ -96,6 +118,10 @@ bool TorqueControlAccuracy::setup(yarp::os::Property& property) {
     ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF(dd->view(ipos),"Unable to open position interface");
     ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF(dd->view(icmd),"Unable to open control mode interface");
     ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF(dd->view(iimd),"Unable to open interaction mode interface");
+    if (!dd->view(itim))
+    {
+        yWarning() << "Unable to open the timed interface: the torque samples will be timestamped when they are read";
+    }
 
     if (!ienc->getAxes(&m_n_part_joints))
     {
@@ -109,6 +135,27 @@ bool TorqueControlAccuracy::setup(yarp::os::Property& property) {
     for (int i = 0; i <m_n_cmd_joints; i++) m_jointsList[i] = jointsBottle->get(i).asInt32();
     for (int i = 0; i <m_n_cmd_joints; i++) m_zeros[i] = zerosBottle->get(i).asFloat64();
 
+    //group the joints which can be stepped at the same time
+    std::vector<int> joints(m_jointsList, m_jointsList + m_n_cmd_joints);
+    m_batches = JointBatchScheduler::sequential(m_n_cmd_joints);
+    if (m_parallel)
+    {
+        IRemoteVariables* ivar = 0;
+        Bottle b;
+        CouplingMatrix coupling;
+        std::string coupling_error;
+        if (dd->view(ivar) && ivar->getRemoteVariable("kinematic_mj", b) &&
+            coupling.fromRemoteVariable(b, m_n_part_joints, coupling_error))
+        {
+            m_batches = JointBatchScheduler::independent(joints, coupling);
+        }
+        else
+        {
+            yWarning() << "Unable to get the coupling matrix" << coupling_error << ": the joints will be tested one at a time";
+        }
+    }
+    ROBOTTESTINGFRAMEWORK_TEST_REPORT(Asserter::format("Joint batches: %s", JointBatchScheduler::toString(m_batches, joints).c_str()));
+
     return true;
 }
 
@@ -123,71 +170,43 @@ void TorqueControlAccuracy::tearDown()
 
 void TorqueControlAccuracy::setMode(int desired_mode)
 {
-    for (int i = 0; i<m_n_cmd_joints; i++)
-    {
-        icmd->setControlMode(m_jointsList[i], desired_mode);
-        iimd->setInteractionMode(m_jointsList[i], VOCAB_IM_STIFF);
-        yarp::os::Time::delay(0.010);
-    }
-
-    int cmode;
-    yarp::dev::InteractionModeEnum imode;
-    int timeout = 0;
-
-    while (1)
-    {
-        int ok=0;
-        for (int i = 0; i<m_n_cmd_joints; i++)
-        {
-            icmd->getControlMode(m_jointsList[i], &cmode);
-            iimd->getInteractionMode(m_jointsList[i], &imode);
-            if (cmode==desired_mode && imode==VOCAB_IM_STIFF) ok++;
-        }
-        if (ok == m_n_cmd_joints) break;
-        if (timeout>100)
-        {
-            ROBOTTESTINGFRAMEWORK_ASSERT_ERROR("Unable to set control mode/interaction mode");
-        }
-        yarp::os::Time::delay(0.2);
-        timeout++;
-    }
+    ControlModeSwitcher switcher(icmd, iimd, m_jointsList, m_n_cmd_joints);
+    ControlModeSwitcher::Result result = switcher.change(desired_mode, VOCAB_IM_STIFF);
+    ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(result.ok, switcher.failureMessage(result, "Control mode change"));
+    ROBOTTESTINGFRAMEWORK_TEST_REPORT(switcher.successMessage(result, "Control mode change"));
 }
 
 bool TorqueControlAccuracy::goHome()
 {
-    for (int i = 0; i<m_n_cmd_joints; i++)
-    {
-        ipos->setRefSpeed(m_jointsList[i], 20.0);
-        ipos->positionMove(m_jointsList[i], m_zeros[i]);
-    }
-
-    int timeout = 0;
-    while (1)
+    MotionWaiter waiter;
+    waiter.configure(ienc, ipos, m_jointsList, m_n_cmd_joints);
+    waiter.setTolerance(0.5);
+    MotionWaiter::Result result = waiter.moveAndWait(std::vector<double>(m_zeros, m_zeros+m_n_cmd_joints), 20.0);
+    if (!result.ok)
     {
-        int in_position=0;
-        for (int i = 0; i<m_n_cmd_joints; i++)
-        {
-            ienc->getEncoder(m_jointsList[i], &m_encoders[m_jointsList[i]]);
-            if (fabs(m_encoders[m_jointsList[i]] - m_zeros[i])<0.5) in_position++;
-        }
-        if (in_position == m_n_cmd_joints) break;
-        if (timeout>100)
-        {
-            ROBOTTESTINGFRAMEWORK_ASSERT_ERROR("Timeout while reaching zero position");
-            return false;
-        }
-        yarp::os::Time::delay(0.2);
-        timeout++;
+        ROBOTTESTINGFRAMEWORK_ASSERT_ERROR("Timeout while reaching zero position");
+        return false;
     }
-    //sleep some additional time to complete movement from 0.5 to 0
-    yarp::os::Time::delay(0.5);
     return true;
 }
 
 void TorqueControlAccuracy::run()
 {
-    for (int i = 0; i < m_n_cmd_joints; i++)
+    bool use_stamps = (itim != 0);
+    for (size_t batch = 0; batch < m_batches.size(); batch++)
     {
+        const std::vector<size_t>& idx = m_batches[batch];
+        std::vector<int> batch_joints(idx.size());
+        std::vector<double> batch_refs(idx.size());
+        std::vector<StepResponseAnalyzer> analyzers(idx.size(), StepResponseAnalyzer(m_step_limits));
+        std::string batch_str;
+        for (size_t k = 0; k < idx.size(); k++)
+        {
+            batch_joints[k] = m_jointsList[idx[k]];
+            batch_str += (k == 0 ? "" : " ") + std::to_string(batch_joints[k]);
+            m_samples[idx[k]].clear();
+        }
+
         for (int cycle = 0; cycle < m_cycles; cycle++)
         {
             setMode(VOCAB_CM_POSITION);
@@ -198,25 +217,27 @@ void TorqueControlAccuracy::run()
             setMode(VOCAB_CM_TORQUE);
             double start_time = yarp::os::Time::now();
 
-            std::string buff = "Testing Joint: " + std::to_string(i) + " cycle: " + std::to_string(cycle);
-            ROBOTTESTINGFRAMEWORK_TEST_REPORT(buff);
+            ROBOTTESTINGFRAMEWORK_TEST_REPORT(Asserter::format("Testing Joints: %s cycle: %d", batch_str.c_str(), cycle));
 
             double time_zero = 0;
-            yarp::os::Bottle      dataToPlotRaw;
-            yarp::os::Bottle      dataToPlotSync;
+            double prev_stamp = 0;
+            int stale = 0;
+            for (size_t k = 0; k < idx.size(); k++) m_samples[idx[k]].beginCycle(cycle);
 
+            double next_time = start_time;
             while (1)
             {
                 double curr_time = yarp::os::Time::now();
                 double elapsed = curr_time - start_time;
+                double cmd = 0.0;
 
                 if (elapsed <= 1.0)
                 {
-                    m_cmd_single = 0.0;
+                    cmd = 0.0;
                 }
                 else if (elapsed > 1.0 && elapsed <= 4.0)
                 {
-                    m_cmd_single = m_zeros[i] + m_step;
+                    cmd = m_step;
                     if (time_zero == 0) time_zero = elapsed;
                 }
                 else
@@ -224,42 +245,78 @@ void TorqueControlAccuracy::run()
                     break;
                 }
 
-                ienc->getEncoders(m_encoders);
                 itrq->getTorques(m_torques);
-                itrq->setRefTorque(m_jointsList[i], m_cmd_single);
-
-                Bottle& b1 = dataToPlotRaw.addList();
-                b1.addInt32(cycle);
-                b1.addFloat64(elapsed);
-                b1.addFloat64(m_torques[m_jointsList[i]]);
-                b1.addFloat64(m_cmd_single);
-                yarp::os::Time::delay(m_sampleTime);
+                double stamp = use_stamps ? itim->getLastInputStamp().getTime() : 0;
+                if (stamp > 0 && fabs(stamp - curr_time) > max_stamp_offset)
+                {
+                    yWarning() << "The timestamps of the robot are" << stamp - curr_time << "s away from the local clock: the torque samples will be timestamped when they are read";
+                    use_stamps = false;
+                    stamp = 0;
+                }
+                //the encoders are stored with the torque sample, under its timestamp
+                if (m_record_position) ienc->getEncoders(m_encoders);
+
+                for (size_t k = 0; k < idx.size(); k++) batch_refs[k] = cmd;
+                itrq->setRefTorques((int)idx.size(), batch_joints.data(), batch_refs.data());
+
+                //a torque sample with the same timestamp as the previous one was already recorded
+                if (stamp > 0 && stamp == prev_stamp)
+                {
+                    stale++;
+                }
+                else
+                {
+                    //the remote timestamp and start_time are compared directly, the clocks are assumed to be synchronized
+                    double t = (stamp > 0) ? stamp - start_time : elapsed;
+                    for (size_t k = 0; k < idx.size(); k++)
+                    {
+                        int j = batch_joints[k];
+                        m_samples[idx[k]].push(t, m_torques[j], cmd, m_record_position ? &m_encoders[j] : 0);
+                    }
+                }
+                prev_stamp = stamp;
+
+                //absolute deadlines, so the time spent in the calls does not lower the sampling rate
+                next_time += m_sampleTime;
+                double wait = next_time - yarp::os::Time::now();
+                if (wait > 0) yarp::os::Time::delay(wait);
+                else next_time = yarp::os::Time::now();
             }
 
-            //reorder data
-            for (int t = 0; t < dataToPlotRaw.size(); t++)
+            if (stale > 0)
             {
-                int    cycle = dataToPlotRaw.get(t).asList()->get(0).asInt32();
-                double time = dataToPlotRaw.get(t).asList()->get(1).asFloat64();
-                double val = dataToPlotRaw.get(t).asList()->get(2).asFloat64();
-                double cmd = dataToPlotRaw.get(t).asList()->get(3).asFloat64();
-                Bottle& b1 = dataToPlotSync.addList();
-                b1.addInt32(cycle);
-                b1.addFloat64(time - time_zero);
-                b1.addFloat64(val);
-                b1.addFloat64(cmd);
+                ROBOTTESTINGFRAMEWORK_TEST_REPORT(Asserter::format("Joints: %s cycle: %d, %d ticks without a new torque sample", batch_str.c_str(), cycle, stale));
             }
 
-            m_dataToSave.append(dataToPlotSync);
+            for (size_t k = 0; k < idx.size(); k++)
+            {
+                StepSampleBuffer& buffer = m_samples[idx[k]];
+                buffer.setTimeOffset(time_zero);
+                const StepSampleBuffer::Cycle& c = buffer.cycle(buffer.cycles() - 1);
+                StepResponseMetrics m = analyzers[k].add(buffer.time() + c.begin, buffer.value() + c.begin, buffer.command() + c.begin, c.size, c.timeOffset);
+                //a step which cannot be analyzed is a failure only if some metric is limited
+                if (analyzers[k].hasLimits())
+                    ROBOTTESTINGFRAMEWORK_TEST_CHECK(m.valid, Asserter::format("Step response of joint %d cycle %d can be analyzed", batch_joints[k], cycle));
+                else if (!m.valid)
+                    ROBOTTESTINGFRAMEWORK_TEST_REPORT(Asserter::format("Step response of joint %d cycle %d cannot be analyzed", batch_joints[k], cycle));
+            }
         } //cycle loop
 
-        //save data
-        std::string filename = "torqueControlAccuracy_plot_";
-        filename += m_partName;
-        filename += std::to_string(i);
-        filename += ".txt";
-        saveToFile(filename, m_dataToSave);
-    } //joint loop
+        for (size_t k = 0; k < idx.size(); k++)
+        {
+            int i = (int)idx[k];
+            ROBOTTESTINGFRAMEWORK_TEST_REPORT(Asserter::format("Joint %d step response: %s", m_jointsList[i], analyzers[k].toString().c_str()));
+            std::string failures = analyzers[k].failuresToString();
+            ROBOTTESTINGFRAMEWORK_TEST_FAIL_IF_FALSE(failures.empty(), Asserter::format("Joint %d step response out of limits: %s", m_jointsList[i], failures.c_str()));
+
+            //save data
+            std::string filename = "torqueControlAccuracy_plot_";
+            filename += m_partName;
+            filename += std::to_string(i);
+            filename += ".txt";
+            ROBOTTESTINGFRAMEWORK_TEST_CHECK(m_samples[i].save(filename), Asserter::format("Saving data to %s", filename.c_str()));
+        }
+    } //batch loop
 
     //data acquisition ends here
     setMode(VOCAB_CM_POSITION);
@@ -278,19 +335,3 @@ void TorqueControlAccuracy::run()
         system(plotstring);
     }*/
 }
-
-void TorqueControlAccuracy::saveToFile(std::string filename, yarp::os::Bottle &b)
-{
-    std::fstream fs;
-    fs.open(filename.c_str(), std::fstream::out);
-
-    for (int i = 0; i<b.size(); i++)
-    {
-        std::string s = b.get(i).toString();
-        std::replace(s.begin(), s.end(), '(', ' ');
-        std::replace(s.begin(), s.end(), ')', ' ');
-        fs << s << std::endl;
-    }
-
-    fs.close();
-}
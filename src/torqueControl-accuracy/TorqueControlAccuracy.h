@@ -22,15 +22,28 @@
 #define _TORQUEACCURACY_H_
 
 #include <string>
+#include <vector>
 #include <yarp/robottestingframework/TestCase.h>
 #include <yarp/dev/ControlBoardInterfaces.h>
 #include <yarp/dev/PolyDriver.h>
 
+#include "JointBatchScheduler.h"
+#include "StepResponseAnalyzer.h"
+#include "StepSampleBuffer.h"
+
 /**
 * \ingroup icub-tests
 * This tests checks the a torque PID response, sending a step reference signal with a setRefTorque command.
-* This test currently does not return any error report. It simply moves a joint, and saves data to a different file for each joint.
-* The data acquired can be analized with a matalab script to evaluate the torque PID properties.
+* For each joint, rise time, overshoot, settling time and steady-state error are computed on every cycle and their mean and standard deviation are reported.
+* The test fails if the mean of a metric exceeds its limit (the checks are disabled by default).
+* Each torque sample is stored with the timestamp of the state it was read from (IPreciselyTimed::getLastInputStamp()), so that
+* the samples are aligned with the time they were measured and not with the time they were read; samples which were already read
+* in the previous tick are discarded. The timestamps must be in the same time base as the test (e.g. the test runs on the same machine
+* as the robot interface, or the network clock is used): if they differ from the local clock by more than 1 s, the samples are
+* timestamped when they are read. The encoders are read (with their timestamps) only if record_position is enabled.
+* With the parallel option the joints which are not mechanically coupled (according to the kinematic_mj coupling matrix of the part)
+* are grouped in batches and stepped at the same time, with a single setRefTorques() call.
+* The data acquired is also saved to a different file for each joint, and can be analized with a matalab script to evaluate the torque PID properties.
 * Be aware that a step greater than 1 Nm may be dangerous for both the robot and the human operator!
 
 * example: testRunner -v -t TorqueControlAccuracy.dll -p "--robot icubSim --part head --joints ""(0 1 2)"" --zeros ""(0 0 0)""  --step 5  --cycles 10 --sampleTime 0.010"
@@ -46,6 +59,14 @@
 * | cycles             | int    | -     | -     | Yes | Each joint will be tested multiple times |   |
 * | step               | double | Nm    | -     | Yes | The amplitude of the step reference signal | Recommended max: 1 Nm! |
 * | sampleTime         | double | s     | -     | Yes | The sample time of the control thread | |
+* | max_rise_time      | double | s     | -1    | No  | If >=0, max acceptable mean rise time (10%-90%) | |
+* | max_overshoot      | double | %     | -1    | No  | If >=0, max acceptable mean overshoot, in percentage of the response amplitude | |
+* | max_settling_time  | double | s     | -1    | No  | If >=0, max acceptable mean settling time | |
+* | max_steady_state_error | double | Nm | -1   | No  | If >=0, max acceptable absolute mean steady-state error | |
+* | settling_band      | double | -     | 0.05  | No  | The settling band, as a fraction of the step amplitude | |
+* | steady_state_window | double | -    | 0.2   | No  | The final fraction of the step used to compute the steady-state value | |
+* | parallel           | bool   | -     | false | No  | If true, uncoupled joints are tested at the same time | Make sure that moving several joints at once is safe |
+* | record_position    | bool   | -     | false | No  | If true, the joint position is also acquired and saved as an additional column | |
 *
 */
 
@@ -63,7 +84,6 @@ public:
     bool goHome();
     void executeCmd();
     void setMode(int desired_mode);
-    void saveToFile(std::string filename, yarp::os::Bottle &b);
 
 private:
     std::string m_robotName;
@@ -75,18 +95,23 @@ private:
     double      m_step;
     int         m_n_part_joints;
     int         m_n_cmd_joints;
-    yarp::os::Bottle      m_dataToSave;
+    std::vector<StepSampleBuffer> m_samples;
+    bool        m_parallel;
+    bool        m_record_position;
+    JointBatchScheduler::Batches m_batches;
 
     yarp::dev::PolyDriver        *dd;
     yarp::dev::IPositionControl *ipos;
     yarp::dev::IControlMode     *icmd;
     yarp::dev::IInteractionMode  *iimd;
-    yarp::dev::IEncoders         *ienc;
+    yarp::dev::IEncodersTimed    *ienc;
     yarp::dev::ITorqueControl    *itrq;
+    yarp::dev::IPreciselyTimed   *itim;
 
-    double  m_cmd_single;
     double* m_encoders;
     double* m_torques;
+
+    StepResponseLimits m_step_limits;
 };
 
 #endif
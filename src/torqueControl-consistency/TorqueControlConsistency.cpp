@@ -23,8 +23,10 @@
 #include <robottestingframework/dll/Plugin.h>
 #include <yarp/os/Time.h>
 #include <yarp/os/Property.h>
+#include <algorithm>
 
 #include "TorqueControlConsistency.h"
+#include "MotionWaiter.h"
 
 //example1    -v -t TorqueControlConsistency.dll -p "--robot icub --part head --joints ""(0)"" --zero 0"
 //example2    -v -t TorqueControlConsistency.dll -p "--robot icub --part head --joints ""(0 1 2)"" --zero 0 "
@@ -51,6 +53,11 @@ TorqueControlConsistency::TorqueControlConsistency() : yarp::robottestingframewo
     cmd_tot=0;
     prevcurr_some=0;
     prevcurr_tot=0;
+    batched_verify=false;
+    verify_timeout=0.5;
+    ref_set_time=0;
+    ref_ok=0;
+    ref_propagation=0;
 }
 
 TorqueControlConsistency::~TorqueControlConsistency() { }
@@ -72,6 +79,10 @@ bool TorqueControlConsistency::setup(yarp::os::Property& property) {
 
     zero = property.find("zero").asFloat64();
 
+    if(property.check("batched_verify")) {batched_verify = property.find("batched_verify").asBool();}
+    if(property.check("verify_timeout")) {verify_timeout = property.find("verify_timeout").asFloat64();}
+    ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(verify_timeout>0,"invalid verify_timeout");
+
     Bottle* jointsBottle = property.find("joints").asList();
     ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(jointsBottle!=0,"unable to parse joints parameter");
     n_cmd_joints = jointsBottle->size();
@@ -114,6 +125,8 @@ bool TorqueControlConsistency::setup(yarp::os::Property& property) {
     prevcurr_tot=new double[n_part_joints];
     prevcurr_some=new double[n_cmd_joints];
     for (int i=0; i <n_cmd_joints; i++) jointsList[i]=jointsBottle->get(i).asInt32();
+    modeSwitcher.configure(icmd, iimd, jointsList, n_cmd_joints);
+    ref_readback.resize(n_part_joints);
 
     return true;
 }
@@ -126,74 +139,32 @@ void TorqueControlConsistency::tearDown()
 
 void TorqueControlConsistency::setMode(int desired_control_mode, yarp::dev::InteractionModeEnum desired_interaction_mode)
 {
-    for (int i=0; i<n_cmd_joints; i++)
-    {
-        icmd->setControlMode(jointsList[i],desired_control_mode);
-        iimd->setInteractionMode(jointsList[i],desired_interaction_mode);
-        yarp::os::Time::delay(0.010);
-    }
+    modeSwitcher.request(desired_control_mode, desired_interaction_mode);
 }
 
 void TorqueControlConsistency::verifyMode(int desired_control_mode, yarp::dev::InteractionModeEnum desired_interaction_mode, std::string title)
 {
-    int cmode;
-    yarp::dev::InteractionModeEnum imode;
-    int timeout = 0;
-
-    while (1)
-    {
-        int ok=0;
-        for (int i=0; i<n_cmd_joints; i++)
-        {
-            icmd->getControlMode (jointsList[i],&cmode);
-            iimd->getInteractionMode(jointsList[i],&imode);
-            if (cmode==desired_control_mode && imode==desired_interaction_mode) ok++;
-        }
-        if (ok==n_cmd_joints) break;
-        if (timeout>100)
-        {
-            char sbuf[500];
-            sprintf(sbuf,"Test (%s) failed: current mode is (%d,%d), it should be (%d,%d)",title.c_str(), desired_control_mode,desired_interaction_mode,cmode,imode);
-            ROBOTTESTINGFRAMEWORK_ASSERT_ERROR(sbuf);
-        }
-        yarp::os::Time::delay(0.2);
-        timeout++;
-    }
-    char sbuf[500];
-    sprintf(sbuf,"Test (%s) passed: current mode is (%d,%d)",title.c_str(), desired_control_mode,desired_interaction_mode);
-    ROBOTTESTINGFRAMEWORK_TEST_REPORT(sbuf);
+    ControlModeSwitcher::Result result = modeSwitcher.wait(desired_control_mode, desired_interaction_mode);
+    ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(result.ok, modeSwitcher.failureMessage(result, "Test ("+title+")"));
+    ROBOTTESTINGFRAMEWORK_TEST_REPORT(modeSwitcher.successMessage(result, "Test ("+title+")"));
 }
 
 void TorqueControlConsistency::goHome()
 {
-    for (int i=0; i<n_cmd_joints; i++)
+    MotionWaiter waiter;
+    waiter.configure(ienc, ipos, jointsList, n_cmd_joints);
+    waiter.setTolerance(0.5);
+    MotionWaiter::Result result = waiter.moveAndWait(std::vector<double>(n_cmd_joints, zero), 20.0);
+    if (!result.ok)
     {
-        ipos->setRefSpeed(jointsList[i],20.0);
-        ipos->positionMove(jointsList[i],zero);
-    }
-
-    int timeout = 0;
-    while (1)
-    {
-        int in_position=0;
-        for (int i=0; i<n_cmd_joints; i++)
-        {
-            ienc->getEncoder(jointsList[i],&pos_tot[jointsList[i]]);
-            if (fabs(pos_tot[jointsList[i]]-zero)<0.5) in_position++;
-        }
-        if (in_position==n_cmd_joints) break;
-        if (timeout>100)
-        {
-            ROBOTTESTINGFRAMEWORK_ASSERT_ERROR("Timeout while reaching zero position");
-        }
-        yarp::os::Time::delay(0.2);
-        timeout++;
+        ROBOTTESTINGFRAMEWORK_ASSERT_ERROR("Timeout while reaching zero position");
     }
 }
 
 void TorqueControlConsistency::setRefTorque(double value)
 {
     cmd_single=value;
+    ref_set_time = yarp::os::Time::now();
     if (cmd_mode==single_joint)
     {
         for (int i=0; i<n_cmd_joints; i++)
@@ -221,11 +192,71 @@ void TorqueControlConsistency::setRefTorque(double value)
     {
         ROBOTTESTINGFRAMEWORK_ASSERT_ERROR("Invalid cmd_mode");
     }
-    yarp::os::Time::delay(0.010);
+
+    //the batched verification polls the reference right after the set, so that the propagation time
+    //does not include the other checks performed before verifyRefTorque()
+    if (batched_verify) pollRefTorques(value);
+    else yarp::os::Time::delay(0.010);
+}
+
+void TorqueControlConsistency::pollRefTorques(double verify_val)
+{
+    //the references of the commanded joints are read back with one call, until all of them match or the deadline expires
+    double deadline = ref_set_time + verify_timeout;
+    while (1)
+    {
+        ref_ok = 0;
+        if (itrq->getRefTorques(ref_readback.data()))
+        {
+            for (int i=0; i<n_cmd_joints; i++)
+            {
+                if (fabs(ref_readback[jointsList[i]]-verify_val)<1e-6) ref_ok++;
+            }
+        }
+        if (ref_ok==n_cmd_joints || yarp::os::Time::now()>deadline) break;
+        yarp::os::Time::delay(0.001);
+    }
+    ref_propagation = yarp::os::Time::now()-ref_set_time;
+}
+
+void TorqueControlConsistency::verifyRefTorqueBatched(double verify_val, std::string title)
+{
+    //the reference has been polled by setRefTorque(), check that it is still the commanded one
+    int ok = 0;
+    if (ref_ok==n_cmd_joints && itrq->getRefTorques(ref_readback.data()))
+    {
+        for (int i=0; i<n_cmd_joints; i++)
+        {
+            if (fabs(ref_readback[jointsList[i]]-verify_val)<1e-6) ok++;
+        }
+    }
+    else
+    {
+        ok = ref_ok;
+    }
+    double propagation = ref_propagation;
+
+    if (ok==n_cmd_joints)
+    {
+        propagation_times.push_back(propagation);
+        ROBOTTESTINGFRAMEWORK_TEST_REPORT(Asserter::format("Test (%s) passed, current reference is (%f), propagation time %.2f ms",
+                                                           title.c_str(), verify_val, propagation*1000.0));
+    }
+    else
+    {
+        ROBOTTESTINGFRAMEWORK_ASSERT_ERROR(Asserter::format("Test (%s) failed: only %d joints (of %d) reached the reference (%f) within %.0f ms",
+                                                            title.c_str(), ok, n_cmd_joints, verify_val, verify_timeout*1000.0));
+    }
 }
 
 void TorqueControlConsistency::verifyRefTorque(double verify_val, std::string title)
 {
+    if (batched_verify)
+    {
+        verifyRefTorqueBatched(verify_val, title);
+        return;
+    }
+
     double value;
     char sbuf[500];
     if (cmd_mode==single_joint)
@@ -315,4 +346,15 @@ void TorqueControlConsistency::run()
     verifyMode(VOCAB_CM_POSITION,VOCAB_IM_STIFF,"test5");
     goHome();
 
+    if (!propagation_times.empty())
+    {
+        double mean = 0;
+        for (size_t i=0; i<propagation_times.size(); i++) mean += propagation_times[i];
+        mean /= propagation_times.size();
+        double max = *std::max_element(propagation_times.begin(), propagation_times.end());
+        double min = *std::min_element(propagation_times.begin(), propagation_times.end());
+        ROBOTTESTINGFRAMEWORK_TEST_REPORT(Asserter::format("Reference propagation time over %d verifications: mean %.2f ms, min %.2f ms, max %.2f ms",
+                                                           (int)propagation_times.size(), mean*1000.0, min*1000.0, max*1000.0));
+    }
+
 }
@@ -22,10 +22,32 @@
 #define _TORQUECONTORLCONSISTENCY_H_
 
 #include <string>
+#include <vector>
 #include <yarp/robottestingframework/TestCase.h>
 #include <yarp/dev/ControlBoardInterfaces.h>
 #include <yarp/dev/PolyDriver.h>
+#include "ControlModeSwitcher.h"
 
+/**
+* \ingroup icub-tests
+* This test checks the consistency of the torque references: the joints are put in torque control mode, a sequence of torque
+* references is sent and each one is read back with ITorqueControl::getRefTorque()/getRefTorques() and compared with the commanded value.
+* With batched_verify enabled, each reference is read back with a single getRefTorques() call for the whole part, polled until all the
+* commanded joints report the new value or verify_timeout expires; the time from the set call to the readback of the new value is
+* the propagation time of the reference, which is reported for each verification and summarized at the end of the test.
+* The reference is polled right after it is set, and checked again when it is verified.
+*
+*  Accepts the following parameters:
+* | Parameter name     | Type   | Units | Default Value | Required | Description | Notes |
+* |:------------------:|:------:|:-----:|:-------------:|:--------:|:-----------:|:-----:|
+* | robot              | string | -     | -     | Yes | The name of the robot.     | e.g. icub |
+* | part               | string | -     | -     | Yes | The name of the robot part. | e.g. left_arm |
+* | joints             | vector of ints | - | - | Yes | List of joints to be tested | |
+* | zero               | double | deg   | -     | Yes | The home position of the joints | |
+* | batched_verify     | bool   | -     | false | No  | If true, the references are verified with a single getRefTorques() call, polled until they match | |
+* | verify_timeout     | double | s     | 0.5   | No  | The max propagation time of a reference, when batched_verify is enabled | |
+*
+*/
 class TorqueControlConsistency : public yarp::robottestingframework::TestCase {
 public:
     TorqueControlConsistency();
@@ -43,6 +65,8 @@ public:
     void verifyMode(int desired_control_mode, yarp::dev::InteractionModeEnum desired_interaction_mode, std::string title);
     void setRefTorque(double value);
     void verifyRefTorque(double value, std::string title);
+    void verifyRefTorqueBatched(double value, std::string title);
+    void pollRefTorques(double value);
 
     void zeroCurrentLimits();
     void getOriginalCurrentLimits();
@@ -68,6 +92,7 @@ private:
     yarp::dev::IAmplifierControl *iamp;
     yarp::dev::IControlMode     *icmd;
     yarp::dev::IInteractionMode  *iimd;
+    ControlModeSwitcher           modeSwitcher;
     yarp::dev::IEncoders         *ienc;
     yarp::dev::ITorqueControl    *itrq;
 
@@ -80,6 +105,14 @@ private:
     double* prevcurr_some;
 
     double* pos_tot;
+
+    bool    batched_verify;
+    double  verify_timeout;
+    double  ref_set_time;
+    int     ref_ok;
+    double  ref_propagation;
+    std::vector<double> ref_readback;
+    std::vector<double> propagation_times;
 };
 
 #endif //_TORQUECONTORLCONSISTENCY_H
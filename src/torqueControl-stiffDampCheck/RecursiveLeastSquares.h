@@ -0,0 +1,95 @@
+/*
+ * iCub Robot Unit Tests (Robot Testing Framework)
+ *
+ * Copyright (C) 2015-2019 Istituto Italiano di Tecnologia (IIT)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _RECURSIVELEASTSQUARES_H_
+#define _RECURSIVELEASTSQUARES_H_
+
+#include <array>
+#include <cmath>
+#include <cstddef>
+
+/**
+* Recursive least squares estimator of the N parameters theta of the linear model y = phi' * theta.
+* Each call to update() processes one sample in O(N^2), without storing the data, so the
+* estimate is available while the data streams. lambda is the forgetting factor (1 = no forgetting).
+*/
+template <size_t N>
+class RecursiveLeastSquares
+{
+public:
+    explicit RecursiveLeastSquares(double lambda = 1.0, double p0 = 1e6) : m_lambda(lambda), m_p0(p0)
+    {
+        reset();
+    }
+
+    void reset()
+    {
+        for (size_t r = 0; r < N; r++)
+        {
+            m_theta[r] = 0;
+            for (size_t c = 0; c < N; c++) m_P[r][c] = (r == c) ? m_p0 : 0;
+        }
+        m_samples = 0;
+        m_sumSqResidual = 0;
+    }
+
+    void update(const std::array<double, N>& phi, double y)
+    {
+        std::array<double, N> Pphi;
+        double den = m_lambda;
+        double prediction = 0;
+        for (size_t r = 0; r < N; r++)
+        {
+            Pphi[r] = 0;
+            for (size_t c = 0; c < N; c++) Pphi[r] += m_P[r][c] * phi[c];
+            den += phi[r] * Pphi[r];
+            prediction += phi[r] * m_theta[r];
+        }
+
+        double residual = y - prediction;
+        for (size_t r = 0; r < N; r++) m_theta[r] += Pphi[r] / den * residual;
+
+        //P is symmetric, so phi'*P = (P*phi)'
+        for (size_t r = 0; r < N; r++)
+        {
+            for (size_t c = 0; c < N; c++) m_P[r][c] = (m_P[r][c] - Pphi[r] * Pphi[c] / den) / m_lambda;
+        }
+
+        m_samples++;
+        m_sumSqResidual += residual * residual;
+    }
+
+    const std::array<double, N>& parameters() const { return m_theta; }
+
+    size_t samples() const { return m_samples; }
+
+    /** rms of the a priori prediction errors */
+    double rmsResidual() const { return (m_samples > 0) ? std::sqrt(m_sumSqResidual / m_samples) : 0; }
+
+private:
+    double m_lambda;
+    double m_p0;
+    std::array<double, N> m_theta;
+    std::array<std::array<double, N>, N> m_P;
+    size_t m_samples;
+    double m_sumSqResidual;
+};
+
+#endif
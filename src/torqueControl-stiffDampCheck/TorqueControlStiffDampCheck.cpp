@@ -37,6 +37,8 @@
 
 
 #include "TorqueControlStiffDampCheck.h"
+#include "RecursiveLeastSquares.h"
+#include "MotionWaiter.h"
 
 
 using namespace robottestingframework;
@@ -62,6 +64,12 @@ TorqueControlStiffDampCheck::TorqueControlStiffDampCheck() : yarp::robottestingf
     n_part_joints=0;
     n_cmd_joints=0;
     plot_enabled = false;
+    automatic = false;
+    amplitude = 5.0;
+    frequency = 0.5;
+    sampleTime = 0.01;
+    tolerance = 0.2;
+    idir=0;
 }
 
 TorqueControlStiffDampCheck::~TorqueControlStiffDampCheck() { }
@@ -110,7 +118,16 @@ bool TorqueControlStiffDampCheck::setup(yarp::os::Property& property) {
     {
         plot_enabled = property.find("plot_enabled").asBool();
     }
-    if(plot_enabled)
+    if(property.check("automatic"))  {automatic = property.find("automatic").asBool();}
+    if(property.check("amplitude"))  {amplitude = property.find("amplitude").asFloat64();}
+    if(property.check("frequency"))  {frequency = property.find("frequency").asFloat64();}
+    if(property.check("sampleTime")) {sampleTime = property.find("sampleTime").asFloat64();}
+    if(property.check("tolerance"))  {tolerance = property.find("tolerance").asFloat64();}
+    ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(amplitude>0 && frequency>0 && sampleTime>0 && tolerance>0, "amplitude, frequency, sampleTime and tolerance must be bigger than 0");
+
+    if(automatic)
+        yInfo() << "Automatic mode: the test moves the joints and identifies their impedance";
+    else if(plot_enabled)
         yInfo() << "Plot is enabled: the test will run octave and plot test result ";
     else
         yInfo() << "Plot is not enabled. The test collects only data. The user need to plot data to theck if test has successed.";
@@ -129,6 +146,10 @@ bool TorqueControlStiffDampCheck::setup(yarp::os::Property& property) {
     ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(dd->view(icmd),"Unable to open control mode interface");
     ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(dd->view(iimd),"Unable to open interaction mode interface");
     ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(dd->view(iimp),"Unable to open impedence control interface");
+    if(automatic)
+    {
+        ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(dd->view(idir),"Unable to open position direct interface");
+    }
 
 
     if (!ienc->getAxes(&n_part_joints))
@@ -148,6 +169,7 @@ bool TorqueControlStiffDampCheck::setup(yarp::os::Property& property) {
     home=new double[n_cmd_joints];
 
     for (int i=0; i <n_cmd_joints; i++) jointsList[i]=jointsBottle->get(i).asInt32();
+    modeSwitcher.configure(icmd, iimd, jointsList, n_cmd_joints);
     for (int i=0; i <n_cmd_joints; i++) stiffness[i]=b_stiff->get(i).asFloat64();
     for (int i=0; i <n_cmd_joints; i++) damping[i]=b_dump->get(i).asFloat64();
     for (int i=0; i <n_cmd_joints; i++) home[i]=b_home->get(i).asFloat64();
@@ -164,73 +186,25 @@ void TorqueControlStiffDampCheck::tearDown()
 
 void TorqueControlStiffDampCheck::setMode(int desired_control_mode, yarp::dev::InteractionModeEnum desired_interaction_mode)
 {
-    for (int i=0; i<n_cmd_joints; i++)
-    {
-        icmd->setControlMode(jointsList[i],desired_control_mode);
-        iimd->setInteractionMode(jointsList[i],desired_interaction_mode);
-        yarp::os::Time::delay(0.010);
-    }
+    modeSwitcher.request(desired_control_mode, desired_interaction_mode);
 }
 
 void TorqueControlStiffDampCheck::verifyMode(int desired_control_mode, yarp::dev::InteractionModeEnum desired_interaction_mode, std::string title)
 {
-    int cmode;
-    yarp::dev::InteractionModeEnum imode;
-    int timeout = 0;
-
-    while (1)
-    {
-        int ok=0;
-        for (int i=0; i<n_cmd_joints; i++)
-        {
-            icmd->getControlMode (jointsList[i],&cmode);
-            iimd->getInteractionMode(jointsList[i],&imode);
-            if (cmode==desired_control_mode && imode==desired_interaction_mode) ok++;
-        }
-        if (ok==n_cmd_joints) break;
-        if (timeout>100)
-        {
-            char sbuf[800];
-            sprintf(sbuf,"Test (%s) failed: current mode is (%s,%s), it should be (%s,%s)",title.c_str(),
-                    Vocab32::decode((NetInt32)desired_control_mode).c_str(),
-                    Vocab32::decode((NetInt32)desired_interaction_mode).c_str(),
-                    Vocab32::decode((NetInt32)cmode).c_str(),
-                    Vocab32::decode((NetInt32)imode).c_str());
-            ROBOTTESTINGFRAMEWORK_ASSERT_ERROR(sbuf);
-        }
-        yarp::os::Time::delay(0.2);
-        timeout++;
-    }
-    char sbuf[500];
-    sprintf(sbuf,"Test (%s) passed: current mode is (%s,%s)",title.c_str(), Vocab32::decode((NetInt32)desired_control_mode).c_str(),
-            Vocab32::decode((NetInt32)desired_interaction_mode).c_str());
-    ROBOTTESTINGFRAMEWORK_TEST_REPORT(sbuf);
+    ControlModeSwitcher::Result result = modeSwitcher.wait(desired_control_mode, desired_interaction_mode);
+    ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(result.ok, modeSwitcher.failureMessage(result, "Test ("+title+")"));
+    ROBOTTESTINGFRAMEWORK_TEST_REPORT(modeSwitcher.successMessage(result, "Test ("+title+")"));
 }
 
 void TorqueControlStiffDampCheck::goHome()
 {
-    for (int i=0; i<n_cmd_joints; i++)
+    MotionWaiter waiter;
+    waiter.configure(ienc, ipos, jointsList, n_cmd_joints);
+    waiter.setTolerance(0.8);
+    MotionWaiter::Result result = waiter.moveAndWait(std::vector<double>(home, home+n_cmd_joints), 20.0);
+    if (!result.ok)
     {
-        ipos->setRefSpeed(jointsList[i],20.0);
-        ipos->positionMove(jointsList[i],home[i]);
-    }
-
-    int timeout = 0;
-    while (1)
-    {
-        int in_position=0;
-        for (int i=0; i<n_cmd_joints; i++)
-        {
-            ienc->getEncoder(jointsList[i],&pos_tot[i]);
-            if (fabs(pos_tot[i]-home[i])<0.8) in_position++;
-        }
-        if (in_position==n_cmd_joints) break;
-        if (timeout>100)
-        {
-            ROBOTTESTINGFRAMEWORK_ASSERT_ERROR("Timeout while reaching home[i] position");
-        }
-        yarp::os::Time::delay(0.2);
-        timeout++;
+        ROBOTTESTINGFRAMEWORK_ASSERT_ERROR("Timeout while reaching home[i] position");
     }
 }
 
@@ -281,6 +255,110 @@ std::string TorqueControlStiffDampCheck::getPath(const std::string& str)
 
 
 void TorqueControlStiffDampCheck::run()
+{
+    if(automatic)
+        runAutomatic();
+    else
+        runManual();
+}
+
+void TorqueControlStiffDampCheck::runAutomatic()
+{
+    setMode(VOCAB_CM_POSITION,VOCAB_IM_STIFF);
+    verifyMode(VOCAB_CM_POSITION,VOCAB_IM_STIFF,"test0");
+
+    ROBOTTESTINGFRAMEWORK_TEST_REPORT(Asserter::format("try to move joints in home positions"));
+    goHome();
+
+    for (int i=0; i<n_cmd_joints; i++)
+    {
+        ROBOTTESTINGFRAMEWORK_TEST_REPORT(Asserter::format("***** Start impedance identification on joint %d......", jointsList[i]));
+        ROBOTTESTINGFRAMEWORK_ASSERT_ERROR_IF_FALSE(setAndCheckImpedance(jointsList[i], stiffness[i], damping[i]) , Asserter::format("Error setting impedance on j %d", jointsList[i]));
+
+        setMode(VOCAB_CM_POSITION_DIRECT,VOCAB_IM_COMPLIANT);
+        verifyMode(VOCAB_CM_POSITION_DIRECT,VOCAB_IM_COMPLIANT,"test1");
+
+        //parameters: stiffness, damping, torque offset
+        RecursiveLeastSquares<3> rls_measured;
+        RecursiveLeastSquares<3> rls_reference;
+        Bottle b_data;
+
+        double start_time = yarp::os::Time::now();
+        double next_time = start_time;
+        double curr_time = start_time;
+        double prev_equilibrium = home[i];
+        while(curr_time < start_time+testLen_sec)
+        {
+            double t = curr_time-start_time;
+
+            double curr_pos, curr_vel, torque, reftrq;
+            bool ok = ienc->getEncoder(jointsList[i], &curr_pos);
+            ok = ienc->getEncoderSpeed(jointsList[i], &curr_vel) && ok;
+            ok = itrq->getTorque(jointsList[i], &torque) && ok;
+            ok = itrq->getRefTorque(jointsList[i], &reftrq) && ok;
+
+            //the amplitude is ramped up in the first period, to avoid a step in velocity
+            double ramp = std::min(1.0, t*frequency);
+
+            //the state has been read before sending the new equilibrium: it refers to the previous one
+            if (ok && ramp >= 1.0)
+            {
+                std::array<double,3> phi = {{-(curr_pos-prev_equilibrium), -curr_vel, 1.0}};
+                rls_measured.update(phi, torque);
+                rls_reference.update(phi, reftrq);
+            }
+
+            Bottle& row = b_data.addList();
+            row.addFloat64(t);
+            row.addFloat64(curr_pos-home[i]);
+            row.addFloat64(prev_equilibrium-home[i]);
+            row.addFloat64(curr_vel);
+            row.addFloat64(torque);
+            row.addFloat64(reftrq);
+
+            double equilibrium = home[i] + ramp*amplitude*sin(2*M_PI*frequency*t);
+            idir->setPosition(jointsList[i], equilibrium);
+            prev_equilibrium = equilibrium;
+
+            next_time += sampleTime;
+            double wait = next_time - yarp::os::Time::now();
+            if (wait > 0) yarp::os::Time::delay(wait);
+            curr_time = yarp::os::Time::now();
+        }
+
+        Bottle b;
+        b.addInt32(jointsList[i]);
+        saveToFile("impedanceId_" + partName + "_j" + b.toString() + ".txt", b_data);
+
+        setMode(VOCAB_CM_POSITION,VOCAB_IM_STIFF);
+        verifyMode(VOCAB_CM_POSITION,VOCAB_IM_STIFF,"test2");
+        goHome();
+
+        ROBOTTESTINGFRAMEWORK_TEST_FAIL_IF_FALSE(rls_measured.samples()>10, Asserter::format("Not enough samples to identify the impedance of j %d: the duration must be longer than 1/frequency", jointsList[i]));
+
+        const std::array<double,3>& m = rls_measured.parameters();
+        const std::array<double,3>& r = rls_reference.parameters();
+        ROBOTTESTINGFRAMEWORK_TEST_REPORT(Asserter::format("J %d: configured stiffness %.4f damping %.4f", jointsList[i], stiffness[i], damping[i]));
+        ROBOTTESTINGFRAMEWORK_TEST_REPORT(Asserter::format("J %d: identified from the measured torque: stiffness %.4f damping %.4f offset %.3f (rms residual %.3f Nm, %d samples)",
+                                          jointsList[i], m[0], m[1], m[2], rls_measured.rmsResidual(), (int)rls_measured.samples()));
+        ROBOTTESTINGFRAMEWORK_TEST_REPORT(Asserter::format("J %d: identified from the reference torque: stiffness %.4f damping %.4f offset %.3f (rms residual %.3f Nm)",
+                                          jointsList[i], r[0], r[1], r[2], rls_reference.rmsResidual()));
+
+        //a relative tolerance has no meaning for a zero value: the check is skipped
+        if (stiffness[i] != 0)
+        {
+            ROBOTTESTINGFRAMEWORK_TEST_CHECK(fabs(m[0]-stiffness[i]) <= tolerance*fabs(stiffness[i]),
+                                             Asserter::format("J %d: identified stiffness %.4f, configured %.4f", jointsList[i], m[0], stiffness[i]));
+        }
+        if (damping[i] != 0)
+        {
+            ROBOTTESTINGFRAMEWORK_TEST_CHECK(fabs(m[1]-damping[i]) <= tolerance*fabs(damping[i]),
+                                             Asserter::format("J %d: identified damping %.4f, configured %.4f", jointsList[i], m[1], damping[i]));
+        }
+    }
+}
+
+void TorqueControlStiffDampCheck::runManual()
 {
     setMode(VOCAB_CM_POSITION,VOCAB_IM_STIFF);
     verifyMode(VOCAB_CM_POSITION,VOCAB_IM_STIFF,"test0");
@@ -25,10 +25,43 @@
 #include <yarp/robottestingframework/TestCase.h>
 #include <yarp/dev/ControlBoardInterfaces.h>
 #include <yarp/dev/PolyDriver.h>
+#include "ControlModeSwitcher.h"
 
 
 using namespace yarp::os;
 
+/**
+* \ingroup icub-tests
+* This test checks the joint impedance (stiffness and damping) in compliant interaction mode.
+* In the default (manual) mode, for each joint the stiffness and then the damping are set, the user moves the joint by hand
+* and the position/torque and velocity/torque data are saved to file, to be checked with the torqueStiffDamp_plotAll.m octave script.
+* In the automatic mode no operator is needed: the configured stiffness and damping are set together, the joint is put in
+* position direct control mode with compliant interaction, and its equilibrium position is moved along the sinusoidal trajectory
+* home + amplitude*sin(2*pi*frequency*t). While the data streams, the model
+* torque = -stiffness*(position - equilibrium) - damping*velocity + offset
+* is fitted by recursive least squares, both on the measured torque and on the torque reference computed by the controller.
+* The test fails if the stiffness or the damping identified from the measured torque differs from the configured one
+* by more than the given relative tolerance (zero configured values are not checked).
+* The data of each joint is saved to impedanceId_<part>_j<joint>.txt: time, position and equilibrium (relative to home), velocity, torque, reference torque.
+*
+*  Accepts the following parameters:
+* | Parameter name     | Type   | Units | Default Value | Required | Description | Notes |
+* |:------------------:|:------:|:-----:|:-------------:|:--------:|:-----------:|:-----:|
+* | robot              | string | -     | -     | Yes | The name of the robot.     | e.g. icub |
+* | part               | string | -     | -     | Yes | The name of the robot part. | e.g. left_arm |
+* | joints             | vector of ints | - | - | Yes | List of joints to be tested | |
+* | home               | vector of doubles | deg | - | Yes | The home position of each joint | |
+* | stiffness          | vector of doubles | Nm/deg | - | Yes | The stiffness of each joint | |
+* | damping            | vector of doubles | Nm*s/deg | - | Yes | The damping of each joint | |
+* | duration           | double | s     | -     | Yes | The duration of each acquisition | |
+* | plot_enabled       | bool   | -     | false | No  | If true, the octave script is run at the end of the manual test | |
+* | automatic          | bool   | -     | false | No  | If true, the joints are excited by the test and the impedance is identified | |
+* | amplitude          | double | deg   | 5.0   | No  | Automatic mode: the amplitude of the equilibrium trajectory | |
+* | frequency          | double | Hz    | 0.5   | No  | Automatic mode: the frequency of the equilibrium trajectory | |
+* | sampleTime         | double | s     | 0.01  | No  | Automatic mode: the sample time of the acquisition | |
+* | tolerance          | double | -     | 0.2   | No  | Automatic mode: the max relative error of the identified stiffness and damping | |
+*
+*/
 class TorqueControlStiffDampCheck : public yarp::robottestingframework::TestCase {
 public:
     TorqueControlStiffDampCheck();
@@ -40,6 +73,9 @@ public:
 
     virtual void run();
 
+    void runManual();
+    void runAutomatic();
+
     void goHome();
     void setMode(int desired_control_mode, yarp::dev::InteractionModeEnum desired_interaction_mode);
     void verifyMode(int desired_control_mode, yarp::dev::InteractionModeEnum desired_interaction_mode, std::string title);
@@ -61,6 +97,11 @@ private:
     Bottle b_pos_trq;
     Bottle b_vel_trq;
     bool plot_enabled;
+    bool automatic;
+    double amplitude;
+    double frequency;
+    double sampleTime;
+    double tolerance;
 
 
     yarp::dev::PolyDriver        *dd;
@@ -68,9 +109,11 @@ private:
     yarp::dev::IAmplifierControl *iamp;
     yarp::dev::IControlMode     *icmd;
     yarp::dev::IInteractionMode  *iimd;
+    ControlModeSwitcher           modeSwitcher;
     yarp::dev::IEncoders         *ienc;
     yarp::dev::ITorqueControl    *itrq;
     yarp::dev::IImpedanceControl *iimp;
+    yarp::dev::IPositionDirect   *idir;
 
 };
 